@@ -385,54 +385,93 @@ void build_action_entry_2<bm::MatchTableIndirectWS::Entry>(
                        indirect_handle);
 }
 
-template <
-  typename M,
-  typename std::vector<typename M::Entry> (bm::RuntimeInterface::*GetFn)(
-      size_t, const std::string &) const>
-void get_entries_common(const pi_p4info_t *p4info, pi_p4_id_t table_id,
-                        pi_table_fetch_res_t *res) {
-  std::string t_name(pi_p4info_table_name_from_id(p4info, table_id));
-
-  const auto entries = std::bind(GetFn, pibmv2::switch_, 0, t_name)();
-
-  res->num_entries = entries.size();
-  res->mkey_nbytes = pi_p4info_table_match_key_size(p4info, table_id);
-
-  Buffer buffer;
+template <typename E>
+void serialize_entries(const pi_p4info_t *p4info,
+                       const std::vector<E> &entries, Buffer *buffer) {
   for (const auto &e : entries) {
-    emit_entry_handle(buffer.extend(sizeof(s_pi_entry_handle_t)), e.handle);
+    emit_entry_handle(buffer->extend(sizeof(s_pi_entry_handle_t)), e.handle);
     // TODO(antonin): temporary hack; for match types which do not require a
     // priority, bmv2 returns -1, but the PI tends to expect 0, which is a
     // problem for looking up entry state in the PI software. A better
     // solution would be to ignore this value in the PI based on the key match
     // type.
     int priority = (e.priority == -1) ? 0 : e.priority;
-    emit_uint32(buffer.extend(sizeof(uint32_t)), priority);
+    emit_uint32(buffer->extend(sizeof(uint32_t)), priority);
     for (const auto &p : e.match_key) {
       switch (p.type) {
         case bm::MatchKeyParam::Type::EXACT:
-          std::copy(p.key.begin(), p.key.end(), buffer.extend(p.key.size()));
+          std::copy(p.key.begin(), p.key.end(), buffer->extend(p.key.size()));
           break;
         case bm::MatchKeyParam::Type::LPM:
-          std::copy(p.key.begin(), p.key.end(), buffer.extend(p.key.size()));
-          emit_uint32(buffer.extend(sizeof(uint32_t)), p.prefix_length);
+          std::copy(p.key.begin(), p.key.end(), buffer->extend(p.key.size()));
+          emit_uint32(buffer->extend(sizeof(uint32_t)), p.prefix_length);
           break;
         case bm::MatchKeyParam::Type::TERNARY:
         case bm::MatchKeyParam::Type::RANGE:
-          std::copy(p.key.begin(), p.key.end(), buffer.extend(p.key.size()));
-          std::copy(p.mask.begin(), p.mask.end(), buffer.extend(p.mask.size()));
+          std::copy(p.key.begin(), p.key.end(), buffer->extend(p.key.size()));
+          std::copy(p.mask.begin(), p.mask.end(),
+                    buffer->extend(p.mask.size()));
           break;
         case bm::MatchKeyParam::Type::VALID:
-          *buffer.extend(1) = (p.key == std::string("\x01", 1)) ? 1 : 0;
+          *buffer->extend(1) = (p.key == std::string("\x01", 1)) ? 1 : 0;
           break;
       }
     }
-    build_action_entry_2(p4info, e, &buffer);
+    build_action_entry_2(p4info, e, buffer);
 
     // properties
-    emit_uint32(buffer.extend(sizeof(uint32_t)), 0);
+    emit_uint32(buffer->extend(sizeof(uint32_t)), 0);
+  }
+}
+
+// number of entries copied from the table at a time by get_entries_common
+constexpr size_t kFetchPageSize = 1024;
+// number of paged reads attempted by get_entries_common before falling back to
+// reading the whole table at once
+constexpr int kFetchMaxAttempts = 3;
+
+template <
+  typename M,
+  bm::MatchErrorCode (bm::RuntimeInterface::*GetPageFn)(
+      size_t, const std::string &, size_t,
+      bm::MatchTableAbstract::EntryCursor *,
+      std::vector<typename M::Entry> *) const,
+  std::vector<typename M::Entry> (bm::RuntimeInterface::*GetFn)(
+      size_t, const std::string &) const>
+void get_entries_common(const pi_p4info_t *p4info, pi_p4_id_t table_id,
+                        pi_table_fetch_res_t *res) {
+  std::string t_name(pi_p4info_table_name_from_id(p4info, table_id));
+
+  res->mkey_nbytes = pi_p4info_table_match_key_size(p4info, table_id);
+
+  // the entries are serialized one page at a time: the table is only locked
+  // while each page is copied, and we never hold more than one page of entries
+  // in addition to the serialized buffer. If the entries are modified
+  // in-between pages, the result may not be consistent and we start over; if
+  // this keeps on happening, we read all the entries with a single lock.
+  std::vector<typename M::Entry> entries;
+  for (int attempt = 0; attempt < kFetchMaxAttempts; attempt++) {
+    Buffer buffer;
+    size_t num_entries = 0;
+    bm::MatchTableAbstract::EntryCursor cursor;
+    while (!cursor.done && !cursor.modified) {
+      auto rc = std::bind(GetPageFn, pibmv2::switch_, 0, t_name,
+                          kFetchPageSize, &cursor, &entries)();
+      if (rc != bm::MatchErrorCode::SUCCESS) throw bm_exception(rc);
+      num_entries += entries.size();
+      serialize_entries(p4info, entries, &buffer);
+    }
+    if (cursor.modified) continue;
+    res->num_entries = num_entries;
+    res->entries_size = buffer.size();
+    res->entries = buffer.copy();
+    return;
   }
 
+  entries = std::bind(GetFn, pibmv2::switch_, 0, t_name)();
+  Buffer buffer;
+  serialize_entries(p4info, entries, &buffer);
+  res->num_entries = entries.size();
   res->entries_size = buffer.size();
   res->entries = buffer.copy();
 }
@@ -445,18 +484,23 @@ void get_entries(const pi_p4info_t *p4info, pi_p4_id_t table_id,
     case bm::MatchTableType::NONE:
       throw bm_exception(bm::MatchErrorCode::INVALID_TABLE_NAME);
     case bm::MatchTableType::SIMPLE:
-      get_entries_common<bm::MatchTable, &bm::RuntimeInterface::mt_get_entries>(
-          p4info, table_id, res);
+      get_entries_common<bm::MatchTable,
+                         &bm::RuntimeInterface::mt_get_entries_page,
+                         &bm::RuntimeInterface::mt_get_entries>(
+                             p4info, table_id, res);
       break;
     case bm::MatchTableType::INDIRECT:
       get_entries_common<bm::MatchTableIndirect,
+                         &bm::RuntimeInterface::mt_indirect_get_entries_page,
                          &bm::RuntimeInterface::mt_indirect_get_entries>(
                              p4info, table_id, res);
       break;
     case bm::MatchTableType::INDIRECT_WS:
-      get_entries_common<bm::MatchTableIndirectWS,
-                         &bm::RuntimeInterface::mt_indirect_ws_get_entries>(
-                             p4info, table_id, res);
+      get_entries_common<
+        bm::MatchTableIndirectWS,
+        &bm::RuntimeInterface::mt_indirect_ws_get_entries_page,
+        &bm::RuntimeInterface::mt_indirect_ws_get_entries>(
+            p4info, table_id, res);
       break;
   }
 }
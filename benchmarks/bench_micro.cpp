@@ -0,0 +1,521 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+// Per-subsystem microbenchmarks. Everything is set up from
+// mininet/simple_router.json so that the numbers reflect the objects a real
+// program instantiates (same headers, same key layouts, same actions).
+
+#include <bm/bm_sim/action_profile.h>
+#include <bm/bm_sim/actions.h>
+#include <bm/bm_sim/calculations.h>
+#include <bm/bm_sim/deparser.h>
+#include <bm/bm_sim/expressions.h>
+#include <bm/bm_sim/group_selection.h>
+#include <bm/bm_sim/lookup_structures.h>
+#include <bm/bm_sim/match_units.h>
+#include <bm/bm_sim/meters.h>
+#include <bm/bm_sim/P4Objects.h>
+#include <bm/bm_sim/packet.h>
+#include <bm/bm_sim/parser.h>
+#include <bm/bm_sim/phv_source.h>
+#include <bm/bm_sim/queue.h>
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "bench_utils.h"
+
+using bm::ByteContainer;
+using bm::Data;
+using bm::MatchKeyParam;
+
+using bench_utils::BenchRunner;
+using bench_utils::TrafficGen;
+using bench_utils::do_not_optimize;
+
+extern int import_primitives();
+
+namespace {
+
+class MicroEnv {
+ public:
+  MicroEnv()
+      : phv_source(bm::PHVSourceIface::make_phv_source()) {
+    std::ifstream is(bench_utils::src_path("mininet/simple_router.json"));
+    // the expressions built below read fields which simple_router.json only
+    // uses in the parser, so they are not arithmetic-enabled by default
+    bm::P4Objects::ForceArith arith;
+    arith.add_header("ethernet");
+    arith.add_header("ipv4");
+    if (objects.init_objects(&is, &factory, 0, 0, nullptr, {}, arith) != 0) {
+      std::cerr << "Error when loading simple_router.json\n";
+      std::exit(1);
+    }
+    phv_source->set_phv_factory(0, &objects.get_phv_factory());
+  }
+
+  std::unique_ptr<bm::Packet> make_packet(const std::vector<char> &frame) {
+    return std::unique_ptr<bm::Packet>(new bm::Packet(bm::Packet::make_new(
+        static_cast<int>(frame.size()),
+        bm::PacketBuffer(frame.size() + 512, frame.data(), frame.size()),
+        phv_source.get())));
+  }
+
+  // returns a packet which has already gone through the parser
+  std::unique_ptr<bm::Packet> make_parsed_packet(uint32_t dst_addr) {
+    auto pkt = make_packet(TrafficGen::ipv4_udp_frame(dst_addr));
+    objects.get_parser("parser")->parse(pkt.get());
+    return pkt;
+  }
+
+  bm::LookupStructureFactory factory{};
+  bm::P4Objects objects{std::cout};
+  std::unique_ptr<bm::PHVSourceIface> phv_source;
+};
+
+// deterministic so that two runs (or two versions) look up the same keys
+std::vector<uint32_t> random_addrs(size_t n, uint32_t seed) {
+  std::mt19937 gen(seed);
+  std::vector<uint32_t> addrs(n);
+  for (auto &a : addrs) a = gen();
+  return addrs;
+}
+
+ByteContainer addr_to_bytes(uint32_t addr) {
+  const char bytes[4] = {static_cast<char>(addr >> 24),
+                         static_cast<char>(addr >> 16),
+                         static_cast<char>(addr >> 8),
+                         static_cast<char>(addr)};
+  return ByteContainer(bytes, sizeof(bytes));
+}
+
+void add_parser_benches(BenchRunner *runner, MicroEnv *env) {
+  auto parser = env->objects.get_parser("parser");
+  auto pkt = std::make_shared<std::unique_ptr<bm::Packet> >(
+      env->make_packet(TrafficGen::ipv4_udp_frame(0x0a00000a)));
+  runner->add("parser/parse/eth_ipv4", [parser, pkt](size_t iters) {
+    auto p = pkt->get();
+    const auto state = p->save_buffer_state();
+    for (size_t i = 0; i < iters; i++) {
+      parser->parse(p);
+      p->restore_buffer_state(state);
+      p->get_phv()->reset();
+    }
+  });
+}
+
+void add_deparser_benches(BenchRunner *runner, MicroEnv *env) {
+  auto deparser = env->objects.get_deparser("deparser");
+  auto pkt = std::make_shared<std::unique_ptr<bm::Packet> >(
+      env->make_parsed_packet(0x0a00000a));
+  // the deparser pushes the headers back in front of the payload; restoring
+  // the post-parse buffer state pulls them out again, leaving the PHV as is
+  runner->add("deparser/deparse/eth_ipv4/unmodified", [deparser, pkt](
+      size_t iters) {
+    auto p = pkt->get();
+    const auto state = p->save_buffer_state();
+    for (size_t i = 0; i < iters; i++) {
+      deparser->deparse(p);
+      p->restore_buffer_state(state);
+    }
+  });
+  runner->add("deparser/deparse/eth_ipv4/ttl_modified", [deparser, pkt](
+      size_t iters) {
+    auto p = pkt->get();
+    auto &ttl = p->get_phv()->get_field("ipv4.ttl");
+    const auto state = p->save_buffer_state();
+    for (size_t i = 0; i < iters; i++) {
+      ttl.set(i & 0xff);
+      deparser->deparse(p);
+      p->restore_buffer_state(state);
+    }
+  });
+}
+
+void add_match_key_benches(BenchRunner *runner, MicroEnv *env) {
+  bm::header_id_t ipv4_id, eth_id;
+  int dst_offset, src_offset, proto_offset, type_offset;
+  std::tie(ipv4_id, dst_offset) = env->objects.field_info("ipv4", "dstAddr");
+  std::tie(ipv4_id, src_offset) = env->objects.field_info("ipv4", "srcAddr");
+  std::tie(ipv4_id, proto_offset) = env->objects.field_info("ipv4",
+                                                            "protocol");
+  std::tie(eth_id, type_offset) = env->objects.field_info("ethernet",
+                                                          "etherType");
+  auto pkt = std::make_shared<std::unique_ptr<bm::Packet> >(
+      env->make_parsed_packet(0x0a00000a));
+
+  auto lpm_builder = std::make_shared<bm::MatchKeyBuilder>();
+  lpm_builder->push_back_field(ipv4_id, dst_offset, 32,
+                               MatchKeyParam::Type::LPM, "ipv4.dstAddr");
+  lpm_builder->build();
+  runner->add("match_key_builder/ipv4_dst", [lpm_builder, pkt](size_t iters) {
+    const auto &phv = *(*pkt)->get_phv();
+    ByteContainer key;
+    for (size_t i = 0; i < iters; i++) {
+      key.clear();
+      (*lpm_builder)(phv, &key);
+      do_not_optimize(key.data());
+    }
+  });
+
+  auto multi_builder = std::make_shared<bm::MatchKeyBuilder>();
+  multi_builder->push_back_valid_header(ipv4_id, "ipv4");
+  multi_builder->push_back_field(eth_id, type_offset, 16,
+                                 MatchKeyParam::Type::EXACT,
+                                 "ethernet.etherType");
+  multi_builder->push_back_field(ipv4_id, src_offset, 32,
+                                 ByteContainer("\xff\xff\xff\x00", 4),
+                                 MatchKeyParam::Type::TERNARY, "ipv4.srcAddr");
+  multi_builder->push_back_field(ipv4_id, dst_offset, 32,
+                                 MatchKeyParam::Type::TERNARY, "ipv4.dstAddr");
+  multi_builder->push_back_field(ipv4_id, proto_offset, 8,
+                                 MatchKeyParam::Type::EXACT, "ipv4.protocol");
+  multi_builder->build();
+  runner->add("match_key_builder/5_fields_masked", [multi_builder, pkt](
+      size_t iters) {
+    const auto &phv = *(*pkt)->get_phv();
+    ByteContainer key;
+    for (size_t i = 0; i < iters; i++) {
+      key.clear();
+      (*multi_builder)(phv, &key);
+      do_not_optimize(key.data());
+    }
+  });
+}
+
+// Each lookup structure is filled with num_entries entries and looked up with
+// a fixed sequence of keys, half of which hit.
+void add_lookup_structure_benches(BenchRunner *runner, MicroEnv *env) {
+  const size_t num_entries = 4096;
+  const size_t num_keys = 1024;
+  auto &factory = env->factory;
+
+  auto entry_addrs = random_addrs(num_entries, 1);
+  auto miss_addrs = random_addrs(num_keys, 2);
+  auto keys = std::make_shared<std::vector<ByteContainer> >();
+  for (size_t i = 0; i < num_keys; i++) {
+    keys->push_back(addr_to_bytes(
+        (i % 2) ? entry_addrs[i * 3 % num_entries] : miss_addrs[i]));
+  }
+
+  std::shared_ptr<bm::ExactLookupStructure> exact(
+      factory.create_for_exact(num_entries, 4).release());
+  for (size_t i = 0; i < num_entries; i++) {
+    bm::ExactMatchKey key;
+    key.data = addr_to_bytes(entry_addrs[i]);
+    exact->add_entry(key, i);
+  }
+  runner->add("lookup_structure/exact/4096", [exact, keys](size_t iters) {
+    bm::internal_handle_t handle;
+    for (size_t i = 0; i < iters; i++)
+      do_not_optimize(exact->lookup((*keys)[i % keys->size()], &handle));
+  });
+
+  // prefixes between /8 and /32, to exercise the trie depth
+  std::shared_ptr<bm::LPMLookupStructure> lpm(
+      factory.create_for_LPM(num_entries, 4).release());
+  for (size_t i = 0; i < num_entries; i++) {
+    int prefix_length = 8 + static_cast<int>(i % 25);
+    uint32_t mask = ~((1ull << (32 - prefix_length)) - 1);
+    bm::LPMMatchKey key(addr_to_bytes(entry_addrs[i] & mask), prefix_length,
+                        0);
+    if (!lpm->entry_exists(key)) lpm->add_entry(key, i);
+  }
+  runner->add("lookup_structure/lpm/4096", [lpm, keys](size_t iters) {
+    bm::internal_handle_t handle;
+    for (size_t i = 0; i < iters; i++)
+      do_not_optimize(lpm->lookup((*keys)[i % keys->size()], &handle));
+  });
+
+  // ternary lookups are linear in the number of entries, so use a realistic
+  // ACL-sized table instead; the ternary and range structures keep pointers to
+  // the keys (normally owned by the match unit), so the keys live as long as
+  // the benchmark
+  const size_t num_ternary = 256;
+  std::shared_ptr<bm::TernaryLookupStructure> ternary(
+      factory.create_for_ternary(num_ternary, 4).release());
+  auto ternary_keys = std::make_shared<std::vector<bm::TernaryMatchKey> >();
+  ternary_keys->reserve(num_ternary);
+  for (size_t i = 0; i < num_ternary; i++) {
+    ternary_keys->emplace_back(
+        addr_to_bytes(entry_addrs[i * 3 % num_entries]),
+        addr_to_bytes(0xffffff00 | (i & 0xff)), static_cast<int>(i), 0);
+    auto &key = ternary_keys->back();
+    key.data.apply_mask(key.mask);
+    ternary->add_entry(key, i);
+  }
+  runner->add("lookup_structure/ternary/256", [ternary, ternary_keys, keys](
+      size_t iters) {
+    bm::internal_handle_t handle;
+    for (size_t i = 0; i < iters; i++)
+      do_not_optimize(ternary->lookup((*keys)[i % keys->size()], &handle));
+  });
+
+  std::shared_ptr<bm::RangeLookupStructure> range(
+      factory.create_for_range(num_ternary, 4).release());
+  auto range_keys = std::make_shared<std::vector<bm::RangeMatchKey> >();
+  range_keys->reserve(num_ternary);
+  for (size_t i = 0; i < num_ternary; i++) {
+    // a single 32-bit range field: data is the lower bound, mask the upper
+    uint32_t lo = entry_addrs[i] & 0xffff0000;
+    range_keys->emplace_back(addr_to_bytes(lo), addr_to_bytes(lo | 0xffff),
+                             static_cast<int>(i), std::vector<size_t>({4}),
+                             0);
+    range->add_entry(range_keys->back(), i);
+  }
+  runner->add("lookup_structure/range/256", [range, range_keys, keys](
+      size_t iters) {
+    bm::internal_handle_t handle;
+    for (size_t i = 0; i < iters; i++)
+      do_not_optimize(range->lookup((*keys)[i % keys->size()], &handle));
+  });
+}
+
+void add_expression_benches(BenchRunner *runner, MicroEnv *env) {
+  bm::header_id_t ipv4_id, eth_id;
+  int ttl_offset, type_offset;
+  std::tie(ipv4_id, ttl_offset) = env->objects.field_info("ipv4", "ttl");
+  std::tie(eth_id, type_offset) = env->objects.field_info("ethernet",
+                                                          "etherType");
+  auto pkt = std::make_shared<std::unique_ptr<bm::Packet> >(
+      env->make_parsed_packet(0x0a00000a));
+
+  // valid(ipv4) && ipv4.ttl > 0 && ethernet.etherType == 0x0800
+  auto cond = std::make_shared<bm::Expression>();
+  cond->push_back_load_header(ipv4_id);
+  cond->push_back_op(bm::ExprOpcode::VALID_HEADER);
+  cond->push_back_load_field(ipv4_id, ttl_offset);
+  cond->push_back_load_const(Data(0));
+  cond->push_back_op(bm::ExprOpcode::GT_DATA);
+  cond->push_back_op(bm::ExprOpcode::AND);
+  cond->push_back_load_field(eth_id, type_offset);
+  cond->push_back_load_const(Data(0x0800));
+  cond->push_back_op(bm::ExprOpcode::EQ_DATA);
+  cond->push_back_op(bm::ExprOpcode::AND);
+  cond->build();
+  runner->add("expression/eval_bool/valid_ttl_ethertype", [cond, pkt](
+      size_t iters) {
+    const auto &phv = *(*pkt)->get_phv();
+    for (size_t i = 0; i < iters; i++) do_not_optimize(cond->eval_bool(phv));
+  });
+
+  // (ipv4.ttl + 0xff) & 0xff, i.e. a decrement modulo 2^8
+  auto arith = std::make_shared<bm::Expression>();
+  arith->push_back_load_field(ipv4_id, ttl_offset);
+  arith->push_back_load_const(Data(0xff));
+  arith->push_back_op(bm::ExprOpcode::ADD);
+  arith->push_back_load_const(Data(0xff));
+  arith->push_back_op(bm::ExprOpcode::BIT_AND);
+  arith->build();
+  runner->add("expression/eval_arith/ttl_decrement", [arith, pkt](
+      size_t iters) {
+    const auto &phv = *(*pkt)->get_phv();
+    Data result;
+    for (size_t i = 0; i < iters; i++) {
+      arith->eval_arith(phv, &result);
+      do_not_optimize(result);
+    }
+  });
+}
+
+void add_action_benches(BenchRunner *runner, MicroEnv *env) {
+  auto pkt = std::make_shared<std::unique_ptr<bm::Packet> >(
+      env->make_parsed_packet(0x0a00000a));
+
+  // set_nhop(10.0.0.10, 1): 2 modify_field and 1 add_to_field
+  auto set_nhop = std::make_shared<bm::ActionFnEntry>(
+      env->objects.get_action("ipv4_lpm", "set_nhop"));
+  set_nhop->push_back_action_data(0x0a00000a);
+  set_nhop->push_back_action_data(1);
+  runner->add("action/execute/set_nhop", [set_nhop, pkt](size_t iters) {
+    auto p = pkt->get();
+    auto &ttl = p->get_phv()->get_field("ipv4.ttl");
+    for (size_t i = 0; i < iters; i++) {
+      set_nhop->execute(p);
+      // keep the TTL from wrapping around in a long run
+      ttl.set(64);
+    }
+  });
+
+  auto set_dmac = std::make_shared<bm::ActionFnEntry>(
+      env->objects.get_action("forward", "set_dmac"));
+  set_dmac->push_back_action_data("\x00\x04\x00\x00\x00\x00", 6);
+  runner->add("action/execute/set_dmac", [set_dmac, pkt](size_t iters) {
+    auto p = pkt->get();
+    for (size_t i = 0; i < iters; i++) set_dmac->execute(p);
+  });
+}
+
+void add_queue_benches(BenchRunner *runner) {
+  runner->add("queue/push_pop/same_thread", [](size_t iters) {
+    bm::Queue<std::unique_ptr<int> > queue(1024);
+    std::unique_ptr<int> item;
+    for (size_t i = 0; i < iters; i++) {
+      queue.push_front(std::unique_ptr<int>(new int(i)));
+      queue.pop_back(&item);
+    }
+    do_not_optimize(*item);
+  });
+
+  // one producer, one consumer, the way targets use the queues between their
+  // pipeline threads
+  runner->add("queue/push_pop/2_threads", [](size_t iters) {
+    bm::Queue<std::unique_ptr<int> > queue(1024);
+    std::thread consumer([&queue, iters]() {
+      std::unique_ptr<int> item;
+      for (size_t i = 0; i < iters; i++) queue.pop_back(&item);
+    });
+    for (size_t i = 0; i < iters; i++)
+      queue.push_front(std::unique_ptr<int>(new int(i)));
+    consumer.join();
+  });
+}
+
+void add_hash_benches(BenchRunner *runner, MicroEnv *env) {
+  using HashMap = bm::CalculationsMap;
+  // the 5-tuple is 13 bytes, a header is a few tens of bytes
+  const std::vector<size_t> sizes = {13, 64};
+  const char *hash_names[] = {"crc16", "crc32", "crcCCITT", "cksum16",
+                              "csum16", "xxh64", "identity"};
+  for (const char *name : hash_names) {
+    std::shared_ptr<HashMap::MyC> hash(
+        HashMap::get_instance()->get_copy(name).release());
+    for (size_t size : sizes) {
+      auto buffer = std::make_shared<std::vector<char> >(
+          TrafficGen::ipv4_udp_frame(0x0a00000a, size));
+      runner->add(std::string("hash/") + name + "/" + std::to_string(size),
+                  [hash, buffer](size_t iters) {
+        for (size_t i = 0; i < iters; i++) {
+          (*buffer)[0] = static_cast<char>(i);
+          do_not_optimize(hash->output(buffer->data(), buffer->size()));
+        }
+      });
+    }
+  }
+
+  // field list based calculation, as used for checksum verification / update
+  auto calc = env->objects.get_named_calculation("ipv4_checksum");
+  auto pkt = std::make_shared<std::unique_ptr<bm::Packet> >(
+      env->make_parsed_packet(0x0a00000a));
+  runner->add("hash/named_calculation/ipv4_checksum", [calc, pkt](
+      size_t iters) {
+    const auto &p = *pkt->get();
+    for (size_t i = 0; i < iters; i++) do_not_optimize(calc->output(p));
+  });
+}
+
+// member selection in a 16-member group, the identity hash of ipv4.srcAddr
+// is used so that the selection itself dominates
+void add_group_selection_benches(BenchRunner *runner, MicroEnv *env) {
+  using bm::ActionProfile;
+  bm::header_id_t ipv4;
+  int src_addr;
+  std::tie(ipv4, src_addr) = env->objects.field_info("ipv4", "srcAddr");
+  auto action_fn = std::make_shared<bm::ActionFn>("noop", 0, 0);
+  auto resilient = std::make_shared<bm::ResilientGroupSelector>();
+  for (const bool use_resilient : {false, true}) {
+    auto profile = std::make_shared<ActionProfile>("profile", 0, true);
+    if (use_resilient) profile->set_group_selector(resilient.get());
+    bm::BufBuilder builder;
+    builder.push_back_field(ipv4, src_addr);
+    profile->set_hash(std::unique_ptr<bm::Calculation>(
+        new bm::Calculation(builder, "identity")));
+    ActionProfile::grp_hdl_t grp;
+    profile->create_group(&grp);
+    for (int i = 0; i < 16; i++) {
+      ActionProfile::mbr_hdl_t mbr;
+      profile->add_member(action_fn.get(), bm::ActionData(), &mbr);
+      profile->add_member_to_group(mbr, grp);
+    }
+    auto index = ActionProfile::IndirectIndex::make_grp_index(grp);
+    auto pkt = std::make_shared<std::unique_ptr<bm::Packet> >(
+        env->make_parsed_packet(0x0a00000a));
+    runner->add(std::string("group_selection/") +
+                (use_resilient ? "resilient" : "default") + "/16",
+                [profile, resilient, action_fn, index, pkt, ipv4, src_addr](
+                    size_t iters) {
+      auto &p = **pkt;
+      auto &f = p.get_phv()->get_field(ipv4, src_addr);
+      for (size_t i = 0; i < iters; i++) {
+        f.set(static_cast<unsigned int>(i));
+        do_not_optimize(&profile->lookup(p, index));
+      }
+    });
+  }
+}
+
+// a 2-rate packet meter executed concurrently by several threads; the rates
+// are so low that all the packets but the first are RED, so the watermark is
+// never written and only the cost of synchronizing with the rate updates is
+// shared by the threads
+void add_meter_benches(BenchRunner *runner, MicroEnv *env) {
+  using bm::Meter;
+  auto pkt = std::make_shared<std::unique_ptr<bm::Packet> >(
+      env->make_parsed_packet(0x0a00000a));
+  for (const size_t num_threads : {1u, 4u}) {
+    auto meter = std::make_shared<Meter>(Meter::MeterType::PACKETS, 2);
+    meter->set_rates({Meter::rate_config_t::make(0.000001, 1),
+                      Meter::rate_config_t::make(0.000002, 1)});
+    runner->add("meter/execute/" + std::to_string(num_threads) +
+                (num_threads == 1 ? "_thread" : "_threads"),
+                [meter, pkt, num_threads](size_t iters) {
+      const auto &p = **pkt;
+      auto execute = [&meter, &p](size_t n) {
+        for (size_t i = 0; i < n; i++) do_not_optimize(meter->execute(p));
+      };
+      // the iterations are split between the threads, so that the result is
+      // the aggregate throughput
+      std::vector<std::thread> threads;
+      for (size_t t = 1; t < num_threads; t++)
+        threads.emplace_back(execute, iters / num_threads);
+      execute(iters - (num_threads - 1) * (iters / num_threads));
+      for (auto &t : threads) t.join();
+    });
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  import_primitives();
+
+  // the benchmarks hold packets, so they must be destroyed before the env
+  MicroEnv env;
+  BenchRunner runner("micro", argc, argv);
+
+  add_parser_benches(&runner, &env);
+  add_deparser_benches(&runner, &env);
+  add_match_key_benches(&runner, &env);
+  add_lookup_structure_benches(&runner, &env);
+  add_expression_benches(&runner, &env);
+  add_action_benches(&runner, &env);
+  add_queue_benches(&runner);
+  add_hash_benches(&runner, &env);
+  add_group_selection_benches(&runner, &env);
+  add_meter_benches(&runner, &env);
+
+  return runner.run();
+}
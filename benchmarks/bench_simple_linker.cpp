@@ -0,0 +1,219 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+// End-to-end simple_linker benchmarks. The programs are the compiled versions
+// of the dc and enterprise programs checked in under
+// targets/simple_linker/tests/input-jsons/ (the .p4 sources cannot be compiled
+// as part of the build).
+// - simple_linker/<program>/*: packets go through a LinkerSwitch with the same
+//   per-packet processing as the simple_linker pipeline thread, but run
+//   synchronously in receive_() and handed to a transmit callback.
+// - simple_linker/load*: cost of loading the 2 programs, with and without
+//   linking them with bm::Linker (the difference is the linking cost).
+
+#include <bm/bm_sim/deparser.h>
+#include <bm/bm_sim/parser.h>
+#include <bm/bm_sim/pipeline.h>
+
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench_utils.h"
+#include "linker_switch.h"
+
+using bm::ActionData;
+using bm::MatchErrorCode;
+using bm::MatchKeyParam;
+
+using bench_utils::BenchRunner;
+using bench_utils::TrafficGen;
+
+// the simple_switch primitives are a superset of the simple_linker ones
+extern int import_primitives();
+
+namespace {
+
+const char *input_dir = "targets/simple_linker/tests/input-jsons/";
+
+std::string read_file(const std::string &path) {
+  std::ifstream fs(path);
+  if (!fs) {
+    std::cerr << "Cannot open '" << path << "'\n";
+    std::exit(1);
+  }
+  std::stringstream ss;
+  ss << fs.rdbuf();
+  return ss.str();
+}
+
+std::string ipv4(uint32_t addr) {
+  const char bytes[4] = {static_cast<char>(addr >> 24),
+                         static_cast<char>(addr >> 16),
+                         static_cast<char>(addr >> 8),
+                         static_cast<char>(addr)};
+  return std::string(bytes, sizeof(bytes));
+}
+
+class LinkerSwitchBench : public ls::LinkerSwitch {
+ public:
+  using TransmitFn = std::function<void(int, const char *, int)>;
+
+  explicit LinkerSwitchBench(TransmitFn transmit)
+      : transmit(std::move(transmit)) { }
+
+  // same processing as SimpleLinker::pipeline_thread()
+  int receive_(int port_num, const char *buffer, int len) override {
+    auto packet = new_packet_ptr(port_num, packet_id++, len,
+                                 bm::PacketBuffer(len + 512, buffer, len));
+    auto phv = packet->get_phv();
+    parser->parse(packet.get());
+    ingress_mau->apply(packet.get());
+    int egress_spec = phv->get_field("standard_metadata.egress_spec").get_int();
+    if (egress_spec == 511) return 0;
+    packet->set_egress_port(egress_spec);
+    phv->get_field("standard_metadata.egress_port").set(egress_spec);
+    egress_mau->apply(packet.get());
+    deparser->deparse(packet.get());
+    transmit(packet->get_egress_port(), packet->data(),
+             packet->get_data_size());
+    return 0;
+  }
+
+  void start_and_return_() override {
+    ingress_mau = get_pipeline("ingress");
+    egress_mau = get_pipeline("egress");
+    parser = get_parser("parser");
+    deparser = get_deparser("deparser");
+  }
+
+ private:
+  TransmitFn transmit;
+  bm::packet_id_t packet_id{0};
+  bm::Pipeline *ingress_mau{nullptr};
+  bm::Pipeline *egress_mau{nullptr};
+  bm::Parser *parser{nullptr};
+  bm::Deparser *deparser{nullptr};
+};
+
+void populate_tables(LinkerSwitchBench *sw) {
+  bm::entry_handle_t handle;
+  const uint32_t subnets[] = {0x0a000000, 0x0a000100};
+  for (int i = 0; i < 2; i++) {
+    ActionData ipv4_forward;
+    ipv4_forward.push_back_action_data("\x00\x04\x00\x00\x00\x00", 6);
+    ipv4_forward.push_back_action_data(i + 1);
+    auto rc = sw->mt_add_entry(0, "ipv4_lpm",
+                               {MatchKeyParam(MatchKeyParam::Type::LPM,
+                                              ipv4(subnets[i]), 24)},
+                               "ipv4_forward", std::move(ipv4_forward),
+                               &handle);
+    if (rc != MatchErrorCode::SUCCESS) {
+      std::cerr << "Error when populating tables\n";
+      std::exit(1);
+    }
+  }
+}
+
+void add_pipeline_benches(BenchRunner *runner, const std::string &program) {
+  auto transmitted = std::make_shared<size_t>(0);
+  // the switch needs to outlive the runner, it is never deleted
+  auto sw = new LinkerSwitchBench(
+      [transmitted](int port_num, const char *buffer, int len) {
+        (void) port_num; (void) buffer; (void) len;
+        (*transmitted)++;
+      });
+  sw->init_objects(bench_utils::src_path(input_dir + program + ".json"));
+  populate_tables(sw);
+  sw->start_and_return_();
+
+  for (size_t size : {64, 512, 1500}) {
+    std::vector<std::vector<char> > frames = {
+      TrafficGen::ipv4_udp_frame(0x0a00000a, size),
+      TrafficGen::ipv4_udp_frame(0x0a00010a, size)};
+    runner->add("simple_linker/" + program + "/ipv4_" + std::to_string(size),
+                [sw, frames, transmitted](size_t iters) {
+      size_t base = *transmitted;
+      for (size_t i = 0; i < iters; i++) {
+        const auto &frame = frames[i % frames.size()];
+        sw->receive_(0, frame.data(), static_cast<int>(frame.size()));
+      }
+      if (*transmitted - base != iters) {
+        std::cerr << "Some packets were dropped by the pipeline\n";
+        std::exit(1);
+      }
+    });
+  }
+}
+
+void add_link_benches(BenchRunner *runner) {
+  auto programs = std::make_shared<std::vector<std::string> >();
+  for (const char *p : {"dc", "enterprise"})
+    programs->push_back(read_file(bench_utils::src_path(
+        std::string(input_dir) + p + ".json")));
+  auto factory = std::make_shared<bm::LookupStructureFactory>();
+  // discard the P4Objects output, we load the programs many times
+  auto null_out = std::make_shared<std::ostringstream>();
+
+  auto load = [programs, factory, null_out]() {
+    std::vector<std::shared_ptr<bm::P4Objects> > objects;
+    for (const auto &program : *programs) {
+      std::istringstream is(program);
+      objects.push_back(std::make_shared<bm::P4Objects>(*null_out));
+      if (objects.back()->init_objects(&is, factory.get()) != 0) {
+        std::cerr << "Error when loading program\n";
+        std::exit(1);
+      }
+    }
+    null_out->str("");
+    return objects;
+  };
+
+  runner->add("simple_linker/load/dc+enterprise", [load](size_t iters) {
+    for (size_t i = 0; i < iters; i++) load();
+  });
+  runner->add("simple_linker/load_and_link/dc+enterprise", [load](
+      size_t iters) {
+    for (size_t i = 0; i < iters; i++) {
+      auto objects = load();
+      bm::Linker linker;
+      for (size_t p = 0; p < objects.size(); p++)
+        linker.add_p4objects("p4." + std::to_string(p), objects[p]);
+    }
+  });
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  import_primitives();
+
+  BenchRunner runner("simple_linker", argc, argv);
+
+  add_pipeline_benches(&runner, "dc");
+  add_pipeline_benches(&runner, "enterprise");
+  add_link_benches(&runner);
+
+  return runner.run();
+}
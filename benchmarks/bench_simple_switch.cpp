@@ -0,0 +1,154 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+// End-to-end simple_switch benchmark: packets are injected with receive_() and
+// counted in the transmit function, so the whole target (ingress thread,
+// egress queues and threads, transmit thread) is exercised without any
+// interface. The program is mininet/simple_router.json, populated like
+// mininet/stress_test_commands.txt does.
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_utils.h"
+#include "simple_switch.h"
+
+using bm::ActionData;
+using bm::MatchErrorCode;
+using bm::MatchKeyParam;
+
+using bench_utils::BenchRunner;
+using bench_utils::TrafficGen;
+
+namespace {
+
+// maximum number of packets in flight, smaller than the egress queue depth so
+// that no packet is ever dropped by the queueing logic
+constexpr size_t window = 512;
+constexpr size_t queue_depth = 1024;
+
+std::string ipv4(uint32_t addr) {
+  const char bytes[4] = {static_cast<char>(addr >> 24),
+                         static_cast<char>(addr >> 16),
+                         static_cast<char>(addr >> 8),
+                         static_cast<char>(addr)};
+  return std::string(bytes, sizeof(bytes));
+}
+
+void check(MatchErrorCode rc) {
+  if (rc != MatchErrorCode::SUCCESS) {
+    std::cerr << "Error when populating tables\n";
+    std::exit(1);
+  }
+}
+
+void populate_tables(SimpleSwitch *sw) {
+  bm::entry_handle_t handle;
+  check(sw->mt_set_default_action(0, "send_frame", "_drop", ActionData()));
+  check(sw->mt_set_default_action(0, "forward", "_drop", ActionData()));
+  check(sw->mt_set_default_action(0, "ipv4_lpm", "_drop", ActionData()));
+
+  const char *smacs[] = {"\x00\xaa\xbb\x00\x00\x00",
+                         "\x00\xaa\xbb\x00\x00\x01"};
+  const char *dmacs[] = {"\x00\x04\x00\x00\x00\x00",
+                         "\x00\x04\x00\x00\x00\x01"};
+  const uint32_t hosts[] = {0x0a00000a, 0x0a00010a};
+  for (int i = 0; i < 2; i++) {
+    const unsigned int port = i + 1;
+    ActionData rewrite_mac;
+    rewrite_mac.push_back_action_data(smacs[i], 6);
+    check(sw->mt_add_entry(0, "send_frame",
+                           {MatchKeyParam(MatchKeyParam::Type::EXACT,
+                                          std::string(1, '\x00') +
+                                          std::string(1, port))},
+                           "rewrite_mac", std::move(rewrite_mac), &handle));
+
+    ActionData set_dmac;
+    set_dmac.push_back_action_data(dmacs[i], 6);
+    check(sw->mt_add_entry(0, "forward",
+                           {MatchKeyParam(MatchKeyParam::Type::EXACT,
+                                          ipv4(hosts[i]))},
+                           "set_dmac", std::move(set_dmac), &handle));
+
+    ActionData set_nhop;
+    set_nhop.push_back_action_data(hosts[i]);
+    set_nhop.push_back_action_data(port);
+    check(sw->mt_add_entry(0, "ipv4_lpm",
+                           {MatchKeyParam(MatchKeyParam::Type::LPM,
+                                          ipv4(hosts[i]), 32)},
+                           "set_nhop", std::move(set_nhop), &handle));
+  }
+}
+
+class SimpleSwitchBench {
+ public:
+  SimpleSwitchBench() {
+    // the simple_switch threads are detached, so the switch is never deleted
+    sw = new SimpleSwitch(8);
+    sw->init_objects(bench_utils::src_path("mininet/simple_router.json"));
+    sw->set_all_egress_queue_depths(queue_depth);
+    sw->set_transmit_fn([this](int port_num, const char *buffer, int len) {
+      (void) port_num; (void) buffer; (void) len;
+      transmitted.fetch_add(1, std::memory_order_release);
+    });
+    populate_tables(sw);
+    // no DevMgr: we start the target threads directly and bypass
+    // Switch::receive() / DevMgr::transmit_fn()
+    sw->start_and_return_();
+  }
+
+  // alternates between the given frames, returns once all of them have been
+  // transmitted
+  void run(size_t iters, const std::vector<std::vector<char> > &frames) {
+    const size_t base = transmitted.load(std::memory_order_acquire);
+    for (size_t i = 0; i < iters; i++) {
+      while (i - (transmitted.load(std::memory_order_acquire) - base) >= window)
+        std::this_thread::yield();
+      const auto &frame = frames[i % frames.size()];
+      sw->receive_(0, frame.data(), static_cast<int>(frame.size()));
+    }
+    while (transmitted.load(std::memory_order_acquire) - base < iters)
+      std::this_thread::yield();
+  }
+
+ private:
+  SimpleSwitch *sw{nullptr};
+  std::atomic<size_t> transmitted{0};
+};
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  BenchRunner runner("simple_switch", argc, argv);
+  SimpleSwitchBench bench;
+
+  for (size_t size : {64, 512, 1500}) {
+    std::vector<std::vector<char> > frames = {
+      TrafficGen::ipv4_udp_frame(0x0a00000a, size),
+      TrafficGen::ipv4_udp_frame(0x0a00010a, size)};
+    runner.add("simple_switch/simple_router/ipv4_" + std::to_string(size),
+               [&bench, frames](size_t iters) { bench.run(iters, frames); });
+  }
+
+  return runner.run();
+}
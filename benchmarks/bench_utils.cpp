@@ -0,0 +1,242 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <jsoncpp/json.h>
+
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "bench_utils.h"
+#include "version.h"
+
+namespace bench_utils {
+
+double
+BenchResult::min() const {
+  return *std::min_element(ns_per_iter.begin(), ns_per_iter.end());
+}
+
+double
+BenchResult::max() const {
+  return *std::max_element(ns_per_iter.begin(), ns_per_iter.end());
+}
+
+double
+BenchResult::mean() const {
+  return std::accumulate(ns_per_iter.begin(), ns_per_iter.end(), 0.0) /
+      ns_per_iter.size();
+}
+
+double
+BenchResult::median() const {
+  auto sorted = ns_per_iter;
+  std::sort(sorted.begin(), sorted.end());
+  size_t n = sorted.size();
+  return (n % 2) ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+BenchRunner::BenchRunner(const std::string &suite, int argc, char *argv[])
+    : suite(suite) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    bool has_value = (i + 1 < argc);
+    if (arg == "--list") {
+      list_only = true;
+    } else if (arg == "--min-time" && has_value) {
+      min_time = std::stod(argv[++i]);
+    } else if (arg == "--repetitions" && has_value) {
+      repetitions = std::max(1ul, std::stoul(argv[++i]));
+    } else if (arg == "--filter" && has_value) {
+      filter = argv[++i];
+    } else if (arg == "--json" && has_value) {
+      json_path = argv[++i];
+    } else {
+      std::cerr << "Invalid argument '" << arg << "'\n"
+                << "Usage: " << argv[0] << " [--min-time <seconds>]"
+                << " [--repetitions <n>] [--filter <substring>]"
+                << " [--json <path>] [--list]\n";
+      bad_args = true;
+      break;
+    }
+  }
+}
+
+void
+BenchRunner::add(const std::string &name, BenchFn fn) {
+  benches.push_back({name, std::move(fn)});
+}
+
+double
+BenchRunner::time_one(const BenchFn &fn, size_t iterations) const {
+  auto start = clock::now();
+  fn(iterations);
+  auto end = clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+BenchResult
+BenchRunner::run_one(const Bench &bench) const {
+  const double min_ns = min_time * 1e9;
+  // warm-up + calibration
+  size_t iterations = 1;
+  double elapsed;
+  while ((elapsed = time_one(bench.fn, iterations)) < min_ns / 10)
+    iterations *= 2;
+  iterations = std::max<size_t>(
+      1, static_cast<size_t>(iterations * (min_ns / elapsed)));
+
+  BenchResult result;
+  result.name = bench.name;
+  result.iterations = iterations;
+  for (size_t rep = 0; rep < repetitions; rep++)
+    result.ns_per_iter.push_back(time_one(bench.fn, iterations) / iterations);
+  return result;
+}
+
+int
+BenchRunner::run() {
+  if (bad_args) return 1;
+  if (list_only) {
+    for (const auto &bench : benches) std::cout << bench.name << "\n";
+    return 0;
+  }
+
+  std::cout << std::left << std::setw(48) << "benchmark"
+            << std::right << std::setw(14) << "ns/iter"
+            << std::setw(14) << "iters/s"
+            << std::setw(10) << "spread" << "\n";
+  for (const auto &bench : benches) {
+    if (bench.name.find(filter) == std::string::npos) continue;
+    results.push_back(run_one(bench));
+    const auto &r = results.back();
+    double median = r.median();
+    // relative difference between the slowest and fastest repetitions
+    double spread = (r.max() - r.min()) / median * 100.;
+    std::cout << std::left << std::setw(48) << r.name
+              << std::right << std::fixed << std::setprecision(1)
+              << std::setw(14) << median
+              << std::setw(14) << std::setprecision(0) << 1e9 / median
+              << std::setw(9) << std::setprecision(1) << spread << "%\n";
+  }
+
+  if (!json_path.empty()) return write_json(json_path);
+  return 0;
+}
+
+int
+BenchRunner::write_json(const std::string &path) const {
+  Json::Value root(Json::objectValue);
+
+  Json::Value context(Json::objectValue);
+  context["suite"] = suite;
+  context["bm_version"] = bm::bm_version_str;
+  char date[32];
+  std::time_t now = std::time(nullptr);
+  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+  context["date"] = date;
+#ifdef __VERSION__
+  context["compiler"] = __VERSION__;
+#endif
+#ifdef NDEBUG
+  context["assertions"] = false;
+#else
+  context["assertions"] = true;
+#endif
+  context["min_time_s"] = min_time;
+  context["repetitions"] = static_cast<Json::UInt64>(repetitions);
+  root["context"] = context;
+
+  Json::Value benchmarks(Json::arrayValue);
+  for (const auto &r : results) {
+    Json::Value b(Json::objectValue);
+    b["name"] = r.name;
+    b["iterations"] = static_cast<Json::UInt64>(r.iterations);
+    b["ns_per_iter"] = r.median();
+    b["iters_per_sec"] = 1e9 / r.median();
+    b["ns_per_iter_min"] = r.min();
+    b["ns_per_iter_max"] = r.max();
+    b["ns_per_iter_mean"] = r.mean();
+    Json::Value reps(Json::arrayValue);
+    for (double ns : r.ns_per_iter) reps.append(ns);
+    b["repetitions"] = reps;
+    benchmarks.append(b);
+  }
+  root["benchmarks"] = benchmarks;
+
+  std::ofstream fs(path);
+  if (!fs) {
+    std::cerr << "Cannot open '" << path << "' for writing\n";
+    return 1;
+  }
+  fs << root;
+  return 0;
+}
+
+std::vector<char>
+TrafficGen::ipv4_udp_frame(uint32_t dst_addr, size_t size, uint8_t ttl) {
+  size = std::max<size_t>(size, 14 + 20 + 8);
+  std::vector<char> frame(size, 0);
+  auto *p = reinterpret_cast<unsigned char *>(frame.data());
+  const unsigned char dmac[6] = {0x00, 0xaa, 0xbb, 0x00, 0x00, 0x10};
+  const unsigned char smac[6] = {0x00, 0xaa, 0xbb, 0x00, 0x00, 0x20};
+  std::copy(dmac, dmac + 6, p);
+  std::copy(smac, smac + 6, p + 6);
+  p[12] = 0x08; p[13] = 0x00;
+  unsigned char *ip = p + 14;
+  size_t ip_len = size - 14;
+  ip[0] = 0x45;
+  ip[2] = ip_len >> 8; ip[3] = ip_len & 0xff;
+  ip[8] = ttl;
+  ip[9] = 17;  // UDP
+  ip[12] = 10; ip[13] = 0; ip[14] = 0; ip[15] = 1;
+  ip[16] = dst_addr >> 24; ip[17] = dst_addr >> 16;
+  ip[18] = dst_addr >> 8; ip[19] = dst_addr;
+  uint32_t sum = 0;
+  for (int i = 0; i < 20; i += 2) sum += (ip[i] << 8) | ip[i + 1];
+  while (sum >> 16) sum = (sum & 0xffff) + (sum >> 16);
+  ip[10] = ~sum >> 8; ip[11] = ~sum & 0xff;
+  unsigned char *udp = ip + 20;
+  size_t udp_len = ip_len - 20;
+  udp[0] = 0x30; udp[1] = 0x39;  // 12345
+  udp[2] = 0x00; udp[3] = 0x35;  // 53
+  udp[4] = udp_len >> 8; udp[5] = udp_len & 0xff;
+  return frame;
+}
+
+std::unique_ptr<bm::Packet>
+SwitchBench::make_packet(int ingress_port, const std::vector<char> &frame) {
+  static uint64_t packet_id = 0;
+  return new_packet_ptr(
+      ingress_port, packet_id++, static_cast<int>(frame.size()),
+      bm::PacketBuffer(frame.size() + 512, frame.data(), frame.size()));
+}
+
+std::string
+src_path(const std::string &relative_path) {
+  return std::string(BENCH_SRCDIR) + "/" + relative_path;
+}
+
+}  // namespace bench_utils
@@ -0,0 +1,132 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#ifndef BENCHMARKS_BENCH_UTILS_H_
+#define BENCHMARKS_BENCH_UTILS_H_
+
+#include <bm/bm_sim/packet.h>
+#include <bm/bm_sim/switch.h>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace bench_utils {
+
+// A benchmark body is called with the number of iterations it has to run and
+// must run exactly that many; the runner times the whole call. Setup work
+// should be done before registering the benchmark (the closure captures it).
+using BenchFn = std::function<void(size_t iterations)>;
+
+struct BenchResult {
+  std::string name{};
+  // iterations per repetition, as chosen by calibration
+  size_t iterations{0};
+  // one entry per repetition
+  std::vector<double> ns_per_iter{};
+
+  double min() const;
+  double max() const;
+  double mean() const;
+  double median() const;
+};
+
+// Minimal benchmark runner. Each registered benchmark is first calibrated (the
+// iteration count is doubled until one run takes at least 1/10th of the
+// minimum time), then run for the requested number of repetitions. Results are
+// printed as a table on stdout and, if requested, written as JSON so that they
+// can be compared between versions (see compare_results.py).
+//
+// Recognized command-line options:
+//   --min-time <seconds>   minimum duration of one repetition (default 0.5)
+//   --repetitions <n>      number of repetitions (default 5)
+//   --filter <substring>   only run benchmarks whose name contains substring
+//   --json <path>          write machine-readable results to path
+//   --list                 print the benchmark names and exit
+class BenchRunner {
+ public:
+  BenchRunner(const std::string &suite, int argc, char *argv[]);
+
+  void add(const std::string &name, BenchFn fn);
+
+  // returns 0 on success, can be used as the exit code of main
+  int run();
+
+  const std::vector<BenchResult> &get_results() const { return results; }
+
+ private:
+  using clock = std::chrono::steady_clock;
+
+  struct Bench {
+    std::string name;
+    BenchFn fn;
+  };
+
+  double time_one(const BenchFn &fn, size_t iterations) const;
+  BenchResult run_one(const Bench &bench) const;
+  int write_json(const std::string &path) const;
+
+  std::string suite;
+  double min_time{0.5};
+  size_t repetitions{5};
+  std::string filter{};
+  std::string json_path{};
+  bool list_only{false};
+  bool bad_args{false};
+  std::vector<Bench> benches{};
+  std::vector<BenchResult> results{};
+};
+
+// Builds synthetic Ethernet / IPv4 / UDP frames, which is what the
+// simple_router.json program (and the linker test programs) expect.
+struct TrafficGen {
+  static std::vector<char> ipv4_udp_frame(uint32_t dst_addr, size_t size = 64,
+                                          uint8_t ttl = 64);
+};
+
+class SwitchBench : public bm::Switch {
+ public:
+  int receive_(int port_num, const char *buffer, int len) override {
+    (void) port_num; (void) buffer; (void) len;
+    return 0;
+  }
+
+  void start_and_return_() override {
+  }
+
+  std::unique_ptr<bm::Packet> make_packet(int ingress_port,
+                                          const std::vector<char> &frame);
+};
+
+// absolute path of a file in the source tree (BENCH_SRCDIR is the top-level
+// source directory)
+std::string src_path(const std::string &relative_path);
+
+// prevents the compiler from optimizing away a computed value
+template <typename T>
+inline void do_not_optimize(const T &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+}  // namespace bench_utils
+
+#endif  // BENCHMARKS_BENCH_UTILS_H_
@@ -0,0 +1,87 @@
+#!/usr/bin/env python
+
+# Copyright 2013-present Barefoot Networks, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+#
+# Antonin Bas (antonin@barefootnetworks.com)
+#
+#
+
+# Compares 2 sets of benchmark results (as written by the benchmark programs
+# with --json, or by 'make bench'). Arguments can be JSON files or directories
+# of JSON files. Exits with a non-zero status if at least one benchmark is
+# slower by more than the threshold.
+
+import argparse
+import json
+import os
+import sys
+
+
+def load_results(path):
+    files = [path]
+    if os.path.isdir(path):
+        files = sorted(os.path.join(path, f) for f in os.listdir(path)
+                       if f.endswith(".json"))
+    results = {}
+    versions = set()
+    for f in files:
+        with open(f) as fp:
+            data = json.load(fp)
+        versions.add(data["context"].get("bm_version", "?"))
+        for b in data["benchmarks"]:
+            results[b["name"]] = b["ns_per_iter"]
+    return results, ", ".join(sorted(versions))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare benchmark results')
+    parser.add_argument('baseline', help='JSON file or directory')
+    parser.add_argument('contender', help='JSON file or directory')
+    parser.add_argument('--threshold', type=float, default=5.0,
+                        help='Regression threshold, in percent (default 5)')
+    args = parser.parse_args()
+
+    baseline, baseline_version = load_results(args.baseline)
+    contender, contender_version = load_results(args.contender)
+
+    print("baseline: {}, contender: {}".format(
+        baseline_version, contender_version))
+    print("{:<48}{:>14}{:>14}{:>10}".format(
+        "benchmark", "base ns/iter", "new ns/iter", "change"))
+    regressions = []
+    for name in sorted(set(baseline) & set(contender)):
+        old, new = baseline[name], contender[name]
+        change = (new - old) / old * 100.
+        flag = ""
+        if change > args.threshold:
+            flag = "  <-- regression"
+            regressions.append(name)
+        print("{:<48}{:>14.1f}{:>14.1f}{:>9.1f}%{}".format(
+            name, old, new, change, flag))
+    for name in sorted(set(baseline) ^ set(contender)):
+        print("{:<48} only in {}".format(
+            name, "baseline" if name in baseline else "contender"))
+
+    if regressions:
+        print("{} benchmark(s) regressed by more than {}%".format(
+            len(regressions), args.threshold))
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,91 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#ifndef BM_BM_APPS_SHM_PACKET_PIPE_H_
+#define BM_BM_APPS_SHM_PACKET_PIPE_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace bm_apps {
+
+class ShmPacketInjectImp;
+
+// Counterpart of the switch's shared memory device manager (--packet-in-shm),
+// meant for traffic generators and sinks running on the same host. Packets are
+// exchanged through lock-free rings, without any system call, and can be sent
+// in batches.
+class ShmPacketInject {
+ public:
+  // the buffer points to shared memory which is reused as soon as the callback
+  // returns, make a copy if you need to
+  using PacketReceiveCb = std::function<void(int port_num, const char *buffer,
+                                             int len, void *cookie)>;
+
+  struct Packet {
+    int port_num;
+    const char *buffer;
+    int len;
+  };
+
+  // shm_name is the name of the segment given to the switch
+  explicit ShmPacketInject(const std::string &shm_name);
+
+  ~ShmPacketInject();
+
+  // attaches to the shared memory segment (which is created by the switch) and
+  // starts the receiving thread; returns false if the segment does not exist
+  // (e.g. the switch is not running yet) or cannot be used, in which case
+  // start() can be called again later
+  bool start();
+
+  // should be called before start()
+  void set_packet_receiver(const PacketReceiveCb &cb, void *cookie);
+
+  // does not block: returns false if the packet could not be enqueued because
+  // the ring is full (or the packet too large, see get_max_packet_size())
+  bool send(int port_num, const char *buffer, int len);
+
+  // enqueues as many packets as possible, in order, and returns how many were
+  // enqueued; the switch is notified once for the whole batch
+  size_t send_batch(const Packet *pkts, size_t num_pkts);
+
+  // returns 0 if start() has not succeeded yet
+  int get_max_packet_size() const;
+
+  // these 4 port_* functions are optional, depending on receiver configuration;
+  // they wait for room in the ring if needed
+  void port_add(int port_num);
+
+  void port_remove(int port_num);
+
+  void port_bring_up(int port_num);
+
+  void port_bring_down(int port_num);
+
+ private:
+  // cannot use {nullptr} with pimpl
+  std::unique_ptr<ShmPacketInjectImp> pimp;
+};
+
+}  // namespace bm_apps
+
+#endif  // BM_BM_APPS_SHM_PACKET_PIPE_H_
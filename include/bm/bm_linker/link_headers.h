@@ -94,6 +94,11 @@ class HeaderUIDTable {
                                          const p4object_name_t& type_name,
                                          header_id_t& rp_header_id_out);
 
+  //! Looks up the linker header id a header of program p4_name was linked to
+  ObjectLinkStateCode get_linked_header_id(const std::string& p4_name,
+                                           header_id_t header_id,
+                                           header_id_t& rp_header_id_out) const;
+
   void get_linked_header_ids_map(
       std::unordered_map<std::string, header_id_t>& out) const;
 
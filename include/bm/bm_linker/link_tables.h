@@ -0,0 +1,144 @@
+/*
+ * Hardik Soni (hardik.soni@inria.fr)
+ *
+ */
+
+//! @file link_tables.h
+
+#ifndef BM_BM_LINKER_TABLES_H_
+#define BM_BM_LINKER_TABLES_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <bm/bm_sim/P4Objects.h>
+#include <bm/bm_sim/match_tables.h>
+#include <bm/bm_linker/link_headers.h>
+#include <bm/bm_linker/p4objects_linker_ext.h>
+
+namespace bm {
+
+//! Links the match-action tables of the P4 programs added to the Linker.
+//!
+//! Each table gets a structural signature: its key fields, where headers are
+//! replaced by their linker header id (or, for headers which were not linked
+//! through the parser, e.g. metadata, by their linker header type and name),
+//! with their match type, bitwidth and mask, and the parameter bitwidths of
+//! each of its actions. Tables of different programs with the same signature
+//! are linked to a single linker table, i.e. they can share one lookup
+//! structure. Each program is given a tenant id, meant to prefix the match key
+//! of its entries in the shared lookup structure (see get_linked_match_key()),
+//! so that a program only ever hits its own entries.
+//!
+//! Only the link state is recorded here: no lookup structure is allocated
+//! until the control flows of the programs are merged, and each program keeps
+//! on using its own tables. In particular, the default action of each program
+//! is only recorded by name in its TenantTable, for the merged pipeline to
+//! install.
+//!
+//! Only tables of type MatchTableType::SIMPLE without lookup side effects
+//! (direct counters, direct meters, ageing) are shared; other tables are still
+//! given a linker table, but one which is never shared.
+class LinkTables {
+
+ public:
+  using tenant_id_t = uint16_t;
+
+  //! One of the program tables linked to a linker table
+  struct TenantTable {
+    p4object_name_t table_name;
+    tenant_id_t tenant_id;
+    size_t size;
+    //! empty if the program does not define one
+    p4object_name_t default_action;
+  };
+
+  struct LinkedTable {
+    p4object_name_t name;
+    linker_uid_t signature;
+    bool shareable;
+    //! program name -> table of that program
+    std::map<std::string, TenantTable> tenants;
+
+    //! number of entries the shared lookup structure needs to hold
+    size_t get_size() const;
+  };
+
+  explicit LinkTables(
+           std::shared_ptr<const HeaderTypeUIDTable> header_type_uid_table,
+           std::shared_ptr<const HeaderUIDTable> header_uid_table)
+    : header_type_uid_table_(header_type_uid_table),
+      header_uid_table_(header_uid_table) {
+  }
+
+  //! Links all the tables of the program, must be called once its headers
+  //! are linked. Returns TABLE_LINKED on success.
+  ObjectLinkStateCode link_tables(
+      std::shared_ptr<P4ObjectsLinkerExt> p4objects_ext);
+
+  //! Retrieves the linker table a program table was linked to. Returns
+  //! TABLE_SHARED if other programs are linked to the same table,
+  //! TABLE_LINKED if not and TABLE_LINK_FAILED if the table is unknown.
+  ObjectLinkStateCode get_linked_table(const std::string& p4_name,
+                                       const p4object_name_t& table_name,
+                                       const LinkedTable*& out) const;
+
+  //! Translates the match key of an entry of a program table into the match
+  //! key of the linker table: the tenant id of the program (as an exact match
+  //! field of tenant_id_bytes bytes) comes first.
+  ObjectLinkStateCode get_linked_match_key(
+      const std::string& p4_name, const p4object_name_t& table_name,
+      const std::vector<MatchKeyParam>& match_key,
+      std::vector<MatchKeyParam>& out) const;
+
+  //! Returns TABLE_LINK_FAILED if no table of program p4_name was linked
+  ObjectLinkStateCode get_tenant_id(const std::string& p4_name,
+                                    tenant_id_t& out) const;
+
+  size_t get_num_linked_tables() const {
+    return linked_tables.size();
+  }
+
+  std::string to_string();
+
+  static constexpr size_t tenant_id_bytes = sizeof(tenant_id_t);
+
+  // Disabling copying, but allow moving
+  LinkTables(const LinkTables &other) = delete;
+  LinkTables &operator=(const LinkTables &) = delete;
+
+ private:
+  bool get_table_signature(const P4ObjectsLinkerExt* p4objects_ext,
+                           const MatchActionTable* table,
+                           linker_uid_t& signature) const;
+
+  bool get_header_uid(const P4ObjectsLinkerExt* p4objects_ext,
+                      header_id_t header_id, std::string& uid) const;
+
+  p4object_name_t get_new_table_name() {
+    return "linker_table_" + std::to_string(table_id++);
+  }
+
+ private:
+  std::shared_ptr<const HeaderTypeUIDTable> header_type_uid_table_;
+  std::shared_ptr<const HeaderUIDTable> header_uid_table_;
+
+  //! <p4_name>.<table name> to linker table name
+  LinkerUIDTableGeneric<p4object_name_t> tables_link_table;
+
+  //! signature to the linker table name for shareable tables
+  std::unordered_map<linker_uid_t, p4object_name_t> signature_table_map{};
+  std::unordered_map<p4object_name_t, LinkedTable> linked_tables{};
+
+  std::unordered_map<std::string, tenant_id_t> tenant_ids{};
+
+  size_t table_id{0};
+};
+
+}  // namespace bm
+
+#endif  // BM_BM_LINKER_TABLES_H_
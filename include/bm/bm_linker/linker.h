@@ -22,6 +22,7 @@
 
 #include <bm/bm_linker/link_headers.h>
 #include <bm/bm_linker/link_parsers.h>
+#include <bm/bm_linker/link_tables.h>
 #include <bm/bm_linker/p4objects_linker_ext.h> 
 
 namespace bm {
@@ -34,9 +35,17 @@ class Linker {
   explicit Linker();
 
   //! it gives pointer to new object
+  //! Calls have to be serialized, the Linker state is not protected; they can
+  //! however run concurrently with packet processing, since the returned
+  //! object is a new one.
   std::shared_ptr<P4Objects> add_p4objects(const std::string& p4_name, 
                                             std::shared_ptr<P4Objects> objs);
 
+  //! gives access to the links between the tables of the added programs
+  const LinkTables& get_table_linker() const {
+    return table_linker;
+  }
+
   // Disabling copying, but allow moving
   Linker(const Linker &other) = delete;
   Linker &operator=(const Linker &) = delete;
@@ -68,6 +77,7 @@ class Linker {
   std::shared_ptr<HeaderUIDTable> header_uid_table_{nullptr};
 
   LinkParsers parser_linker;
+  LinkTables table_linker;
 
 };
 
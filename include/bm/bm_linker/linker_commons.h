@@ -59,6 +59,9 @@ enum ObjectLinkStateCode {
   STATE_LINKED,
   STATE_MATCHED,
   PARSER_LINKING_FAILED,
+  TABLE_LINKED,
+  TABLE_SHARED,
+  TABLE_LINK_FAILED,
   LINKING_FAILED,
   DEFAULT
 };
@@ -85,6 +88,9 @@ class Enums {
       case STATE_LINKED: return "STATE_LINKED";
       case STATE_MATCHED: return "STATE_MATCHED";
       case PARSER_LINKING_FAILED: return "PARSER_LINKING_FAILED";
+      case TABLE_LINKED: return "TABLE_LINKED";
+      case TABLE_SHARED: return "TABLE_SHARED";
+      case TABLE_LINK_FAILED: return "TABLE_LINK_FAILED";
       case LINKING_FAILED: return "LINKING_FAILED";
       default: return "DEFAULT";
     }
@@ -57,6 +57,10 @@ class P4ObjectsLinkerExt {
     return p4objects;
   }
 
+  std::shared_ptr<const P4Objects> get_p4objects() const {
+    return p4objects;
+  }
+
   std::unordered_set<header_id_t> get_header_ids() const;
 
   p4object_name_t get_header_name(header_id_t id) const;
@@ -66,6 +66,7 @@ class P4Objects {
   friend class Linker;
   friend class P4ObjectsLinkerExt;
   friend class LinkParsers;
+  friend class LinkTables;
  public:
   using header_field_pair = std::pair<std::string, std::string>;
 
@@ -132,6 +133,10 @@ class P4Objects {
   void serialize(std::ostream *out) const;
   void deserialize(std::istream *in);
 
+  //! Writes the telemetry for all tables, parsers and deparsers to \p out
+  void dump_telemetry(Json::Value *out) const;
+  void reset_telemetry();
+
   enum class IdLookupErrorCode {
     SUCCESS,
     INVALID_RESOURCE_TYPE,
@@ -243,11 +248,18 @@ class P4Objects {
 
   ActionProfile *get_action_profile_rt(const std::string &name) const;
 
+  // install a ResilientGroupSelector with nb_buckets buckets on every action
+  // profile with selection; must be called before any member is added
+  void enable_resilient_group_selection(size_t nb_buckets);
+
   bool field_exists(const std::string &header_name,
                     const std::string &field_name) const;
 
   bool header_exists(const std::string &header_name) const;
 
+  std::tuple<header_id_t, int> field_info(const std::string &header_name,
+                                          const std::string &field_name) const;
+
   // public to be accessed by test class
   ActionPrimitive_ *get_primitive(const std::string &name);
 
@@ -391,6 +403,10 @@ class P4Objects {
   std::unordered_map<std::string, std::unique_ptr<MatchActionTable> >
   match_action_tables_map{};
 
+  // declared before action_profiles_map, as they need to outlive the profiles
+  std::vector<std::unique_ptr<ActionProfile::GroupSelectionIface> >
+  group_selectors{};
+
   std::unordered_map<std::string, std::unique_ptr<ActionProfile> >
   action_profiles_map{};
 
@@ -506,8 +522,6 @@ class P4Objects {
   size_t get_field_bytes(header_id_t header_id, int field_offset) const;
   size_t get_field_bits(header_id_t header_id, int field_offset) const;
   size_t get_header_bits(header_id_t header_id) const;
-  std::tuple<header_id_t, int> field_info(const std::string &header_name,
-                                          const std::string &field_name) const;
   bool check_required_fields(
       const std::set<header_field_pair> &required_fields);
 
@@ -77,6 +77,7 @@
 #include <iosfwd>
 #include <limits>
 #include <tuple>
+#include <array>
 
 #include <cassert>
 
@@ -517,6 +518,32 @@ struct unpack_caller {
   }
 };
 
+struct ActionFusedOp;
+
+// A pre-bound implementation of one primitive call, see ActionFn::compile()
+using ActionFusedFn = void (*)(const ActionFusedOp &op,
+                               ActionEngineState *state,
+                               const ActionParam *args);
+
+// One step of a compiled ActionFn. The default step simply calls
+// ActionPrimitive_::execute(). Primitives can provide a specialized step (see
+// ActionPrimitive_::fuse()) which operates directly on the PHV, with the types
+// of the call arguments resolved once and for all at compile time.
+struct ActionFusedOp {
+  ActionFusedFn fn{nullptr};
+  // non owning pointer
+  ActionPrimitive_ *primitive{nullptr};
+  // offset of the first argument of the call in ActionFn::params
+  size_t param_offset{0};
+  // true iff the primitive may alter the control flow (see
+  // ActionPrimitive_::get_jump_offset()); specialized steps never do
+  bool may_jump{true};
+  // extra operands resolved by ActionPrimitive_::fuse(), if the primitive
+  // needs to access objects which are not part of the call arguments (e.g. a
+  // metadata field accessed by name)
+  std::array<ActionParam, 2> bound{};
+};
+
 class ActionPrimitive_ {
  public:
   virtual ~ActionPrimitive_() { }
@@ -531,6 +558,38 @@ class ActionPrimitive_ {
     return current_offset + 1;
   }
 
+  //! Return true if the primitive only accesses its RegisterArray parameters
+  //! through the thread-safe per-index methods (RegisterArray::read(),
+  //! RegisterArray::fetch_add(), ...). In this case, the arrays it receives as
+  //! parameters are not locked for the duration of the enclosing action, which
+  //! lets threads accessing different indices proceed concurrently.
+  virtual bool manages_register_sync() const {
+    return false;
+  }
+
+  //! Return true if the effects of the primitive can be replayed by a
+  //! FlowCache, i.e. if the primitive only reads the PHV through its
+  //! parameters, only writes PHV fields, header validity bits and (by adding
+  //! to them) packet registers, and does not update any other state (register
+  //! arrays, counters, meters, externs, ...). The default implementation
+  //! returns false, which excludes the actions calling this primitive from
+  //! the flow cache.
+  virtual bool is_flow_cacheable() const {
+    return false;
+  }
+
+  //! Called once for each call to this primitive when the enclosing action is
+  //! compiled (see ActionFn::compile()). \p args are the call arguments, whose
+  //! types are known at that point. The primitive can return true after
+  //! setting `op->fn` (and optionally `op->bound`) to bind the call to a
+  //! specialized implementation, which will be used instead of execute(). The
+  //! specialized implementation is not allowed to jump (see
+  //! get_jump_offset()). The default implementation returns false.
+  virtual bool fuse(const ActionParam *args, ActionFusedOp *op) {
+    (void) args; (void) op;
+    return false;
+  }
+
   void _set_p4objects(P4Objects *p4objects) {
     this->p4objects = p4objects;
   }
@@ -622,6 +681,16 @@ class ActionPrimitiveCall {
 
   SourceInfo *get_source_info() const { return source_info.get(); }
 
+  bool manages_register_sync() const {
+    return primitive->manages_register_sync();
+  }
+
+  bool is_flow_cacheable() const {
+    return primitive->is_flow_cacheable();
+  }
+
+  ActionFusedOp fuse(const ActionParam *args) const;
+
  private:
   ActionPrimitive_ *primitive;
   size_t param_offset;
@@ -671,8 +740,35 @@ class ActionFn :  public NamedP4Object {
 
   size_t get_num_params() const;
 
+  //! Sets the bitwidth of each runtime parameter of the action, as given in
+  //! the JSON
+  void set_param_bitwidths(std::vector<size_t> bitwidths);
+
+  //! Empty if the bitwidths were not set, see set_param_bitwidths()
+  const std::vector<size_t> &get_param_bitwidths() const {
+    return param_bitwidths;
+  }
+
+  //! Lower the primitive calls into a sequence of pre-bound operations, giving
+  //! each primitive a chance to specialize itself for the types of its
+  //! arguments (see ActionPrimitive_::fuse()). Needs to be called once the
+  //! action has been fully built; pushing new primitives discards the compiled
+  //! sequence, in which case the action is interpreted like before.
+  void compile();
+
+  bool is_compiled() const { return !fused_ops.empty(); }
+
+  const std::vector<ActionPrimitiveCall> &get_primitives() const {
+    return primitives;
+  }
+
+  //! Returns the arguments of all the primitive calls, see
+  //! ActionPrimitiveCall::get_param_offset()
+  const std::vector<ActionParam> &get_params() const { return params; }
+
  private:
   std::vector<ActionPrimitiveCall> primitives{};
+  std::vector<ActionFusedOp> fused_ops{};
   std::vector<ActionParam> params{};
   RegisterSync register_sync{};
   std::vector<Data> const_values{};
@@ -680,6 +776,7 @@ class ActionFn :  public NamedP4Object {
   std::vector<std::unique_ptr<ArithExpression> > expressions{};
   std::vector<std::string> strings{};
   size_t num_params;
+  std::vector<size_t> param_bitwidths{};
 
  private:
   static size_t nb_data_tmps;
@@ -21,8 +21,11 @@
 #ifndef BM_BM_SIM_AGEING_H_
 #define BM_BM_SIM_AGEING_H_
 
+#include <functional>
 #include <memory>
+#include <vector>
 
+#include "match_key_types.h"
 #include "transport.h"
 
 namespace bm {
@@ -41,10 +44,19 @@ class AgeingMonitorIface {
     char _padding[4];  // the header size for notifications is always 32 bytes
   } __attribute__((packed));
 
+  //! Called by the sweep thread with the handles of the entries of \p table
+  //! which have just expired, after the notification has been sent. This is
+  //! how a target can remove the entries itself (see DataPlaneLearner), instead
+  //! of relying on the controller.
+  using AgeingCb = std::function<void(
+      MatchTableAbstract *table, const std::vector<entry_handle_t> &handles)>;
+
   virtual ~AgeingMonitorIface() { }
 
   virtual void add_table(MatchTableAbstract *table) = 0;
 
+  virtual void register_ageing_cb(const AgeingCb &cb) = 0;
+
   virtual void set_sweep_interval(unsigned int ms) = 0;
 
   virtual void reset_state() = 0;
@@ -25,14 +25,73 @@
 
 #include <boost/functional/hash.hpp>
 
+#include <algorithm>  // for std::equal
 #include <vector>
 #include <iterator>
 #include <string>
 
+#include <cassert>
+
 #include "short_alloc.h"
 
 namespace bm {
 
+//! A read-only view of a range of bytes owned by someone else. This is what
+//! Field::get_bytes() returns, since the bytes of most fields live in the
+//! storage arena of their PHV rather than in a ByteContainer. The view is only
+//! valid as long as the underlying bytes are alive.
+class ByteView {
+ public:
+  using const_iterator = const char *;
+  using iterator = const_iterator;
+  using const_reference = const char &;
+  using size_type = size_t;
+
+ public:
+  ByteView() = default;
+
+  //! Constructs a view of the range `[data; data + nbytes)`
+  ByteView(const char *data, size_t nbytes)
+      : bytes(data), nbytes(nbytes) { }
+
+  //! Returns the number of bytes in the view
+  size_type size() const noexcept { return nbytes; }
+
+  //! Returns pointer to the first byte of the view
+  const char *data() const noexcept { return bytes; }
+
+  //! NC
+  const_iterator begin() const { return bytes; }
+
+  //! NC
+  const_iterator end() const { return bytes + nbytes; }
+
+  //! Access the character at position \p n. Will assert if n \p is greater or
+  //! equal than the number of bytes in the view.
+  const_reference operator[](size_type n) const {
+    assert(n < size());
+    return bytes[n];
+  }
+
+  //! Returns true is the contents of the views are equal
+  bool operator==(const ByteView &other) const {
+    return (nbytes == other.nbytes) &&
+        std::equal(begin(), end(), other.begin());
+  }
+
+  //! Returns true is the contents of the views are not equal
+  bool operator!=(const ByteView &other) const {
+    return !(*this == other);
+  }
+
+  //! Returns the hexadecimal representation of the bytes as a string
+  std::string to_hex(bool upper_case = false) const;
+
+ private:
+  const char *bytes{nullptr};
+  size_t nbytes{0};
+};
+
 //! This class is used everytime a vector of bytes is needed in bmv2. It is most
 //! notably used by the Field class (to store the byte representation of a
 //! field) as well as to store match keys in tables.
@@ -67,6 +126,10 @@ class ByteContainer {
   ByteContainer(const char *bytes, size_t nbytes)
       : bytes(bytes, bytes + nbytes, _a) { }
 
+  //! Constructs the container by copying the bytes in view \p view
+  explicit ByteContainer(const ByteView &view)
+      : bytes(view.begin(), view.end(), _a) { }
+
   static char char2digit(char c) {
     if (c >= '0' && c <= '9')
       return (c - '0');
@@ -156,6 +219,12 @@ class ByteContainer {
     return *this;
   }
 
+  //! Appends the bytes in view \p view to this container
+  ByteContainer &append(const ByteView &view) {
+    bytes.insert(end(), view.begin(), view.end());
+    return *this;
+  }
+
   //! Appends a byte array to this container
   ByteContainer &append(const char *byte_array, size_t nbytes) {
     bytes.insert(end(), byte_array, byte_array + nbytes);
@@ -239,6 +308,23 @@ class ByteContainer {
     return !(*this == other);
   }
 
+  //! Returns a view of the bytes in the container, which is invalidated by any
+  //! operation which changes the size of the container
+  ByteView view() const {
+    return ByteView(data(), size());
+  }
+
+  //! Returns true is the contents of the container and of \p other are equal
+  bool operator==(const ByteView &other) const {
+    return view() == other;
+  }
+
+  //! Returns true is the contents of the container and of \p other are not
+  //! equal
+  bool operator!=(const ByteView &other) const {
+    return !(*this == other);
+  }
+
   //! Increase the capacity of the container
   void reserve(size_t n) {
     bytes.reserve(n);
@@ -277,6 +363,14 @@ class ByteContainer {
   _vector bytes;
 };
 
+inline bool operator==(const ByteView &view, const ByteContainer &bc) {
+  return bc == view;
+}
+
+inline bool operator!=(const ByteView &view, const ByteContainer &bc) {
+  return bc != view;
+}
+
 struct ByteContainerKeyHash {
   std::size_t operator()(const ByteContainer& b) const {
     // Murmur, boost::hash_range or Jenkins?
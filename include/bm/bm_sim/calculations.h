@@ -62,6 +62,8 @@
 #include <vector>
 #include <algorithm>   // for std::copy
 #include <iosfwd>
+#include <atomic>
+#include <mutex>
 
 #include "boost/variant.hpp"
 
@@ -229,8 +231,20 @@ class RawCalculation
 };
 
 
+//! Builds the byte buffer on which a calculation (hash, checksum, ...) is
+//! run. The first time it is applied to a packet, the builder compiles its
+//! inputs into a flat copy plan, in which the offset of each input in the
+//! output buffer is known ahead of time. The plan is used whenever all the
+//! headers it depends on are valid; otherwise the builder falls back to
+//! deparsing each input in turn.
 class BufBuilder {
  public:
+  BufBuilder();
+  ~BufBuilder();
+
+  BufBuilder(const BufBuilder &other);
+  BufBuilder &operator=(const BufBuilder &other);
+
   void push_back_field(header_id_t header, int field_offset);
   void push_back_constant(const ByteContainer &v, size_t nbits);
   void push_back_header(header_id_t header);
@@ -254,9 +268,19 @@ class BufBuilder {
   };
 
   struct Deparse;  // defined in calculations.cpp
+  struct CopyPlan;  // defined in calculations.cpp
+  struct PlanCompiler;  // defined in calculations.cpp
+
+  const CopyPlan *get_plan(const PHV &phv) const;
+  void invalidate_plan();
 
   std::vector<boost::variant<field_t, constant_t, header_t> > entries{};
   bool with_payload{false};
+  // the plan depends on the field bitwidths, which are only known once we see
+  // a PHV, so it is compiled lazily
+  mutable std::unique_ptr<CopyPlan> plan_storage;
+  mutable std::atomic<const CopyPlan *> plan{nullptr};
+  mutable std::mutex plan_mutex{};
 };
 
 
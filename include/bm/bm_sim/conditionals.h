@@ -50,6 +50,13 @@ class Conditional
     false_next = next_node;
   }
 
+  const ControlFlowNode *get_next_node_if_true() const { return true_next; }
+
+  const ControlFlowNode *get_next_node_if_false() const { return false_next; }
+
+  // evaluates the condition for pkt, with the same logging as operator()
+  bool evaluate(Packet *pkt) const;
+
   // return pointer to next control flow node
   const ControlFlowNode *operator()(Packet *pkt) const override;
 
@@ -55,6 +55,7 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <tuple>
 #include <typeindex>
 
 #include "P4Objects.h"
@@ -161,6 +162,29 @@ class Context final {
     return p4objects->get_action(table_name, action_name)->get_id();
   }
 
+  //! Get a raw, non-owning pointer to the match table with P4 name \p name,
+  //! e.g. to configure a DataPlaneLearner. Throw a std::out_of_range exception
+  //! if there is no table with this name.
+  MatchTableAbstract *get_match_table(const std::string &name) {
+    return p4objects->get_abstract_match_table(name);
+  }
+
+  //! Get a raw, non-owning pointer to action \p action_name of table \p
+  //! table_name. Throw a std::out_of_range exception if there is no such
+  //! action.
+  ActionFn *get_action(const std::string &table_name,
+                       const std::string &action_name) {
+    return p4objects->get_action(table_name, action_name);
+  }
+
+  //! Get the header id and the offset in the header of field \p field_name of
+  //! header \p header_name. Throw a std::out_of_range exception if there is no
+  //! such field.
+  std::tuple<header_id_t, int> get_field_info(const std::string &header_name,
+                                              const std::string &field_name) {
+    return p4objects->field_info(header_name, field_name);
+  }
+
  private:
   // ---------- runtime interfaces ----------
 
@@ -291,6 +315,12 @@ class Context final {
   std::vector<typename T::Entry>
   mt_get_entries(const std::string &table_name) const;
 
+  template <typename T>
+  MatchErrorCode
+  mt_get_entries_page(const std::string &table_name, size_t max_entries,
+                      MatchTableAbstract::EntryCursor *cursor,
+                      std::vector<typename T::Entry> *entries) const;
+
   template <typename T>
   MatchErrorCode
   mt_get_entry(const std::string &table_name, entry_handle_t handle,
@@ -426,6 +456,8 @@ class Context final {
 
   void set_force_arith(bool force_arith);
 
+  void set_resilient_group_selection(size_t nb_buckets);
+
   using header_field_pair = P4Objects::header_field_pair;
   using ForceArith = P4Objects::ForceArith;
   int init_objects(std::istream *is,
@@ -448,6 +480,8 @@ class Context final {
         std::set<header_field_pair>(),
       const ForceArith &arith_objects = ForceArith());
 
+  ErrorCode load_new_objects(std::shared_ptr<P4Objects> p4objs);
+
   ErrorCode swap_configs();
 
   ErrorCode reset_state();
@@ -455,6 +489,9 @@ class Context final {
   ErrorCode serialize(std::ostream *out);
   ErrorCode deserialize(std::istream *in);
 
+  ErrorCode dump_telemetry(Json::Value *out);
+  ErrorCode reset_telemetry();
+
   int do_swap();
 
   int swap_requested() { return swap_ordered; }
@@ -484,6 +521,9 @@ class Context final {
   std::atomic<bool> swap_ordered{false};
 
   bool force_arith{false};
+
+  // 0 if the default group selection is used
+  size_t resilient_group_buckets{0};
 };
 
 }  // namespace bm
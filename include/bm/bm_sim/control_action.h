@@ -42,6 +42,11 @@ class ControlAction : public ControlFlowNode {
 
   void set_action(ActionFn *action);
 
+  const ControlFlowNode *get_next_node() const { return next_node; }
+
+  // executes the action, without returning the next node
+  void execute(Packet *pkt) const;
+
   const ControlFlowNode *operator()(Packet *pkt) const override;
 
  private:
@@ -31,6 +31,12 @@ struct assign : public ActionPrimitive<Data &, const Data &> {
   void operator ()(Data &dst, const Data &src) {
     dst.set(src);
   }
+
+  // specialized when the destination is a field and the source is a field, a
+  // constant or action data
+  bool fuse(const ActionParam *args, ActionFusedOp *op) override;
+
+  bool is_flow_cacheable() const override { return true; }
 };
 
 struct assign_VL : public ActionPrimitive<Field &, const Field &> {
@@ -41,6 +47,8 @@ struct assign_VL : public ActionPrimitive<Field &, const Field &> {
 
 struct assign_header : public ActionPrimitive<Header &, const Header &> {
   void operator ()(Header &dst, const Header &src);
+
+  bool is_flow_cacheable() const override { return true; }
 };
 
 struct assign_union
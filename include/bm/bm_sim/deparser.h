@@ -28,6 +28,7 @@
 
 #include "named_p4object.h"
 #include "phv_forward.h"
+#include "telemetry.h"
 
 namespace bm {
 
@@ -60,6 +61,10 @@ class Deparser : public NamedP4Object {
   //! Packet::get_data_size().
   void deparse(Packet *pkt) const;
 
+  //! Distribution of the time spent in deparse(), in nanoseconds
+  const TelemetryHistogram &get_latency() const { return latency_ns; }
+  void reset_telemetry() { latency_ns.reset(); }
+
  private:
   size_t get_headers_size(const PHV &phv) const;
 
@@ -68,6 +73,7 @@ class Deparser : public NamedP4Object {
  private:
   std::vector<header_id_t> headers{};
   std::vector<const Checksum *> checksums{};
+  mutable TelemetryHistogram latency_ns{};
 };
 
 }  // namespace bm
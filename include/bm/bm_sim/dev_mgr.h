@@ -29,6 +29,8 @@
 //! receive packets
 //!   - PacketInDevMgrImp: uses a nanomsg PAIR socket to send and receive
 //! packets
+//!   - ShmDevMgrImp: uses lock-free rings in a shared memory segment to send
+//! and receive packets, see shm_ring.h
 //!   - FilesDevMgrImp: reads incoming packets from pcap files and writes
 //! outgoing packet to different pcap files
 
@@ -44,6 +46,8 @@
 
 namespace bm {
 
+struct PcapReplayConfig;
+
 class DevMgrIface : public PacketDispatcherIface {
  public:
   using port_t = PortMonitorIface::port_t;
@@ -145,6 +149,25 @@ class DevMgr : public PacketDispatcherIface {
   // wait before starting to process packets.
   void set_dev_mgr_files(unsigned wait_time_in_seconds);
 
+  // Same as set_dev_mgr_files(), but the input files are loaded in memory and
+  // replayed at high rate, according to \p config. Output files are written
+  // asynchronously. Statistics (achieved rate, number of packets dropped by
+  // the switch) are logged at the end of the replay.
+  void set_dev_mgr_pcap_replay(const PcapReplayConfig &config,
+                               unsigned wait_time_in_seconds);
+
+#ifdef BMAFPACKET_ON
+  // Linux only: uses AF_PACKET sockets with memory-mapped (TPACKET_V3) RX / TX
+  // rings. Each port gets queues_per_port receive threads, which share the
+  // traffic through PACKET_FANOUT and call the packet handler concurrently. The
+  // kernel is notified of transmitted packets every tx_batch packets (and at
+  // least every few milliseconds).
+  void set_dev_mgr_af_packet(
+      int device_id,
+      std::shared_ptr<TransportIface> notifications_transport = nullptr,
+      unsigned int queues_per_port = 1, unsigned int tx_batch = 1);
+#endif
+
 #ifdef BMNANOMSG_ON
   // if enforce ports is set to true, packets coming in on un-registered ports
   // are dropped
@@ -154,6 +177,18 @@ class DevMgr : public PacketDispatcherIface {
       bool enforce_ports = false);
 #endif
 
+  // Exchanges packets with an external process (see bm_apps::ShmPacketInject)
+  // through shared memory segment shm_name (a POSIX shared memory object name,
+  // e.g. "/bmv2-0"), which holds nb_slots slots of slot_size bytes in each
+  // direction. Ports are managed as with set_dev_mgr_packet_in(). Returns
+  // ReturnCode::ERROR, without setting a device manager, if the segment cannot
+  // be created.
+  ReturnCode set_dev_mgr_shm(
+      int device_id, const std::string &shm_name,
+      std::shared_ptr<TransportIface> notifications_transport = nullptr,
+      bool enforce_ports = false, unsigned int nb_slots = 4096,
+      unsigned int slot_size = 2048);
+
   ReturnCode port_add(const std::string &iface_name, port_t port_num,
                       const char *in_pcap, const char *out_pcap);
 
@@ -166,6 +201,11 @@ class DevMgr : public PacketDispatcherIface {
   //! Transmits a data packet out of port \p port_num
   void transmit_fn(int port_num, const char *buffer, int len);
 
+  //! Sets the function called for every packet received by the device
+  //! manager. The handler has to be thread-safe: with af_packet, it is called
+  //! concurrently by the receive threads of all the ports. The other
+  //! implementations never call it concurrently, but they may call it from
+  //! several threads, so the handler should not rely on thread-local state.
   ReturnCode set_packet_handler(const PacketHandler &handler, void *cookie)
       override;
 
@@ -0,0 +1,162 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+//! @file dp_learning.h
+//! Learning in the data plane: instead of (or in addition to) sending a
+//! digest to the controller and waiting for it to add the corresponding
+//! entries, the target inserts them directly in exact match tables. The
+//! controller can still be notified through the LearnEngine, after the fact.
+
+#ifndef BM_BM_SIM_DP_LEARNING_H_
+#define BM_BM_SIM_DP_LEARNING_H_
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <cstdint>
+
+#include "match_key_types.h"
+#include "phv_forward.h"
+
+namespace bm {
+
+class ActionFn;
+class MatchTable;
+class MatchTableAbstract;
+class Packet;
+
+//! Applies a set of learning rules to packets. Each rule inserts (or
+//! refreshes) an entry in a table with exact match keys, using
+//! MatchTable::add_or_refresh_entry(). The key and the action data are read
+//! from PHV fields. For example, a L2 switch can learn that a source MAC
+//! address is reachable through the ingress port of the packet.
+//!
+//! The number of learning events is rate limited with a token bucket, to
+//! bound the cost of table updates in the packet processing path. Events
+//! which exceed the rate are simply ignored: the target can rely on the
+//! controller to catch up, or on the next packet from the same source.
+//!
+//! Entries learned with a non-zero ttl are reported by the AgeingMonitor like
+//! any other entry, which requires the table to support ageing. The
+//! AgeingMonitor only notifies the controller though: for the entries to be
+//! removed without the controller, register remove_aged_entries() as an
+//! ageing callback, e.g.
+//! @code
+//! monitor->register_ageing_cb(
+//!     [learner](MatchTableAbstract *table,
+//!               const std::vector<entry_handle_t> &handles) {
+//!       learner->remove_aged_entries(table, handles);
+//!     });
+//! @endcode
+//!
+//! Tables and actions are referenced through raw pointers, the rules need to
+//! be re-configured if a configuration swap is performed by the target.
+//! Once the rules are configured, learn() can be called concurrently by
+//! several threads.
+class DataPlaneLearner {
+ public:
+  using field_t = std::pair<header_id_t, int>;
+
+  struct Stats {
+    //! number of new entries
+    uint64_t added;
+    //! number of existing entries which were refreshed or modified
+    uint64_t refreshed;
+    //! number of calls to learn() which were ignored because of rate limiting
+    uint64_t rate_limited;
+    //! number of failed table updates (e.g. the table is full)
+    uint64_t errors;
+    //! number of entries removed by remove_aged_entries()
+    uint64_t aged_out;
+  };
+
+  //! \p max_rate is the maximum sustained number of learning events per
+  //! second, 0 meaning no limit, and \p burst the number of events which can
+  //! be processed back-to-back after a quiet period.
+  explicit DataPlaneLearner(unsigned int max_rate = 0, unsigned int burst = 1);
+
+  //! Adds a learning rule: the key of the entry is made of the values of \p
+  //! key_fields (one per field of the table's match key, which must all be
+  //! exact), the action is \p action_fn and its parameters are the values of
+  //! \p action_data_fields. If \p ttl_ms is not 0, it is used as the timeout
+  //! of the entry.
+  void add_rule(MatchTable *table, std::vector<field_t> key_fields,
+                const ActionFn *action_fn,
+                std::vector<field_t> action_data_fields,
+                unsigned int ttl_ms = 0);
+
+  //! Removes all the rules
+  void clear_rules();
+
+  //! Applies all the rules to \p pkt. Rules for which one of the key fields
+  //! belongs to an invalid header are skipped. Returns true if at least one
+  //! new entry was added, in which case the target may want to notify the
+  //! controller.
+  bool learn(const Packet &pkt);
+
+  //! Deletes the entries of \p table listed in \p handles, as reported by the
+  //! AgeingMonitor, if \p table is the table of one of the rules. Entries
+  //! which were hit or learned again since they were reported are kept. The
+  //! entries learned with the same key by the other rules with the same key
+  //! fields are deleted as well, so that they age as one unit: otherwise, for
+  //! an L2 switch, the source MAC entry could keep on being hit after the
+  //! destination MAC entry expired, and the address would never be learned
+  //! again. Returns the number of entries deleted.
+  size_t remove_aged_entries(MatchTableAbstract *table,
+                             const std::vector<entry_handle_t> &handles);
+
+  Stats get_stats() const;
+
+  DataPlaneLearner(const DataPlaneLearner &other) = delete;
+  DataPlaneLearner &operator=(const DataPlaneLearner &other) = delete;
+
+ private:
+  using clock = std::chrono::steady_clock;
+
+  struct Rule {
+    MatchTable *table;
+    std::vector<field_t> key_fields;
+    const ActionFn *action_fn;
+    std::vector<field_t> action_data_fields;
+    unsigned int ttl_ms;
+  };
+
+  bool take_token();
+
+  unsigned int max_rate;
+  double burst;
+  std::vector<Rule> rules{};
+  // token bucket
+  std::mutex bucket_mutex{};
+  double tokens;
+  clock::time_point last_refill;
+  std::atomic<uint64_t> added{0};
+  std::atomic<uint64_t> refreshed{0};
+  std::atomic<uint64_t> rate_limited{0};
+  std::atomic<uint64_t> errors{0};
+  std::atomic<uint64_t> aged_out{0};
+};
+
+}  // namespace bm
+
+#endif  // BM_BM_SIM_DP_LEARNING_H_
@@ -23,8 +23,10 @@
 #ifndef BM_BM_SIM_EVENT_LOGGER_H_
 #define BM_BM_SIM_EVENT_LOGGER_H_
 
+#include <atomic>
 #include <string>
 #include <memory>
+#include <vector>
 
 #include "phv_forward.h"
 #include "transport.h"
@@ -62,11 +64,72 @@ using entry_handle_t = uint32_t;
 //! responsible of generated "packet in" and "packet out" messages (when a
 //! packet is received / transmitted). Obviously, this is optional and you do
 //! not have to do it if you are not interested in using the event logger.
+//!
+//! By default, messages are sent synchronously, by the thread generating the
+//! event. After enable_async() has been called, each thread instead records
+//! its messages in its own lock-free ring buffer, and a background thread
+//! drains all the buffers and sends the messages on the transport. If a buffer
+//! is full, the message is dropped and a drop counter is incremented (see
+//! get_stats()). Independently of the mode, each event type can be sampled
+//! with set_sampling_rate(), in which case messages for this event type are
+//! only generated for 1 in N packets (based on the packet id, so that all the
+//! sampled events of a given packet are kept together).
 class EventLogger {
  public:
+  //! Event types, as encoded in the message header
+  enum EventType {
+    PACKET_IN = 0, PACKET_OUT,
+    PARSER_START, PARSER_DONE, PARSER_EXTRACT,
+    DEPARSER_START, DEPARSER_DONE, DEPARSER_EMIT,
+    CHECKSUM_UPDATE,
+    PIPELINE_START, PIPELINE_DONE,
+    CONDITION_EVAL, TABLE_HIT, TABLE_MISS,
+    ACTION_EXECUTE,
+    CONFIG_CHANGE = 999
+  };
+
+  //! Number of packet event types (i.e. excluding CONFIG_CHANGE)
+  static constexpr size_t num_packet_event_types = ACTION_EXECUTE + 1;
+
+  //! Default capacity (in messages) of the per-thread ring buffers
+  static constexpr size_t default_ring_size = 4096;
+
+  struct Stats {
+    //! messages sent on the transport
+    uint64_t sent;
+    //! messages dropped because a ring buffer was full
+    uint64_t dropped;
+    //! ring buffers allocated, at most one per thread which logged an event
+    //! and is still running (the buffers of the threads which exited are
+    //! re-used)
+    uint64_t rings;
+  };
+
   explicit EventLogger(std::unique_ptr<TransportIface> transport,
-                       int device_id = 0)
-      : transport_instance(std::move(transport)), device_id(device_id) { }
+                       int device_id = 0);
+
+  ~EventLogger();
+
+  //! Switch to asynchronous mode, with per-thread ring buffers able to hold
+  //! \p ring_size messages each (rounded up to a power of 2). This needs to be
+  //! called before any packet is processed and has no effect if asynchronous
+  //! mode is already enabled.
+  void enable_async(size_t ring_size = default_ring_size);
+
+  //! Only generate messages of type \p type for 1 in \p one_in_n packets. \p
+  //! one_in_n equal to 1 (the default) means every packet, while 0 disables
+  //! the event type completely. Has no effect for CONFIG_CHANGE. This method
+  //! is not thread-safe and needs to be called before any packet is processed.
+  void set_sampling_rate(EventType type, unsigned int one_in_n);
+
+  //! Same as above, but the event type is identified by its name, which is the
+  //! name of the corresponding EventLogger method (e.g. `"table_hit"`). Returns
+  //! false if \p event_name is not valid.
+  bool set_sampling_rate(const std::string &event_name, unsigned int one_in_n);
+
+  //! Returns the message counters. Messages discarded because of sampling are
+  //! not counted.
+  Stats get_stats() const;
 
   // we need the ingress / egress ports, but they are part of the Packet
   //! Signal that a packet was received by the switch
@@ -110,8 +173,16 @@ class EventLogger {
   }
 
  private:
+  struct AsyncState;
+
+  bool is_sampled(EventType type, const Packet &packet) const;
+  void send(const char *msg, size_t len);
+
   std::unique_ptr<TransportIface> transport_instance{nullptr};
   int device_id{};
+  std::vector<unsigned int> sampling_rates{};
+  std::atomic<uint64_t> sent_sync{0};
+  std::unique_ptr<AsyncState> async{nullptr};
 };
 
 }  // namespace bm
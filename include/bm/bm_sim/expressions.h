@@ -151,6 +151,10 @@ class Expression {
 
   bool empty() const;
 
+  //! Returns the (built) sequence of operations, e.g. to determine which PHV
+  //! fields are read when evaluating the expression
+  const std::vector<Op> &get_ops() const { return ops; }
+
   // I am authorizing copy for this object
   Expression(const Expression &other) = default;
   Expression &operator=(const Expression &other) = default;
@@ -41,6 +41,11 @@ class Header;
 //! manipulate Field objects to set and access the target's intrinsic metadata.
 //! Most of the interesting methods for a target designer are inherited from
 //! Data.
+//!
+//! The byte representation of a fixed-width field lives in the storage arena of
+//! the PHV which owns the field (see PHV), next to the bytes of the other
+//! fields, so that the PHV can be copied in one go. Variable-length fields, and
+//! fields which do not belong to a PHV, own their bytes.
 class Field : public Data {
  public:
   // Data() is called automatically
@@ -48,9 +53,11 @@ class Field : public Data {
   // Field. Unfortunately that would require adding an extra level of
   // indirection in Header (for the field vector), so I am sticking to this for
   // now.
+  // if storage is not nullptr, it points to the nbytes bytes (initialized to 0)
+  // used to store the field in the PHV arena
   explicit Field(int nbits, Header *parent_hdr, bool arith_flag = true,
                  bool is_signed = false, bool hidden = false, bool VL = false,
-                 bool is_saturating = false);
+                 bool is_saturating = false, char *storage = nullptr);
 
   // to avoid dynamic resizing of the Bytecontainer, which would invalide field
   // references
@@ -60,26 +67,29 @@ class Field : public Data {
   // It is probably only going to be used by the checksum engine anyway...
   void set_bytes(const char *src_bytes, int len) {
     assert(len == nbytes);
-    std::copy(src_bytes, src_bytes + len, bytes.begin());
+    std::copy(src_bytes, src_bytes + len, bytes_data());
+    mark_parent_modified();
     if (arith) sync_value();
   }
 
   void sync_value() {
-    bignum::import_bytes(&value, bytes.data(), nbytes);
+    bignum::import_bytes(&value, bytes_data(), nbytes);
     if (is_signed && bignum::test_bit(value, nbits - 1)) {
       bignum::clear_bit(&value, nbits - 1);
       value += min;
     }
     written_to = true;
+    mark_parent_modified();
     // TODO(antonin): should notifications be disabled for hidden fields?
-    DEBUGGER_NOTIFY_UPDATE(*packet_id, my_id, bytes.data(), nbits);
+    DEBUGGER_NOTIFY_UPDATE(*packet_id, my_id, bytes_data(), nbits);
   }
 
   //! Return the byte representation of this field. Note that this returns a
-  //! reference to a byte container, which is only valid as long as the Field
-  //! instance is alive.
-  const ByteContainer &get_bytes() const {
-    return bytes;
+  //! view of the bytes, which is only valid as long as the Field instance is
+  //! alive and, for a variable-length field, until the field is extracted
+  //! again.
+  ByteView get_bytes() const {
+    return ByteView(bytes_data(), nbytes);
   }
 
   //! Get the number of bytes occupied by this field, not based on its layout in
@@ -99,7 +109,8 @@ class Field : public Data {
   bool get_arith_flag() const { return arith; }
 
   void export_bytes() override {
-    std::fill(bytes.begin(), bytes.end(), 0);  // very important !
+    char *dst = bytes_data();
+    std::fill(dst, dst + nbytes, 0);  // very important !
 
     if (is_saturating) {
       if (value < min) value = min;
@@ -109,23 +120,40 @@ class Field : public Data {
     if (!is_signed) {
       // is this efficient enough?
       value &= mask;
-      bignum::export_bytes(bytes.data(), nbytes, value);
+      bignum::export_bytes(dst, nbytes, value);
     } else {
       if (value < min || value > mask) {
         value &= mask;
         if (value > max) value -= (mask + 1);
       }
       if (value >= 0) {
-        bignum::export_bytes(bytes.data(), nbytes, value);
+        bignum::export_bytes(dst, nbytes, value);
       } else {
         // e.g. if width is 8 and value is -127 (1000 0001), subtracting min
         // (-128) one time gives us 1, a second time gives us 129, 129 has a
         // bignum representation of 1000 0001, which is what we wanted
-        bignum::export_bytes(bytes.data(), nbytes, value - min - min);
+        bignum::export_bytes(dst, nbytes, value - min - min);
       }
     }
     written_to = true;
-    DEBUGGER_NOTIFY_UPDATE(*packet_id, my_id, bytes.data(), nbits);
+    mark_parent_modified();
+    DEBUGGER_NOTIFY_UPDATE(*packet_id, my_id, dst, nbits);
+  }
+
+  //! Same as set(const Data &), but when \p src has the same bitwidth and
+  //! signedness as this field, the byte representation of \p src is copied as
+  //! is instead of being recomputed from the value.
+  void set_from_field(const Field &src) {
+    if (nbits != src.nbits || is_signed != src.is_signed || VL || src.VL) {
+      set(src);
+      return;
+    }
+    value = src.value;
+    const char *src_bytes = src.bytes_data();
+    std::copy(src_bytes, src_bytes + nbytes, bytes_data());
+    written_to = true;
+    mark_parent_modified();
+    DEBUGGER_NOTIFY_UPDATE(*packet_id, my_id, bytes_data(), nbits);
   }
 
   // useful for header stacks
@@ -155,6 +183,18 @@ class Field : public Data {
   // pointer. This is used by PHV::copy_headers().
   void copy_value(const Field &src);
 
+  // same as copy_value(), for when the bytes of the field have already been
+  // copied along with the rest of the PHV arena
+  void copy_value_no_storage(const Field &src) {
+    if (!storage) {
+      copy_value(src);
+      return;
+    }
+    // the value of a non-arith field is never read
+    if (arith) value = src.value;
+    mark_parent_modified();
+  }
+
   bool is_hidden() const {
     return hidden;
   }
@@ -176,9 +216,30 @@ class Field : public Data {
     return written_to;
   }
 
+  // called by the parent Header: the flag is set every time the value of this
+  // field changes, which lets the deparser know whether the original packet
+  // bytes for the header can be re-used (see PHV::get_packet_bytes())
+  void set_parent_modified_flag(bool *flag) {
+    parent_modified = flag;
+  }
+
  private:
+  void mark_parent_modified() {
+    if (parent_modified) *parent_modified = true;
+  }
+
+  char *bytes_data() {
+    return storage ? storage : bytes.data();
+  }
+
+  const char *bytes_data() const {
+    return storage ? storage : bytes.data();
+  }
+
   int nbits;
   int nbytes;
+  // bytes in the PHV arena, or nullptr if the field uses its own ByteContainer
+  char *storage{nullptr};
   ByteContainer bytes;
   Header *parent_hdr;
   bool is_signed{false};
@@ -186,6 +247,8 @@ class Field : public Data {
   bool VL{false};
   bool is_saturating{false};
   bool written_to{false};  // used to keep track of whether a field was modified
+  // nullptr for hidden fields, which are not part of the packet
+  bool *parent_modified{nullptr};
   Bignum mask{1};
   Bignum max{1};
   Bignum min{1};
@@ -0,0 +1,218 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+//! @file flow_cache.h
+//! A megaflow cache (similar to the one found in Open vSwitch) which can be
+//! put in front of a Pipeline. The first packet of a flow goes through the
+//! pipeline normally, while recording which PHV fields are consulted by the
+//! tables, conditions and actions it traverses. The cache then stores the
+//! effect of the traversal on the PHV (field writes and header validity
+//! changes), keyed by the values of the consulted fields only. Later packets
+//! with the same values for these fields skip the pipeline and have the
+//! stored effect applied directly.
+
+#ifndef BM_BM_SIM_FLOW_CACHE_H_
+#define BM_BM_SIM_FLOW_CACHE_H_
+
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "phv_forward.h"
+#include "telemetry.h"
+
+namespace bm {
+
+class ActionFn;
+class Expression;
+class MatchTableAbstract;
+class Packet;
+class Pipeline;
+
+//! Collects the PHV inputs of a pipeline traversal. The pipeline building
+//! blocks (match tables, conditions and control actions) report themselves to
+//! the recorder active on the current thread, if any, before they are
+//! applied. Anything whose effects cannot be replayed from the PHV alone
+//! (stateful primitives, register accesses, header stacks and unions, tables
+//! with direct resources, ...) makes the traversal uncacheable.
+class FlowCacheRecorder {
+ public:
+  struct Input {
+    enum class Kind : unsigned char {
+      //! the validity of the header
+      VALIDITY,
+      //! the value of the field, whether the header is valid or not
+      FIELD,
+      //! the value of the field as seen by a match key, i.e. only if the
+      //! header is valid
+      MATCH_FIELD
+    };
+
+    header_id_t header;
+    //! -1 for Kind::VALIDITY
+    int field_offset;
+    Kind kind;
+
+    bool operator<(const Input &other) const;
+    bool operator==(const Input &other) const;
+  };
+
+  //! Makes a recorder active on the current thread for its lifetime
+  class Scope {
+   public:
+    explicit Scope(FlowCacheRecorder *recorder)
+        : prev(current) {
+      current = recorder;
+    }
+
+    ~Scope() {
+      current = prev;
+    }
+
+    Scope(const Scope &other) = delete;
+    Scope &operator=(const Scope &other) = delete;
+
+   private:
+    FlowCacheRecorder *prev;
+  };
+
+  explicit FlowCacheRecorder(const PHV &phv);
+
+  //! Returns the recorder active on the current thread, or nullptr
+  static FlowCacheRecorder *get() { return current; }
+
+  //! \p action_fn is the action executed as the result of the lookup, it can
+  //! be nullptr
+  void record_table(const MatchTableAbstract &table, const ActionFn *action_fn);
+
+  void record_condition(const Expression &expr);
+
+  void record_action(const ActionFn *action_fn);
+
+  void set_uncacheable() { cacheable = false; }
+
+  bool is_cacheable() const { return cacheable; }
+
+  //! Returns the inputs recorded so far, sorted and without duplicates
+  std::vector<Input> get_inputs() const;
+
+  FlowCacheRecorder(const FlowCacheRecorder &other) = delete;
+  FlowCacheRecorder &operator=(const FlowCacheRecorder &other) = delete;
+
+ private:
+  void add_field(header_id_t header, int field_offset, Input::Kind kind);
+  // the validity and all the fields
+  void add_header(header_id_t header);
+  void add_expression(const Expression &expr);
+
+  static thread_local FlowCacheRecorder *current;
+
+  const PHV &phv;
+  std::vector<Input> inputs{};
+  bool cacheable{true};
+};
+
+//! See flow_cache.h. Entries are grouped by set of consulted fields (a "mask"
+//! in OVS terms); a lookup checks every group, using a hash map keyed by the
+//! values of the group's fields.
+//!
+//! The cache is flushed whenever the entries of a match table are modified (see
+//! invalidate_all()), when a new P4 configuration is swapped in, when the
+//! pipeline passed to apply() changes and when it is full. Only the ingress
+//! pipeline of a target is meant to be cached; as with the parser and the
+//! deparser, the event logger and the debugger do not see the tables and
+//! conditions of a cache hit.
+//!
+//! This class is not thread-safe: a target with several ingress threads needs
+//! one instance per thread.
+class FlowCache {
+ public:
+  using Input = FlowCacheRecorder::Input;
+
+  static constexpr size_t default_max_entries = 65536;
+
+  explicit FlowCache(size_t max_entries = default_max_entries);
+
+  //! Equivalent to `pipeline->apply(pkt)`, using the cache if possible
+  void apply(Pipeline *pipeline, Packet *pkt);
+
+  //! Invalidates the content of all the flow caches. Called by the match
+  //! tables each time their entries or default entry are modified and on
+  //! config swaps.
+  static void invalidate_all();
+
+  size_t get_num_entries() const { return num_entries; }
+
+  //! Removes all the entries
+  void flush();
+
+  FlowCacheTelemetry *get_telemetry() { return &telemetry; }
+
+  FlowCache(const FlowCache &other) = delete;
+  FlowCache &operator=(const FlowCache &other) = delete;
+
+ private:
+  struct FieldWrite {
+    header_id_t header;
+    int field_offset;
+    std::string value;
+  };
+
+  // the effect of a pipeline traversal on the packet
+  struct Result {
+    std::vector<header_id_t> invalidated{};
+    std::vector<header_id_t> validated{};
+    std::vector<FieldWrite> writes{};
+    std::vector<std::pair<size_t, uint64_t> > register_deltas{};
+  };
+
+  struct Subtable {
+    explicit Subtable(std::vector<Input> inputs)
+        : inputs(std::move(inputs)) { }
+
+    std::vector<Input> inputs;
+    std::unordered_map<std::string, Result> entries{};
+  };
+
+  static void build_key(const PHV &phv, const std::vector<Input> &inputs,
+                        std::string *key);
+  static void replay(const Result &result, Packet *pkt);
+
+  const Result *lookup(const PHV &phv);
+  void miss(Pipeline *pipeline, Packet *pkt, uint64_t gen);
+  void insert(std::vector<Input> inputs, std::string key, Result result);
+
+  static std::atomic<uint64_t> generation;
+
+  size_t max_entries;
+  size_t num_entries{0};
+  std::vector<Subtable> subtables{};
+  uint64_t cache_generation{0};
+  const Pipeline *cache_pipeline{nullptr};
+  // re-used across lookups to avoid allocations
+  std::string key_buffer{};
+  FlowCacheTelemetry telemetry{};
+};
+
+}  // namespace bm
+
+#endif  // BM_BM_SIM_FLOW_CACHE_H_
@@ -0,0 +1,90 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+//! @file group_selection.h
+//! Alternative member selection algorithms for action profiles with
+//! selection, see ActionProfile::set_group_selector().
+
+#ifndef BM_BM_SIM_GROUP_SELECTION_H_
+#define BM_BM_SIM_GROUP_SELECTION_H_
+
+#include <unordered_map>
+#include <vector>
+
+#include "action_profile.h"
+
+namespace bm {
+
+//! Resilient hashing: each group maps a fixed number of buckets to its
+//! members and the hash of a packet selects a bucket. When a member is added
+//! to a group, it takes over buckets from the members which have the most;
+//! when a member is removed, only its own buckets are handed over to the
+//! remaining members. Packets which were mapped to a member which is still in
+//! the group therefore keep being mapped to it. Each member gets the same
+//! number of buckets, up to one.
+//!
+//! Selecting a member is a single array access, the cost of a membership
+//! change is linear in the number of buckets.
+//!
+//! An instance can only be used by a single action profile, and has to be
+//! set with ActionProfile::set_group_selector() before any member is added
+//! to a group. It needs to outlive the action profile.
+class ResilientGroupSelector : public ActionProfile::GroupSelectionIface {
+ public:
+  using mbr_hdl_t = ActionProfile::mbr_hdl_t;
+  using grp_hdl_t = ActionProfile::grp_hdl_t;
+  using hash_t = ActionProfile::hash_t;
+
+  static constexpr size_t default_nb_buckets = 4096;
+
+  //! \p nb_buckets is rounded up to the next power of 2. It bounds the number
+  //! of members per group that can be selected.
+  explicit ResilientGroupSelector(size_t nb_buckets = default_nb_buckets);
+
+  void add_member_to_group(grp_hdl_t grp, mbr_hdl_t mbr) override;
+  void remove_member_from_group(grp_hdl_t grp, mbr_hdl_t mbr) override;
+
+  //! The group must not be empty
+  mbr_hdl_t get_from_hash(grp_hdl_t grp, hash_t h) const override {
+    return groups[grp].buckets[h & bucket_mask];
+  }
+
+  void reset() override;
+
+  size_t get_nb_buckets() const { return bucket_mask + 1; }
+
+  //! Returns the member each bucket of the group is mapped to, or an empty
+  //! vector if the group is empty
+  std::vector<mbr_hdl_t> get_buckets(grp_hdl_t grp) const;
+
+ private:
+  struct GroupState {
+    std::vector<mbr_hdl_t> buckets{};
+    // the buckets mapped to each member
+    std::unordered_map<mbr_hdl_t, std::vector<size_t> > mbr_buckets{};
+  };
+
+  size_t bucket_mask;
+  std::vector<GroupState> groups{};
+};
+
+}  // namespace bm
+
+#endif  // BM_BM_SIM_GROUP_SELECTION_H_
@@ -245,6 +245,15 @@ class HandleMgr {
     return const_iterator(this, index);
   }
 
+  // first valid handle greater than or equal to index
+  const_iterator lower_bound(handle_t index) const {
+    Word_t jindex = index;
+    int Rc_int;
+    J1F(Rc_int, handles, jindex);
+    if (!Rc_int) jindex = -1;
+    return const_iterator(this, jindex);
+  }
+
   iterator end() {
     Word_t index = -1;
     /* int Rc_int; */
@@ -40,6 +40,8 @@ class ArithExpression;
 
 class HeaderUnion;
 
+template <typename T> class Stack;
+
 class HeaderType : public NamedP4Object {
   friend class HeaderTypeUIDTable;
  public:
@@ -132,8 +134,26 @@ class HeaderType : public NamedP4Object {
 
   int get_VL_max_header_bytes() const;
 
+  //! Returns the offset of the bytes of field \p field_offset in the storage
+  //! of a header of this type (see PHV), or -1 for a variable-length field,
+  //! which owns its bytes since its size is not known in advance
+  int get_storage_offset(int field_offset) const {
+    return storage_offsets[field_offset];
+  }
+
+  //! Returns the number of bytes of storage needed by the fixed-width fields
+  //! of a header of this type, i.e. the sum of their `(bitwidth + 7) / 8`
+  size_t get_storage_nbytes() const {
+    return storage_nbytes;
+  }
+
+ private:
+  void update_storage_layout();
+
  private:
   std::vector<FInfo> fields_info;
+  std::vector<int> storage_offsets;
+  size_t storage_nbytes{0};
   // used for VL headers only
   std::unique_ptr<VLHeaderExpression> VL_expr_raw;
   int VL_offset{-1};
@@ -153,9 +173,13 @@ class Header : public NamedP4Object {
   friend class PHV;
 
  public:
+  //! If \p storage is not `nullptr`, it needs to point to at least
+  //! HeaderType::get_storage_nbytes() bytes, initialized to `0`, which hold the
+  //! bytes of the fixed-width fields of the header; otherwise each field owns
+  //! its bytes.
   Header(const std::string &name, p4object_id_t id,
          const HeaderType &header_type, const std::set<int> &arith_offsets,
-         const bool metadata = false);
+         const bool metadata = false, char *storage = nullptr);
 
   //! Returns the number of byte occupied by this header when it is deserialized
   //! in the packet
@@ -204,6 +228,17 @@ class Header : public NamedP4Object {
     return fields.at(field_offset);
   }
 
+  //! Returns a pointer to the bytes of the field at the given offset in the
+  //! header storage, which is the same as `get_field(field_offset).get_bytes()`
+  //! but does not require accessing the Field instance. Returns `nullptr` if
+  //! the header does not have storage or if the field is a variable-length
+  //! field.
+  const char *get_field_storage(int field_offset) const {
+    if (!storage) return nullptr;
+    int offset = header_type.get_storage_offset(field_offset);
+    return (offset < 0) ? nullptr : storage + offset;
+  }
+
   const HeaderType &get_header_type() const { return header_type; }
 
   //! Returns an integral id which represents the header type of the
@@ -226,6 +261,14 @@ class Header : public NamedP4Object {
 
   void deparse(char *data) const;
 
+  //! Returns true if the value of at least one of the packet fields of this
+  //! header has changed since the header was last extracted by the parser. If
+  //! this returns false, the header can be deparsed by copying the original
+  //! packet bytes (see PHV::get_packet_bytes()).
+  bool is_modified() const {
+    return modified;
+  }
+
   //! Returns the number of fields in the header
   size_type size() const noexcept { return fields.size(); }
 
@@ -261,6 +304,10 @@ class Header : public NamedP4Object {
 
   void copy_fields(const Header &src);
 
+  // same as copy_fields(), but assumes that the header storage has already been
+  // copied from the storage of src
+  void copy_fields_no_storage(const Header &src);
+
   // compare to another header instance; returns true iff headers have the same
   // type, are both valid (irrelevant for metadata) and all the fields have the
   // same value.
@@ -306,14 +353,25 @@ class Header : public NamedP4Object {
   };
 
   const HeaderType &header_type;
+  // owned by the PHV, nullptr if the header was not created by a PHV
+  char *storage{nullptr};
   std::vector<Field> fields{};
   bool valid{false};
   // is caching this pointer here really useful?
   Field *valid_field{nullptr};
   bool metadata{false};
   int nbytes_packet{0};
+  // location of the header in the bytes saved by the PHV during the last
+  // parse, only meaningful if modified is false
+  int packet_offset{-1};
+  unsigned int packet_gen{0};
+  bool modified{true};
   std::unique_ptr<ArithExpression> VL_expr;
   std::unique_ptr<UnionMembership> union_membership{nullptr};
+  // set by the PHV if the header belongs to a circular header stack, in which
+  // case its id designates position stack_idx in that stack
+  Stack<Header> *stack{nullptr};
+  size_t stack_idx{0};
 #ifdef BMDEBUG_ON
   const Debugger::PacketId *packet_id{&Debugger::dummy_PacketId};
 #endif
@@ -40,6 +40,14 @@ class Packet;
 //! Enables learning in the switch. For now it is the responsibility of the
 //! switch (look at the simple switch target for an example) to invoke the
 //! learn() method, which will send out the learning notifications.
+//!
+//! learn() never waits for notifications to be sent: samples are staged and
+//! batched into notifications by a separate thread, either when a batch of
+//! `max_samples` samples is ready or when the oldest sample has waited for
+//! `timeout_ms`. A sample is filtered out as long as an identical sample has
+//! not been acked. The number of unacked samples is bounded (see
+//! list_set_max_unacked()); samples learned beyond that bound are dropped and
+//! counted as overflows.
 class LearnEngineIface {
  public:
   using list_id_t = int;
@@ -64,6 +72,20 @@ class LearnEngineIface {
   using LearnCb = std::function<void(const msg_hdr_t &, size_t,
                                      std::unique_ptr<char[]>, void *)>;
 
+  //! Per-list statistics, see list_get_stats()
+  struct ListStats {
+    //! samples accepted for notification
+    uint64_t samples;
+    //! samples ignored because an identical sample was not acked yet
+    uint64_t filtered;
+    //! samples dropped because there were too many unacked samples
+    uint64_t overflows;
+    //! notifications sent
+    uint64_t notifications;
+  };
+
+  static constexpr size_t default_max_unacked = 65536;
+
   virtual ~LearnEngineIface() { }
 
   virtual void list_create(list_id_t list_id, size_t max_samples = 1,
@@ -89,6 +111,15 @@ class LearnEngineIface {
   virtual LearnErrorCode list_set_max_samples(list_id_t list_id,
                                               size_t max_samples) = 0;
 
+  //! Sets the maximum number of samples which can be waiting to be sent or
+  //! acked for this list, which bounds the memory used by the list. Lowering
+  //! it does not drop samples which are already waiting.
+  virtual LearnErrorCode list_set_max_unacked(list_id_t list_id,
+                                              size_t max_unacked) = 0;
+
+  virtual LearnErrorCode list_get_stats(list_id_t list_id,
+                                        ListStats *stats) const = 0;
+
   //! Performs learning on the packet. Needs to be called by the target after a
   //! learning-enabled pipeline has been applied on the packet. See the simple
   //! switch implementation for an example.
@@ -29,12 +29,18 @@
 //! packet
 //!   - BMLOG_TRACE(), or BMLOG_TRACE_PKT() for messages regarding a specific
 //! packet
+//!
+//! The debug and trace macros are compiled in only if BMLOG_DEBUG_ON
+//! (resp. BMLOG_TRACE_ON) is defined (see the `--with-log-max-level` configure
+//! option). When they are compiled in, their arguments are only evaluated if
+//! the message level is enabled at runtime.
 
 #ifndef BM_BM_SIM_LOGGER_H_
 #define BM_BM_SIM_LOGGER_H_
 
 #include <bm/spdlog/spdlog.h>
 
+#include <cstdint>
 #include <string>
 
 namespace bm {
@@ -55,6 +61,16 @@ namespace bm {
 //! packet
 //!   - BMLOG_TRACE(), or BMLOG_TRACE_PKT() for messages regarding a specific
 //! packet
+//!
+//! By default, messages are formatted and written to the sink (console or
+//! file) synchronously, by the thread logging them. After enable_async() has
+//! been called, each thread instead copies its messages (the user message,
+//! with its arguments substituted, along with the level, timestamp and thread
+//! id) to its own lock-free ring buffer, and a background thread drains all
+//! the buffers, applies the log pattern and writes to the sink. If a buffer is
+//! full, the message is dropped and a drop counter is incremented (see
+//! get_stats()); the background thread also logs a warning with the number of
+//! messages dropped.
 class Logger {
  public:
   //! Different log levels
@@ -62,6 +78,19 @@ class Logger {
     TRACE, DEBUG, INFO, NOTICE, WARN, ERROR, CRITICAL, ALERT, EMERG, OFF
   };
 
+  //! Default capacity (in messages) of the per-thread ring buffers
+  static constexpr size_t default_ring_size = 4096;
+
+  struct Stats {
+    //! messages written to the sink, only counted in asynchronous mode
+    uint64_t logged;
+    //! messages dropped because a ring buffer was full
+    uint64_t dropped;
+    //! ring buffers allocated, at most one per running thread which logged a
+    //! message (the buffers of the threads which exited are re-used)
+    uint64_t rings;
+  };
+
  public:
   //! Get an instance of the logger. It actually returns a pointer to a spdlog
   //! logger instance.
@@ -91,9 +120,24 @@ class Logger {
   static void set_logger_file(const std::string &filename,
                               bool force_flush = false);
 
+  //! Log all messages to the given spdlog sink.
+  static void set_logger_sink(spdlog::sink_ptr sink);
+
+  //! Switch to asynchronous mode, with per-thread ring buffers able to hold
+  //! \p ring_size messages each (rounded up to a power of 2). Applies to the
+  //! current console or file logger, if any, as well as to the ones set
+  //! afterwards. This needs to be called before any packet is processed and
+  //! has no effect if asynchronous mode is already enabled.
+  static void enable_async(size_t ring_size = default_ring_size);
+
+  //! Returns the message counters of the current logger.
+  static Stats get_stats();
+
  private:
   static spdlog::logger *init_logger();
 
+  static void set_logger(spdlog::sink_ptr sink);
+
   static spdlog::level::level_enum to_spd_level(LogLevel level);
 
   static void set_pattern();
@@ -102,6 +146,10 @@ class Logger {
 
  private:
   static spdlog::logger *logger;
+  // sink of the current console or file logger, nullptr if there is none
+  static spdlog::sink_ptr sink;
+  // 0 in synchronous mode
+  static size_t async_ring_size;
 };
 
 }  // namespace bm
@@ -109,17 +157,37 @@ class Logger {
 #ifdef BMLOG_DEBUG_ON
 //! Preferred way (because can be disabled at compile time) to log a debug
 //! message. Is enabled by preprocessor BMLOG_DEBUG_ON.
-#define BMLOG_DEBUG(...) bm::Logger::get()->debug(__VA_ARGS__);
+#define BMLOG_DEBUG(...)                                    \
+  do {                                                      \
+    auto bmlog_logger_ = bm::Logger::get();                 \
+    if (bmlog_logger_->should_log(spdlog::level::debug))    \
+      bmlog_logger_->debug(__VA_ARGS__);                    \
+  } while (0);
+//! Evaluates to true iff debug messages are enabled, both at compile time and
+//! at runtime (see Logger::set_log_level()).
+#define BMLOG_DEBUG_ENABLED() \
+  bm::Logger::get()->should_log(spdlog::level::debug)
 #else
 #define BMLOG_DEBUG(...)
+#define BMLOG_DEBUG_ENABLED() false
 #endif
 
 #ifdef BMLOG_TRACE_ON
 //! Preferred way (because can be disabled at compile time) to log a trace
 //! message. Is enabled by preprocessor BMLOG_TRACE_ON.
-#define BMLOG_TRACE(...) bm::Logger::get()->trace(__VA_ARGS__);
+#define BMLOG_TRACE(...)                                    \
+  do {                                                      \
+    auto bmlog_logger_ = bm::Logger::get();                 \
+    if (bmlog_logger_->should_log(spdlog::level::trace))    \
+      bmlog_logger_->trace(__VA_ARGS__);                    \
+  } while (0);
+//! Evaluates to true iff trace messages are enabled, both at compile time and
+//! at runtime (see Logger::set_log_level()).
+#define BMLOG_TRACE_ENABLED() \
+  bm::Logger::get()->should_log(spdlog::level::trace)
 #else
 #define BMLOG_TRACE(...)
+#define BMLOG_TRACE_ENABLED() false
 #endif
 
 //! Same as for BMLOG_DEBUG but for messages regarding a specific packet. Will
@@ -136,12 +204,18 @@ class Logger {
               (pkt).get_context(), ##__VA_ARGS__)
 //! Same as BMLOG_TRACE_PKT except it takes a pointer to a SourceInfo
 //! object, and if non-NULL, include its data in the output.
-#define BMLOG_TRACE_SI_PKT(pkt, source_info, s, ...)       \
-  BMLOG_TRACE("[{}] [cxt {}] {}" s, (pkt).get_unique_id(), \
-              (pkt).get_context(),                         \
-              (source_info == nullptr) ? ""                \
-                : (source_info->to_string() + " "),        \
-              ##__VA_ARGS__)
+//! The arguments are only evaluated if trace messages are enabled at runtime,
+//! since building the source info string is expensive.
+#define BMLOG_TRACE_SI_PKT(pkt, source_info, s, ...)           \
+  do {                                                         \
+    if (BMLOG_TRACE_ENABLED()) {                               \
+      BMLOG_TRACE("[{}] [cxt {}] {}" s, (pkt).get_unique_id(), \
+                  (pkt).get_context(),                         \
+                  (source_info == nullptr) ? ""                \
+                    : (source_info->to_string() + " "),        \
+                  ##__VA_ARGS__)                               \
+    }                                                          \
+  } while (0)
 
 #define BMLOG_ERROR(...) bm::Logger::get()->error(__VA_ARGS__)
 
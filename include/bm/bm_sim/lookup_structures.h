@@ -125,6 +125,16 @@ class LookupStructure {
   virtual bool lookup(const ByteContainer &key_data,
                       internal_handle_t *handle) const = 0;
 
+  //! Look up \p n keys at once. For each key `keys[i]`, `hits[i]` is set to
+  //! the return value of lookup() and `handles[i]` to the found value if there
+  //! is a match. The default implementation simply calls lookup() for each key,
+  //! but data structures can override it to overlap the memory accesses of
+  //! consecutive lookups.
+  virtual void lookup_batch(size_t n, const ByteContainer *keys,
+                            internal_handle_t *handles, bool *hits) const {
+    for (size_t i = 0; i < n; i++) hits[i] = lookup(keys[i], &handles[i]);
+  }
+
   //! Check whether an entry exists. This is distinct from a lookup operation
   //! in that this will also match against the prefix length in the case of
   //! an LPM structure, and against the mask and priority in the case of a
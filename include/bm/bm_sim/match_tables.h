@@ -35,6 +35,7 @@
 #include "lookup_structures.h"
 #include "action_entry.h"
 #include "action_profile.h"
+#include "telemetry.h"
 
 namespace bm {
 
@@ -58,6 +59,25 @@ class MatchTableAbstract : public NamedP4Object {
     uint32_t time_since_hit_ms{0};
   };
 
+  //! Position in a table, used to read its entries one page at a time (see
+  //! MatchTable::get_entries_page()). Start with a default-constructed
+  //! cursor and keep on reading pages until `done` is set. The table is only
+  //! locked while reading each page, not for the whole iteration: entries
+  //! which are in the table for the whole iteration are returned exactly
+  //! once, while entries added, modified or removed in-between pages may or
+  //! may not be returned, or be returned with their old state. The `modified`
+  //! flag tells whether this happened.
+  struct EntryCursor {
+    //! where to resume the iteration
+    uint64_t position{0};
+    //! version of the table when the first page was read
+    uint64_t version{0};
+    //! set once all the entries have been returned
+    bool done{false};
+    //! set if the table was modified after the first page was read
+    bool modified{false};
+  };
+
   class handle_iterator
       : public std::iterator<std::forward_iterator_tag, handle_t> {
    public:
@@ -121,6 +141,19 @@ class MatchTableAbstract : public NamedP4Object {
 
   virtual bool is_valid_handle(entry_handle_t handle) const = 0;
 
+  const MatchKeyBuilder &get_match_key_builder() const {
+    return match_unit_->get_match_key_builder();
+  }
+
+  //! Returns the maximum number of entries in the table
+  size_t get_size() const { return match_unit_->get_size(); }
+
+  //! Returns true if a lookup in this table updates state other than the PHV
+  //! (direct counters, direct meters or entry timestamps for ageing)
+  bool has_lookup_side_effects() const {
+    return with_counters || with_meters || with_ageing;
+  }
+
   MatchErrorCode dump_entry(std::ostream *out,
                             entry_handle_t handle) const {
     ReadLock lock = lock_read();
@@ -147,6 +180,11 @@ class MatchTableAbstract : public NamedP4Object {
   void set_next_node_miss(const ControlFlowNode *next_node);
   void set_next_node_miss_default(const ControlFlowNode *next_node);
 
+  // returns all the nodes which can follow this table in the control flow,
+  // including nullptr if the table can be the last node in the pipeline; used
+  // by Pipeline::compile()
+  std::vector<const ControlFlowNode *> get_next_nodes() const;
+
   void set_direct_meters(MeterArray *meter_array,
                          header_id_t target_header,
                          int target_offset);
@@ -168,11 +206,21 @@ class MatchTableAbstract : public NamedP4Object {
 
   MatchErrorCode set_entry_ttl(entry_handle_t handle, unsigned int ttl_ms);
 
+  //! Enables ageing for a table which was not configured with it in the JSON
+  //! (`support_timeout`), e.g. because a target option requires it. Lookups in
+  //! the table are then no longer cached by FlowCache. The table still has to
+  //! be added to the AgeingMonitor.
+  void enable_ageing();
+
   void sweep_entries(std::vector<entry_handle_t> *entries) const;
 
   handle_iterator handles_begin() const;
   handle_iterator handles_end() const;
 
+  //! Hit / miss counts and lookup latency, updated by apply_action()
+  const TableTelemetry &get_telemetry() const { return telemetry; }
+  void reset_telemetry() { telemetry.reset(); }
+
   MatchTableAbstract(const MatchTableAbstract &other) = delete;
   MatchTableAbstract &operator=(const MatchTableAbstract &other) = delete;
 
@@ -192,6 +240,15 @@ class MatchTableAbstract : public NamedP4Object {
 
   ReadLock lock_read() const { return ReadLock(t_mutex); }
   WriteLock lock_write() const { return WriteLock(t_mutex); }
+  // to be used by the methods which modify the entries or the default entry
+  // (or the table properties which affect lookups), also invalidates the flow
+  // caches and bumps the version used by EntryCursor, see FlowCache
+  WriteLock lock_write_entries() const;
+
+  // returns the handles of the next page of entries and updates the cursor,
+  // the read lock must be held
+  std::vector<entry_handle_t> get_page_handles(size_t max_entries,
+                                               EntryCursor *cursor) const;
 
  protected:
   // Not sure these guys need to be atomic with the current code
@@ -200,7 +257,11 @@ class MatchTableAbstract : public NamedP4Object {
   std::atomic_bool with_meters{false};
   std::atomic_bool with_ageing{false};
 
-  std::unordered_map<p4object_id_t, const ControlFlowNode *> next_nodes{};
+  // indexed by action id, action ids are allocated densely by the compiler;
+  // has_next_node is used to tell apart an action with no next node (nullptr)
+  // from an action which cannot be used with this table
+  std::vector<const ControlFlowNode *> next_nodes{};
+  std::vector<bool> has_next_node{};
   const ControlFlowNode *next_node_hit{nullptr};
   // next node if table is a miss
   const ControlFlowNode *next_node_miss{nullptr};
@@ -229,7 +290,10 @@ class MatchTableAbstract : public NamedP4Object {
 
  private:
   mutable boost::shared_mutex t_mutex{};
+  // incremented each time the entries are modified, see EntryCursor
+  mutable std::atomic<uint64_t> version{0};
   MatchUnitAbstract_ *match_unit_{nullptr};
+  TableTelemetry telemetry{};
 };
 
 // MatchTable is exposed to the runtime for configuration
@@ -259,6 +323,20 @@ class MatchTable : public MatchTableAbstract {
                               const ActionFn *action_fn,
                               ActionData action_data);
 
+  //! Meant to be called from the data plane (see DataPlaneLearner). Adds an
+  //! entry for \p match_key, or, if one already exists, replaces its action
+  //! if it is different. If \p ttl_ms is not 0, the ttl of the entry is set
+  //! and its timestamp refreshed, so that it is not aged out by the
+  //! AgeingMonitor; this requires ageing support for the table. When the
+  //! existing entry is left unchanged, the table is not write-locked. \p
+  //! added is set to true iff the entry did not exist.
+  MatchErrorCode add_or_refresh_entry(
+      const std::vector<MatchKeyParam> &match_key,
+      const ActionFn *action_fn,
+      ActionData action_data,  // move it
+      unsigned int ttl_ms,
+      entry_handle_t *handle, bool *added);
+
   MatchErrorCode set_default_action(const ActionFn *action_fn,
                                     ActionData action_data);
 
@@ -269,6 +347,12 @@ class MatchTable : public MatchTableAbstract {
 
   std::vector<Entry> get_entries() const;
 
+  //! Returns the next (at most) \p max_entries entries of the table, see
+  //! MatchTableAbstract::EntryCursor. Unlike get_entries(), the table is only
+  //! read-locked while the page is being copied.
+  std::vector<Entry> get_entries_page(size_t max_entries,
+                                      EntryCursor *cursor) const;
+
   MatchErrorCode get_default_entry(Entry *entry) const;
 
   MatchTableType get_table_type() const override {
@@ -365,6 +449,10 @@ class MatchTableIndirect : public MatchTableAbstract {
 
   std::vector<Entry> get_entries() const;
 
+  //! See MatchTable::get_entries_page()
+  std::vector<Entry> get_entries_page(size_t max_entries,
+                                      EntryCursor *cursor) const;
+
   MatchErrorCode get_default_entry(Entry *entry) const;
 
   MatchTableType get_table_type() const override {
@@ -446,6 +534,10 @@ class MatchTableIndirectWS : public MatchTableIndirect {
 
   std::vector<Entry> get_entries() const;
 
+  //! See MatchTable::get_entries_page()
+  std::vector<Entry> get_entries_page(size_t max_entries,
+                                      EntryCursor *cursor) const;
+
   MatchErrorCode get_default_entry(Entry *entry) const;
 
   MatchTableType get_table_type() const override {
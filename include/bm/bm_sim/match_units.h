@@ -100,6 +100,7 @@ class MatchKeyBuilder {
 
   void apply_big_mask(ByteContainer *key) const;
 
+  // overwrites the contents of key with the lookup key for phv
   void operator()(const PHV &phv, ByteContainer *key) const;
 
   std::vector<std::string> key_to_fields(const ByteContainer &key) const;
@@ -121,6 +122,23 @@ class MatchKeyBuilder {
 
   size_t get_nbytes_key() const { return nbytes_key; }
 
+  //! Returns the PHV inputs of the key, in order, as (header, field offset)
+  //! pairs; the field offset is -1 for a match on the validity of the header
+  std::vector<std::pair<header_id_t, int> > get_inputs() const;
+
+  //! Description of one field of the key, see get_key_fields()
+  struct KeyFieldDesc {
+    header_id_t header;
+    int f_offset;
+    MatchKeyParam::Type mtype;
+    size_t nbits;
+    ByteContainer mask;
+    std::string name;
+  };
+
+  //! Returns a description of each field of the key, in P4 order
+  std::vector<KeyFieldDesc> get_key_fields() const;
+
   const std::string &get_name(size_t idx) const { return name_map.get(idx); }
 
   size_t max_name_size() const { return name_map.max_size(); }
@@ -142,10 +160,26 @@ class MatchKeyBuilder {
     size_t max_s{0};
   };
 
+  // build() compiles key_input into one of these per field: each one copies a
+  // field (or the header validity byte) at a fixed offset in the key, applying
+  // the corresponding slice of big_mask if needed
+  struct KeyCopyOp {
+    header_id_t header;
+    int f_offset;
+    size_t key_offset;
+    size_t nbytes;
+    bool is_valid_op;
+    bool masked;
+  };
+
   // takes ownership of input
   void push_back(KeyF &&input, const ByteContainer &mask,
                  const std::string &name);
 
+  // used before build() and when a field does not have its nominal width
+  // (variable-length field)
+  void build_key_generic(const PHV &phv, ByteContainer *key) const;
+
   std::vector<KeyF> key_input{};
   size_t nbytes_key{0};
   bool has_big_mask{false};
@@ -160,6 +194,7 @@ class MatchKeyBuilder {
   NameMap name_map{};
   bool built{false};
   std::vector<ByteContainer> masks{};
+  std::vector<KeyCopyOp> copy_ops{};
 };
 
 namespace MatchUnit {
@@ -274,6 +309,10 @@ class MatchUnitAbstract_ {
 
   size_t get_nbytes_key() const { return nbytes_key; }
 
+  const MatchKeyBuilder &get_match_key_builder() const {
+    return match_key_builder;
+  }
+
   bool valid_handle(entry_handle_t handle) const;
 
   MatchUnit::EntryMeta &get_entry_meta(entry_handle_t handle);
@@ -297,6 +336,13 @@ class MatchUnitAbstract_ {
   handle_iterator handles_begin() const;
   handle_iterator handles_end() const;
 
+  // appends the handles of at most max_handles entries to page, in the same
+  // order as the handle_iterator, starting with the entry whose internal
+  // handle is *position or the next one; returns true if there are no more
+  // entries, otherwise *position is updated to resume after the page
+  bool get_handles_page(uint64_t *position, size_t max_handles,
+                        std::vector<entry_handle_t> *page) const;
+
  protected:
   MatchErrorCode get_and_set_handle(internal_handle_t *handle);
   MatchErrorCode unset_handle(internal_handle_t handle);
@@ -41,6 +41,8 @@
 #include <string>
 #include <iosfwd>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 
 #include <cassert>
 
@@ -68,6 +70,16 @@ class Packet;
 //!
 //! Note that a Meter operates on either bytes or packets (not both, unlike a
 //! Counter).
+//!
+//! Meter::execute() is lock-free: the state of each token bucket is packed
+//! into a single atomic integer, which is updated with a compare-and-swap. As a
+//! result, many packet processing threads can execute the same meter
+//! concurrently without serializing on a mutex. The mutex is only used to
+//! serialize configuration changes. Before rewriting the rates, a configuration
+//! change marks the meter as not configured and waits for the executions in
+//! progress to complete, so that execute() never sees a mix of old and new
+//! rates; packets executed during the change are marked GREEN, like for a meter
+//! which has not been configured yet.
 class Meter {
  public:
   using color_t = unsigned int;
@@ -102,6 +114,11 @@ class Meter {
   Meter(MeterType type, size_t rate_count)
     : type(type), rates(rate_count) { }
 
+  // needed because of the atomic members, so that Meter instances can be
+  // stored in a vector (MeterArray)
+  Meter(Meter &&other) noexcept;
+  Meter &operator=(Meter &&other) noexcept;
+
   // the rate configs must be sorted from smaller rate to higher rate
   // in the 2 rate meter case: {CIR, PIR}
 
@@ -123,13 +140,16 @@ class Meter {
     assert(n >= 0);
     auto lock = unique_lock();
     if (static_cast<size_t>(n) != rates.size()) return BAD_RATES_LIST;
-    size_t idx = 0;
-    for (auto it = first; it < last; ++it) {
-      MeterErrorCode rc = set_rate(idx++, *it);
-      if (rc != SUCCESS) return rc;
+    // an invalid list of rates leaves the meter untouched
+    for (decltype(n) i = 1; i < n; i++) {
+      if (first[i - 1].info_rate > first[i].info_rate)
+        return INVALID_INFO_RATE_VALUE;
     }
+    stop_executions();
+    size_t idx = 0;
+    for (auto it = first; it < last; ++it) set_rate(idx++, *it);
     std::reverse(rates.begin(), rates.end());
-    configured = true;
+    configured.store(true, std::memory_order_release);
     return SUCCESS;
   }
 
@@ -170,17 +190,35 @@ class Meter {
   void unlock(UniqueLock &lock) const { lock.unlock(); }  // NOLINT
 
  private:
+  // Rather than maintaining the number of tokens in the bucket and the last
+  // time the bucket was updated (which would require a double-width CAS), we
+  // maintain a single "watermark": the number of tokens generated since init
+  // minus the number of tokens currently in the bucket. At any time, the bucket
+  // holds min(tokens_since_init - watermark, burst_size) tokens. The fields
+  // which describe the rate are atomic so that they can be read by execute()
+  // without holding the mutex. Once the rates are configured, they are sorted
+  // from higher rate to smaller rate and the color returned when a packet does
+  // not conform to rates[i] is rates.size() - i.
   struct MeterRate {
-    bool valid{};  // TODO(antonin): get rid of this?
-    double info_rate{};  // in bytes / packets per microsecond
-    size_t burst_size{};
-    size_t tokens{};
-    uint64_t tokens_last{};
-    color_t color{};
+    MeterRate() = default;
+    MeterRate(const MeterRate &other);
+    MeterRate &operator=(const MeterRate &other);
+
+    std::atomic<bool> valid{false};  // TODO(antonin): get rid of this?
+    // in bytes / packets per microsecond
+    std::atomic<double> info_rate{0.};
+    std::atomic<size_t> burst_size{0u};
+    std::atomic<int64_t> watermark{0};
   };
 
  private:
-  MeterErrorCode set_rate(size_t idx, const rate_config_t &config);
+  // must be called with the mutex held
+  void set_rate(size_t idx, const rate_config_t &config);
+
+  // marks the meter as not configured and waits until no execute() call is
+  // using the rates anymore, after which they can be rewritten; must be called
+  // with the mutex held
+  void stop_executions();
 
  private:
   MeterType type;
@@ -190,7 +228,7 @@ class Meter {
   std::unique_ptr<std::mutex> m_mutex{new std::mutex()};
   // mutable std::mutex m_mutex;
   std::vector<MeterRate> rates;
-  bool configured{false};
+  std::atomic<bool> configured{false};
 };
 
 using meter_array_id_t = p4object_id_t;
@@ -26,6 +26,7 @@
 #include <iosfwd>
 #include <string>
 #include <map>
+#include <vector>
 
 #include "logger.h"
 #include "target_parser.h"
@@ -69,9 +70,22 @@ class OptionsParser {
   bool use_files{false};
   // time to wait (in seconds) before starting packet processing
   int wait_time{0};
+  // if true, the files are replayed from memory (implies use_files)
+  bool pcap_replay{false};
+  // "max", "pps=<rate>" or "speed=<scale>", see PcapReplayConfig
+  std::string pcap_replay_pacing{"max"};
+  unsigned int pcap_replay_burst{32};
+  unsigned int pcap_replay_loops{1};
+  // if true use AF_PACKET mmap rings instead of libpcap for interfaces
+  bool af_packet{false};
+  // number of receive queues (and threads) per interface with af_packet
+  unsigned int af_packet_queues{1};
   // if true read/write packets from nanomsg socket instead of interfaces
   bool packet_in{false};
   std::string packet_in_addr{};
+  // if true read/write packets from shared memory rings instead of interfaces
+  bool packet_in_shm{false};
+  std::string packet_in_shm_name{};
   std::string event_logger_addr{};
   std::string file_logger{};
   bool console_logging{false};
@@ -79,11 +93,15 @@ class OptionsParser {
   Logger::LogLevel log_level{Logger::LogLevel::TRACE};
   // by default file logs are not "force-flushed" to disk
   bool log_flush{false};
+  // if true, log messages are written by a background thread
+  bool log_async{false};
   std::string notifications_addr{};
   bool debugger{false};
   std::string debugger_addr{};
   std::string state_file_path{};
   size_t dump_packet_data{0};
+  // thread class (e.g. "ingress") -> cores, see ThreadPlacement
+  std::map<std::string, std::vector<int> > cpu_affinity{};
 };
 
 }  // namespace bm
@@ -37,6 +37,7 @@
 #include "parser_error.h"
 #include "expressions.h"
 #include "actions.h"
+#include "telemetry.h"
 
 namespace bm {
 
@@ -561,6 +562,10 @@ class Parser : public NamedP4Object {
   //! send it to another Parser for deeper parsing.
   void parse(Packet *pkt) const;
 
+  //! Distribution of the time spent in parse(), in nanoseconds
+  const TelemetryHistogram &get_latency() const { return latency_ns; }
+  void reset_telemetry() { latency_ns.reset(); }
+
   //! Deleted copy constructor
   Parser(const Parser &other) = delete;
   //! Deleted copy assignment operator
@@ -578,6 +583,7 @@ class Parser : public NamedP4Object {
   const ErrorCodeMap *error_codes;
   const ErrorCode no_error;
   std::vector<const Checksum *> checksums{};
+  mutable TelemetryHistogram latency_ns{};
 };
 
 }  // namespace bm
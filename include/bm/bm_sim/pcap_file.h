@@ -20,7 +20,11 @@
 
 #include <stdexcept>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
 #include <cassert>
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <memory>
@@ -114,7 +118,12 @@ class PcapFileOut :
   // port is not really used
   PcapFileOut(unsigned port, std::string filename);
   virtual ~PcapFileOut();
+  // Timestamps the packet with the current time and flushes it to disk
   void writePacket(const char *data, unsigned length);
+  // Does not flush the packet to disk, call flush() for that
+  void writePacket(const char *data, unsigned length,
+                   const struct timeval &ts);
+  void flush();
 
  private:
   pcap_t *pcap;
@@ -175,16 +184,119 @@ class PcapFilesReader :
 };
 
 
+// Replays a set of pcap files at high rate: all the packets are loaded in
+// memory when the files are added, merged in timestamp order, and injected by
+// bursts, with pacing enforced between bursts only.
+struct PcapReplayConfig {
+  enum class Pacing {
+    MAX_RATE,  // inject as fast as possible
+    FIXED_PPS,  // inject at a fixed rate, ignoring packet timestamps
+    TIMESTAMP  // respect packet timestamps, scaled by time_scale
+  };
+
+  Pacing pacing{Pacing::MAX_RATE};
+  double pps{0};
+  // with TIMESTAMP pacing, 2.0 replays the capture twice as fast
+  double time_scale{1.0};
+  unsigned burst_size{32};
+  // number of times the capture is replayed
+  unsigned loops{1};
+
+  // Parses "max", "pps=<rate>" or "speed=<scale>" and sets the pacing
+  // accordingly. Returns false if the string is invalid.
+  bool parsePacing(const std::string &str);
+};
+
+struct PcapReplayStats {
+  uint64_t packets{0};
+  uint64_t bytes{0};
+  double elapsed_seconds{0};
+  // bursts which were sent more than 1ms after their scheduled time
+  uint64_t late_bursts{0};
+
+  double pps() const {
+    return (elapsed_seconds > 0) ? packets / elapsed_seconds : 0;
+  }
+};
+
+class PcapReplayer : public PacketDispatcherIface {
+ public:
+  PcapReplayer(const PcapReplayConfig &config, unsigned wait_time_in_seconds);
+  // Add a file corresponding to the specified port. The whole file is read in
+  // memory.
+  void addFile(unsigned port, std::string file);
+  // Replays all the packets and returns when done.
+  void start();
+
+  PacketDispatcherIface::ReturnCode set_packet_handler(
+      const PacketHandler &handler, void *cookie);
+
+  size_t numPackets() const { return packets.size(); }
+
+  // Can be called while the replay is in progress
+  PcapReplayStats getStats() const;
+
+ private:
+  struct PacketRecord {
+    unsigned port;
+    unsigned length;
+    size_t offset;  // in data
+    uint64_t ts_ns;
+  };
+
+  uint64_t scheduledTime(size_t index, unsigned loop) const;
+
+  PcapReplayConfig config;
+  unsigned wait_time_in_seconds;
+  std::vector<char> data{};
+  std::vector<PacketRecord> packets{};
+  bool sorted{true};
+  std::atomic<uint64_t> packets_sent{0};
+  std::atomic<uint64_t> bytes_sent{0};
+  std::atomic<uint64_t> late_bursts{0};
+  std::atomic<uint64_t> elapsed_ns{0};
+
+  PacketHandler handler{};
+  void *cookie{nullptr};
+
+  PcapReplayer(PcapReplayer const& ) = delete;
+  PcapReplayer& operator=(PcapReplayer const&) = delete;
+};
+
+
 // Writes data to a set of Pcap files.
 class PcapFilesWriter : public PacketReceiverIface {
  public:
-  PcapFilesWriter();
+  // If 'async' is true, packets are copied to a queue and written to disk by a
+  // separate thread, which only flushes the files when the queue is empty.
+  explicit PcapFilesWriter(bool async = false);
+  ~PcapFilesWriter();
   // Add a file corresponding to the specified port.
   void addFile(unsigned port, std::string file);
   void send_packet(int port_num, const char *buffer, int len);
 
+  // Number of calls to send_packet, including for ports without a file
+  uint64_t packetCount() const { return packet_count; }
+
  private:
+  struct PendingPacket {
+    unsigned port;
+    struct timeval ts;
+    std::vector<char> data;
+  };
+
+  void writeLoop();
+
   std::unordered_map<unsigned, std::unique_ptr<PcapFileOut>> files;
+  std::atomic<uint64_t> packet_count{0};
+  bool async;
+  // started on the first packet, once all the files have been added
+  std::once_flag writer_started{};
+  std::thread writer_thread{};
+  std::mutex mutex{};
+  std::condition_variable cv{};
+  std::vector<PendingPacket> pending{};
+  bool stop{false};
 
   PcapFilesWriter(PcapFilesWriter const& ) = delete;
   PcapFilesWriter& operator=(PcapFilesWriter const&) = delete;
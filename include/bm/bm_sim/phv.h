@@ -31,8 +31,10 @@
 #include <unordered_set>
 #include <map>
 #include <memory>
+#include <utility>
 
 #include <cassert>
+#include <cstring>
 
 #include "fields.h"
 #include "headers.h"
@@ -55,6 +57,14 @@ class PHVFactory;
 //! vector of Field instances. The PHV also owns the HeaderStack instances for
 //! the packet.
 //!
+//! The bytes of all the fixed-width fields of the PHV live in a single
+//! cache-line-aligned arena owned by the PHV, in which each header gets a slot
+//! assigned by the PHVFactory when the P4 configuration is loaded. Field
+//! instances only point to their bytes in the arena, which means that copying
+//! all the field bytes of a PHV (see copy_headers()) is a single memcpy and
+//! that the bytes of a field can be located with some offset arithmetic (see
+//! Header::get_field_storage()).
+//!
 //! Because PHV objects are expensive to construct, we maintain a pool of
 //! them. Every time a new Packet is constructed, we retrieve one PHV from the
 //! pool (construct a new one if the pool is empty). When the Packet is
@@ -68,10 +78,10 @@ class PHVFactory;
 //! reset_metadata().
 class PHV {
   using HeaderRef = std::reference_wrapper<Header>;
-  using FieldRef = std::reference_wrapper<Field>;
 
  public:
   friend class PHVFactory;
+  friend class Header;
   friend class Packet;
 
   using HeaderNamesMap = std::unordered_map<std::string, HeaderRef>;
@@ -81,9 +91,13 @@ class PHV {
   //! @copydoc header_name_iterator
   using const_header_name_iterator = HeaderNamesMap::const_iterator;
 
-  using FieldNamesMap = std::unordered_map<std::string, FieldRef>;
+  // field name -> (header id, field offset)
+  using FieldNamesMap =
+      std::unordered_map<std::string, std::pair<header_id_t, int> >;
 
-  //! Used to iterate over headers in ascending id order.
+  //! Used to iterate over headers in ascending id order. Unlike get_header(),
+  //! the iteration is over the Header instances themselves, which means that
+  //! the elements of a header stack are not visited in stack order.
   using header_iterator = std::vector<Header>::iterator;
   //! @copydoc header_iterator
   using const_header_iterator = std::vector<Header>::const_iterator;
@@ -91,29 +105,43 @@ class PHV {
  public:
   PHV() {}
 
+  //! \p storage_nbytes is the size of the field arena, as computed by the
+  //! PHVFactory
   PHV(size_t num_headers, size_t num_header_stacks,
-      size_t num_header_unions, size_t num_header_union_stacks);
+      size_t num_header_unions, size_t num_header_union_stacks,
+      size_t storage_nbytes = 0);
 
-  //! Access the Header with id \p header_index, with no bound checking.
+  //! Access the Header with id \p header_index, with no bound checking. If the
+  //! header is an element of a header stack, this is the Header instance which
+  //! currently occupies that position in the stack (see HeaderStack).
   Header &get_header(header_id_t header_index) {
-    return headers[header_index];
+    Header &header = headers[header_index];
+    return header.stack ? header.stack->get_element(header.stack_idx) : header;
   }
 
   //! @copydoc get_header(header_id_t header_index)
   const Header &get_header(header_id_t header_index) const {
-    return headers[header_index];
+    const Header &header = headers[header_index];
+    return header.stack ? header.stack->get_element(header.stack_idx) : header;
+  }
+
+  //! Returns the name of the header with id \p header_index. For elements of a
+  //! header stack, it may differ from the name of the Header instance returned
+  //! by get_header(), which is the name of the storage it occupies.
+  const std::string &get_header_name(header_id_t header_index) const {
+    return headers[header_index].get_name();
   }
 
   //! Access the Header with name \p header_name. If \p header_name does not
   //! match any known headers, an std::out_of_range exception will be
   //! thrown.
   Header &get_header(const std::string &header_name) {
-    return headers_map.at(header_name);
+    return get_header(headers_map.at(header_name).get().get_id());
   }
 
   //! @copydoc get_header(const std::string &header_name)
   const Header &get_header(const std::string &header_name) const {
-    return headers_map.at(header_name);
+    return get_header(headers_map.at(header_name).get().get_id());
   }
 
   //! Returns true if there exists a Header with name \p header_name in this PHV
@@ -127,24 +155,26 @@ class PHV {
   //! See PHV::get_header(header_id_t header_index) and
   //! Header::get_field(int field_offset) for more information.
   Field &get_field(header_id_t header_index, int field_offset) {
-    return headers[header_index].get_field(field_offset);
+    return get_header(header_index).get_field(field_offset);
   }
 
   //! @copydoc get_field(header_id_t header_index, int field_offset)
   const Field &get_field(header_id_t header_index, int field_offset) const {
-    return headers[header_index].get_field(field_offset);
+    return get_header(header_index).get_field(field_offset);
   }
 
   //! Access the Field with name \p field_name. If \p field_name does not match
   //! any known fields, an std::out_of_range exception will be thrown. \p
   //! field_name must follow the `"hdr.f"` format.
   Field &get_field(const std::string &field_name) {
-    return fields_map.at(field_name);
+    const auto &loc = fields_map.at(field_name);
+    return get_field(loc.first, loc.second);
   }
 
   //! @copydoc get_field(const std::string &field_name)
   const Field &get_field(const std::string &field_name) const {
-    return fields_map.at(field_name);
+    const auto &loc = fields_map.at(field_name);
+    return get_field(loc.first, loc.second);
   }
 
   //! Returns true if there exists a Field with name \p field_name in this
@@ -228,15 +258,59 @@ class PHV {
   //! Every header:
   //!   - is marked valid iff the corresponding \p src header is valid
   //!   - is marked as metadata iff the corresponding \p src header is metadata
-  //!   - receives the same field values as the corresponding \p src header iff
-  //! it is a valid packet header or a metadata header
+  //!   - receives the same field values as the corresponding \p src header
+  //!
+  //! The bytes of all the fixed-width fields are copied with a single memcpy
+  //! of the field arena.
   void copy_headers(const PHV &src) {
+    assert(storage_nbytes == src.storage_nbytes);
+    // header stacks may not be rotated the same way in both PHVs: we give the
+    // same rotation to both, so that each stack element occupies the same
+    // arena slot in both PHVs, which is fine since all the elements are
+    // overwritten
+    for (size_t s = 0; s < header_stacks.size(); s++)
+      header_stacks[s].base = src.header_stacks[s].base;
+    if (storage_nbytes > 0)
+      std::memcpy(storage, src.storage, storage_nbytes);
     for (size_t h = 0; h < headers.size(); h++) {
-      headers[h].valid = src.headers[h].valid;
-      headers[h].metadata = src.headers[h].metadata;
-      if (headers[h].valid || headers[h].metadata)
-        headers[h].copy_fields(src.headers[h]);
+      Header &dst_hdr = headers[h];
+      const Header &src_hdr = src.headers[h];
+      dst_hdr.valid = src_hdr.valid;
+      dst_hdr.metadata = src_hdr.metadata;
+      dst_hdr.copy_fields_no_storage(src_hdr);
+      if (!dst_hdr.valid && !dst_hdr.metadata) dst_hdr.modified = true;
     }
+    packet_bytes = src.packet_bytes;
+    parse_gen = src.parse_gen;
+  }
+
+  //! Called by the Parser before extracting headers from \p data. Headers
+  //! extracted until the next call to end_parse() remember their location in
+  //! the packet.
+  void start_parse(const char *data);
+
+  //! Called by the Parser once parsing is done, \p nbytes is the number of
+  //! bytes which were consumed. These bytes are saved by the PHV so that
+  //! headers which are not modified can be deparsed with a simple copy.
+  void end_parse(size_t nbytes);
+
+  //! Returns the offset of \p data with respect to the start of the packet
+  //! being parsed, or -1 if the PHV is not in the middle of a parse.
+  int get_parse_offset(const char *data) const {
+    return parse_base ? static_cast<int>(data - parse_base) : -1;
+  }
+
+  //! Returns a pointer to the original packet bytes for \p header, if it was
+  //! extracted by the last parse and none of its fields have been modified
+  //! since (see Header::is_modified()). In this case, the returned bytes are
+  //! exactly what Header::deparse() would produce. Returns `nullptr` otherwise.
+  const char *get_packet_bytes(const Header &header) const {
+    if (header.modified || header.packet_gen != parse_gen) return nullptr;
+    assert(header.packet_offset >= 0);
+    size_t end = static_cast<size_t>(header.packet_offset) +
+        header.nbytes_packet;
+    if (end > packet_bytes.size()) return nullptr;
+    return packet_bytes.data() + header.packet_offset;
   }
 
   void set_packet_id(const uint64_t id1, const uint64_t id2) {
@@ -291,6 +365,9 @@ class PHV {
   //! Returns the number of headers included in the PHV
   size_t num_headers() const { return headers.size(); }
 
+  //! Returns the size in bytes of the field arena of the PHV
+  size_t get_storage_nbytes() const { return storage_nbytes; }
+
   //! Returns the full name of the field as a new string. The name is of the
   //! form <hdr_name>.<f_name>.
   const std::string get_field_name(header_id_t header_index,
@@ -300,11 +377,12 @@ class PHV {
   // To  be used only by PHVFactory
   // all headers need to be pushed back in order (according to header_index) !!!
   // TODO(antonin): remove this constraint?
+  // storage_offset is the offset of the header slot in the field arena
   void push_back_header(const std::string &header_name,
                         header_id_t header_index,
                         const HeaderType &header_type,
                         const std::set<int> &arith_offsets,
-                        const bool metadata);
+                        const bool metadata, size_t storage_offset);
 
   void push_back_header_stack(const std::string &header_stack_name,
                               header_stack_id_t header_stack_index,
@@ -326,6 +404,13 @@ class PHV {
   void add_field_alias(const std::string &from, const std::string &to);
 
  private:
+  static constexpr size_t storage_alignment = 64;
+
+  // the field arena; storage points to the first aligned byte of
+  // storage_buffer and does not change when the PHV is moved
+  std::unique_ptr<char[]> storage_buffer{nullptr};
+  char *storage{nullptr};
+  size_t storage_nbytes{0};
   std::vector<Header> headers{};
   std::vector<HeaderStack> header_stacks{};
   std::vector<HeaderUnion> header_unions{};
@@ -337,6 +422,10 @@ class PHV {
   size_t capacity_unions{0};
   size_t capacity_union_stacks{0};
   Debugger::PacketId packet_id;
+  // copy of the packet bytes consumed by the last parse
+  std::vector<char> packet_bytes{};
+  const char *parse_base{nullptr};
+  unsigned int parse_gen{0};
 };
 
 class PHVFactory {
@@ -347,11 +436,14 @@ class PHVFactory {
     const HeaderType &header_type;
     std::set<int> arith_offsets{};
     bool metadata;
+    // offset of the header slot in the field arena of the PHV
+    size_t storage_offset;
 
     HeaderDesc(const std::string &name, const header_id_t index,
-               const HeaderType &header_type, const bool metadata)
+               const HeaderType &header_type, const bool metadata,
+               size_t storage_offset)
         : name(name), index(index), header_type(header_type),
-          metadata(metadata) {
+          metadata(metadata), storage_offset(storage_offset) {
       for (int offset = 0; offset < header_type.get_num_fields(); offset++) {
         arith_offsets.insert(offset);
       }
@@ -448,6 +540,10 @@ class PHVFactory {
 
   void enable_all_arith();
 
+  //! Returns the size in bytes of the field arena of the PHV instances created
+  //! by this factory
+  size_t get_storage_nbytes() const { return storage_nbytes; }
+
   std::unique_ptr<PHV> create() const;
 
  private:
@@ -458,6 +554,7 @@ class PHVFactory {
   header_union_stack_descs{};
   std::map<std::string, std::string> field_aliases{};  // order does not matter
   std::unordered_set<std::string> field_names{};  // just for debugging
+  size_t storage_nbytes{0};
 };
 
 }  // namespace bm
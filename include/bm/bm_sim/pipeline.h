@@ -23,7 +23,10 @@
 #ifndef BM_BM_SIM_PIPELINE_H_
 #define BM_BM_SIM_PIPELINE_H_
 
+#include <array>
 #include <string>
+#include <utility>  // for std::pair
+#include <vector>
 
 #include "control_flow.h"
 #include "named_p4object.h"
@@ -45,6 +48,14 @@ class Pipeline : public NamedP4Object {
   //! flow graph.
   void apply(Packet *pkt);
 
+  //! Flattens the control flow graph reachable from the first node into an
+  //! array of nodes with dense indices, in which the successors of conditions
+  //! and control actions are stored directly as indices. apply() then runs the
+  //! packet through this array in a single loop. Has to be called once all the
+  //! nodes have been connected; the bmv2 JSON loader calls it for every
+  //! pipeline.
+  void compile();
+
   //! Deleted copy constructor
   Pipeline(const Pipeline &other) = delete;
   //! Deleted copy assignment operator
@@ -56,7 +67,23 @@ class Pipeline : public NamedP4Object {
   Pipeline &operator=(Pipeline &&other) /*noexcept*/ = default;
 
  private:
+  struct Step {
+    enum class Kind {TABLE, CONDITIONAL, ACTION, OTHER};
+    Kind kind;
+    const ControlFlowNode *node;
+    // successors (as indices in steps, -1 for the end of the pipeline): true
+    // and false branches for conditions, next node for control actions
+    std::array<int, 2> next;
+    // for tables, all the possible next nodes with the corresponding indices;
+    // there are usually very few distinct ones so a linear search is fine
+    std::vector<std::pair<const ControlFlowNode *, int> > table_next{};
+  };
+
+  void apply_from(const ControlFlowNode *node, Packet *pkt) const;
+  void apply_compiled(Packet *pkt) const;
+
   ControlFlowNode *first_node;
+  std::vector<Step> steps{};
 };
 
 }  // namespace bm
@@ -38,6 +38,8 @@
 #include <chrono>
 #include <algorithm>  // for std::max
 
+#include "telemetry.h"
+
 namespace bm {
 
 //! One of the most basic queueing block possible. Lets you choose (at runtime)
@@ -219,7 +221,7 @@ class QueueingLogicRL {
                   FMap map_to_worker)
       : nb_queues(nb_queues), nb_workers(nb_workers),
         queues_info(nb_queues), workers_info(nb_workers),
-        map_to_worker(std::move(map_to_worker)) {
+        map_to_worker(std::move(map_to_worker)), telemetry(nb_queues) {
     auto now = clock::now();
     for (auto &q_info : queues_info) {
       q_info.capacity = capacity;
@@ -235,11 +237,16 @@ class QueueingLogicRL {
     auto &q_info = queues_info.at(queue_id);
     auto &w_info = workers_info.at(worker_id);
     std::unique_lock<std::mutex> lock(w_info.q_mutex);
-    if (q_info.size >= q_info.capacity) return 0;
-    q_info.last_sent = get_next_tp(q_info);
+    if (q_info.size >= q_info.capacity) {
+      record_drop(queue_id);
+      return 0;
+    }
+    auto now = clock::now();
+    q_info.last_sent = get_next_tp(q_info, now);
     // w_info.queue.emplace(item, queue_id, q_info.last_sent, id++);
-    w_info.queue.emplace(item, queue_id, q_info.last_sent);
+    w_info.queue.emplace(item, queue_id, q_info.last_sent, now);
     q_info.size++;
+    record_enqueue(queue_id, q_info.size);
     w_info.q_not_empty.notify_one();
     return 1;
   }
@@ -251,11 +258,16 @@ class QueueingLogicRL {
     auto &q_info = queues_info.at(queue_id);
     auto &w_info = workers_info.at(worker_id);
     std::unique_lock<std::mutex> lock(w_info.q_mutex);
-    if (q_info.size >= q_info.capacity) return 0;
-    q_info.last_sent = get_next_tp(q_info);
+    if (q_info.size >= q_info.capacity) {
+      record_drop(queue_id);
+      return 0;
+    }
+    auto now = clock::now();
+    q_info.last_sent = get_next_tp(q_info, now);
     // w_info.queue.emplace(std::move(item), queue_id, q_info.last_sent, id++);
-    w_info.queue.emplace(std::move(item), queue_id, q_info.last_sent);
+    w_info.queue.emplace(std::move(item), queue_id, q_info.last_sent, now);
     q_info.size++;
+    record_enqueue(queue_id, q_info.size);
     w_info.q_not_empty.notify_one();
     return 1;
   }
@@ -278,6 +290,7 @@ class QueueingLogicRL {
       }
     }
     *queue_id = queue.top().queue_id;
+    record_dequeue(*queue_id, queue.top().enqueued);
     // TODO(antonin): improve / document this
     // http://stackoverflow.com/questions/20149471/move-out-element-of-std-priority-queue-in-c11
     *pItem = std::move(const_cast<QE &>(queue.top()).e);
@@ -286,6 +299,11 @@ class QueueingLogicRL {
     q_info.size--;
   }
 
+  //! Returns the statistics for the logical queue with id \p queue_id
+  QueueTelemetry *get_telemetry(size_t queue_id) {
+    return &telemetry.at(queue_id);
+  }
+
   //! @copydoc QueueingLogic::size
   size_t size(size_t queue_id) const {
     size_t worker_id = map_to_worker(queue_id);
@@ -337,12 +355,15 @@ class QueueingLogicRL {
   struct QE {
     // QE(T e, size_t queue_id, const clock::time_point &send, size_t id)
     //     : e(std::move(e)), queue_id(queue_id), send(send), id(id) { }
-    QE(T e, size_t queue_id, const clock::time_point &send)
-        : e(std::move(e)), queue_id(queue_id), send(send) { }
+    QE(T e, size_t queue_id, const clock::time_point &send,
+       const clock::time_point &enqueued)
+        : e(std::move(e)), queue_id(queue_id), send(send),
+          enqueued(enqueued) { }
 
     T e;
     size_t queue_id;
     clock::time_point send;
+    clock::time_point enqueued;
     // size_t id;
   };
 
@@ -374,8 +395,28 @@ class QueueingLogicRL {
     mutable std::condition_variable q_not_empty{};
   };
 
-  clock::time_point get_next_tp(const QueueInfo &q_info) {
-    return std::max(clock::now(), q_info.last_sent + q_info.pkt_delay_ticks);
+  clock::time_point get_next_tp(const QueueInfo &q_info,
+                                const clock::time_point &now) {
+    return std::max(now, q_info.last_sent + q_info.pkt_delay_ticks);
+  }
+
+  // the telemetry is only updated with the worker lock held
+  void record_enqueue(size_t queue_id, size_t depth) {
+    if (!Telemetry::is_enabled()) return;
+    auto &t = telemetry[queue_id];
+    t.enqueued.increment();
+    t.depth.record(depth);
+  }
+
+  void record_drop(size_t queue_id) {
+    if (!Telemetry::is_enabled()) return;
+    telemetry[queue_id].dropped.increment();
+  }
+
+  void record_dequeue(size_t queue_id, const clock::time_point &enqueued) {
+    if (!Telemetry::is_enabled()) return;
+    telemetry[queue_id].sojourn_ns.record(
+        std::chrono::duration_cast<ticks>(clock::now() - enqueued).count());
   }
 
   size_t nb_queues;
@@ -383,6 +424,7 @@ class QueueingLogicRL {
   std::vector<QueueInfo> queues_info;
   std::vector<WorkerInfo> workers_info;
   FMap map_to_worker;
+  std::vector<QueueTelemetry> telemetry;
   // size_t id{0};
 };
 
@@ -419,7 +461,7 @@ class QueueingLogicPriRL {
       : nb_queues(nb_queues), nb_workers(nb_workers),
         workers_info(nb_workers),
         map_to_worker(std::move(map_to_worker)),
-        nb_priorities(nb_priorities) {
+        nb_priorities(nb_priorities), telemetry(nb_queues) {
     auto now = clock::now();
     for (size_t i = 0; i < nb_queues; i++) {
       QueueInfoPri v = {0, capacity, 0, ticks::zero(), now};
@@ -438,11 +480,16 @@ class QueueingLogicPriRL {
     auto &w_info = workers_info.at(worker_id);
     auto &q_info_pri = q_info.at(priority);
     LockType lock(w_info.q_mutex);
-    if (q_info_pri.size >= q_info_pri.capacity) return 0;
-    q_info_pri.last_sent = get_next_tp(q_info_pri);
-    w_info.queues[priority].emplace(item, queue_id, q_info_pri.last_sent);
+    if (q_info_pri.size >= q_info_pri.capacity) {
+      record_drop(queue_id);
+      return 0;
+    }
+    auto now = clock::now();
+    q_info_pri.last_sent = get_next_tp(q_info_pri, now);
+    w_info.queues[priority].emplace(item, queue_id, q_info_pri.last_sent, now);
     q_info_pri.size++;
     q_info.size++;
+    record_enqueue(queue_id, q_info.size);
     w_info.size++;
     w_info.q_not_empty.notify_one();
     return 1;
@@ -460,12 +507,17 @@ class QueueingLogicPriRL {
     auto &w_info = workers_info.at(worker_id);
     auto &q_info_pri = q_info.at(priority);
     LockType lock(w_info.q_mutex);
-    if (q_info_pri.size >= q_info_pri.capacity) return 0;
-    q_info_pri.last_sent = get_next_tp(q_info_pri);
+    if (q_info_pri.size >= q_info_pri.capacity) {
+      record_drop(queue_id);
+      return 0;
+    }
+    auto now = clock::now();
+    q_info_pri.last_sent = get_next_tp(q_info_pri, now);
     w_info.queues[priority].emplace(std::move(item), queue_id,
-                                    q_info_pri.last_sent);
+                                    q_info_pri.last_sent, now);
     q_info_pri.size++;
     q_info.size++;
+    record_enqueue(queue_id, q_info.size);
     w_info.size++;
     w_info.q_not_empty.notify_one();
     return 1;
@@ -511,6 +563,7 @@ class QueueingLogicPriRL {
     }
     *queue_id = queue->top().queue_id;
     *priority = pri;
+    record_dequeue(*queue_id, queue->top().enqueued);
     // TODO(antonin): improve / document this
     // http://stackoverflow.com/questions/20149471/move-out-element-of-std-priority-queue-in-c11
     *pItem = std::move(const_cast<QE &>(queue->top()).e);
@@ -529,6 +582,12 @@ class QueueingLogicPriRL {
     return pop_back(worker_id, queue_id, &priority, pItem);
   }
 
+  //! Returns the statistics for the logical queue with id \p queue_id (all
+  //! priority queues combined)
+  QueueTelemetry *get_telemetry(size_t queue_id) {
+    return &telemetry.at(queue_id);
+  }
+
   //! @copydoc QueueingLogic::size
   //! The occupancies of all the priority queues for this logical queue are
   //! added.
@@ -594,12 +653,15 @@ class QueueingLogicPriRL {
   using clock = std::chrono::high_resolution_clock;
 
   struct QE {
-    QE(T e, size_t queue_id, const clock::time_point &send)
-        : e(std::move(e)), queue_id(queue_id), send(send) { }
+    QE(T e, size_t queue_id, const clock::time_point &send,
+       const clock::time_point &enqueued)
+        : e(std::move(e)), queue_id(queue_id), send(send),
+          enqueued(enqueued) { }
 
     T e;
     size_t queue_id;
     clock::time_point send;
+    clock::time_point enqueued;
   };
 
   struct QEComp {
@@ -632,9 +694,28 @@ class QueueingLogicPriRL {
     std::array<MyQ, 32> queues;
   };
 
-  clock::time_point get_next_tp(const QueueInfoPri &q_info_pri) {
-    return std::max(clock::now(),
-                    q_info_pri.last_sent + q_info_pri.pkt_delay_ticks);
+  clock::time_point get_next_tp(const QueueInfoPri &q_info_pri,
+                                const clock::time_point &now) {
+    return std::max(now, q_info_pri.last_sent + q_info_pri.pkt_delay_ticks);
+  }
+
+  // the telemetry is only updated with the worker lock held
+  void record_enqueue(size_t queue_id, size_t depth) {
+    if (!Telemetry::is_enabled()) return;
+    auto &t = telemetry[queue_id];
+    t.enqueued.increment();
+    t.depth.record(depth);
+  }
+
+  void record_drop(size_t queue_id) {
+    if (!Telemetry::is_enabled()) return;
+    telemetry[queue_id].dropped.increment();
+  }
+
+  void record_dequeue(size_t queue_id, const clock::time_point &enqueued) {
+    if (!Telemetry::is_enabled()) return;
+    telemetry[queue_id].sojourn_ns.record(
+        std::chrono::duration_cast<ticks>(clock::now() - enqueued).count());
   }
 
   template <typename Function>
@@ -695,6 +776,7 @@ class QueueingLogicPriRL {
   std::vector<MyQ> queues{};
   FMap map_to_worker;
   size_t nb_priorities;
+  std::vector<QueueTelemetry> telemetry;
 };
 
 }  // namespace bm
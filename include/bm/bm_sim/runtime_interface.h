@@ -250,6 +250,24 @@ class RuntimeInterface {
   mt_indirect_ws_get_entries(size_t cxt_id,
                              const std::string &table_name) const = 0;
 
+  virtual MatchErrorCode
+  mt_get_entries_page(size_t cxt_id, const std::string &table_name,
+                      size_t max_entries,
+                      MatchTableAbstract::EntryCursor *cursor,
+                      std::vector<MatchTable::Entry> *entries) const = 0;
+
+  virtual MatchErrorCode
+  mt_indirect_get_entries_page(
+      size_t cxt_id, const std::string &table_name, size_t max_entries,
+      MatchTableAbstract::EntryCursor *cursor,
+      std::vector<MatchTableIndirect::Entry> *entries) const = 0;
+
+  virtual MatchErrorCode
+  mt_indirect_ws_get_entries_page(
+      size_t cxt_id, const std::string &table_name, size_t max_entries,
+      MatchTableAbstract::EntryCursor *cursor,
+      std::vector<MatchTableIndirectWS::Entry> *entries) const = 0;
+
   virtual MatchErrorCode
   mt_get_entry(size_t cxt_id, const std::string &table_name,
                entry_handle_t handle, MatchTable::Entry *entry) const = 0;
@@ -383,6 +401,14 @@ class RuntimeInterface {
 
   virtual ErrorCode
   serialize(std::ostream *out) = 0;
+
+  //! Returns a JSON document with the per-stage telemetry (tables, parsers,
+  //! deparsers, queues and threads), see telemetry.h
+  virtual std::string
+  get_telemetry() = 0;
+
+  virtual ErrorCode
+  reset_telemetry() = 0;
 };
 
 }  // namespace bm
@@ -0,0 +1,348 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+//! @file shm_ring.h
+//! Lock-free single-producer / single-consumer rings in a POSIX shared memory
+//! segment, used to exchange packets between the switch (ShmDevMgrImp) and an
+//! external process (bm_apps::ShmPacketInject) without any system call or
+//! intermediate copy. This header is self-contained (it does not depend on
+//! the rest of bm_sim) so that it can be used by both sides.
+
+#ifndef BM_BM_SIM_SHM_RING_H_
+#define BM_BM_SIM_SHM_RING_H_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace bm {
+
+//! One direction of a ShmPacketChannel. Each slot holds one message: a
+//! ShmMsgHdr followed by at most max_data_size() bytes of data. The producer
+//! and the consumer each own one index, which only they write; each side also
+//! keeps a private copy of the other side's index, which is only refreshed
+//! when the ring looks full (resp. empty), so that in steady state the shared
+//! cache lines are only touched once per batch.
+//!
+//! The other side of the ring is not trusted: each side keeps a private copy of
+//! its own index and checks the index of the other side, so that a buggy or
+//! malicious peer cannot make us access memory outside of the ring. Once an
+//! invalid index has been seen, the ring is considered broken (see
+//! has_peer_error()) and no message is exchanged anymore. Note that the
+//! contents of the messages (e.g. the data size of packets) still need to be
+//! checked by the consumer.
+class ShmRing {
+ public:
+  //! Header of every message in the rings
+  struct ShmMsgHdr {
+    uint32_t type;
+    int32_t port;
+    // status for PORT_SET_STATUS, length of the data for packets
+    uint32_t more;
+    uint32_t reserved;
+  };
+
+  //! Message to enqueue, see push_batch()
+  struct MsgDesc {
+    uint32_t type;
+    int port;
+    uint32_t more;
+    const char *data;
+  };
+
+  //! The two indices live in different cache lines of the shared segment
+  struct Indices {
+    alignas(64) uint64_t head;  // written by the producer
+    alignas(64) uint64_t tail;  // written by the consumer
+  };
+
+  ShmRing(Indices *indices, char *slots, uint32_t nb_slots,
+          uint32_t slot_size)
+      : indices(indices), slots(slots), mask(nb_slots - 1),
+        slot_size(slot_size),
+        head(load(&indices->head)), tail(load(&indices->tail)),
+        cached_head(head), cached_tail(tail) {
+    if (head - tail > mask + 1) peer_error = true;
+  }
+
+  uint32_t max_data_size() const {
+    return slot_size - static_cast<uint32_t>(sizeof(ShmMsgHdr));
+  }
+
+  //! Producer side: copies as many messages from \p msgs as there is room for
+  //! in the ring, and makes them visible to the consumer with a single store.
+  //! Returns the number of messages enqueued, which is a prefix of \p msgs.
+  //! The data size of packet messages must not exceed max_data_size().
+  size_t push_batch(const MsgDesc *msgs, size_t n) {
+    if (peer_error) return 0;
+    if (head + n > cached_tail + mask + 1) {
+      const uint64_t new_tail = load(&indices->tail);
+      // the consumer cannot have released slots we have not written yet, and
+      // its index never goes back
+      if (new_tail > head || new_tail < cached_tail) {
+        peer_error = true;
+        return 0;
+      }
+      cached_tail = new_tail;
+      const uint64_t room = cached_tail + mask + 1 - head;
+      if (n > room) n = room;
+    }
+    for (size_t i = 0; i < n; i++) {
+      char *slot = get_slot(head + i);
+      ShmMsgHdr hdr{msgs[i].type, msgs[i].port, msgs[i].more, 0};
+      std::memcpy(slot, &hdr, sizeof(hdr));
+      if (msgs[i].data)
+        std::memcpy(slot + sizeof(hdr), msgs[i].data, msgs[i].more);
+    }
+    if (n > 0) {
+      head += n;
+      store(&indices->head, head);
+    }
+    return n;
+  }
+
+  //! Consumer side: calls fn(const ShmMsgHdr &, const char *data) for at most
+  //! \p max messages, directly from the shared memory, then releases all the
+  //! slots with a single store. Returns the number of messages consumed.
+  template <typename Fn>
+  size_t pop_batch(size_t max, const Fn &fn) {
+    if (peer_error) return 0;
+    if (tail + max > cached_head) {
+      const uint64_t new_head = load(&indices->head);
+      // the producer cannot have written more than nb_slots messages we have
+      // not consumed yet, and its index never goes back
+      if (new_head - tail > mask + 1 || new_head < cached_head) {
+        peer_error = true;
+        return 0;
+      }
+      cached_head = new_head;
+      if (tail + max > cached_head) max = cached_head - tail;
+    }
+    for (size_t i = 0; i < max; i++) {
+      const char *slot = get_slot(tail + i);
+      ShmMsgHdr hdr;
+      std::memcpy(&hdr, slot, sizeof(hdr));
+      fn(hdr, slot + sizeof(hdr));
+    }
+    if (max > 0) {
+      tail += max;
+      store(&indices->tail, tail);
+    }
+    return max;
+  }
+
+  //! Returns true if the other side of the ring was found to have written an
+  //! invalid index in the shared memory, in which case push_batch() and
+  //! pop_batch() do not do anything anymore
+  bool has_peer_error() const { return peer_error; }
+
+ private:
+  // the indices are shared with another process, the acquire / release
+  // semantics order them with respect to the slot contents
+  static uint64_t load(const uint64_t *idx) {
+    return __atomic_load_n(idx, __ATOMIC_ACQUIRE);
+  }
+
+  static void store(uint64_t *idx, uint64_t v) {
+    __atomic_store_n(idx, v, __ATOMIC_RELEASE);
+  }
+
+  char *get_slot(uint64_t idx) const {
+    return slots + (idx & mask) * slot_size;
+  }
+
+  Indices *indices;
+  char *slots;
+  uint64_t mask;
+  uint32_t slot_size;
+  // private copies of the indices; only one of head / tail is written by this
+  // side, depending on whether it is the producer or the consumer
+  uint64_t head;
+  uint64_t tail;
+  // private copies of the other side's index, as last validated
+  uint64_t cached_head;
+  uint64_t cached_tail;
+  bool peer_error{false};
+};
+
+//! A named POSIX shared memory segment holding two ShmRing instances, one per
+//! direction. The switch creates the segment (and removes it when it is
+//! destroyed), the external process opens it by name. The segment starts with
+//! a header describing its geometry, so that only the name needs to be known
+//! by the external process.
+class ShmPacketChannel {
+ public:
+  //! Types of the messages exchanged through the rings. They match the
+  //! messages of the nanomsg packet-in backend, without INFO_REQ / INFO_REP.
+  enum MsgType : uint32_t {
+    MSG_TYPE_PORT_ADD = 0,
+    MSG_TYPE_PORT_REMOVE,
+    MSG_TYPE_PORT_SET_STATUS,
+    MSG_TYPE_PACKET_IN,
+    MSG_TYPE_PACKET_OUT
+  };
+
+  enum MsgPortStatus : uint32_t {
+    MSG_PORT_STATUS_DOWN = 0,
+    MSG_PORT_STATUS_UP
+  };
+
+  //! Creates (or re-creates) segment \p name, with \p nb_slots slots of \p
+  //! slot_size bytes in each direction. \p nb_slots is rounded up to a power of
+  //! 2. Returns nullptr on failure, with errno set.
+  static std::unique_ptr<ShmPacketChannel> create(const std::string &name,
+                                                  uint32_t nb_slots,
+                                                  uint32_t slot_size) {
+    uint32_t nb = 1;
+    while (nb < nb_slots) nb <<= 1;
+    // keeps slots (and their headers) aligned
+    slot_size = (slot_size + 63) & ~63u;
+    if (slot_size <= sizeof(ShmRing::ShmMsgHdr)) {
+      errno = EINVAL;
+      return nullptr;
+    }
+    const size_t size = map_size(nb, slot_size);
+    // a stale segment left by a switch which did not exit cleanly is reused
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+    if (fd < 0) return nullptr;
+    if (ftruncate(fd, 0) < 0 || ftruncate(fd, size) < 0) {
+      close_keep_errno(fd);
+      shm_unlink(name.c_str());
+      return nullptr;
+    }
+    void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close_keep_errno(fd);
+    if (addr == MAP_FAILED) {
+      shm_unlink(name.c_str());
+      return nullptr;
+    }
+    // the segment is zero-filled, i.e. both rings are empty
+    auto *hdr = static_cast<SegmentHdr *>(addr);
+    hdr->nb_slots = nb;
+    hdr->slot_size = slot_size;
+    hdr->version = kVersion;
+    // written last, the external process checks it before anything else
+    __atomic_store_n(&hdr->magic, kMagic, __ATOMIC_RELEASE);
+    return std::unique_ptr<ShmPacketChannel>(
+        new ShmPacketChannel(name, static_cast<char *>(addr), size, true));
+  }
+
+  //! Opens segment \p name, which must have been created with create().
+  //! Returns nullptr on failure (with errno set to EPROTO if the segment does
+  //! not have the expected format).
+  static std::unique_ptr<ShmPacketChannel> open(const std::string &name) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+      close_keep_errno(fd);
+      return nullptr;
+    }
+    const size_t size = static_cast<size_t>(st.st_size);
+    if (size < sizeof(SegmentHdr)) {
+      close(fd);
+      errno = EPROTO;
+      return nullptr;
+    }
+    void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close_keep_errno(fd);
+    if (addr == MAP_FAILED) return nullptr;
+    const auto *hdr = static_cast<SegmentHdr *>(addr);
+    if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != kMagic ||
+        hdr->version != kVersion ||
+        size != map_size(hdr->nb_slots, hdr->slot_size)) {
+      munmap(addr, size);
+      errno = EPROTO;
+      return nullptr;
+    }
+    return std::unique_ptr<ShmPacketChannel>(
+        new ShmPacketChannel(name, static_cast<char *>(addr), size, false));
+  }
+
+  ~ShmPacketChannel() {
+    munmap(map, size);
+    if (owner) shm_unlink(name.c_str());
+  }
+
+  //! Ring written by the external process and read by the switch
+  ShmRing *to_switch() { return &rings[0]; }
+
+  //! Ring written by the switch and read by the external process
+  ShmRing *from_switch() { return &rings[1]; }
+
+  const std::string &get_name() const { return name; }
+
+  ShmPacketChannel(const ShmPacketChannel &other) = delete;
+  ShmPacketChannel &operator=(const ShmPacketChannel &other) = delete;
+
+ private:
+  static constexpr uint32_t kMagic = 0x626d3273;  // "bm2s"
+  static constexpr uint32_t kVersion = 1;
+
+  struct alignas(64) SegmentHdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nb_slots;
+    uint32_t slot_size;
+  };
+
+  // header, then the indices of both rings, then the slots of both rings
+  static size_t map_size(uint32_t nb_slots, uint32_t slot_size) {
+    return sizeof(SegmentHdr) + 2 * sizeof(ShmRing::Indices) +
+        2 * static_cast<size_t>(nb_slots) * slot_size;
+  }
+
+  static void close_keep_errno(int fd) {
+    int e = errno;
+    close(fd);
+    errno = e;
+  }
+
+  ShmPacketChannel(const std::string &name, char *map, size_t size,
+                   bool owner)
+      : name(name), map(map), size(size), owner(owner),
+        rings{make_ring(map, 0), make_ring(map, 1)} { }
+
+  static ShmRing make_ring(char *map, int dir) {
+    const auto *hdr = reinterpret_cast<const SegmentHdr *>(map);
+    auto *indices = reinterpret_cast<ShmRing::Indices *>(
+        map + sizeof(SegmentHdr)) + dir;
+    char *slots = map + sizeof(SegmentHdr) + 2 * sizeof(ShmRing::Indices) +
+        dir * static_cast<size_t>(hdr->nb_slots) * hdr->slot_size;
+    return ShmRing(indices, slots, hdr->nb_slots, hdr->slot_size);
+  }
+
+  std::string name;
+  char *map;
+  size_t size;
+  bool owner;
+  ShmRing rings[2];
+};
+
+}  // namespace bm
+
+#endif  // BM_BM_SIM_SHM_RING_H_
@@ -93,6 +93,17 @@ class StackIface {
 //! references to the HeaderUnion / Header instances which constitute the stack,
 //! as well as the stack internal state (e.g. number of valid headers in the
 //! stack).
+//!
+//! Header stacks are circular: the stack maintains a base index into its
+//! elements and push_front() / pop_front() simply move that index (and update
+//! the validity of the elements which were pushed / popped) instead of
+//! shifting the field values. As a consequence, a Header instance does not
+//! always occupy the same position in the stack, and the PHV resolves the id
+//! of a stack element (e.g. `mpls[1]`) to the Header instance which currently
+//! occupies that position. References to stack elements obtained from the PHV
+//! should therefore not be kept across push_front() / pop_front() calls. Stacks
+//! of variable-length headers, as well as stacks of header unions, shift the
+//! values instead, which is linear in the stack depth.
 template <typename T>
 class Stack : public StackIface, public NamedP4Object {
  public:
@@ -122,7 +133,11 @@ class Stack : public StackIface, public NamedP4Object {
   T &get_next();
   const T &get_next() const;
 
+  //! Returns the element at position \p idx in the stack, with bound
+  //! checking. If \p idx is out of range, an exception of type
+  //! std::out_of_range is thrown.
   T &at(size_t idx);
+  //! @copydoc at
   const T &at(size_t idx) const;
 
  private:
@@ -133,9 +148,27 @@ class Stack : public StackIface, public NamedP4Object {
   // NOLINTNEXTLINE
   void set_next_element(T &e);
 
+  // position in the stack -> element, called by the PHV for every access to a
+  // header which belongs to a circular stack
+  T &get_element(size_t idx) {
+    size_t i = base + idx;
+    if (i >= elements.size()) i -= elements.size();
+    return elements[i];
+  }
+
+  const T &get_element(size_t idx) const {
+    size_t i = base + idx;
+    if (i >= elements.size()) i -= elements.size();
+    return elements[i];
+  }
+
   std::vector<TRef> elements{};
   // first empty index; if next == headers.size(), stack is full
   size_t next{0};
+  // index in elements of the first element of the stack, always 0 if the stack
+  // is not circular
+  size_t base{0};
+  bool circular{false};
 };
 
 using header_stack_id_t = p4object_id_t;
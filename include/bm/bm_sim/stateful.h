@@ -31,16 +31,28 @@
 //!   }
 //! };
 //! @endcode
+//!
+//! By default, a RegisterArray is protected by a single lock which every action
+//! referencing the array acquires for its whole duration. For stateful programs
+//! in which many threads touch different indices of the same array (sketches,
+//! bloom filters, per-flow counters...), this lock quickly becomes a point of
+//! contention. The RegisterArray::SyncMode enum gives two alternatives: striped
+//! per-index locking and, for registers no wider than 64 bits, lock-free atomic
+//! access. Both are meant to be used through the per-index methods
+//! (RegisterArray::read(), RegisterArray::write(), RegisterArray::fetch_add(),
+//! RegisterArray::compare_exchange(), ...), from primitives which override
+//! ActionPrimitive_::manages_register_sync().
 
 #ifndef BM_BM_SIM_STATEFUL_H_
 #define BM_BM_SIM_STATEFUL_H_
 
 #include <boost/thread/locks.hpp>  // for boost::lock
 
+#include <atomic>
 #include <string>
 #include <vector>
+#include <memory>
 #include <mutex>
-#include <unordered_set>
 #include <functional>
 
 #include "data.h"
@@ -97,7 +109,48 @@ class RegisterArray : public NamedP4Object {
   using iterator = std::vector<Register>::iterator;
   using const_iterator = std::vector<Register>::const_iterator;
 
-  using UniqueLock = std::unique_lock<std::mutex>;
+  //! Determines how concurrent accesses to the array are synchronized.
+  enum class SyncMode {
+    //! a single lock for the whole array (default)
+    ARRAY_LOCK,
+    //! one lock per stripe of indices; the per-index methods only acquire the
+    //! lock for the stripe of the index they access, and so do actions which
+    //! reference a register with a constant index. Actions which pass the
+    //! array to a legacy primitive, or use a computed index, acquire all the
+    //! stripes: without contention, this costs about 50 times as much as the
+    //! single lock of ARRAY_LOCK with the default 64 stripes, so this mode is
+    //! only worth it if most accesses use the per-index methods.
+    STRIPED,
+    //! registers are stored as 64-bit atomics and can only be accessed through
+    //! the per-index methods; only available if bitwidth <= 64. The array
+    //! cannot be referenced directly (with a constant or computed index) by
+    //! actions or expressions, which would need a Register reference.
+    LOCK_FREE
+  };
+
+  //! Default number of stripes used by SyncMode::STRIPED
+  static constexpr size_t default_num_stripes = 64;
+
+  //! Exclusive ownership of the whole array, as returned by unique_lock(). In
+  //! SyncMode::STRIPED, this means owning all the stripes, which are acquired
+  //! in order. In SyncMode::LOCK_FREE, nothing is locked.
+  class UniqueLock {
+   public:
+    explicit UniqueLock(const RegisterArray &register_array);
+    ~UniqueLock();
+
+    UniqueLock(UniqueLock &&other) noexcept;
+    UniqueLock &operator=(UniqueLock &&other) noexcept;
+
+    UniqueLock(const UniqueLock &other) = delete;
+    UniqueLock &operator=(const UniqueLock &other) = delete;
+
+    void unlock();
+
+   private:
+    std::mutex *stripes{nullptr};
+    size_t num_locked{0};
+  };
 
   //! Used to notify listeners that a write occurred in the array at \p idx. You
   //! can register your own notifier function by calling register_notifier().
@@ -106,26 +159,31 @@ class RegisterArray : public NamedP4Object {
   RegisterArray(const std::string &name, p4object_id_t id,
                 size_t size, int bitwidth);
 
-  //! Access the register at position \p idx, asserts if bad \p idx
+  //! Access the register at position \p idx, asserts if bad \p idx. Not
+  //! available in SyncMode::LOCK_FREE.
   Register &operator[](size_t idx) {
     assert(idx < size());
+    assert(sync_mode != SyncMode::LOCK_FREE);
     return registers[idx];
   }
 
   //! @copydoc operator[]
   const Register &operator[](size_t idx) const {
     assert(idx < size());
+    assert(sync_mode != SyncMode::LOCK_FREE);
     return registers[idx];
   }
 
   //! Access the register at position \p idx, throws a std::out_of_range
-  //! exception if \p idx is invalid
+  //! exception if \p idx is invalid. Not available in SyncMode::LOCK_FREE.
   Register &at(size_t idx) {
+    assert(sync_mode != SyncMode::LOCK_FREE);
     return registers.at(idx);
   }
 
   //! @copydoc at
   const Register &at(size_t idx) const {
+    assert(sync_mode != SyncMode::LOCK_FREE);
     return registers.at(idx);
   }
 
@@ -147,29 +205,92 @@ class RegisterArray : public NamedP4Object {
   //! includes)
   size_t size() const { return registers.size(); }
 
+  //! Return the width in bits of each register in the array
+  int get_bitwidth() const { return bitwidth; }
+
+  //! Change the synchronization mode of the array. \p num_stripes is only used
+  //! for SyncMode::STRIPED and is rounded up to a power of 2. The current
+  //! register values are preserved. This method is not thread-safe and must
+  //! not be called while packets are being processed; it is normally called
+  //! when the JSON is loaded, based on the `sync_mode` attribute of the array.
+  //! Returns false (and leaves the array unchanged) if SyncMode::LOCK_FREE is
+  //! requested for an array wider than 64 bits.
+  bool set_sync_mode(SyncMode mode,
+                     size_t num_stripes = default_num_stripes);
+
+  //! Return the current synchronization mode
+  SyncMode get_sync_mode() const { return sync_mode; }
+
+  // Per-index accessors. They can be called concurrently from any thread
+  // (including from an action primitive) in every SyncMode: they acquire the
+  // lock protecting \p idx, unless the calling thread already owns the array
+  // because the executing action or parse state referenced it. The uint64_t
+  // variants require bitwidth <= 64 and all values are truncated to bitwidth.
+
+  //! Copy the register at position \p idx to \p dst
+  void read(size_t idx, Data *dst) const;
+
+  //! Overwrite the register at position \p idx with \p src
+  void write(size_t idx, const Data &src);
+
+  //! Return the value of the register at position \p idx
+  uint64_t load(size_t idx) const;
+
+  //! Overwrite the register at position \p idx with \p v
+  void store(size_t idx, uint64_t v);
+
+  //! Atomically add \p v to the register at position \p idx (wrapping around
+  //! on overflow) and return the previous value
+  uint64_t fetch_add(size_t idx, uint64_t v);
+
+  //! Atomically OR \p v into the register at position \p idx and return the
+  //! previous value
+  uint64_t fetch_or(size_t idx, uint64_t v);
+
+  //! If the register at position \p idx is equal to \p *expected, replace it
+  //! with \p desired and return true. Otherwise, store its current value in \p
+  //! *expected and return false.
+  bool compare_exchange(size_t idx, uint64_t *expected, uint64_t desired);
+
   void reset_state();
 
   //! Register your own notifier function. Every time a write operation is
   //! performed on the register array, your notifier will be called, with the
   //! index at which the write happened as an argument. This method is not
-  //! thread-safe. Please request the lock using unique_lock() if needed.
+  //! thread-safe. Please request the lock using unique_lock() if needed. In
+  //! SyncMode::LOCK_FREE, notifiers are called after the write without any lock
+  //! held, so they may be called concurrently.
   void register_notifier(Notifier notifier);
 
   //! Request exclusive access to this register array. This method needs to be
   //! called when the target needs to read or write a register. Note that it is
   //! never necessary to call this method in a primitive action, since when an
   //! action is executed, it is guaranteed exclusive access to all the register
-  //! arrays it reads or writes.
-  UniqueLock unique_lock() const { return UniqueLock(m_mutex); }
+  //! arrays it reads or writes. The per-index accessors do not require it.
+  UniqueLock unique_lock() const { return UniqueLock(*this); }
   // NOLINTNEXTLINE(runtime/references)
   void unlock(UniqueLock &lock) const { lock.unlock(); }
 
  private:
+  class IndexLock;
+
   void notify(const Register &reg) const;
+  void notify(size_t idx) const;
+
+  std::mutex &stripe_for(size_t idx) const {
+    return stripes[idx & stripe_mask];
+  }
 
   std::vector<Register> registers{};
-  mutable std::mutex m_mutex{};
   int bitwidth{};
+  uint64_t value_mask{};
+  SyncMode sync_mode{SyncMode::ARRAY_LOCK};
+  size_t num_stripes{1};
+  size_t stripe_mask{0};
+  std::unique_ptr<std::mutex[]> stripes;
+  // only allocated in SyncMode::LOCK_FREE, in which case it holds the register
+  // values instead of the registers vector
+  std::unique_ptr<std::atomic<uint64_t>[]> atomic_values{nullptr};
   std::vector<Notifier> notifiers{};
 };
 
@@ -177,33 +298,67 @@ class RegisterArray : public NamedP4Object {
 // This class was added to provide some measure of concurrency support for
 // register accesses. Every time an action is executed, this action is given
 // exclusive access to all the registers it is referring to. Same thing for a
-// parse state.
+// parse state. Arrays in RegisterArray::SyncMode::LOCK_FREE are skipped. For
+// arrays in RegisterArray::SyncMode::STRIPED, only the stripes of the indices
+// referenced are acquired if all the indices are known in advance, otherwise
+// all the stripes are. The registers held by the current thread are tracked, so
+// that the RegisterArray per-index accessors do not try to acquire them a
+// second time.
 class RegisterSync {
  public:
-  using Lock = RegisterArray::UniqueLock;
+  using Lock = std::unique_lock<std::mutex>;
 
   template <size_t NumLocks = 4>
   using LockVector = std::vector<
     Lock, ::detail::short_alloc<Lock, NumLocks * sizeof(Lock), alignof(Lock)> >;
 
   struct RegisterLocks {
+    ~RegisterLocks();
+
     LockVector<>::allocator_type::arena_type a;
     LockVector<> v{a};
+    // to maintain the per-thread stack of held RegisterSync objects
+    const RegisterSync *sync{nullptr};
+    const RegisterLocks *prev{nullptr};
   };
 
+  // any register of the array may be accessed
   void add_register_array(const RegisterArray *register_array);
 
+  // only the register at position idx is accessed
+  void add_register_index(const RegisterArray *register_array, size_t idx);
+
+  // the array is only accessed through the RegisterArray per-index methods,
+  // which synchronize themselves; nothing is acquired for it, unless some
+  // specific indices are also referenced, in which case the whole array is
+  // acquired (holding some stripes while a per-index method waits for another
+  // one could deadlock)
+  void add_register_array_unlocked(const RegisterArray *register_array);
+
   void merge_from(const RegisterSync &other);
 
   // tried NRVO, but RegisterLocks not movable
-  void lock(RegisterLocks *RL) const {
-    for (auto m : mutexes) RL->v.emplace_back(*m, std::defer_lock);
-    boost::lock(RL->v.begin(), RL->v.end());
-  }
+  void lock(RegisterLocks *RL) const;
+
+  // true iff the calling thread currently holds the register at position idx
+  // of register_array through a RegisterSync::lock call
+  static bool is_held(const RegisterArray *register_array, size_t idx);
 
  private:
-  mutable std::vector<std::mutex *> mutexes{};
-  std::unordered_set<const RegisterArray *> register_arrays{};
+  enum class Access { UNLOCKED, INDICES, WHOLE };
+
+  struct ArrayAccess {
+    const RegisterArray *register_array;
+    Access access;
+    // sorted, only used for Access::INDICES
+    std::vector<size_t> indices;
+  };
+
+  void add(const RegisterArray *register_array, Access access, size_t idx);
+
+  std::vector<ArrayAccess> accesses{};
+
+  static thread_local const RegisterLocks *held;
 };
 
 }  // namespace bm
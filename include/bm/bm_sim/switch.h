@@ -74,6 +74,7 @@
 #include <typeinfo>
 #include <typeindex>
 #include <set>
+#include <tuple>
 #include <vector>
 #include <iosfwd>
 #include <condition_variable>
@@ -86,6 +87,8 @@
 #include "phv_source.h"
 #include "lookup_structures.h"
 #include "target_parser.h"
+#include "telemetry.h"
+#include "thread_placement.h"
 
 namespace bm {
 
@@ -146,6 +149,13 @@ class SwitchWContexts : public DevMgr, public RuntimeInterface {
   //! Disable JSON config swapping for the switch.
   void disable_config_swap();
 
+  //! Use resilient hashing (see ResilientGroupSelector) with \p nb_buckets
+  //! buckets per group to select members in all the action profiles with
+  //! selection, including the ones of configs loaded later. It has to be called
+  //! before any member is added, e.g. right after
+  //! init_from_command_line_options().
+  void enable_resilient_group_selection(size_t nb_buckets);
+
   //! Specify that the field is required for this target switch, i.e. the field
   //! needs to be defined in the input JSON. This function is purely meant as a
   //! safeguard and you should use it for error checking. For example, the
@@ -268,6 +278,15 @@ class SwitchWContexts : public DevMgr, public RuntimeInterface {
   //! be using. See switch.h documentation for more information.
   int do_swap();
 
+  //! Stages \p p4objects, which were built outside of the switch (e.g. by a
+  //! program linker running in a background thread), as the new configuration
+  //! of context \p cxt_id. As with load_new_config(), the new configuration is
+  //! only used once swap_configs() is called; until then, packets keep being
+  //! processed with the current one. Returns `ONGOING_SWAP` if a configuration
+  //! is already staged for the context.
+  RuntimeInterface::ErrorCode load_new_objects(
+      size_t cxt_id, std::shared_ptr<P4Objects> p4objects);
+
   //! Construct and return a Packet instance for the given \p cxt_id.
   std::unique_ptr<Packet> new_packet_ptr(size_t cxt_id, int ingress_port,
                                          packet_id_t id, int ingress_length,
@@ -551,6 +570,33 @@ class SwitchWContexts : public DevMgr, public RuntimeInterface {
     return contexts.at(cxt_id).mt_get_entries<MatchTableIndirectWS>(table_name);
   }
 
+  MatchErrorCode
+  mt_get_entries_page(size_t cxt_id, const std::string &table_name,
+                      size_t max_entries,
+                      MatchTableAbstract::EntryCursor *cursor,
+                      std::vector<MatchTable::Entry> *entries) const override {
+    return contexts.at(cxt_id).mt_get_entries_page<MatchTable>(
+        table_name, max_entries, cursor, entries);
+  }
+
+  MatchErrorCode
+  mt_indirect_get_entries_page(
+      size_t cxt_id, const std::string &table_name, size_t max_entries,
+      MatchTableAbstract::EntryCursor *cursor,
+      std::vector<MatchTableIndirect::Entry> *entries) const override {
+    return contexts.at(cxt_id).mt_get_entries_page<MatchTableIndirect>(
+        table_name, max_entries, cursor, entries);
+  }
+
+  MatchErrorCode
+  mt_indirect_ws_get_entries_page(
+      size_t cxt_id, const std::string &table_name, size_t max_entries,
+      MatchTableAbstract::EntryCursor *cursor,
+      std::vector<MatchTableIndirectWS::Entry> *entries) const override {
+    return contexts.at(cxt_id).mt_get_entries_page<MatchTableIndirectWS>(
+        table_name, max_entries, cursor, entries);
+  }
+
   MatchErrorCode
   mt_get_entry(size_t cxt_id, const std::string &table_name,
                entry_handle_t handle, MatchTable::Entry *entry) const override {
@@ -759,6 +805,12 @@ class SwitchWContexts : public DevMgr, public RuntimeInterface {
   RuntimeInterface::ErrorCode
   serialize(std::ostream *out) override;
 
+  std::string
+  get_telemetry() override;
+
+  RuntimeInterface::ErrorCode
+  reset_telemetry() override;
+
   RuntimeInterface::ErrorCode
   load_new_config(const std::string &new_config) override;
 
@@ -827,6 +879,17 @@ class SwitchWContexts : public DevMgr, public RuntimeInterface {
   int deserialize(std::istream *in);
   int deserialize_from_file(const std::string &state_dump_path);
 
+  //! Targets register their threads and queues with this object for them to
+  //! be included in the output of get_telemetry().
+  TelemetryRegistry *get_telemetry_registry() { return &telemetry_registry; }
+
+  //! Targets call this at the beginning of each of their processing threads
+  //! to apply the `--cpu-affinity` configuration, see ThreadPlacement. Returns
+  //! the core the thread was pinned to, or -1.
+  int place_thread(const std::string &thread_class, size_t index = 0) const {
+    return thread_placement.place_current_thread(thread_class, index);
+  }
+
  private:
   //! LinkerSwitch:
   //! virtuality gives possible control to intercept the init calls in linker
@@ -900,6 +963,10 @@ class SwitchWContexts : public DevMgr, public RuntimeInterface {
   mutable std::mutex config_mutex{};
 
   std::string event_logger_addr{};
+
+  TelemetryRegistry telemetry_registry{};
+
+  ThreadPlacement thread_placement{};
 };
 
 
@@ -980,6 +1047,25 @@ class Switch : public SwitchWContexts {
     return get_context(0)->get_action_id(table_name, action_name);
   }
 
+  //! See Context::get_match_table(). This pointer will be invalidated if a
+  //! configuration swap is performed by the target.
+  MatchTableAbstract *get_match_table(const std::string &name) {
+    return get_context(0)->get_match_table(name);
+  }
+
+  //! See Context::get_action(). This pointer will be invalidated if a
+  //! configuration swap is performed by the target.
+  ActionFn *get_action(const std::string &table_name,
+                       const std::string &action_name) {
+    return get_context(0)->get_action(table_name, action_name);
+  }
+
+  //! See Context::get_field_info()
+  std::tuple<header_id_t, int> get_field_info(const std::string &header_name,
+                                              const std::string &field_name) {
+    return get_context(0)->get_field_info(header_name, field_name);
+  }
+
   // to avoid C++ name hiding
   using SwitchWContexts::get_learn_engine;
   //! Obtain a pointer to the LearnEngine for this Switch instance
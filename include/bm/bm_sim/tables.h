@@ -53,6 +53,9 @@ class MatchActionTable : public ControlFlowNode {
   const ControlFlowNode *operator()(Packet *pkt) const override;
 
   MatchTableAbstract *get_match_table() { return match_table.get(); }
+  const MatchTableAbstract *get_match_table() const {
+    return match_table.get();
+  }
 
  public:
   template <typename MT>
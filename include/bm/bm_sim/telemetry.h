@@ -0,0 +1,326 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+//! @file telemetry.h
+//! Always-on, low-overhead performance counters and latency histograms for the
+//! packet processing stages (match tables, parsers, deparsers, queues and
+//! target threads). The data path only updates per-thread slots with relaxed
+//! atomic operations; the slots are aggregated when the telemetry is read
+//! (e.g. through the `bm_get_telemetry` runtime call).
+
+#ifndef BM_BM_SIM_TELEMETRY_H_
+#define BM_BM_SIM_TELEMETRY_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Json {
+
+class Value;
+
+}  // namespace Json
+
+namespace bm {
+
+//! Global switch for the telemetry. When disabled, the timers do not read the
+//! clock and nothing is recorded. Telemetry is enabled by default.
+class Telemetry {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  //! Maximum number of per-thread slots for each counter / histogram. Threads
+  //! are assigned a slot in a round-robin fashion, so if there are more
+  //! threads than slots, some threads will share a slot (which is still
+  //! correct, only slower).
+  static constexpr size_t max_slots = 16;
+
+  static bool is_enabled() {
+    return enabled.load(std::memory_order_relaxed);
+  }
+
+  static void set_enabled(bool enable) {
+    enabled.store(enable, std::memory_order_relaxed);
+  }
+
+  //! Returns the slot assigned to the calling thread
+  static size_t thread_slot();
+
+  static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        clock::now().time_since_epoch()).count();
+  }
+
+ private:
+  static std::atomic<bool> enabled;
+};
+
+//! A monotonic event counter, sharded by thread.
+class TelemetryCounter {
+ public:
+  void increment(uint64_t v = 1) {
+    slots[Telemetry::thread_slot()].v.fetch_add(v, std::memory_order_relaxed);
+  }
+
+  //! Sum of all the per-thread slots
+  uint64_t get() const;
+
+  void reset();
+
+ private:
+  // padded to a cache line to avoid false sharing between threads
+  struct Slot {
+    std::atomic<uint64_t> v{0};
+    char pad[64 - sizeof(std::atomic<uint64_t>)];
+  };
+
+  std::array<Slot, Telemetry::max_slots> slots{};
+};
+
+//! A log-linear histogram, similar to HdrHistogram: values are recorded with a
+//! relative precision of 1 / 2^sub_bucket_bits (12.5%) up to 2^max_value_bits
+//! (values above are clamped). Used to record latencies in nanoseconds, but
+//! any unsigned value (e.g. a queue depth) can be recorded. Per-thread slots
+//! are allocated on first use by a thread.
+class TelemetryHistogram {
+ public:
+  static constexpr int sub_bucket_bits = 3;
+  static constexpr int max_value_bits = 40;
+  static constexpr size_t nb_buckets =
+      (max_value_bits - sub_bucket_bits + 1) << sub_bucket_bits;
+
+  //! Aggregated view of the histogram
+  struct Snapshot {
+    uint64_t count{0};
+    uint64_t sum{0};
+    std::vector<uint64_t> buckets{};
+
+    uint64_t min() const;
+    uint64_t max() const;
+    double mean() const;
+    //! Highest value equivalent to the value at the given percentile (in
+    //! [0, 100]), i.e. the reported value is never below the real one.
+    uint64_t percentile(double p) const;
+
+    //! Writes count, mean, min, max, p50, p90, p99 and p999 to \p out
+    void dump_json(Json::Value *out) const;
+  };
+
+  TelemetryHistogram();
+  ~TelemetryHistogram();
+
+  TelemetryHistogram(const TelemetryHistogram &other) = delete;
+  TelemetryHistogram &operator=(const TelemetryHistogram &other) = delete;
+
+  void record(uint64_t v) {
+    Slot *slot = get_slot();
+    slot->buckets[bucket_index(v)].fetch_add(1, std::memory_order_relaxed);
+    slot->count.fetch_add(1, std::memory_order_relaxed);
+    slot->sum.fetch_add(v, std::memory_order_relaxed);
+  }
+
+  Snapshot get_snapshot() const;
+
+  void reset();
+
+  static size_t bucket_index(uint64_t v);
+  //! Smallest value mapped to bucket \p idx
+  static uint64_t bucket_lowest(size_t idx);
+  //! Highest value mapped to bucket \p idx
+  static uint64_t bucket_highest(size_t idx);
+
+ private:
+  struct Slot {
+    std::array<std::atomic<uint64_t>, nb_buckets> buckets{};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum{0};
+  };
+
+  Slot *get_slot() {
+    auto &s = slots[Telemetry::thread_slot()];
+    Slot *slot = s.load(std::memory_order_acquire);
+    return slot ? slot : allocate_slot(&s);
+  }
+
+  Slot *allocate_slot(std::atomic<Slot *> *s);
+
+  std::array<std::atomic<Slot *>, Telemetry::max_slots> slots{};
+};
+
+//! RAII helper which records the time spent in a scope (in nanoseconds) into
+//! a histogram.
+class TelemetryTimer {
+ public:
+  explicit TelemetryTimer(TelemetryHistogram *histogram)
+      : histogram(Telemetry::is_enabled() ? histogram : nullptr) {
+    if (this->histogram) start = Telemetry::clock::now();
+  }
+
+  ~TelemetryTimer() {
+    stop();
+  }
+
+  //! Records the time elapsed since construction, if it has not been recorded
+  //! yet. Can be used to end the measurement before the end of the scope.
+  void stop() {
+    if (!histogram) return;
+    histogram->record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Telemetry::clock::now() - start).count());
+    histogram = nullptr;
+  }
+
+  TelemetryTimer(const TelemetryTimer &other) = delete;
+  TelemetryTimer &operator=(const TelemetryTimer &other) = delete;
+
+ private:
+  TelemetryHistogram *histogram;
+  Telemetry::clock::time_point start{};
+};
+
+//! Per match table statistics
+struct TableTelemetry {
+  TelemetryCounter hits{};
+  TelemetryCounter misses{};
+  TelemetryHistogram lookup_ns{};
+
+  void dump_json(Json::Value *out) const;
+  void reset();
+};
+
+//! Per queue statistics, updated by the queueing logic. The depth is sampled
+//! every time a packet is enqueued, the sojourn time is measured between
+//! enqueue and dequeue.
+struct QueueTelemetry {
+  TelemetryCounter enqueued{};
+  TelemetryCounter dropped{};
+  TelemetryHistogram depth{};
+  TelemetryHistogram sojourn_ns{};
+
+  void dump_json(Json::Value *out) const;
+  void reset();
+};
+
+//! Flow cache statistics, see FlowCache. A lookup is either a hit or a miss;
+//! misses whose traversal could not be cached are also counted as
+//! uncacheable. The cost of invalidating the cache (after a table update or a
+//! config swap) is measured by the flushes, the number of entries they drop
+//! and the time they take; the cost of re-populating it by the misses and
+//! their processing time, which includes the recording of the traversal.
+struct FlowCacheTelemetry {
+  TelemetryCounter hits{};
+  TelemetryCounter misses{};
+  TelemetryCounter uncacheable{};
+  TelemetryCounter flushes{};
+  TelemetryCounter flushed_entries{};
+  TelemetryHistogram flush_ns{};
+  TelemetryHistogram miss_ns{};
+  //! current number of entries, not affected by reset()
+  std::atomic<uint64_t> entries{0};
+
+  void dump_json(Json::Value *out) const;
+  void reset();
+};
+
+//! Busy / idle time accounting for a target thread. The owning thread marks
+//! the periods during which it is blocked waiting for work (typically around
+//! a blocking queue pop) with an IdleScope; the rest of the time since the
+//! last reset is considered busy. Can be read from any thread.
+class ThreadActivity {
+ public:
+  class IdleScope {
+   public:
+    explicit IdleScope(ThreadActivity *activity)
+        : activity(activity) {
+      activity->idle_begin();
+    }
+
+    ~IdleScope() {
+      activity->idle_end();
+    }
+
+    IdleScope(const IdleScope &other) = delete;
+    IdleScope &operator=(const IdleScope &other) = delete;
+
+   private:
+    ThreadActivity *activity;
+  };
+
+  explicit ThreadActivity(const std::string &name);
+
+  const std::string &get_name() const { return name; }
+
+  void idle_begin();
+  void idle_end();
+
+  uint64_t get_idle_ns() const;
+  uint64_t get_busy_ns() const;
+
+  void dump_json(Json::Value *out) const;
+  void reset();
+
+ private:
+  // all times in ns since the clock's epoch
+  uint64_t get_idle_ns(uint64_t now) const;
+
+  const std::string name;
+  std::atomic<uint64_t> start_ns;
+  std::atomic<uint64_t> idle_ns{0};
+  // 0 when the thread is busy
+  std::atomic<uint64_t> idle_since_ns{0};
+};
+
+//! Telemetry objects which do not belong to a P4 program (and therefore are
+//! not owned by a Context), e.g. target threads and queues. Owned by the
+//! switch, targets register their objects with it.
+class TelemetryRegistry {
+ public:
+  //! Creates a new ThreadActivity instance, owned by the registry. The
+  //! returned pointer remains valid for the lifetime of the registry.
+  ThreadActivity *register_thread(const std::string &name);
+
+  //! Registers a QueueTelemetry instance owned by the target. Queues which
+  //! have not seen any traffic are omitted from the dump.
+  void register_queue(const std::string &name, QueueTelemetry *queue);
+
+  //! Registers a FlowCacheTelemetry instance owned by the target. Caches
+  //! which have not been used are omitted from the dump.
+  void register_flow_cache(const std::string &name,
+                           FlowCacheTelemetry *flow_cache);
+
+  //! Writes the "threads", "queues" and "flow_caches" members of \p out
+  void dump_json(Json::Value *out) const;
+
+  void reset();
+
+ private:
+  mutable std::mutex mutex{};
+  std::vector<std::unique_ptr<ThreadActivity> > threads{};
+  std::vector<std::pair<std::string, QueueTelemetry *> > queues{};
+  std::vector<std::pair<std::string, FlowCacheTelemetry *> > flow_caches{};
+};
+
+}  // namespace bm
+
+#endif  // BM_BM_SIM_TELEMETRY_H_
@@ -0,0 +1,76 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+//! @file thread_placement.h
+
+#ifndef BM_BM_SIM_THREAD_PLACEMENT_H_
+#define BM_BM_SIM_THREAD_PLACEMENT_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace bm {
+
+//! Pins target threads to CPU cores and binds the memory they allocate to the
+//! NUMA node of their core. Threads are grouped in classes (e.g. "ingress",
+//! "egress", "transmit" for simple_switch) and each class is assigned a list
+//! of cores, typically with the `--cpu-affinity` command-line option. Thread
+//! number `i` of a class is pinned to core `i % n` of the list, where `n` is
+//! the size of the list. Threads of a class without a core list are left
+//! alone.
+//!
+//! Once a thread is pinned, its memory policy is set to prefer the NUMA node
+//! of its core, so that everything it allocates (e.g. PHVs, packet copies and
+//! queue blocks) is local to the core which processes it. On non-NUMA systems
+//! (or on platforms other than Linux) only the pinning is done, when
+//! possible.
+class ThreadPlacement {
+ public:
+  //! Parses a list of cores, e.g. `"0-3,8,10-11"`. Returns false if \p str is
+  //! not a valid list (including if a core id is greater than 65535), in which
+  //! case \p cores is left unchanged.
+  static bool parse_core_list(const std::string &str, std::vector<int> *cores);
+
+  //! Returns the NUMA node of \p core, or -1 if it cannot be determined.
+  static int get_numa_node(int core);
+
+  //! Sets the list of cores for threads of class \p thread_class.
+  void set_cores(const std::string &thread_class, std::vector<int> cores);
+
+  //! Returns true if a core list was provided for \p thread_class.
+  bool has_cores(const std::string &thread_class) const;
+
+  //! Pins the calling thread, which is thread number \p index of class \p
+  //! thread_class, and logs the placement. Returns the core the thread was
+  //! pinned to, or -1 if the class has no core list or if pinning failed.
+  int place_current_thread(const std::string &thread_class,
+                           size_t index = 0) const;
+
+  //! Logs the configured core lists, with their NUMA nodes
+  void log_config() const;
+
+ private:
+  std::map<std::string, std::vector<int> > cores_by_class{};
+};
+
+}  // namespace bm
+
+#endif  // BM_BM_SIM_THREAD_PLACEMENT_H_
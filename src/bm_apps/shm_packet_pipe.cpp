@@ -0,0 +1,221 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <bm/bm_apps/shm_packet_pipe.h>
+
+// header-only, libbmapps does not depend on libbmsim
+#include <bm/bm_sim/shm_ring.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace bm_apps {
+
+namespace {
+
+constexpr size_t batch_size = 64;
+constexpr unsigned int rx_spin_count = 1024;
+constexpr auto rx_idle_sleep = std::chrono::microseconds(50);
+
+}  // namespace
+
+class ShmPacketInjectImp final {
+  using PacketReceiveCb = ShmPacketInject::PacketReceiveCb;
+  using Packet = ShmPacketInject::Packet;
+  using ShmPacketChannel = bm::ShmPacketChannel;
+  using ShmRing = bm::ShmRing;
+
+ public:
+  explicit ShmPacketInjectImp(const std::string &shm_name)
+      : shm_name(shm_name) { }
+
+  ~ShmPacketInjectImp() {
+    if (started) {
+      stop_receive_thread = true;
+      receive_thread.join();
+    }
+  }
+
+  bool start() {
+    std::unique_lock<std::mutex> lock(tx_mutex);
+    if (started) return true;
+    channel = ShmPacketChannel::open(shm_name);
+    if (!channel) return false;
+    max_packet_size = static_cast<int>(
+        channel->to_switch()->max_data_size());
+    receive_thread = std::thread(&ShmPacketInjectImp::receive_loop, this);
+    started = true;
+    return true;
+  }
+
+  void set_packet_receiver(const PacketReceiveCb &cb, void *cookie) {
+    std::unique_lock<std::mutex> lock(cb_mutex);
+    cb_fn = cb;
+    cb_cookie = cookie;
+  }
+
+  size_t send_batch(const Packet *pkts, size_t num_pkts) {
+    std::unique_lock<std::mutex> lock(tx_mutex);
+    if (!started) return 0;
+    std::array<ShmRing::MsgDesc, batch_size> msgs;
+    size_t sent = 0;
+    while (sent < num_pkts) {
+      size_t n = 0;
+      for (; n < batch_size && sent + n < num_pkts; n++) {
+        const auto &pkt = pkts[sent + n];
+        if (pkt.len < 0 || pkt.len > max_packet_size) break;
+        msgs[n] = {ShmPacketChannel::MSG_TYPE_PACKET_IN, pkt.port_num,
+                   static_cast<uint32_t>(pkt.len), pkt.buffer};
+      }
+      const size_t pushed = channel->to_switch()->push_batch(msgs.data(), n);
+      sent += pushed;
+      if (pushed < batch_size) break;
+    }
+    return sent;
+  }
+
+  int get_max_packet_size() const {
+    std::unique_lock<std::mutex> lock(tx_mutex);
+    return max_packet_size;
+  }
+
+  void send_port_msg(uint32_t type, int port_num, uint32_t more) {
+    const ShmRing::MsgDesc msg{type, port_num, more, nullptr};
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(tx_mutex);
+        if (!started || channel->to_switch()->push_batch(&msg, 1) == 1)
+          return;
+      }
+      std::this_thread::yield();
+    }
+  }
+
+ private:
+  void receive_loop() {
+    auto *ring = channel->from_switch();
+    PacketReceiveCb cb_fn_;
+    void *cb_cookie_ = nullptr;
+    const uint32_t max_data_size = std::min<uint32_t>(
+        ring->max_data_size(), std::numeric_limits<int>::max());
+    auto handle = [&cb_fn_, &cb_cookie_, max_data_size](
+        const ShmRing::ShmMsgHdr &hdr, const char *data) {
+      // others are ignored, as are packets with a length that does not fit in
+      // a slot
+      if (cb_fn_ && hdr.type == ShmPacketChannel::MSG_TYPE_PACKET_OUT &&
+          hdr.more <= max_data_size)
+        cb_fn_(hdr.port, data, static_cast<int>(hdr.more), cb_cookie_);
+    };
+    unsigned int idle = 0;
+    while (!stop_receive_thread) {
+      {
+        // copied once per batch instead of holding the lock for the callback
+        std::unique_lock<std::mutex> lock(cb_mutex);
+        cb_fn_ = cb_fn;
+        cb_cookie_ = cb_cookie;
+      }
+      if (ring->pop_batch(batch_size, handle) > 0) {
+        idle = 0;
+      } else if (idle < rx_spin_count) {
+        idle++;
+        std::this_thread::yield();
+      } else {
+        std::this_thread::sleep_for(rx_idle_sleep);
+      }
+    }
+  }
+
+  std::string shm_name;
+  std::unique_ptr<ShmPacketChannel> channel{nullptr};
+  int max_packet_size{0};
+
+  PacketReceiveCb cb_fn{};
+  void *cb_cookie{nullptr};
+  mutable std::mutex cb_mutex{};
+  std::thread receive_thread{};
+  std::atomic<bool> stop_receive_thread{false};
+  bool started{false};
+  // the ring to the switch has a single producer
+  mutable std::mutex tx_mutex{};
+};
+
+ShmPacketInject::ShmPacketInject(const std::string &shm_name)
+    : pimp(new ShmPacketInjectImp(shm_name)) { }
+
+ShmPacketInject::~ShmPacketInject() = default;
+
+bool
+ShmPacketInject::start() {
+  return pimp->start();
+}
+
+void
+ShmPacketInject::set_packet_receiver(const PacketReceiveCb &cb,
+                                     void *cookie) {
+  pimp->set_packet_receiver(cb, cookie);
+}
+
+bool
+ShmPacketInject::send(int port_num, const char *buffer, int len) {
+  const Packet pkt{port_num, buffer, len};
+  return pimp->send_batch(&pkt, 1) == 1;
+}
+
+size_t
+ShmPacketInject::send_batch(const Packet *pkts, size_t num_pkts) {
+  return pimp->send_batch(pkts, num_pkts);
+}
+
+int
+ShmPacketInject::get_max_packet_size() const {
+  return pimp->get_max_packet_size();
+}
+
+void
+ShmPacketInject::port_add(int port_num) {
+  pimp->send_port_msg(bm::ShmPacketChannel::MSG_TYPE_PORT_ADD, port_num, 0);
+}
+
+void
+ShmPacketInject::port_remove(int port_num) {
+  pimp->send_port_msg(bm::ShmPacketChannel::MSG_TYPE_PORT_REMOVE, port_num,
+                      0);
+}
+
+void
+ShmPacketInject::port_bring_up(int port_num) {
+  pimp->send_port_msg(bm::ShmPacketChannel::MSG_TYPE_PORT_SET_STATUS,
+                      port_num, bm::ShmPacketChannel::MSG_PORT_STATUS_UP);
+}
+
+void
+ShmPacketInject::port_bring_down(int port_num) {
+  pimp->send_port_msg(bm::ShmPacketChannel::MSG_TYPE_PORT_SET_STATUS,
+                      port_num, bm::ShmPacketChannel::MSG_PORT_STATUS_DOWN);
+}
+
+}  // namespace bm_apps
@@ -588,6 +588,33 @@ public:
     }
   }
 
+  template <typename M,
+            MatchErrorCode (RuntimeInterface::*GetFn)(
+                size_t, const std::string &, size_t,
+                MatchTableAbstract::EntryCursor *,
+                std::vector<typename M::Entry> *) const>
+  void get_entries_page_common(size_t cxt_id, const std::string &table_name,
+                               size_t max_entries,
+                               MatchTableAbstract::EntryCursor *cursor,
+                               std::vector<BmMtEntry> &_return) {
+    std::vector<typename M::Entry> entries;
+    auto rc = std::bind(GetFn, switch_, cxt_id, table_name, max_entries,
+                        cursor, &entries)();
+    if(rc != MatchErrorCode::SUCCESS) {
+      InvalidTableOperation ito;
+      ito.code = get_exception_code(rc);
+      throw ito;
+    }
+    _return.reserve(entries.size());
+    for (const auto &entry : entries) {
+      BmMtEntry e;
+      copy_match_part_entry(&e, entry);
+      build_action_entry(&e.action_entry, entry);
+      copy_entry_life_info(&e, entry);
+      _return.push_back(std::move(e));
+    }
+  }
+
   template <typename M,
             MatchErrorCode (RuntimeInterface::*GetFn)(
                 size_t, const std::string &, entry_handle_t, typename M::Entry *) const>
@@ -627,6 +654,48 @@ public:
     }
   }
 
+  void bm_mt_get_entries_page(BmMtEntriesPage& _return, const int32_t cxt_id, const std::string& table_name, const BmMtEntriesCursor& cursor, const int32_t max_entries) {
+    Logger::get()->trace("bm_mt_get_entries_page");
+    if (max_entries <= 0) {
+      InvalidTableOperation ito;
+      ito.code = TableOperationErrorCode::ERROR;
+      throw ito;
+    }
+    MatchTableAbstract::EntryCursor bm_cursor;
+    bm_cursor.position = static_cast<uint64_t>(cursor.position);
+    bm_cursor.version = static_cast<uint64_t>(cursor.version);
+    bm_cursor.done = cursor.done;
+    bm_cursor.modified = cursor.modified;
+    switch (switch_->mt_get_type(cxt_id, table_name)) {
+      case MatchTableType::NONE:
+        {
+          InvalidTableOperation ito;
+          ito.code = TableOperationErrorCode::INVALID_TABLE_NAME;
+          throw ito;
+        }
+      case MatchTableType::SIMPLE:
+        get_entries_page_common<MatchTable,
+                                &RuntimeInterface::mt_get_entries_page>(
+            cxt_id, table_name, max_entries, &bm_cursor, _return.entries);
+        break;
+      case MatchTableType::INDIRECT:
+        get_entries_page_common<
+          MatchTableIndirect, &RuntimeInterface::mt_indirect_get_entries_page>(
+              cxt_id, table_name, max_entries, &bm_cursor, _return.entries);
+        break;
+      case MatchTableType::INDIRECT_WS:
+        get_entries_page_common<
+          MatchTableIndirectWS,
+          &RuntimeInterface::mt_indirect_ws_get_entries_page>(
+              cxt_id, table_name, max_entries, &bm_cursor, _return.entries);
+        break;
+    }
+    _return.cursor.position = static_cast<int64_t>(bm_cursor.position);
+    _return.cursor.version = static_cast<int64_t>(bm_cursor.version);
+    _return.cursor.done = bm_cursor.done;
+    _return.cursor.modified = bm_cursor.modified;
+  }
+
   void bm_mt_get_entry(BmMtEntry& _return, const int32_t cxt_id, const std::string& table_name, const BmEntryHandle entry_handle) {
     Logger::get()->trace("bm_mt_get_entry");
     switch (switch_->mt_get_type(cxt_id, table_name)) {
@@ -1177,6 +1246,16 @@ public:
     _return.append(stream.str());
   }
 
+  void bm_get_telemetry(std::string& _return) {
+    Logger::get()->trace("bm_get_telemetry");
+    _return.append(switch_->get_telemetry());
+  }
+
+  void bm_reset_telemetry() {
+    Logger::get()->trace("bm_reset_telemetry");
+    switch_->reset_telemetry();
+  }
+
 private:
   SwitchWContexts *switch_;
 };
@@ -19,12 +19,14 @@
  */
 
 #include <bm/bm_sim/P4Objects.h>
+#include <bm/bm_sim/group_selection.h>
 #include <bm/bm_sim/phv.h>
 
 #include <istream>
 #include <ostream>
 #include <string>
 #include <tuple>
+#include <unordered_map>
 #include <vector>
 #include <set>
 #include <exception>
@@ -111,6 +113,19 @@ class ExceptionFormatter {
 
 using EFormat = ExceptionFormatter;
 
+// registers in lock-free mode are not stored as Register objects, they can only
+// be accessed through the per-index RegisterArray methods
+void check_register_ref(const RegisterArray *register_array,
+                        const Json::Value &cfg) {
+  if (register_array->get_sync_mode() == RegisterArray::SyncMode::LOCK_FREE) {
+    throw json_exception(
+        EFormat() << "Register array '" << register_array->get_name()
+                  << "' uses sync_mode 'lock_free' and cannot be accessed "
+                  << "directly with an index",
+        cfg);
+  }
+}
+
 }  // namespace
 
 
@@ -338,17 +353,17 @@ P4Objects::build_expression(const Json::Value &json_expression,
     // TODO(antonin): cheap optimization
     // this may not be worth doing, and probably does not belong here
     const auto register_array_name = json_value[0].asString();
+    auto register_array = get_register_array(register_array_name);
+    check_register_ref(register_array, json_value);
     const auto &json_index = json_value[1];
     assert(json_index.size() == 2);
     if (json_index["type"].asString() == "hexstr") {
       const auto idx = hexstr_to_int<unsigned int>(
           json_index["value"].asString());
-      expr->push_back_load_register_ref(
-          get_register_array(register_array_name), idx);
+      expr->push_back_load_register_ref(register_array, idx);
     } else {
       build_expression(json_index, expr);
-      expr->push_back_load_register_gen(
-          get_register_array(register_array_name));
+      expr->push_back_load_register_gen(register_array);
     }
     *expr_type = ExprType::DATA;
   } else if (type == "header_stack") {
@@ -480,20 +495,20 @@ P4Objects::add_primitive_to_action(const Json::Value &cfg_primitive,
       // this may not be worth doing, and probably does not belong here
       const auto &cfg_register = cfg_parameter["value"];
       const auto register_array_name = cfg_register[0].asString();
+      auto register_array = get_register_array(register_array_name);
+      check_register_ref(register_array, cfg_parameter);
       auto &json_index = cfg_register[1];
       assert(json_index.size() == 2);
       if (json_index["type"].asString() == "hexstr") {
         const auto idx = hexstr_to_int<unsigned int>(
             json_index["value"].asString());
-        action_fn->parameter_push_back_register_ref(
-            get_register_array(register_array_name), idx);
+        action_fn->parameter_push_back_register_ref(register_array, idx);
       } else {
         auto idx_expr = new ArithExpression();
         build_expression(json_index, idx_expr);
         idx_expr->build();
         action_fn->parameter_push_back_register_gen(
-            get_register_array(register_array_name),
-            std::unique_ptr<ArithExpression>(idx_expr));
+            register_array, std::unique_ptr<ArithExpression>(idx_expr));
       }
     } else if (type == "extern") {
       const auto name = cfg_parameter["value"].asString();
@@ -1058,6 +1073,7 @@ P4Objects::init_parsers(const Json::Value &cfg_root, InitState *init_state) {
           std::unique_ptr<ActionFn> action_fn(new ActionFn(
               primitive_name, 0, 0));
           add_primitive_to_action(cfg_parameters[0], action_fn.get());
+          action_fn->compile();
           parse_state->add_method_call(action_fn.get());
           parse_methods.push_back(std::move(action_fn));
         } else if (op_type == "shift") {
@@ -1306,6 +1322,30 @@ P4Objects::init_register_arrays(const Json::Value &cfg_root) {
 
     RegisterArray *register_array = new RegisterArray(name, id, size, bitwidth);
     add_register_array(name, unique_ptr<RegisterArray>(register_array));
+
+    if (!cfg_register_array.isMember("sync_mode")) continue;
+    using SyncMode = RegisterArray::SyncMode;
+    static const std::unordered_map<std::string, SyncMode> sync_modes = {
+      {"array_lock", SyncMode::ARRAY_LOCK},
+      {"striped", SyncMode::STRIPED},
+      {"lock_free", SyncMode::LOCK_FREE}};
+    const auto sync_mode_str = cfg_register_array["sync_mode"].asString();
+    const auto it = sync_modes.find(sync_mode_str);
+    if (it == sync_modes.end()) {
+      throw json_exception(
+          EFormat() << "Invalid sync_mode '" << sync_mode_str
+                    << "' for register array '" << name << "'",
+          cfg_register_array);
+    }
+    const size_t num_stripes = cfg_register_array.get(
+        "num_stripes", static_cast<Json::UInt>(
+            RegisterArray::default_num_stripes)).asUInt();
+    if (!register_array->set_sync_mode(it->second, num_stripes)) {
+      throw json_exception(
+          EFormat() << "sync_mode 'lock_free' requires a bitwidth <= 64 for "
+                    << "register array '" << name << "'",
+          cfg_register_array);
+    }
   }
 }
 
@@ -1318,10 +1358,17 @@ P4Objects::init_actions(const Json::Value &cfg_root) {
     std::unique_ptr<ActionFn> action_fn(new ActionFn(
         action_name, action_id, cfg_action["runtime_data"].size(),
         object_source_info(cfg_action)));
+    std::vector<size_t> param_bitwidths;
+    for (const auto &cfg_runtime_data : cfg_action["runtime_data"])
+      param_bitwidths.push_back(cfg_runtime_data["bitwidth"].asUInt());
+    action_fn->set_param_bitwidths(std::move(param_bitwidths));
 
     const auto &cfg_primitive_calls = cfg_action["primitives"];
     for (const auto &cfg_primitive_call : cfg_primitive_calls)
       add_primitive_to_action(cfg_primitive_call, action_fn.get());
+    // lower the primitive calls into pre-bound operations, now that all the
+    // parameter types are known
+    action_fn->compile();
 
     add_action(action_id, std::move(action_fn));
   }
@@ -1846,6 +1893,7 @@ P4Objects::init_pipelines(const Json::Value &cfg_root,
     }
 
     Pipeline *pipeline = new Pipeline(pipeline_name, pipeline_id, first_node);
+    pipeline->compile();
     add_pipeline(pipeline_name, unique_ptr<Pipeline>(pipeline));
   }
 }
@@ -2149,6 +2197,30 @@ P4Objects::deserialize(std::istream *in) {
   }
 }
 
+void
+P4Objects::dump_telemetry(Json::Value *out) const {
+  Json::Value &tables = (*out)["tables"];
+  tables = Json::Value(Json::objectValue);
+  for (const auto &e : match_action_tables_map)
+    e.second->get_match_table()->get_telemetry().dump_json(&tables[e.first]);
+  Json::Value &parsers_json = (*out)["parsers"];
+  parsers_json = Json::Value(Json::objectValue);
+  for (const auto &e : parsers)
+    e.second->get_latency().get_snapshot().dump_json(&parsers_json[e.first]);
+  Json::Value &deparsers_json = (*out)["deparsers"];
+  deparsers_json = Json::Value(Json::objectValue);
+  for (const auto &e : deparsers)
+    e.second->get_latency().get_snapshot().dump_json(&deparsers_json[e.first]);
+}
+
+void
+P4Objects::reset_telemetry() {
+  for (const auto &e : match_action_tables_map)
+    e.second->get_match_table()->reset_telemetry();
+  for (const auto &e : parsers) e.second->reset_telemetry();
+  for (const auto &e : deparsers) e.second->reset_telemetry();
+}
+
 namespace {
 
 template <typename T>
@@ -2422,6 +2494,16 @@ P4Objects::get_action_profile_rt(const std::string &name) const {
   return (it != action_profiles_map.end()) ? it->second.get() : nullptr;
 }
 
+void
+P4Objects::enable_resilient_group_selection(size_t nb_buckets) {
+  for (auto &p : action_profiles_map) {
+    auto &action_profile = p.second;
+    if (!action_profile->has_selection()) continue;
+    group_selectors.emplace_back(new ResilientGroupSelector(nb_buckets));
+    action_profile->set_group_selector(group_selectors.back().get());
+  }
+}
+
 ConfigOptionMap
 P4Objects::get_config_options() const {
   return config_options;
@@ -112,18 +112,23 @@ ActionFn::parameter_push_back_action_data(int action_data_offset) {
 void
 ActionFn::parameter_push_back_register_ref(RegisterArray *register_array,
                                            unsigned int idx) {
+  // a Register reference is needed
+  assert(register_array->get_sync_mode() !=
+         RegisterArray::SyncMode::LOCK_FREE);
   ActionParam param;
   param.tag = ActionParam::REGISTER_REF;
   param.register_ref.array = register_array;
   param.register_ref.idx = idx;
   params.push_back(param);
 
-  register_sync.add_register_array(register_array);
+  register_sync.add_register_index(register_array, idx);
 }
 
 void
 ActionFn::parameter_push_back_register_gen(
     RegisterArray *register_array, std::unique_ptr<ArithExpression> idx) {
+  assert(register_array->get_sync_mode() !=
+         RegisterArray::SyncMode::LOCK_FREE);
   ActionParam param;
   param.tag = ActionParam::REGISTER_GEN;
   param.register_gen.array = register_array;
@@ -168,7 +173,11 @@ ActionFn::parameter_push_back_register_array(RegisterArray *register_array) {
   param.register_array = register_array;
   params.push_back(param);
 
-  register_sync.add_register_array(register_array);
+  // primitives are pushed before their parameters
+  if (primitives.empty() || !primitives.back().manages_register_sync())
+    register_sync.add_register_array(register_array);
+  else
+    register_sync.add_register_array_unlocked(register_array);
 }
 
 void
@@ -226,6 +235,7 @@ ActionFn::push_back_primitive(ActionPrimitive_ *primitive,
     param_offset += primitives.back().get_num_params();
   }
   primitives.emplace_back(primitive, param_offset, std::move(source_info));
+  fused_ops.clear();
 }
 
 void
@@ -238,6 +248,20 @@ ActionFn::get_num_params() const {
   return num_params;
 }
 
+void
+ActionFn::set_param_bitwidths(std::vector<size_t> bitwidths) {
+  assert(bitwidths.size() == num_params);
+  param_bitwidths = std::move(bitwidths);
+}
+
+void
+ActionFn::compile() {
+  fused_ops.clear();
+  for (const auto &primitive : primitives)
+    fused_ops.push_back(
+        primitive.fuse(params.data() + primitive.get_param_offset()));
+}
+
 namespace core {
 
 extern int _bm_core_primitives_import();
@@ -291,6 +315,31 @@ ActionPrimitiveCall::get_num_params() const {
   return primitive->get_num_params();
 }
 
+namespace {
+
+void
+execute_generic(const ActionFusedOp &op, ActionEngineState *state,
+                const ActionParam *args) {
+  op.primitive->execute(state, args);
+}
+
+}  // namespace
+
+ActionFusedOp
+ActionPrimitiveCall::fuse(const ActionParam *args) const {
+  ActionFusedOp op;
+  op.primitive = primitive;
+  op.param_offset = param_offset;
+  if (primitive->fuse(args, &op)) {
+    assert(op.fn);
+    op.may_jump = false;
+  } else {
+    op.fn = execute_generic;
+    op.may_jump = true;
+  }
+  return op;
+}
+
 void
 ActionFnEntry::push_back_action_data(const Data &data) {
   action_data.push_back_action_data(data);
@@ -314,6 +363,17 @@ ActionFnEntry::execute(Packet *pkt) const {
   size_t param_offset = 0;
   BMLOG_TRACE_SI_PKT(*pkt, action_fn->get_source_info(),
                      "Action {}", action_fn->get_name());
+  // we use the interpreter when tracing, to get one log message per primitive
+  if (action_fn->is_compiled() && !BMLOG_TRACE_ENABLED()) {
+    const auto &ops = action_fn->fused_ops;
+    const ActionParam *params = action_fn->params.data();
+    for (size_t idx = 0; idx < ops.size();) {
+      const auto &op = ops[idx];
+      op.fn(op, &state, params + op.param_offset);
+      idx = op.may_jump ? primitives[idx].get_jump_offset(idx) : (idx + 1);
+    }
+    return;
+  }
   for (size_t idx = 0; idx < primitives.size();) {
     const auto &primitive = primitives[idx];
     BMLOG_TRACE_SI_PKT(*pkt, primitive.get_source_info(),
@@ -51,6 +51,8 @@ class AgeingMonitor final : public AgeingMonitorIface {
 
   void add_table(MatchTableAbstract *table) override;
 
+  void register_ageing_cb(const AgeingCb &cb) override;
+
   void set_sweep_interval(unsigned int ms) override;
 
   void reset_state() override;
@@ -79,6 +81,8 @@ class AgeingMonitor final : public AgeingMonitorIface {
 
   std::map<p4object_id_t, TableData> tables_with_ageing{};
 
+  std::vector<AgeingCb> ageing_cbs{};
+
   int device_id{};
   int cxt_id{};
 
@@ -114,9 +118,17 @@ AgeingMonitor::~AgeingMonitor() {
 
 void
 AgeingMonitor::add_table(MatchTableAbstract *table) {
+  // the sweep thread is already running
+  std::unique_lock<std::mutex> lock(mutex);
   tables_with_ageing.insert(std::make_pair(table->get_id(), TableData(table)));
 }
 
+void
+AgeingMonitor::register_ageing_cb(const AgeingCb &cb) {
+  std::unique_lock<std::mutex> lock(mutex);
+  ageing_cbs.push_back(cb);
+}
+
 void
 AgeingMonitor::set_sweep_interval(unsigned int ms) {
   sweep_interval_ms = ms;
@@ -196,6 +208,7 @@ AgeingMonitor::do_sweep() {
     TransportIface::MsgBuf buf_entries =
       {reinterpret_cast<char *>(entries.data()), size};
     writer->send_msgs({buf_hdr, buf_entries});
+    for (const auto &cb : ageing_cbs) cb(data.table, entries);
     entries.clear();
   }
 }
@@ -39,4 +39,11 @@ ByteContainer::to_hex(size_t start, size_t s, bool upper_case) const {
   return ret.str();
 }
 
+std::string
+ByteView::to_hex(bool upper_case) const {
+  std::ostringstream ret;
+  utils::dump_hexstring(ret, begin(), end(), upper_case);
+  return ret.str();
+}
+
 }  // namespace bm
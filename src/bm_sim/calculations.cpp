@@ -28,7 +28,9 @@
 #include <string>
 #include <algorithm>
 #include <mutex>
+#include <vector>
 #include <ostream>
+#include <cstring>  // for std::memcpy
 
 #include "xxhash.h"
 #include "crc_tables.h"
@@ -36,22 +38,174 @@
 
 namespace bm {
 
+// Flat list of copy instructions, with the destination of each instruction in
+// the output buffer computed ahead of time. This is only valid as long as all
+// the headers referenced by the BufBuilder are valid (invalid headers are
+// skipped, which shifts everything that comes after) and no variable-length
+// field is involved.
+struct BufBuilder::CopyPlan {
+  enum class OpType { FIELD, CONSTANT, HEADER };
+
+  struct op_t {
+    OpType type;
+    header_id_t header;
+    int field_offset;
+    const char *constant;
+    int nbits;
+    size_t byte_offset;
+    int bit_shift;
+  };
+
+  bool applies(const PHV &phv) const {
+    if (!usable) return false;
+    for (auto header : headers)
+      if (!phv.get_header(header).is_valid()) return false;
+    return true;
+  }
+
+  void run(const PHV &phv, char *dst) const {
+    // unaligned deparsing may leave stale bits at the end of the buffer
+    if (!aligned) std::fill(dst, dst + nbytes, 0);
+    for (const auto &op : ops) {
+      char *ptr = dst + op.byte_offset;
+      switch (op.type) {
+        case OpType::FIELD:
+          {
+            const Field &field = phv.get_field(op.header, op.field_offset);
+            if (op.bit_shift == 0 && op.nbits % 8 == 0)
+              std::memcpy(ptr, field.get_bytes().data(), op.nbits / 8);
+            else
+              field.deparse(ptr, op.bit_shift);
+          }
+          break;
+        case OpType::CONSTANT:
+          extract::generic_deparse(op.constant, op.nbits, ptr, op.bit_shift);
+          break;
+        case OpType::HEADER:
+          {
+            const Header &header = phv.get_header(op.header);
+            const char *src = phv.get_packet_bytes(header);
+            if (src)
+              std::memcpy(ptr, src, header.get_nbytes_packet());
+            else
+              header.deparse(ptr);
+          }
+          break;
+      }
+    }
+  }
+
+  std::vector<op_t> ops{};
+  std::vector<header_id_t> headers{};
+  size_t nbytes{0};
+  bool aligned{true};
+  bool usable{true};
+};
+
+struct BufBuilder::PlanCompiler : public boost::static_visitor<> {
+  PlanCompiler(const PHV &phv, CopyPlan *plan)
+      : phv(phv), plan(plan) { }
+
+  void add_op(CopyPlan::OpType type, header_id_t header, int field_offset,
+              const char *constant, int nbits) {
+    CopyPlan::op_t op = {type, header, field_offset, constant, nbits,
+                         nbits_total / 8, static_cast<int>(nbits_total % 8)};
+    if (op.bit_shift != 0 || nbits % 8 != 0) plan->aligned = false;
+    plan->ops.push_back(op);
+    nbits_total += nbits;
+  }
+
+  void add_header(header_id_t header) {
+    auto &headers = plan->headers;
+    if (std::find(headers.begin(), headers.end(), header) == headers.end())
+      headers.push_back(header);
+  }
+
+  void operator()(const field_t &f) {
+    const Field &field = phv.get_field(f.header, f.field_offset);
+    if (field.is_VL()) plan->usable = false;
+    add_header(f.header);
+    add_op(CopyPlan::OpType::FIELD, f.header, f.field_offset, nullptr,
+           field.get_nbits());
+  }
+
+  void operator()(const constant_t &c) {
+    add_op(CopyPlan::OpType::CONSTANT, 0, 0, c.v.data(),
+           static_cast<int>(c.nbits));
+  }
+
+  void operator()(const header_t &h) {
+    const Header &header = phv.get_header(h.header);
+    if (header.is_VL_header()) plan->usable = false;
+    add_header(h.header);
+    add_op(CopyPlan::OpType::HEADER, h.header, 0, nullptr,
+           header.get_nbytes_packet() * 8);
+  }
+
+  const PHV &phv;
+  CopyPlan *plan;
+  size_t nbits_total{0};
+};
+
+BufBuilder::BufBuilder() = default;
+
+BufBuilder::~BufBuilder() = default;
+
+BufBuilder::BufBuilder(const BufBuilder &other)
+    : entries(other.entries), with_payload(other.with_payload) { }
+
+BufBuilder &
+BufBuilder::operator=(const BufBuilder &other) {
+  if (this == &other) return *this;
+  entries = other.entries;
+  with_payload = other.with_payload;
+  invalidate_plan();
+  return *this;
+}
+
+void
+BufBuilder::invalidate_plan() {
+  std::unique_lock<std::mutex> lock(plan_mutex);
+  plan.store(nullptr);
+  plan_storage.reset();
+}
+
+const BufBuilder::CopyPlan *
+BufBuilder::get_plan(const PHV &phv) const {
+  const CopyPlan *p = plan.load(std::memory_order_acquire);
+  if (p) return p;
+  std::unique_lock<std::mutex> lock(plan_mutex);
+  if (!plan_storage) {
+    std::unique_ptr<CopyPlan> new_plan(new CopyPlan());
+    PlanCompiler compiler(phv, new_plan.get());
+    std::for_each(entries.begin(), entries.end(),
+                  boost::apply_visitor(compiler));
+    new_plan->nbytes = (compiler.nbits_total + 7) / 8;
+    plan_storage = std::move(new_plan);
+  }
+  plan.store(plan_storage.get(), std::memory_order_release);
+  return plan_storage.get();
+}
+
 void
 BufBuilder::push_back_field(header_id_t header, int field_offset) {
   field_t f = {header, field_offset};
   entries.emplace_back(f);
+  invalidate_plan();
 }
 
 void
 BufBuilder::push_back_constant(const ByteContainer &v, size_t nbits) {
   constant_t c = {v, nbits};
   entries.emplace_back(c);
+  invalidate_plan();
 }
 
 void
 BufBuilder::push_back_header(header_id_t header) {
   header_t h = {header};
   entries.emplace_back(h);
+  invalidate_plan();
 }
 
 void
@@ -94,7 +248,12 @@ struct BufBuilder::Deparse : public boost::static_visitor<> {
     assert(get_offset() == 0);
     const Header &header = phv.get_header(h.header);
     if (header.is_valid()) {
-      header.deparse(extend(header.get_nbytes_packet() * 8));
+      const char *src = phv.get_packet_bytes(header);
+      char *dst = extend(header.get_nbytes_packet() * 8);
+      if (src)
+        std::memcpy(dst, src, header.get_nbytes_packet());
+      else
+        header.deparse(dst);
     }
   }
 
@@ -111,8 +270,21 @@ struct BufBuilder::Deparse : public boost::static_visitor<> {
 
 void
 BufBuilder::operator()(const Packet &pkt, ByteContainer *buf) const {
-  buf->clear();
   const PHV *phv = pkt.get_phv();
+  const CopyPlan *copy_plan = get_plan(*phv);
+  if (copy_plan->applies(*phv)) {
+    size_t psize = with_payload ? pkt.get_data_size() : 0;
+    // when called with a thread-local buffer (see Calculation_::output), this
+    // does not allocate once the buffer has grown to its steady-state size
+    buf->resize(copy_plan->nbytes + psize);
+    copy_plan->run(*phv, buf->data());
+    if (with_payload)
+      std::copy(pkt.data(), pkt.data() + psize,
+                buf->begin() + copy_plan->nbytes);
+    return;
+  }
+
+  buf->clear();
   Deparse visitor(*phv, buf);
   std::for_each(entries.begin(), entries.end(),
                 boost::apply_visitor(visitor));
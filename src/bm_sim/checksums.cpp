@@ -25,6 +25,7 @@
 #include <bm/bm_sim/phv.h>
 
 #include <cstdint>
+#include <cstring>  // for std::memcpy, std::memcmp
 #include <string>
 
 namespace bm {
@@ -76,6 +77,16 @@ uint16_t cksum16(char *buf, size_t len) {
   return ~t3;
 }
 
+// copies the packet representation of the header to buffer, without deparsing
+// it if the original packet bytes are available
+void header_bytes(const PHV &phv, const Header &hdr, char *buffer) {
+  const char *src = phv.get_packet_bytes(hdr);
+  if (src)
+    std::memcpy(buffer, src, hdr.get_nbytes_packet());
+  else
+    hdr.deparse(buffer);
+}
+
 }  // namespace
 
 Checksum::Checksum(const std::string &name, p4object_id_t id,
@@ -143,7 +154,8 @@ void
 CalcBasedChecksum::update_(Packet *pkt) const {
   const uint64_t cksum = calculation->output(*pkt);
   auto &f_cksum = pkt->get_phv()->get_field(header_id, field_offset);
-  f_cksum.set(cksum);
+  // avoid marking the header as modified if the checksum is already correct
+  if (f_cksum.get<uint64_t>() != cksum) f_cksum.set(cksum);
 }
 
 bool
@@ -166,11 +178,14 @@ void IPv4Checksum::update_(Packet *pkt) const {
   Header &ipv4_hdr = phv->get_header(header_id);
   if (!ipv4_hdr.is_valid()) return;
   Field &ipv4_cksum = ipv4_hdr[field_offset];
-  ipv4_hdr.deparse(buffer);
+  header_bytes(*phv, ipv4_hdr, buffer);
   buffer[IPV4_CKSUM_OFFSET] = 0; buffer[IPV4_CKSUM_OFFSET + 1] = 0;
   uint16_t cksum = cksum16(buffer, ipv4_hdr.get_nbytes_packet());
   // cksum is in network byte order
-  ipv4_cksum.set_bytes(reinterpret_cast<char *>(&cksum), 2);
+  // avoid marking the header as modified if the checksum is already correct
+  if (std::memcmp(reinterpret_cast<char *>(&cksum),
+                  ipv4_cksum.get_bytes().data(), 2))
+    ipv4_cksum.set_bytes(reinterpret_cast<char *>(&cksum), 2);
 }
 
 bool
@@ -180,7 +195,7 @@ IPv4Checksum::verify_(const Packet &pkt) const {
   const Header &ipv4_hdr = phv.get_header(header_id);
   if (!ipv4_hdr.is_valid()) return true;  // return true if no header... TODO ?
   const Field &ipv4_cksum = ipv4_hdr[field_offset];
-  ipv4_hdr.deparse(buffer);
+  header_bytes(phv, ipv4_hdr, buffer);
   buffer[IPV4_CKSUM_OFFSET] = 0; buffer[IPV4_CKSUM_OFFSET + 1] = 0;
   uint16_t cksum = cksum16(buffer, ipv4_hdr.get_nbytes_packet());
   // TODO(antonin): improve this?
@@ -20,6 +20,7 @@
 
 #include <bm/bm_sim/conditionals.h>
 #include <bm/bm_sim/event_logger.h>
+#include <bm/bm_sim/flow_cache.h>
 #include <bm/bm_sim/packet.h>
 #include <bm/bm_sim/logger.h>
 
@@ -27,14 +28,16 @@
 
 namespace bm {
 
-const ControlFlowNode *
-Conditional::operator()(Packet *pkt) const {
+bool
+Conditional::evaluate(Packet *pkt) const {
   // TODO(antonin)
   // this is temporary while we experiment with the debugger
   DEBUGGER_NOTIFY_CTR(
       Debugger::PacketId::make(pkt->get_packet_id(), pkt->get_copy_id()),
       DBG_CTR_CONDITION | get_id());
   PHV *phv = pkt->get_phv();
+  if (auto recorder = FlowCacheRecorder::get())
+    recorder->record_condition(*this);
   bool result = eval(*phv);
   BMELOG(condition_eval, *pkt, *this, result);
 
@@ -53,7 +56,12 @@ Conditional::operator()(Packet *pkt) const {
   DEBUGGER_NOTIFY_CTR(
       Debugger::PacketId::make(pkt->get_packet_id(), pkt->get_copy_id()),
       DBG_CTR_EXIT(DBG_CTR_CONDITION) | get_id());
-  return result ? true_next : false_next;
+  return result;
+}
+
+const ControlFlowNode *
+Conditional::operator()(Packet *pkt) const {
+  return evaluate(pkt) ? true_next : false_next;
 }
 
 }  // namespace bm
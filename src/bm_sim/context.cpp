@@ -19,8 +19,11 @@
  */
 
 #include <bm/bm_sim/context.h>
+#include <bm/bm_sim/flow_cache.h>
 
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 #include <set>
 
@@ -436,6 +439,36 @@ Context::mt_get_entries<MatchTableIndirect>(const std::string &) const;
 template std::vector<MatchTableIndirectWS::Entry>
 Context::mt_get_entries<MatchTableIndirectWS>(const std::string &) const;
 
+template <typename T>
+MatchErrorCode
+Context::mt_get_entries_page(const std::string &table_name,
+                             size_t max_entries,
+                             MatchTableAbstract::EntryCursor *cursor,
+                             std::vector<typename T::Entry> *entries) const {
+  boost::shared_lock<boost::shared_mutex> lock(request_mutex);
+  MatchTableAbstract *abstract_table =
+      p4objects_rt->get_abstract_match_table(table_name);
+  if (!abstract_table) return MatchErrorCode::INVALID_TABLE_NAME;
+  T *table = dynamic_cast<T *>(abstract_table);
+  if (!table) return MatchErrorCode::WRONG_TABLE_TYPE;
+  *entries = table->get_entries_page(max_entries, cursor);
+  return MatchErrorCode::SUCCESS;
+}
+
+// explicit instantiation
+template MatchErrorCode
+Context::mt_get_entries_page<MatchTable>(
+    const std::string &, size_t, MatchTableAbstract::EntryCursor *,
+    std::vector<MatchTable::Entry> *) const;
+template MatchErrorCode
+Context::mt_get_entries_page<MatchTableIndirect>(
+    const std::string &, size_t, MatchTableAbstract::EntryCursor *,
+    std::vector<MatchTableIndirect::Entry> *) const;
+template MatchErrorCode
+Context::mt_get_entries_page<MatchTableIndirectWS>(
+    const std::string &, size_t, MatchTableAbstract::EntryCursor *,
+    std::vector<MatchTableIndirectWS::Entry> *) const;
+
 template <typename T>
 MatchErrorCode
 Context::mt_get_entry(const std::string &table_name,
@@ -587,8 +620,7 @@ Context::register_read(const std::string &register_name,
       register_name);
   if (!register_array) return Register::INVALID_REGISTER_NAME;
   if (idx >= register_array->size()) return Register::INVALID_INDEX;
-  auto register_lock = register_array->unique_lock();
-  value->set((*register_array)[idx]);
+  register_array->read(idx, value);
   return Register::SUCCESS;
 }
 
@@ -600,8 +632,7 @@ Context::register_write(const std::string &register_name,
       register_name);
   if (!register_array) return Register::INVALID_REGISTER_NAME;
   if (idx >= register_array->size()) return Register::INVALID_INDEX;
-  auto register_lock = register_array->unique_lock();
-  (*register_array)[idx].set(std::move(value));
+  register_array->write(idx, value);
   return Register::SUCCESS;
 }
 
@@ -615,9 +646,8 @@ Context::register_write_range(const std::string &register_name,
   if (!register_array) return Register::INVALID_REGISTER_NAME;
   if (end > register_array->size() || start > end)
     return Register::INVALID_INDEX;
-  auto register_lock = register_array->unique_lock();
   for (size_t idx = start; idx < end; idx++)
-    register_array->at(idx).set(value);
+    register_array->write(idx, value);
   return Register::SUCCESS;
 }
 
@@ -721,6 +751,16 @@ Context::set_force_arith(bool v) {
   force_arith = v;
 }
 
+void
+Context::set_resilient_group_selection(size_t nb_buckets) {
+  boost::unique_lock<boost::shared_mutex> lock(request_mutex);
+  resilient_group_buckets = nb_buckets;
+  // also applies to the config which is already loaded (if any)
+  p4objects->enable_resilient_group_selection(nb_buckets);
+  if (p4objects_rt != p4objects)
+    p4objects_rt->enable_resilient_group_selection(nb_buckets);
+}
+
 int
 Context::init_objects(std::istream *is,
                       LookupStructureFactory *lookup_factory,
@@ -733,6 +773,8 @@ Context::init_objects(std::istream *is,
   if (status) return status;
   if (force_arith)
     get_phv_factory().enable_all_arith();
+  if (resilient_group_buckets > 0)
+    p4objects_rt->enable_resilient_group_selection(resilient_group_buckets);
   return 0;
 }
 
@@ -747,6 +789,8 @@ Context::init_objects(std::shared_ptr<P4Objects> p4objs) {
   // force_arith is set by SwitchWContexts::init_from_options_parser
   if (force_arith)
     get_phv_factory().enable_all_arith();
+  if (resilient_group_buckets > 0)
+    p4objects->enable_resilient_group_selection(resilient_group_buckets);
   return ErrorCode::SUCCESS;
 }
 
@@ -765,6 +809,19 @@ Context::load_new_config(
   return ErrorCode::SUCCESS;
 }
 
+Context::ErrorCode
+Context::load_new_objects(std::shared_ptr<P4Objects> p4objs) {
+  boost::unique_lock<boost::shared_mutex> lock(request_mutex);
+  // check that there is no ongoing config swap
+  if (p4objects != p4objects_rt) return ErrorCode::ONGOING_SWAP;
+  p4objects_rt = std::move(p4objs);
+  if (force_arith)
+    p4objects_rt->get_phv_factory().enable_all_arith();
+  if (resilient_group_buckets > 0)
+    p4objects_rt->enable_resilient_group_selection(resilient_group_buckets);
+  return ErrorCode::SUCCESS;
+}
+
 Context::ErrorCode
 Context::swap_configs() {
   boost::unique_lock<boost::shared_mutex> lock(request_mutex);
@@ -788,6 +845,22 @@ Context::serialize(std::ostream *out) {
   return ErrorCode::SUCCESS;
 }
 
+// the telemetry objects are only updated / read with atomic operations, the
+// shared lock is only needed to prevent a config swap
+Context::ErrorCode
+Context::dump_telemetry(Json::Value *out) {
+  boost::shared_lock<boost::shared_mutex> lock(request_mutex);
+  p4objects_rt->dump_telemetry(out);
+  return ErrorCode::SUCCESS;
+}
+
+Context::ErrorCode
+Context::reset_telemetry() {
+  boost::shared_lock<boost::shared_mutex> lock(request_mutex);
+  p4objects_rt->reset_telemetry();
+  return ErrorCode::SUCCESS;
+}
+
 // we assume this is called when the switch is started, just after loading the
 // JSON, so no traffic yet
 Context::ErrorCode
@@ -806,6 +879,8 @@ Context::do_swap() {
   boost::unique_lock<boost::shared_mutex> lock(request_mutex);
   p4objects = p4objects_rt;
   swap_ordered = false;
+  // the flow caches could otherwise refer to objects from the old config
+  FlowCache::invalidate_all();
   return 0;
 }
 
@@ -20,6 +20,7 @@
 
 #include <bm/bm_sim/actions.h>
 #include <bm/bm_sim/control_action.h>
+#include <bm/bm_sim/flow_cache.h>
 #include <bm/bm_sim/packet.h>
 
 #include <string>
@@ -43,13 +44,20 @@ ControlAction::set_action(ActionFn *action) {
   this->action = action;
 }
 
-const ControlFlowNode *
-ControlAction::operator()(Packet *pkt) const {
+void
+ControlAction::execute(Packet *pkt) const {
   assert(action);
+  if (auto recorder = FlowCacheRecorder::get())
+    recorder->record_action(action);
   ActionFnEntry action_entry(action);
   // TODO(unknown): log action call with source information, or ActionFnEntry
   // log is sufficient?
   action_entry(pkt);
+}
+
+const ControlFlowNode *
+ControlAction::operator()(Packet *pkt) const {
+  execute(pkt);
   return next_node;
 }
 
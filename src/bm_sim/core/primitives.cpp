@@ -36,6 +36,58 @@ REGISTER_PRIMITIVE(push);
 
 REGISTER_PRIMITIVE(pop);
 
+namespace {
+
+void
+assign_field_from_field(const ActionFusedOp &op, ActionEngineState *state,
+                        const ActionParam *args) {
+  (void) op;
+  Field &dst = state->phv.get_field(args[0].field.header,
+                                    args[0].field.field_offset);
+  const Field &src = state->phv.get_field(args[1].field.header,
+                                          args[1].field.field_offset);
+  dst.set_from_field(src);
+}
+
+void
+assign_field_from_const(const ActionFusedOp &op, ActionEngineState *state,
+                        const ActionParam *args) {
+  (void) op;
+  Field &dst = state->phv.get_field(args[0].field.header,
+                                    args[0].field.field_offset);
+  dst.set(state->const_values[args[1].const_offset]);
+}
+
+void
+assign_field_from_action_data(const ActionFusedOp &op,
+                              ActionEngineState *state,
+                              const ActionParam *args) {
+  (void) op;
+  Field &dst = state->phv.get_field(args[0].field.header,
+                                    args[0].field.field_offset);
+  dst.set(state->action_data.get(args[1].action_data_offset));
+}
+
+}  // namespace
+
+bool
+assign::fuse(const ActionParam *args, ActionFusedOp *op) {
+  if (args[0].tag != ActionParam::FIELD) return false;
+  switch (args[1].tag) {
+    case ActionParam::FIELD:
+      op->fn = assign_field_from_field;
+      return true;
+    case ActionParam::CONST:
+      op->fn = assign_field_from_const;
+      return true;
+    case ActionParam::ACTION_DATA:
+      op->fn = assign_field_from_action_data;
+      return true;
+    default:
+      return false;
+  }
+}
+
 void
 assign_header::operator ()(Header &dst, const Header &src) {
   if (!src.is_valid()) {
@@ -26,6 +26,8 @@
 #include <bm/bm_sim/checksums.h>
 #include <bm/bm_sim/phv.h>
 
+#include <cstring>  // for std::memcpy
+
 namespace bm {
 
 size_t
@@ -42,6 +44,7 @@ Deparser::get_headers_size(const PHV &phv) const {
 
 void
 Deparser::deparse(Packet *pkt) const {
+  TelemetryTimer timer(&latency_ns);
   PHV *phv = pkt->get_phv();
   BMELOG(deparser_start, *pkt, *this);
   // TODO(antonin)
@@ -53,18 +56,36 @@ Deparser::deparse(Packet *pkt) const {
   update_checksums(pkt);
   char *data = pkt->prepend(get_headers_size(*phv));
   int bytes_parsed = 0;
+  // headers which have not been modified since they were parsed are copied
+  // from the original packet bytes; consecutive such headers which were also
+  // consecutive in the original packet are copied with a single memcpy
+  const char *run_src = nullptr;
+  int run_len = 0;
+  int run_dst = 0;
   // invalidating headers, and resetting header stacks is done in the Packet
   // destructor, when the PHV is released
   for (auto it = headers.begin(); it != headers.end(); ++it) {
-    Header &header = phv->get_header(*it);
+    const Header &header = phv->get_header(*it);
     if (header.is_valid()) {
       BMELOG(deparser_emit, *pkt, *it);
-      BMLOG_DEBUG_PKT(*pkt, "Deparsing header '{}'", header.get_name());
-      header.deparse(data + bytes_parsed);
-      bytes_parsed += header.get_nbytes_packet();
+      BMLOG_DEBUG_PKT(*pkt, "Deparsing header '{}'",
+                      phv->get_header_name(*it));
+      const int nbytes = header.get_nbytes_packet();
+      const char *src = phv->get_packet_bytes(header);
+      if (src && run_src && src == run_src + run_len) {
+        run_len += nbytes;
+      } else {
+        if (run_src) std::memcpy(data + run_dst, run_src, run_len);
+        run_src = src;
+        run_len = nbytes;
+        run_dst = bytes_parsed;
+        if (!src) header.deparse(data + bytes_parsed);
+      }
+      bytes_parsed += nbytes;
       // header.mark_invalid();
     }
   }
+  if (run_src) std::memcpy(data + run_dst, run_src, run_len);
   // phv->reset_header_stacks();
   BMELOG(deparser_done, *pkt, *this);
   DEBUGGER_NOTIFY_CTR(
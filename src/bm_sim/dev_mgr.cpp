@@ -24,6 +24,7 @@
 
 #include <cassert>
 #include <algorithm>  // std::min
+#include <chrono>
 #include <thread>
 #include <mutex>
 #include <string>
@@ -105,6 +106,95 @@ class FilesDevMgrImp : public DevMgrIface {
   std::map<port_t, DevMgrIface::PortInfo> port_info;
 };
 
+// Implementation which preloads Pcap files in memory and replays them at high
+// rate (see PcapReplayer); output packets are written asynchronously
+class ReplayDevMgrImp : public DevMgrIface {
+ public:
+  ReplayDevMgrImp(const PcapReplayConfig &config,
+                  unsigned wait_time_in_seconds)
+      : replayer(config, wait_time_in_seconds), writer(true) {
+    p_monitor = PortMonitorIface::make_dummy();
+  }
+
+ private:
+  ~ReplayDevMgrImp() override {
+    if (replay_thread.joinable()) replay_thread.join();
+  }
+
+  ReturnCode port_add_(const std::string &iface_name, port_t port_num,
+                       const char *in_pcap, const char *out_pcap) override {
+    replayer.addFile(port_num, std::string(in_pcap));
+    writer.addFile(port_num, std::string(out_pcap));
+
+    PortInfo p_info(port_num, iface_name);
+    if (in_pcap) p_info.add_extra("in_pcap", std::string(in_pcap));
+    if (out_pcap) p_info.add_extra("out_pcap", std::string(out_pcap));
+
+    Lock lock(mutex);
+    port_info.emplace(port_num, std::move(p_info));
+
+    return ReturnCode::SUCCESS;
+  }
+
+  ReturnCode port_remove_(port_t port_num) override {
+    UNUSED(port_num);
+    Logger::get()->warn("Removing ports not possible when replaying pcap "
+                        "files");
+    return ReturnCode::UNSUPPORTED;
+  }
+
+  void transmit_fn_(int port_num, const char *buffer, int len) override {
+    writer.send_packet(port_num, buffer, len);
+  }
+
+  void start_() override {
+    replay_thread = std::thread(&ReplayDevMgrImp::replay, this);
+  }
+
+  ReturnCode set_packet_handler_(const PacketHandler &handler, void *cookie)
+      override {
+    replayer.set_packet_handler(handler, cookie);
+    return ReturnCode::SUCCESS;
+  }
+
+  bool port_is_up_(port_t port) const override {
+    Lock lock(mutex);
+    return port_info.find(port) != port_info.end();
+  }
+
+  std::map<port_t, PortInfo> get_port_info_() const override {
+    Lock lock(mutex);
+    return port_info;
+  }
+
+  void replay() {
+    replayer.start();
+    // wait for the output to settle (no packet for 1s) before reporting how
+    // many packets made it out of the switch
+    uint64_t out = writer.packetCount();
+    for (int idle = 0; idle < 10; idle++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      uint64_t now = writer.packetCount();
+      if (now != out) idle = 0;
+      out = now;
+    }
+    uint64_t in = replayer.getStats().packets;
+    Logger::get()->info(
+        "Pcap replay: {} packets in, {} packets out, {} packets dropped",
+        in, out, (in > out) ? (in - out) : 0);
+  }
+
+ private:
+  using Mutex = std::mutex;
+  using Lock = std::lock_guard<std::mutex>;
+
+  PcapReplayer replayer;
+  PcapFilesWriter writer;
+  std::thread replay_thread;
+  mutable Mutex mutex;
+  std::map<port_t, DevMgrIface::PortInfo> port_info;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 
 DevMgrIface::~DevMgrIface() {
@@ -176,6 +266,14 @@ DevMgr::set_dev_mgr_files(unsigned wait_time_in_seconds) {
       false /* no real-time packet replay */, wait_time_in_seconds));
 }
 
+void
+DevMgr::set_dev_mgr_pcap_replay(const PcapReplayConfig &config,
+                                unsigned wait_time_in_seconds) {
+  assert(!pimp);
+  pimp = std::unique_ptr<DevMgrIface>(new ReplayDevMgrImp(
+      config, wait_time_in_seconds));
+}
+
 void
 DevMgr::start() {
   assert(pimp);
@@ -0,0 +1,497 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#ifdef BMAFPACKET_ON
+
+#include <bm/bm_sim/dev_mgr.h>
+#include <bm/bm_sim/logger.h>
+
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tx_batcher.h"
+
+namespace bm {
+
+// private implementation
+
+// Implementation which uses Linux AF_PACKET sockets with memory-mapped rings
+// (TPACKET_V3) to send / receive packets from true interfaces. Compared to the
+// BMI implementation:
+//   - received packets are retrieved from the ring one block (i.e. a batch of
+//     packets) at a time and handed to the packet handler directly from the
+//     ring memory, without any intermediate copy
+//   - there is one receive thread per port, or per queue if the port is
+//     configured with several queues, in which case the queues join the same
+//     PACKET_FANOUT group and the kernel spreads the flows among them; the
+//     threads call the packet handler concurrently, so it has to be
+//     thread-safe (see DevMgr::set_packet_handler)
+//   - transmitted packets are written to a TX ring and the kernel is only
+//     notified every tx_batch packets, or once the oldest pending packet has
+//     waited for tx_max_delay, which is checked by a dedicated thread
+
+namespace {
+
+// parameters of the memory-mapped rings, see
+// https://www.kernel.org/doc/Documentation/networking/packet_mmap.txt
+constexpr unsigned int rx_block_size = 1 << 18;  // 256KB
+constexpr unsigned int rx_block_nr = 64;
+constexpr unsigned int rx_frame_size = 1 << 11;
+// the kernel retires a block after this timeout even if it is not full
+constexpr unsigned int rx_block_timeout_ms = 1;
+constexpr unsigned int tx_frame_size = 1 << 14;  // large enough for jumbos
+constexpr unsigned int tx_frame_nr = 512;
+constexpr unsigned int tx_block_size = 1 << 20;
+constexpr int poll_timeout_ms = 100;
+// maximum time a packet waits in the TX ring when tx_batch > 1, the TX rings
+// are checked with the same period
+constexpr std::chrono::milliseconds tx_max_delay(1);
+
+class AfPacketSocket {
+ public:
+  AfPacketSocket(const std::string &iface_name, int fanout_id,
+                 bool with_tx_ring, unsigned int tx_batch)
+      : iface_name(iface_name), tx_batcher(tx_batch, tx_max_delay) {
+    fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    if (fd < 0) {
+      error("socket");
+      return;
+    }
+
+    int version = TPACKET_V3;
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION,
+                   &version, sizeof(version)) < 0) {
+      error("PACKET_VERSION");
+      return;
+    }
+
+    // a frame is never split between blocks, so there is no need to set any
+    // tp_frame_nr constraint beyond what the kernel checks
+    std::memset(&rx_req, 0, sizeof(rx_req));
+    rx_req.tp_block_size = rx_block_size;
+    rx_req.tp_block_nr = rx_block_nr;
+    rx_req.tp_frame_size = rx_frame_size;
+    rx_req.tp_frame_nr = (rx_block_size * rx_block_nr) / rx_frame_size;
+    rx_req.tp_retire_blk_tov = rx_block_timeout_ms;
+    rx_req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+    if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING,
+                   &rx_req, sizeof(rx_req)) < 0) {
+      error("PACKET_RX_RING");
+      return;
+    }
+
+    if (with_tx_ring) {
+      std::memset(&tx_req, 0, sizeof(tx_req));
+      tx_req.tp_block_size = tx_block_size;
+      tx_req.tp_frame_size = tx_frame_size;
+      tx_req.tp_frame_nr = tx_frame_nr;
+      tx_req.tp_block_nr = (tx_frame_size * tx_frame_nr) / tx_block_size;
+      if (setsockopt(fd, SOL_PACKET, PACKET_TX_RING,
+                     &tx_req, sizeof(tx_req)) < 0) {
+        error("PACKET_TX_RING");
+        return;
+      }
+    }
+
+    size_t rx_size = rx_req.tp_block_size * rx_req.tp_block_nr;
+    size_t tx_size = tx_req.tp_block_size * tx_req.tp_block_nr;
+    map_size = rx_size + tx_size;
+    void *addr = mmap(nullptr, map_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_LOCKED | MAP_POPULATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      // MAP_LOCKED requires CAP_IPC_LOCK / a sufficient RLIMIT_MEMLOCK
+      addr = mmap(nullptr, map_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, 0);
+    }
+    if (addr == MAP_FAILED) {
+      map_size = 0;
+      error("mmap");
+      return;
+    }
+    map = static_cast<char *>(addr);
+    tx_ring = map + rx_size;
+
+    ifindex = if_nametoindex(iface_name.c_str());
+    if (ifindex == 0) {
+      error("if_nametoindex");
+      return;
+    }
+
+    struct sockaddr_ll ll;
+    std::memset(&ll, 0, sizeof(ll));
+    ll.sll_family = AF_PACKET;
+    ll.sll_protocol = htons(ETH_P_ALL);
+    ll.sll_ifindex = ifindex;
+    if (bind(fd, reinterpret_cast<struct sockaddr *>(&ll), sizeof(ll)) < 0) {
+      error("bind");
+      return;
+    }
+
+    if (fanout_id >= 0) {
+      int fanout_arg = (fanout_id & 0xffff) |
+          ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+      if (setsockopt(fd, SOL_PACKET, PACKET_FANOUT,
+                     &fanout_arg, sizeof(fanout_arg)) < 0) {
+        error("PACKET_FANOUT");
+        return;
+      }
+    }
+
+    ok = true;
+  }
+
+  ~AfPacketSocket() {
+    if (map) munmap(map, map_size);
+    if (fd >= 0) close(fd);
+  }
+
+  bool is_ok() const { return ok; }
+
+  // Blocks until at least one block of packets is available in the RX ring (or
+  // until the poll timeout expires) and calls fn(data, len) for every packet in
+  // the available blocks, returning the blocks to the kernel afterwards.
+  template <typename Fn>
+  void receive(const Fn &fn) {
+    auto *block = get_rx_block(rx_block_idx);
+    if (!(load_status(&block->hdr.bh1.block_status) & TP_STATUS_USER)) {
+      struct pollfd pfd;
+      pfd.fd = fd;
+      pfd.events = POLLIN | POLLERR;
+      pfd.revents = 0;
+      poll(&pfd, 1, poll_timeout_ms);
+    }
+    while (load_status(&block->hdr.bh1.block_status) & TP_STATUS_USER) {
+      auto num_pkts = block->hdr.bh1.num_pkts;
+      auto *ppd = reinterpret_cast<struct tpacket3_hdr *>(
+          reinterpret_cast<char *>(block) + block->hdr.bh1.offset_to_first_pkt);
+      for (decltype(num_pkts) i = 0; i < num_pkts; i++) {
+        auto *ll = reinterpret_cast<const struct sockaddr_ll *>(
+            reinterpret_cast<char *>(ppd) +
+            TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+        // ignore the packets we sent ourselves
+        if (ll->sll_pkttype != PACKET_OUTGOING) {
+          fn(reinterpret_cast<const char *>(ppd) + ppd->tp_mac,
+             static_cast<int>(ppd->tp_snaplen));
+        }
+        ppd = reinterpret_cast<struct tpacket3_hdr *>(
+            reinterpret_cast<char *>(ppd) + ppd->tp_next_offset);
+      }
+      store_status(&block->hdr.bh1.block_status, TP_STATUS_KERNEL);
+      rx_block_idx = (rx_block_idx + 1) % rx_req.tp_block_nr;
+      block = get_rx_block(rx_block_idx);
+    }
+  }
+
+  // Copies the packet to the next available TX frame; the kernel is notified
+  // once at least tx_batch frames are pending, see TxBatcher. Returns false if
+  // the packet was dropped (packet too large or TX ring full).
+  bool transmit(const char *buffer, int len) {
+    constexpr size_t data_offset =
+        TPACKET_ALIGN(sizeof(struct tpacket3_hdr));
+    if (static_cast<size_t>(len) + data_offset > tx_req.tp_frame_size)
+      return false;
+    std::lock_guard<std::mutex> lock(tx_mutex);
+    auto *ppd = get_tx_frame(tx_frame_idx);
+    if (load_status(&ppd->tp_status) != TP_STATUS_AVAILABLE) {
+      // TX ring full, try to make some progress before giving up
+      kick_tx();
+      if (load_status(&ppd->tp_status) != TP_STATUS_AVAILABLE) return false;
+    }
+    std::memcpy(reinterpret_cast<char *>(ppd) + data_offset, buffer, len);
+    ppd->tp_len = len;
+    ppd->tp_snaplen = len;
+    ppd->tp_next_offset = 0;
+    store_status(&ppd->tp_status, TP_STATUS_SEND_REQUEST);
+    tx_frame_idx = (tx_frame_idx + 1) % tx_req.tp_frame_nr;
+    if (tx_batcher.add(TxBatcher::clock::now())) kick_tx();
+    return true;
+  }
+
+  // notifies the kernel if the oldest pending TX frame has waited for too long
+  void flush_tx_expired(TxBatcher::clock::time_point now) {
+    std::lock_guard<std::mutex> lock(tx_mutex);
+    if (tx_batcher.expired(now)) kick_tx();
+  }
+
+  bool is_up() const {
+    struct ifreq ifr;
+    std::memset(&ifr, 0, sizeof(ifr));
+    std::strncpy(ifr.ifr_name, iface_name.c_str(), IFNAMSIZ - 1);
+    if (ioctl(fd, SIOCGIFFLAGS, &ifr) < 0) return false;
+    return (ifr.ifr_flags & IFF_UP) && (ifr.ifr_flags & IFF_RUNNING);
+  }
+
+  AfPacketSocket(const AfPacketSocket &other) = delete;
+  AfPacketSocket &operator=(const AfPacketSocket &other) = delete;
+
+ private:
+  // the status words are shared with the kernel, the acquire / release
+  // semantics order them with respect to the packet data
+  static uint32_t load_status(const uint32_t *status) {
+    return __atomic_load_n(status, __ATOMIC_ACQUIRE);
+  }
+
+  static void store_status(uint32_t *status, uint32_t v) {
+    __atomic_store_n(status, v, __ATOMIC_RELEASE);
+  }
+
+  struct tpacket_block_desc *get_rx_block(unsigned int idx) const {
+    return reinterpret_cast<struct tpacket_block_desc *>(
+        map + idx * rx_req.tp_block_size);
+  }
+
+  struct tpacket3_hdr *get_tx_frame(unsigned int idx) const {
+    return reinterpret_cast<struct tpacket3_hdr *>(
+        tx_ring + idx * tx_req.tp_frame_size);
+  }
+
+  void kick_tx() {
+    send(fd, nullptr, 0, MSG_DONTWAIT);
+    tx_batcher.flushed();
+  }
+
+  void error(const char *what) {
+    Logger::get()->error("AF_PACKET setup failed for interface '{}' ({}): {}",
+                         iface_name, what, std::strerror(errno));
+  }
+
+  std::string iface_name;
+  int fd{-1};
+  unsigned int ifindex{0};
+  bool ok{false};
+  struct tpacket_req3 rx_req{};
+  struct tpacket_req3 tx_req{};
+  char *map{nullptr};
+  size_t map_size{0};
+  char *tx_ring{nullptr};
+  unsigned int rx_block_idx{0};
+  std::mutex tx_mutex{};
+  unsigned int tx_frame_idx{0};
+  TxBatcher tx_batcher;
+};
+
+}  // namespace
+
+class AfPacketDevMgrImp : public DevMgrIface {
+ public:
+  AfPacketDevMgrImp(int device_id,
+                    std::shared_ptr<TransportIface> notifications_transport,
+                    unsigned int queues_per_port, unsigned int tx_batch)
+      : queues_per_port(queues_per_port ? queues_per_port : 1),
+        tx_batch(tx_batch ? tx_batch : 1) {
+    p_monitor = PortMonitorIface::make_active(device_id,
+                                              notifications_transport);
+  }
+
+ private:
+  // one per port; queue 0 is also used for transmission
+  struct Port {
+    std::vector<std::unique_ptr<AfPacketSocket> > queues{};
+    std::vector<std::thread> threads{};
+    std::atomic<bool> stop{false};
+  };
+
+  ~AfPacketDevMgrImp() override {
+    {
+      Lock lock(tx_flush_mutex);
+      tx_flush_stop = true;
+    }
+    tx_flush_cv.notify_one();
+    if (tx_flush_thread.joinable()) tx_flush_thread.join();
+    Lock lock(mutex);
+    for (auto &p : ports) stop_port(p.second.get());
+  }
+
+  ReturnCode port_add_(const std::string &iface_name, port_t port_num,
+                       const char *in_pcap, const char *out_pcap) override {
+    if (in_pcap || out_pcap) {
+      Logger::get()->warn("pcap dumps are not supported with AF_PACKET "
+                          "interfaces and will be ignored");
+    }
+
+    std::shared_ptr<Port> port(new Port());
+    // fanout group ids are 16-bit and shared by all processes on the host
+    int fanout_id = (queues_per_port > 1) ?
+        static_cast<int>((getpid() ^ (port_num << 8)) & 0xffff) : -1;
+    for (unsigned int q = 0; q < queues_per_port; q++) {
+      std::unique_ptr<AfPacketSocket> sock(
+          new AfPacketSocket(iface_name, fanout_id, q == 0, tx_batch));
+      if (!sock->is_ok()) return ReturnCode::ERROR;
+      port->queues.push_back(std::move(sock));
+    }
+
+    PortInfo p_info(port_num, iface_name);
+    p_info.add_extra("queues", std::to_string(queues_per_port));
+
+    Lock lock(mutex);
+    if (ports.find(port_num) != ports.end()) return ReturnCode::ERROR;
+    if (started) start_port(port_num, port.get());
+    ports.emplace(port_num, std::move(port));
+    port_info.emplace(port_num, std::move(p_info));
+
+    return ReturnCode::SUCCESS;
+  }
+
+  ReturnCode port_remove_(port_t port_num) override {
+    Lock lock(mutex);
+    auto it = ports.find(port_num);
+    if (it == ports.end()) return ReturnCode::ERROR;
+    stop_port(it->second.get());
+    ports.erase(it);
+    port_info.erase(port_num);
+    return ReturnCode::SUCCESS;
+  }
+
+  void transmit_fn_(int port_num, const char *buffer, int len) override {
+    // keeps the sockets alive even if the port is removed concurrently
+    std::shared_ptr<Port> port;
+    {
+      Lock lock(mutex);
+      auto it = ports.find(port_num);
+      if (it == ports.end()) return;
+      port = it->second;
+    }
+    if (!port->queues.front()->transmit(buffer, len))
+      BMLOG_DEBUG("Dropping packet of size {} on port {}", len, port_num);
+  }
+
+  void start_() override {
+    Lock lock(mutex);
+    if (started) return;
+    for (auto &p : ports) start_port(p.first, p.second.get());
+    if (tx_batch > 1)
+      tx_flush_thread = std::thread(&AfPacketDevMgrImp::tx_flush_loop, this);
+    started = true;
+  }
+
+  ReturnCode set_packet_handler_(const PacketHandler &handler, void *cookie)
+      override {
+    pkt_handler = handler;
+    pkt_cookie = cookie;
+    return ReturnCode::SUCCESS;
+  }
+
+  bool port_is_up_(port_t port_num) const override {
+    Lock lock(mutex);
+    auto it = ports.find(port_num);
+    return (it != ports.end()) && it->second->queues.front()->is_up();
+  }
+
+  std::map<port_t, PortInfo> get_port_info_() const override {
+    std::map<port_t, PortInfo> info;
+    {
+      Lock lock(mutex);
+      info = port_info;
+    }
+    for (auto &pi : info) {
+      pi.second.is_up = port_is_up_(pi.first);
+    }
+    return info;
+  }
+
+  void start_port(port_t port_num, Port *port) {
+    for (auto &sock : port->queues) {
+      port->threads.emplace_back(
+          &AfPacketDevMgrImp::receive_loop, this, port_num, port, sock.get());
+    }
+  }
+
+  void stop_port(Port *port) {
+    port->stop = true;
+    for (auto &t : port->threads) t.join();
+    port->threads.clear();
+  }
+
+  void receive_loop(port_t port_num, Port *port, AfPacketSocket *sock) {
+    auto handle = [this, port_num](const char *data, int len) {
+      BMLOG_TRACE("Packet received on port {}", port_num);
+      pkt_handler(port_num, data, len, pkt_cookie);
+    };
+    while (!port->stop) sock->receive(handle);
+  }
+
+  // makes sure packets do not sit in the TX rings when the traffic is low
+  void tx_flush_loop() {
+    std::unique_lock<std::mutex> flush_lock(tx_flush_mutex);
+    while (!tx_flush_stop) {
+      tx_flush_cv.wait_for(flush_lock, tx_max_delay);
+      std::vector<std::shared_ptr<Port> > to_flush;
+      {
+        Lock lock(mutex);
+        for (const auto &p : ports) to_flush.push_back(p.second);
+      }
+      const auto now = TxBatcher::clock::now();
+      for (const auto &port : to_flush)
+        port->queues.front()->flush_tx_expired(now);
+    }
+  }
+
+ private:
+  using Mutex = std::mutex;
+  using Lock = std::lock_guard<std::mutex>;
+
+  unsigned int queues_per_port;
+  unsigned int tx_batch;
+  PacketHandler pkt_handler{};
+  void *pkt_cookie{nullptr};
+  std::thread tx_flush_thread{};
+  Mutex tx_flush_mutex{};
+  std::condition_variable tx_flush_cv{};
+  bool tx_flush_stop{false};
+  bool started{false};
+  mutable Mutex mutex;
+  std::map<port_t, std::shared_ptr<Port> > ports;
+  std::map<port_t, DevMgrIface::PortInfo> port_info;
+};
+
+void
+DevMgr::set_dev_mgr_af_packet(
+    int device_id, std::shared_ptr<TransportIface> notifications_transport,
+    unsigned int queues_per_port, unsigned int tx_batch) {
+  assert(!pimp);
+  pimp = std::unique_ptr<DevMgrIface>(
+      new AfPacketDevMgrImp(device_id, notifications_transport,
+                            queues_per_port, tx_batch));
+}
+
+}  // namespace bm
+
+#endif  // BMAFPACKET_ON
@@ -0,0 +1,299 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <bm/bm_sim/dev_mgr.h>
+#include <bm/bm_sim/logger.h>
+#include <bm/bm_sim/shm_ring.h>
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace bm {
+
+// private implementation
+
+// Implementation which exchanges packets with an external process (e.g. a
+// traffic generator using bm_apps::ShmPacketInject) through a pair of
+// single-producer / single-consumer rings in a shared memory segment. Compared
+// to the nanomsg packet-in implementation, there is no system call and no
+// message allocation per packet:
+//   - the receive thread dequeues messages in batches and hands packets to the
+//     packet handler directly from the shared memory
+//   - transmitted packets are copied to the next free slot of the outgoing
+//     ring; transmit_fn_ calls are serialized, since the ring has a single
+//     producer
+// Port management is done through messages, like with the nanomsg backend.
+// The external process is not trusted: the rings check the indices it writes
+// (see ShmRing) and packets whose length does not fit in a slot are dropped.
+
+namespace {
+
+constexpr size_t rx_batch = 64;
+// number of times the receive thread polls an empty ring before it starts
+// sleeping, which trades a bit of latency for an idle CPU core
+constexpr unsigned int rx_spin_count = 1024;
+constexpr auto rx_idle_sleep = std::chrono::microseconds(50);
+
+}  // namespace
+
+class ShmDevMgrImp : public DevMgrIface {
+ public:
+  ShmDevMgrImp(int device_id, std::unique_ptr<ShmPacketChannel> channel,
+               std::shared_ptr<TransportIface> notifications_transport,
+               bool enforce_ports)
+      : shm_name(channel->get_name()), channel(std::move(channel)),
+        enforce_ports(enforce_ports) {
+    p_monitor = PortMonitorIface::make_passive(device_id,
+                                               notifications_transport);
+  }
+
+ private:
+  using MsgType = ShmPacketChannel::MsgType;
+  using ShmMsgHdr = ShmRing::ShmMsgHdr;
+
+  ~ShmDevMgrImp() override {
+    if (started) {
+      stop_receive_thread = true;
+      receive_thread.join();
+    }
+  }
+
+  ReturnCode port_add_(const std::string &iface_name, port_t port_num,
+                       const char *in_pcap, const char *out_pcap) override {
+    (void) iface_name;
+    (void) port_num;
+    (void) in_pcap;
+    (void) out_pcap;
+    Logger::get()->warn("When using shared memory packet in, port_add is "
+                        "done through messages");
+    return ReturnCode::UNSUPPORTED;
+  }
+
+  ReturnCode port_remove_(port_t port_num) override {
+    (void) port_num;
+    Logger::get()->warn("When using shared memory packet in, port_remove is "
+                        "done through messages");
+    return ReturnCode::UNSUPPORTED;
+  }
+
+  void transmit_fn_(int port_num, const char *buffer, int len) override {
+    auto *ring = channel->from_switch();
+    if (static_cast<uint32_t>(len) > ring->max_data_size()) {
+      BMLOG_DEBUG("Dropping packet of size {} on port {}, larger than the "
+                  "shared memory slots", len, port_num);
+      return;
+    }
+    ShmRing::MsgDesc msg{MsgType::MSG_TYPE_PACKET_OUT, port_num,
+                         static_cast<uint32_t>(len), buffer};
+    size_t sent;
+    {
+      std::lock_guard<std::mutex> lock(tx_mutex);
+      sent = ring->push_batch(&msg, 1);
+    }
+    if (sent == 0) {
+      BMLOG_DEBUG("Dropping packet on port {}, shared memory ring full",
+                  port_num);
+    } else {
+      BMLOG_TRACE("Packet out sent for port {}", port_num);
+    }
+  }
+
+  void start_() override {
+    if (started) return;
+    receive_thread = std::thread(&ShmDevMgrImp::receive_loop, this);
+    started = true;
+  }
+
+  ReturnCode set_packet_handler_(const PacketHandler &handler, void *cookie)
+      override {
+    pkt_handler = handler;
+    pkt_cookie = cookie;
+    return ReturnCode::SUCCESS;
+  }
+
+  bool port_is_up_(port_t port) const override {
+    if (!enforce_ports) return true;
+    Lock lock(mutex);
+    auto it = port_info.find(port);
+    return (it != port_info.end() && it->second.is_up);
+  }
+
+  std::map<port_t, PortInfo> get_port_info_() const override {
+    Lock lock(mutex);
+    return port_info;
+  }
+
+  void do_port_add(port_t port) {
+    {
+      Lock lock(mutex);
+      auto it = port_info.find(port);
+      if (it != port_info.end()) return;
+      PortInfo p_info(port, "N/A");
+      p_info.add_extra("shm_name", shm_name);
+      port_info.emplace(port, std::move(p_info));
+    }
+
+    if (!enforce_ports) return;
+    p_monitor->notify(port, PortStatus::PORT_ADDED);
+    p_monitor->notify(port, PortStatus::PORT_UP);
+  }
+
+  void do_port_remove(port_t port) {
+    {
+      Lock lock(mutex);
+      auto it = port_info.find(port);
+      if (it == port_info.end()) return;
+      port_info.erase(it);
+    }
+
+    if (!enforce_ports) return;
+    p_monitor->notify(port, PortStatus::PORT_REMOVED);
+  }
+
+  void do_port_set_status(port_t port, PortStatus status) {
+    {
+      Lock lock(mutex);
+      auto it = port_info.find(port);
+      if (it == port_info.end()) return;
+      it->second.set_is_up(status == PortStatus::PORT_UP);
+    }
+
+    if (!enforce_ports) return;
+    p_monitor->notify(port, status);
+  }
+
+  void handle_msg(const ShmMsgHdr &hdr, const char *data,
+                  uint32_t max_data_size) {
+    switch (hdr.type) {
+      case MsgType::MSG_TYPE_PORT_ADD:
+        do_port_add(hdr.port);
+        break;
+      case MsgType::MSG_TYPE_PORT_REMOVE:
+        do_port_remove(hdr.port);
+        break;
+      case MsgType::MSG_TYPE_PORT_SET_STATUS:
+        switch (hdr.more) {
+          case ShmPacketChannel::MSG_PORT_STATUS_DOWN:
+            do_port_set_status(hdr.port, PortStatus::PORT_DOWN);
+            break;
+          case ShmPacketChannel::MSG_PORT_STATUS_UP:
+            do_port_set_status(hdr.port, PortStatus::PORT_UP);
+            break;
+          default:
+            Logger::get()->error("Unknown port status requested");
+            break;
+        }
+        break;
+      case MsgType::MSG_TYPE_PACKET_IN:
+        // the length comes from the external process, it must not make us
+        // read past the slot
+        if (hdr.more > max_data_size ||
+            hdr.more > static_cast<uint32_t>(
+                std::numeric_limits<int>::max())) {
+          Logger::get()->error("Dropping packet in with invalid length {}",
+                               hdr.more);
+          break;
+        }
+        if (enforce_ports && !port_is_up_(hdr.port)) break;
+        if (pkt_handler) {
+          BMLOG_TRACE("Packet in received on port {}", hdr.port);
+          pkt_handler(hdr.port, data, static_cast<int>(hdr.more), pkt_cookie);
+        }
+        break;
+      case MsgType::MSG_TYPE_PACKET_OUT:
+        Logger::get()->error("Invalid PACKET_OUT message received");
+        break;
+      default:
+        Logger::get()->error("Unknown message type");
+        break;
+    }
+  }
+
+  void receive_loop() {
+    auto *ring = channel->to_switch();
+    const uint32_t max_data_size = ring->max_data_size();
+    auto handle = [this, max_data_size](const ShmMsgHdr &hdr,
+                                        const char *data) {
+      handle_msg(hdr, data, max_data_size);
+    };
+    unsigned int idle = 0;
+    while (!stop_receive_thread) {
+      if (ring->pop_batch(rx_batch, handle) > 0) {
+        idle = 0;
+      } else if (ring->has_peer_error()) {
+        Logger::get()->error("Invalid ring index written to shared memory "
+                             "segment '{}', no longer receiving packets",
+                             shm_name);
+        return;
+      } else if (idle < rx_spin_count) {
+        idle++;
+        std::this_thread::yield();
+      } else {
+        std::this_thread::sleep_for(rx_idle_sleep);
+      }
+    }
+  }
+
+ private:
+  using Mutex = std::mutex;
+  using Lock = std::lock_guard<std::mutex>;
+
+  std::string shm_name;
+  std::unique_ptr<ShmPacketChannel> channel{nullptr};
+  PacketHandler pkt_handler{};
+  void *pkt_cookie{nullptr};
+  std::thread receive_thread{};
+  std::atomic<bool> stop_receive_thread{false};
+  std::atomic<bool> started{false};
+  bool enforce_ports{false};
+  // serializes the producers of the outgoing ring
+  std::mutex tx_mutex{};
+  mutable Mutex mutex;
+  std::map<port_t, DevMgrIface::PortInfo> port_info;
+};
+
+DevMgr::ReturnCode
+DevMgr::set_dev_mgr_shm(
+    int device_id, const std::string &shm_name,
+    std::shared_ptr<TransportIface> notifications_transport,
+    bool enforce_ports, unsigned int nb_slots, unsigned int slot_size) {
+  assert(!pimp);
+  auto channel = ShmPacketChannel::create(shm_name, nb_slots, slot_size);
+  if (!channel) {
+    Logger::get()->error("Cannot create shared memory segment '{}': {}",
+                         shm_name, std::strerror(errno));
+    return ReturnCode::ERROR;
+  }
+  pimp = std::unique_ptr<DevMgrIface>(
+      new ShmDevMgrImp(device_id, std::move(channel), notifications_transport,
+                       enforce_ports));
+  return ReturnCode::SUCCESS;
+}
+
+}  // namespace bm
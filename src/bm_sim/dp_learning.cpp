@@ -0,0 +1,156 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <bm/bm_sim/dp_learning.h>
+#include <bm/bm_sim/logger.h>
+#include <bm/bm_sim/match_tables.h>
+#include <bm/bm_sim/packet.h>
+#include <bm/bm_sim/phv.h>
+
+#include <algorithm>  // for std::min, std::find_if
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bm {
+
+DataPlaneLearner::DataPlaneLearner(unsigned int max_rate, unsigned int burst)
+    : max_rate(max_rate), burst(std::max(burst, 1u)), tokens(this->burst),
+      last_refill(clock::now()) { }
+
+void
+DataPlaneLearner::add_rule(MatchTable *table,
+                           std::vector<field_t> key_fields,
+                           const ActionFn *action_fn,
+                           std::vector<field_t> action_data_fields,
+                           unsigned int ttl_ms) {
+  rules.push_back({table, std::move(key_fields), action_fn,
+                   std::move(action_data_fields), ttl_ms});
+}
+
+void
+DataPlaneLearner::clear_rules() {
+  rules.clear();
+}
+
+bool
+DataPlaneLearner::take_token() {
+  if (max_rate == 0) return true;
+  std::lock_guard<std::mutex> lock(bucket_mutex);
+  const auto now = clock::now();
+  const std::chrono::duration<double> elapsed = now - last_refill;
+  last_refill = now;
+  tokens = std::min(burst, tokens + elapsed.count() * max_rate);
+  if (tokens < 1.) return false;
+  tokens -= 1.;
+  return true;
+}
+
+bool
+DataPlaneLearner::learn(const Packet &pkt) {
+  if (!take_token()) {
+    rate_limited++;
+    return false;
+  }
+
+  const PHV &phv = *pkt.get_phv();
+  bool new_entry = false;
+  for (const auto &rule : rules) {
+    std::vector<MatchKeyParam> match_key;
+    match_key.reserve(rule.key_fields.size());
+    bool valid = true;
+    for (const auto &f : rule.key_fields) {
+      if (!phv.get_header(f.first).is_valid()) {
+        valid = false;
+        break;
+      }
+      const auto &bytes = phv.get_field(f.first, f.second).get_bytes();
+      match_key.emplace_back(MatchKeyParam::Type::EXACT,
+                             std::string(bytes.data(), bytes.size()));
+    }
+    if (!valid) continue;
+
+    ActionData action_data;
+    for (const auto &f : rule.action_data_fields)
+      action_data.push_back_action_data(phv.get_field(f.first, f.second));
+
+    entry_handle_t handle;
+    bool added;
+    const auto rc = rule.table->add_or_refresh_entry(
+        match_key, rule.action_fn, std::move(action_data), rule.ttl_ms,
+        &handle, &added);
+    if (rc != MatchErrorCode::SUCCESS) {
+      BMLOG_DEBUG_PKT(pkt, "Data plane learning failed for table '{}'",
+                      rule.table->get_name());
+      errors++;
+    } else if (added) {
+      new_entry = true;
+      this->added++;
+    } else {
+      refreshed++;
+    }
+  }
+  return new_entry;
+}
+
+size_t
+DataPlaneLearner::remove_aged_entries(
+    MatchTableAbstract *table, const std::vector<entry_handle_t> &handles) {
+  auto it = std::find_if(rules.begin(), rules.end(), [table](const Rule &r) {
+      return static_cast<MatchTableAbstract *>(r.table) == table; });
+  if (it == rules.end()) return 0;
+  MatchTable *mt = it->table;
+  // the rules which learn from the same key fields, their entries are removed
+  // together with the aged ones
+  std::vector<MatchTable *> linked_tables;
+  for (const auto &r : rules) {
+    if (r.table != mt && r.key_fields == it->key_fields)
+      linked_tables.push_back(r.table);
+  }
+  size_t removed = 0;
+  for (const auto handle : handles) {
+    // the entry may have been refreshed since the sweep
+    MatchTable::Entry entry;
+    if (mt->get_entry(handle, &entry) != MatchErrorCode::SUCCESS) continue;
+    if (entry.timeout_ms == 0 || entry.time_since_hit_ms < entry.timeout_ms)
+      continue;
+    if (mt->delete_entry(handle) != MatchErrorCode::SUCCESS) continue;
+    removed++;
+    for (auto linked_table : linked_tables) {
+      MatchTable::Entry linked_entry;
+      if (linked_table->get_entry_from_key(entry.match_key, &linked_entry) !=
+          MatchErrorCode::SUCCESS) continue;
+      if (linked_table->delete_entry(linked_entry.handle) ==
+          MatchErrorCode::SUCCESS) removed++;
+    }
+  }
+  BMLOG_DEBUG("Data plane learning removed {} aged entries from table '{}'",
+              removed, mt->get_name());
+  aged_out += removed;
+  return removed;
+}
+
+DataPlaneLearner::Stats
+DataPlaneLearner::get_stats() const {
+  return {added.load(), refreshed.load(), rate_limited.load(), errors.load(),
+          aged_out.load()};
+}
+
+}  // namespace bm
@@ -28,20 +28,22 @@
 #include <bm/bm_sim/pipeline.h>
 #include <bm/bm_sim/checksums.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace bm {
 
-enum EventType {
-  PACKET_IN = 0, PACKET_OUT,
-  PARSER_START, PARSER_DONE, PARSER_EXTRACT,
-  DEPARSER_START, DEPARSER_DONE, DEPARSER_EMIT,
-  CHECKSUM_UPDATE,
-  PIPELINE_START, PIPELINE_DONE,
-  CONDITION_EVAL, TABLE_HIT, TABLE_MISS,
-  ACTION_EXECUTE,
-  CONFIG_CHANGE = 999
-};
+using EventType = EventLogger::EventType;
 
 struct msg_hdr_t {
   int type;
@@ -65,10 +67,280 @@ fill_msg_hdr(EventType type, int device_id,
   msg_hdr->copy_id = packet.get_copy_id();
 }
 
+// Single-producer single-consumer ring of fixed-size message slots. The
+// producer is the thread which owns the ring, the consumer is the background
+// thread of the logger.
+class EventRing {
+ public:
+  // big enough for all the messages defined in this file
+  static constexpr size_t max_msg_size = 60;
+
+  explicit EventRing(size_t size)
+      : slots(new Slot[size]), mask(size - 1) { }
+
+  // returns false (and counts a drop) if the ring is full
+  bool push(const char *msg, size_t len) {
+    assert(len <= max_msg_size);
+    const size_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) > mask) {
+      dropped.store(dropped.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+      return false;
+    }
+    auto &slot = slots[h & mask];
+    std::memcpy(slot.data.data(), msg, len);
+    slot.len = static_cast<uint32_t>(len);
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // calls f(data, len) for every message in the ring, returns the number of
+  // messages consumed
+  template <typename F>
+  size_t consume(F f) {
+    const size_t t = tail.load(std::memory_order_relaxed);
+    const size_t h = head.load(std::memory_order_acquire);
+    for (size_t i = t; i != h; i++) {
+      const auto &slot = slots[i & mask];
+      f(slot.data.data(), slot.len);
+    }
+    tail.store(h, std::memory_order_release);
+    return h - t;
+  }
+
+  uint64_t get_dropped() const {
+    return dropped.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Slot {
+    uint32_t len;
+    std::array<char, max_msg_size> data;
+  };
+
+  std::unique_ptr<Slot[]> slots;
+  const size_t mask;
+  // the padding keeps producer and consumer indices in different cache lines
+  char pad0[64];
+  std::atomic<size_t> head{0};
+  std::atomic<uint64_t> dropped{0};
+  char pad1[64];
+  std::atomic<size_t> tail{0};
+};
+
+// The rings of an AsyncState. The ring of a thread which exits is not freed
+// but put on the free list, and reused by the next thread which needs one: the
+// messages it still holds are sent by the background thread as usual.
+struct RingPool {
+  explicit RingPool(size_t ring_size)
+      : ring_size(ring_size) { }
+
+  EventRing *acquire() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!free_rings.empty()) {
+      auto ring = free_rings.back();
+      free_rings.pop_back();
+      return ring;
+    }
+    rings.emplace_back(new EventRing(ring_size));
+    return rings.back().get();
+  }
+
+  void release(EventRing *ring) {
+    std::unique_lock<std::mutex> lock(mutex);
+    free_rings.push_back(ring);
+  }
+
+  std::vector<EventRing *> get_rings() const {
+    std::unique_lock<std::mutex> lock(mutex);
+    std::vector<EventRing *> rings_;
+    for (const auto &ring : rings) rings_.push_back(ring.get());
+    return rings_;
+  }
+
+  const size_t ring_size;
+  mutable std::mutex mutex{};
+  std::vector<std::unique_ptr<EventRing> > rings{};
+  std::vector<EventRing *> free_rings{};
+};
+
+// The rings used by a thread, one per logger; they are given back to their
+// pool when the thread exits, unless the logger was destroyed first.
+class ThreadRings {
+ public:
+  ~ThreadRings() {
+    for (const auto &e : entries) {
+      if (auto pool = e.pool.lock()) pool->release(e.ring);
+    }
+  }
+
+  EventRing *get(const std::shared_ptr<RingPool> &pool) {
+    for (const auto &e : entries) {
+      // compares the control blocks, which cannot be re-used while we hold a
+      // weak_ptr, unlike the address of a destroyed pool
+      if (!e.pool.owner_before(pool) && !pool.owner_before(e.pool))
+        return e.ring;
+    }
+    entries.erase(
+        std::remove_if(entries.begin(), entries.end(),
+                       [](const Entry &e) { return e.pool.expired(); }),
+        entries.end());
+    entries.push_back({pool, pool->acquire()});
+    return entries.back().ring;
+  }
+
+ private:
+  struct Entry {
+    std::weak_ptr<RingPool> pool;
+    EventRing *ring;
+  };
+
+  std::vector<Entry> entries{};
+};
+
+thread_local ThreadRings thread_rings;
+
+const char *const event_names[EventLogger::num_packet_event_types] = {
+  "packet_in", "packet_out",
+  "parser_start", "parser_done", "parser_extract",
+  "deparser_start", "deparser_done", "deparser_emit",
+  "checksum_update",
+  "pipeline_start", "pipeline_done",
+  "condition_eval", "table_hit", "table_miss",
+  "action_execute"
+};
+
 }  // namespace
 
+struct EventLogger::AsyncState {
+  AsyncState(const EventLogger *logger, size_t ring_size)
+      : logger(logger), pool(std::make_shared<RingPool>(ring_size)) {
+    thread = std::thread(&AsyncState::drain_loop, this);
+  }
+
+  ~AsyncState() {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      stop = true;
+    }
+    cv.notify_one();
+    thread.join();
+    drain();
+  }
+
+  EventRing *get_ring() {
+    return thread_rings.get(pool);
+  }
+
+  size_t drain() {
+    size_t count = 0;
+    for (auto ring : pool->get_rings()) {
+      count += ring->consume([this](const char *msg, size_t len) {
+          logger->transport_instance->send(msg, static_cast<int>(len));
+      });
+    }
+    sent.store(sent.load(std::memory_order_relaxed) + count,
+               std::memory_order_relaxed);
+    return count;
+  }
+
+  void drain_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stop) {
+      lock.unlock();
+      auto count = drain();
+      lock.lock();
+      // only sleep when there was nothing to send
+      if (count == 0) cv.wait_for(lock, std::chrono::milliseconds(1));
+    }
+  }
+
+  uint64_t get_dropped() const {
+    uint64_t dropped = 0;
+    for (auto ring : pool->get_rings()) dropped += ring->get_dropped();
+    return dropped;
+  }
+
+  const EventLogger *logger;
+  std::shared_ptr<RingPool> pool;
+  mutable std::mutex mutex{};
+  std::condition_variable cv{};
+  bool stop{false};
+  std::atomic<uint64_t> sent{0};
+  std::thread thread{};
+};
+
+constexpr size_t EventLogger::num_packet_event_types;
+constexpr size_t EventLogger::default_ring_size;
+
+EventLogger::EventLogger(std::unique_ptr<TransportIface> transport,
+                         int device_id)
+    : transport_instance(std::move(transport)), device_id(device_id),
+      sampling_rates(num_packet_event_types, 1) { }
+
+EventLogger::~EventLogger() = default;
+
+void
+EventLogger::enable_async(size_t ring_size) {
+  if (async) return;
+  size_t size = 1;
+  while (size < ring_size) size <<= 1;
+  async.reset(new AsyncState(this, size));
+}
+
+void
+EventLogger::set_sampling_rate(EventType type, unsigned int one_in_n) {
+  if (static_cast<size_t>(type) >= num_packet_event_types) return;
+  sampling_rates[type] = one_in_n;
+}
+
+bool
+EventLogger::set_sampling_rate(const std::string &event_name,
+                               unsigned int one_in_n) {
+  for (size_t i = 0; i < num_packet_event_types; i++) {
+    if (event_name == event_names[i]) {
+      set_sampling_rate(static_cast<EventType>(i), one_in_n);
+      return true;
+    }
+  }
+  return false;
+}
+
+EventLogger::Stats
+EventLogger::get_stats() const {
+  Stats stats = {0, 0, 0};
+  if (async) {
+    stats.sent = async->sent.load(std::memory_order_relaxed);
+    stats.dropped = async->get_dropped();
+    stats.rings = async->pool->get_rings().size();
+  } else {
+    stats.sent = sent_sync.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+bool
+EventLogger::is_sampled(EventType type, const Packet &packet) const {
+  const auto rate = sampling_rates[type];
+  if (rate == 1) return true;
+  if (rate == 0) return false;
+  return (packet.get_packet_id() % rate) == 0;
+}
+
+void
+EventLogger::send(const char *msg, size_t len) {
+  if (async) {
+    async->get_ring()->push(msg, len);
+  } else {
+    transport_instance->send(msg, static_cast<int>(len));
+    sent_sync.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
 void
 EventLogger::packet_in(const Packet &packet) {
+  if (!is_sampled(EventType::PACKET_IN, packet)) return;
+
   struct msg_t : msg_hdr_t {
     int port_in;
   } __attribute__((packed));
@@ -76,11 +348,13 @@ EventLogger::packet_in(const Packet &packet) {
   msg_t msg;
   fill_msg_hdr(EventType::PACKET_IN, device_id, packet, &msg);
   msg.port_in = packet.get_ingress_port();
-  transport_instance->send(reinterpret_cast<char *>(&msg), sizeof(msg));
+  send(reinterpret_cast<char *>(&msg), sizeof(msg));
 }
 
 void
 EventLogger::packet_out(const Packet &packet) {
+  if (!is_sampled(EventType::PACKET_OUT, packet)) return;
+
   struct msg_t : msg_hdr_t {
     int port_out;
   } __attribute__((packed));
@@ -88,11 +362,13 @@ EventLogger::packet_out(const Packet &packet) {
   msg_t msg;
   fill_msg_hdr(EventType::PACKET_OUT, device_id, packet, &msg);
   msg.port_out = packet.get_egress_port();
-  transport_instance->send(reinterpret_cast<char *>(&msg), sizeof(msg));
+  send(reinterpret_cast<char *>(&msg), sizeof(msg));
 }
 
 void
 EventLogger::parser_start(const Packet &packet, const Parser &parser) {
+  if (!is_sampled(EventType::PARSER_START, packet)) return;
+
   struct msg_t : msg_hdr_t {
     int parser_id;
   } __attribute__((packed));
@@ -100,11 +376,13 @@ EventLogger::parser_start(const Packet &packet, const Parser &parser) {
   msg_t msg;
   fill_msg_hdr(EventType::PARSER_START, device_id, packet, &msg);
   msg.parser_id = parser.get_id();
-  transport_instance->send(reinterpret_cast<char *>(&msg), sizeof(msg));
+  send(reinterpret_cast<char *>(&msg), sizeof(msg));
 }
 
 void
 EventLogger::parser_done(const Packet &packet, const Parser &parser) {
+  if (!is_sampled(EventType::PARSER_DONE, packet)) return;
+
   struct msg_t : msg_hdr_t {
     int parser_id;
   } __attribute__((packed));
@@ -112,11 +390,13 @@ EventLogger::parser_done(const Packet &packet, const Parser &parser) {
   msg_t msg;
   fill_msg_hdr(EventType::PARSER_DONE, device_id, packet, &msg);
   msg.parser_id = parser.get_id();
-  transport_instance->send(reinterpret_cast<char *>(&msg), sizeof(msg));
+  send(reinterpret_cast<char *>(&msg), sizeof(msg));
 }
 
 void
 EventLogger::parser_extract(const Packet &packet, header_id_t header) {
+  if (!is_sampled(EventType::PARSER_EXTRACT, packet)) return;
+
   struct msg_t : msg_hdr_t {
     int header_id;
   } __attribute__((packed));
@@ -124,11 +404,13 @@ EventLogger::parser_extract(const Packet &packet, header_id_t header) {
   msg_t msg;
   fill_msg_hdr(EventType::PARSER_EXTRACT, device_id, packet, &msg);
   msg.header_id = header;
-  transport_instance->send(reinterpret_cast<char *>(&msg), sizeof(msg));
+  send(reinterpret_cast<char *>(&msg), sizeof(msg));
 }
 
 void
 EventLogger::deparser_start(const Packet &packet, const Deparser &deparser) {
+  if (!is_sampled(EventType::DEPARSER_START, packet)) return;
+
   struct msg_t : msg_hdr_t {
     int deparser_id;
   } __attribute__((packed));
@@ -136,11 +418,13 @@ EventLogger::deparser_start(const Packet &packet, const Deparser &deparser) {
   msg_t msg;
   fill_msg_hdr(EventType::DEPARSER_START, device_id, packet, &msg);
   msg.deparser_id = deparser.get_id();
-  transport_instance->send(reinterpret_cast<char *>(&msg), sizeof(msg));
+  send(reinterpret_cast<char *>(&msg), sizeof(msg));
 }
 
 void
 EventLogger::deparser_done(const Packet &packet, const Deparser &deparser) {
+  if (!is_sampled(EventType::DEPARSER_DONE, packet)) return;
+
   struct msg_t : msg_hdr_t {
     int deparser_id;
   } __attribute__((packed));
@@ -148,11 +432,13 @@ EventLogger::deparser_done(const Packet &packet, const Deparser &deparser) {
   msg_t msg;
   fill_msg_hdr(EventType::DEPARSER_DONE, device_id, packet, &msg);
   msg.deparser_id = deparser.get_id();
-  transport_instance->send(reinterpret_cast<char *>(&msg), sizeof(msg));
+  send(reinterpret_cast<char *>(&msg), sizeof(msg));
 }
 
 void
 EventLogger::deparser_emit(const Packet &packet, header_id_t header) {
+  if (!is_sampled(EventType::DEPARSER_EMIT, packet)) return;
+
   struct msg_t : msg_hdr_t {
     int header_id;
   } __attribute__((packed));
@@ -160,11 +446,13 @@ EventLogger::deparser_emit(const Packet &packet, header_id_t header) {
   msg_t msg;
   fill_msg_hdr(EventType::DEPARSER_EMIT, device_id, packet, &msg);
   msg.header_id = header;
-  transport_instance->send(reinterpret_cast<char *>(&msg), sizeof(msg));
+  send(reinterpret_cast<char *>(&msg), sizeof(msg));
 }
 
 void
 EventLogger::checksum_update(const Packet &packet, const Checksum &checksum) {
+  if (!is_sampled(EventType::CHECKSUM_UPDATE, packet)) return;
+
   struct msg_t : msg_hdr_t {
     int checksum_id;
   } __attribute__((packed));
@@ -172,11 +460,13 @@ EventLogger::checksum_update(const Packet &packet, const Checksum &checksum) {
   msg_t msg;
   fill_msg_hdr(EventType::CHECKSUM_UPDATE, device_id, packet, &msg);
   msg.checksum_id = checksum.get_id();
-  transport_instance->send(reinterpret_cast<char *>(&msg), sizeof(msg));
+  send(reinterpret_cast<char *>(&msg), sizeof(msg));
 }
 
 void
 EventLogger::pipeline_start(const Packet &packet, const Pipeline &pipeline) {
+  if (!is_sampled(EventType::PIPELINE_START, packet)) return;
+
   struct msg_t : msg_hdr_t {
     int pipeline_id;
   } __attribute__((packed));
@@ -184,11 +474,13 @@ EventLogger::pipeline_start(const Packet &packet, const Pipeline &pipeline) {
   msg_t msg;
   fill_msg_hdr(EventType::PIPELINE_START, device_id, packet, &msg);
   msg.pipeline_id = pipeline.get_id();
-  transport_instance->send(reinterpret_cast<char *>(&msg), sizeof(msg));
+  send(reinterpret_cast<char *>(&msg), sizeof(msg));
 }
 
 void
 EventLogger::pipeline_done(const Packet &packet, const Pipeline &pipeline) {
+  if (!is_sampled(EventType::PIPELINE_DONE, packet)) return;
+
   struct msg_t : msg_hdr_t {
     int pipeline_id;
   } __attribute__((packed));
@@ -196,12 +488,14 @@ EventLogger::pipeline_done(const Packet &packet, const Pipeline &pipeline) {
   msg_t msg;
   fill_msg_hdr(EventType::PIPELINE_DONE, device_id, packet, &msg);
   msg.pipeline_id = pipeline.get_id();
-  transport_instance->send(reinterpret_cast<char *>(&msg), sizeof(msg));
+  send(reinterpret_cast<char *>(&msg), sizeof(msg));
 }
 
 void
 EventLogger::condition_eval(const Packet &packet,
                             const Conditional &cond, bool result) {
+  if (!is_sampled(EventType::CONDITION_EVAL, packet)) return;
+
   struct msg_t : msg_hdr_t {
     int condition_id;
     int result;  // 0 (true) or 1 (false);
@@ -211,7 +505,7 @@ EventLogger::condition_eval(const Packet &packet,
   fill_msg_hdr(EventType::CONDITION_EVAL, device_id, packet, &msg);
   msg.condition_id = cond.get_id();
   msg.result = result;
-  transport_instance->send(reinterpret_cast<char *>(&msg), sizeof(msg));
+  send(reinterpret_cast<char *>(&msg), sizeof(msg));
 }
 
 // static inline size_t get_pascal_str_size(const ByteContainer &src) {
@@ -227,6 +521,8 @@ EventLogger::condition_eval(const Packet &packet,
 void
 EventLogger::table_hit(const Packet &packet, const MatchTableAbstract &table,
                        entry_handle_t handle) {
+  if (!is_sampled(EventType::TABLE_HIT, packet)) return;
+
   struct msg_t : msg_hdr_t {
     int table_id;
     int entry_hdl;
@@ -236,11 +532,13 @@ EventLogger::table_hit(const Packet &packet, const MatchTableAbstract &table,
   fill_msg_hdr(EventType::TABLE_HIT, device_id, packet, &msg);
   msg.table_id = table.get_id();
   msg.entry_hdl = static_cast<int>(handle);
-  transport_instance->send(reinterpret_cast<char *>(&msg), sizeof(msg));
+  send(reinterpret_cast<char *>(&msg), sizeof(msg));
 }
 
 void
 EventLogger::table_miss(const Packet &packet, const MatchTableAbstract &table) {
+  if (!is_sampled(EventType::TABLE_MISS, packet)) return;
+
   struct msg_t : msg_hdr_t {
     int table_id;
   } __attribute__((packed));
@@ -248,13 +546,15 @@ EventLogger::table_miss(const Packet &packet, const MatchTableAbstract &table) {
   msg_t msg;
   fill_msg_hdr(EventType::TABLE_MISS, device_id, packet, &msg);
   msg.table_id = table.get_id();
-  transport_instance->send(reinterpret_cast<char *>(&msg), sizeof(msg));
+  send(reinterpret_cast<char *>(&msg), sizeof(msg));
 }
 
 void
 EventLogger::action_execute(const Packet &packet,
                             const ActionFn &action_fn,
                             const ActionData &action_data) {
+  if (!is_sampled(EventType::ACTION_EXECUTE, packet)) return;
+
   struct msg_t : msg_hdr_t {
     int action_id;
   } __attribute__((packed));
@@ -262,7 +562,7 @@ EventLogger::action_execute(const Packet &packet,
   msg_t msg;
   fill_msg_hdr(EventType::ACTION_EXECUTE, device_id, packet, &msg);
   msg.action_id = action_fn.get_id();
-  transport_instance->send(reinterpret_cast<char *>(&msg), sizeof(msg));
+  send(reinterpret_cast<char *>(&msg), sizeof(msg));
   // to costly to send action data?
   (void) action_data;
 }
@@ -273,7 +573,7 @@ EventLogger::config_change() {
   std::memset(&msg, 0, sizeof(msg));
   msg.type = static_cast<int>(EventType::CONFIG_CHANGE);
   msg.switch_id = device_id;
-  transport_instance->send(reinterpret_cast<char *>(&msg), sizeof(msg));
+  send(reinterpret_cast<char *>(&msg), sizeof(msg));
 }
 
 // TODO(antonin): move this?
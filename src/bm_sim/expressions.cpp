@@ -188,6 +188,9 @@ Expression::push_back_load_local(const int offset) {
 void
 Expression::push_back_load_register_ref(RegisterArray *register_array,
                                         unsigned int idx) {
+  // a Register reference is needed
+  assert(register_array->get_sync_mode() !=
+         RegisterArray::SyncMode::LOCK_FREE);
   Op op;
   op.opcode = ExprOpcode::LOAD_REGISTER_REF;
   op.register_ref.array = register_array;
@@ -197,6 +200,9 @@ Expression::push_back_load_register_ref(RegisterArray *register_array,
 
 void
 Expression::push_back_load_register_gen(RegisterArray *register_array) {
+  // a Register reference is needed
+  assert(register_array->get_sync_mode() !=
+         RegisterArray::SyncMode::LOCK_FREE);
   Op op;
   op.opcode = ExprOpcode::LOAD_REGISTER_GEN;
   op.register_array = register_array;
@@ -280,6 +286,9 @@ Expression::grab_register_accesses(RegisterSync *register_sync) const {
   for (auto &op : ops) {
     switch (op.opcode) {
       case ExprOpcode::LOAD_REGISTER_REF:
+        register_sync->add_register_index(op.register_ref.array,
+                                          op.register_ref.idx);
+        break;
       case ExprOpcode::LOAD_REGISTER_GEN:
         register_sync->add_register_array(op.register_array);
         break;
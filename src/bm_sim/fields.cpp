@@ -21,15 +21,16 @@
 #include <bm/bm_sim/fields.h>
 #include <bm/bm_sim/headers.h>
 
-#include <algorithm>  // for std::swap
+#include <algorithm>  // for std::swap, std::swap_ranges
 
 #include "extract.h"
 
 namespace bm {
 
 Field::Field(int nbits, Header *parent_hdr, bool arith_flag, bool is_signed,
-             bool hidden, bool VL, bool is_saturating)
-    : nbits(nbits), nbytes((nbits + 7) / 8), bytes(nbytes),
+             bool hidden, bool VL, bool is_saturating, char *storage)
+    : nbits(nbits), nbytes((nbits + 7) / 8), storage(VL ? nullptr : storage),
+      bytes(this->storage ? 0 : nbytes),
       parent_hdr(parent_hdr),
       is_signed(is_signed), hidden(hidden), VL(VL),
       is_saturating(is_saturating) {
@@ -56,7 +57,13 @@ void
 Field::swap_values(Field *other) {
   // do not swap arith!
   std::swap(value, other->value);
-  std::swap(bytes, other->bytes);
+  assert(!storage == !other->storage);
+  if (storage)
+    std::swap_ranges(storage, storage + nbytes, other->storage);
+  else
+    std::swap(bytes, other->bytes);
+  mark_parent_modified();
+  other->mark_parent_modified();
   if (VL) {
     std::swap(nbits, other->nbits);
     std::swap(nbytes, other->nbytes);
@@ -70,7 +77,8 @@ Field::swap_values(Field *other) {
 
 int
 Field::extract(const char *data, int hdr_offset) {
-  extract::generic_extract(data, hdr_offset, nbits, bytes.data());
+  extract::generic_extract(data, hdr_offset, nbits, bytes_data());
+  mark_parent_modified();
 
   if (arith) sync_value();
 
@@ -100,7 +108,7 @@ Field::deparse(char *data, int hdr_offset) const {
   // ByteContainer's [] operator. The right thing to do would probably be to add
   // a at() method to ByteContainer and not perform any check in [].
   // extract::generic_deparse(&bytes[0], nbits, data, hdr_offset);
-  extract::generic_deparse(bytes.data(), nbits, data, hdr_offset);
+  extract::generic_deparse(bytes_data(), nbits, data, hdr_offset);
   return nbits;
 }
 
@@ -123,6 +131,7 @@ Field::reset_VL() {
   nbits = 0;
   nbytes = 0;
   mask = 1;
+  mark_parent_modified();
   if (is_signed) {
     max = 1;
     min = 1;
@@ -134,7 +143,14 @@ Field::copy_value(const Field &src) {
   // it's important to have a way of copying a field value without the
   // packet_id pointer. This is used by PHV::copy_headers().
   value = src.value;
-  bytes = src.bytes;
+  const ByteView src_bytes = src.get_bytes();
+  if (storage) {
+    std::copy(src_bytes.begin(), src_bytes.end(), storage);
+  } else {
+    bytes.resize(src_bytes.size());
+    std::copy(src_bytes.begin(), src_bytes.end(), bytes.begin());
+  }
+  mark_parent_modified();
   if (VL) {
     nbits = src.nbits;
     nbytes = src.nbytes;
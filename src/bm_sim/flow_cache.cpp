@@ -0,0 +1,419 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <bm/bm_sim/flow_cache.h>
+#include <bm/bm_sim/actions.h>
+#include <bm/bm_sim/expressions.h>
+#include <bm/bm_sim/logger.h>
+#include <bm/bm_sim/match_tables.h>
+#include <bm/bm_sim/packet.h>
+#include <bm/bm_sim/phv.h>
+#include <bm/bm_sim/pipeline.h>
+
+#include <algorithm>  // for std::sort, std::unique
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace bm {
+
+constexpr size_t FlowCache::default_max_entries;
+
+thread_local FlowCacheRecorder *FlowCacheRecorder::current = nullptr;
+
+std::atomic<uint64_t> FlowCache::generation{0};
+
+bool
+FlowCacheRecorder::Input::operator<(const Input &other) const {
+  return std::tie(header, field_offset, kind) <
+      std::tie(other.header, other.field_offset, other.kind);
+}
+
+bool
+FlowCacheRecorder::Input::operator==(const Input &other) const {
+  return header == other.header && field_offset == other.field_offset &&
+      kind == other.kind;
+}
+
+FlowCacheRecorder::FlowCacheRecorder(const PHV &phv)
+    : phv(phv) { }
+
+void
+FlowCacheRecorder::add_field(header_id_t header, int field_offset,
+                             Input::Kind kind) {
+  // we would need to record the length of the field as well
+  if (phv.get_field(header, field_offset).is_VL()) {
+    set_uncacheable();
+    return;
+  }
+  inputs.push_back({header, field_offset, kind});
+}
+
+void
+FlowCacheRecorder::add_header(header_id_t header) {
+  inputs.push_back({header, -1, Input::Kind::VALIDITY});
+  const Header &hdr = phv.get_header(header);
+  for (size_t offset = 0; offset < hdr.size(); offset++)
+    add_field(header, offset, Input::Kind::FIELD);
+}
+
+void
+FlowCacheRecorder::add_expression(const Expression &expr) {
+  for (const auto &op : expr.get_ops()) {
+    switch (op.opcode) {
+      case ExprOpcode::LOAD_FIELD:
+        add_field(op.field.header, op.field.field_offset, Input::Kind::FIELD);
+        break;
+      case ExprOpcode::LOAD_HEADER:
+        // the header can be compared to another one or have one of its fields
+        // accessed, so we record everything
+        add_header(op.header);
+        break;
+      case ExprOpcode::LOAD_BOOL:
+      case ExprOpcode::LOAD_CONST:
+      case ExprOpcode::LOAD_LOCAL:
+      case ExprOpcode::ADD:
+      case ExprOpcode::SUB:
+      case ExprOpcode::MOD:
+      case ExprOpcode::DIV:
+      case ExprOpcode::MUL:
+      case ExprOpcode::SHIFT_LEFT:
+      case ExprOpcode::SHIFT_RIGHT:
+      case ExprOpcode::EQ_DATA:
+      case ExprOpcode::NEQ_DATA:
+      case ExprOpcode::GT_DATA:
+      case ExprOpcode::LT_DATA:
+      case ExprOpcode::GET_DATA:
+      case ExprOpcode::LET_DATA:
+      case ExprOpcode::EQ_HEADER:
+      case ExprOpcode::NEQ_HEADER:
+      case ExprOpcode::EQ_BOOL:
+      case ExprOpcode::NEQ_BOOL:
+      case ExprOpcode::AND:
+      case ExprOpcode::OR:
+      case ExprOpcode::NOT:
+      case ExprOpcode::BIT_AND:
+      case ExprOpcode::BIT_OR:
+      case ExprOpcode::BIT_XOR:
+      case ExprOpcode::BIT_NEG:
+      case ExprOpcode::VALID_HEADER:
+      case ExprOpcode::TERNARY_OP:
+      case ExprOpcode::SKIP:
+      case ExprOpcode::TWO_COMP_MOD:
+      case ExprOpcode::DATA_TO_BOOL:
+      case ExprOpcode::BOOL_TO_DATA:
+      case ExprOpcode::ACCESS_FIELD:
+        break;
+      default:
+        // registers, header stacks and header unions
+        set_uncacheable();
+        return;
+    }
+  }
+}
+
+void
+FlowCacheRecorder::record_table(const MatchTableAbstract &table,
+                                const ActionFn *action_fn) {
+  if (!cacheable) return;
+  // we do not track the state of action profiles, and group selection hashes
+  // fields which are not part of the match key
+  if (table.get_table_type() != MatchTableType::SIMPLE ||
+      table.has_lookup_side_effects()) {
+    set_uncacheable();
+    return;
+  }
+  for (const auto &in : table.get_match_key_builder().get_inputs()) {
+    if (in.second < 0) {
+      inputs.push_back({in.first, -1, Input::Kind::VALIDITY});
+    } else if (phv.get_field(in.first, in.second).is_hidden()) {
+      // hidden fields are always part of the key, see MatchKeyBuilder
+      add_field(in.first, in.second, Input::Kind::FIELD);
+    } else {
+      add_field(in.first, in.second, Input::Kind::MATCH_FIELD);
+    }
+  }
+  if (action_fn) record_action(action_fn);
+}
+
+void
+FlowCacheRecorder::record_condition(const Expression &expr) {
+  if (!cacheable) return;
+  add_expression(expr);
+}
+
+void
+FlowCacheRecorder::record_action(const ActionFn *action_fn) {
+  if (!cacheable) return;
+  for (const auto &primitive : action_fn->get_primitives()) {
+    if (!primitive.is_flow_cacheable()) {
+      set_uncacheable();
+      return;
+    }
+  }
+  // fields written by the action are recorded as well, which can make the
+  // cache entries more specific than necessary but never incorrect
+  for (const auto &param : action_fn->get_params()) {
+    switch (param.tag) {
+      case ActionParam::CONST:
+      case ActionParam::ACTION_DATA:
+      case ActionParam::STRING:
+        break;
+      case ActionParam::FIELD:
+        add_field(param.field.header, param.field.field_offset,
+                  Input::Kind::FIELD);
+        break;
+      case ActionParam::HEADER:
+        add_header(param.header);
+        break;
+      case ActionParam::EXPRESSION:
+        add_expression(*param.expression.ptr);
+        break;
+      default:
+        set_uncacheable();
+        return;
+    }
+  }
+}
+
+std::vector<FlowCacheRecorder::Input>
+FlowCacheRecorder::get_inputs() const {
+  auto sorted = inputs;
+  std::sort(sorted.begin(), sorted.end());
+  sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+  return sorted;
+}
+
+namespace {
+
+// state of the packet before the pipeline is applied
+struct PacketSnapshot {
+  PacketSnapshot(const PHV &phv, Packet *pkt) {
+    valid.reserve(phv.num_headers());
+    // logical header ids, which may differ from the physical order of the
+    // headers if header stacks were rotated
+    for (header_id_t h = 0; h < static_cast<header_id_t>(phv.num_headers());
+         h++) {
+      const Header &hdr = phv.get_header(h);
+      valid.push_back(hdr.is_valid());
+      first_field.push_back(fields.size());
+      for (const auto &f : hdr) fields.emplace_back(f.get_bytes());
+    }
+    for (size_t i = 0; i < Packet::nb_registers; i++)
+      registers.push_back(pkt->get_register(i));
+  }
+
+  bool is_valid(header_id_t header) const {
+    return valid[header];
+  }
+
+  const ByteContainer &get_bytes(header_id_t header, int field_offset) const {
+    return fields[first_field[header] + field_offset];
+  }
+
+  std::vector<bool> valid{};
+  std::vector<size_t> first_field{};
+  std::vector<ByteContainer> fields{};
+  std::vector<uint64_t> registers{};
+};
+
+// S provides is_valid(header) and get_bytes(header, field_offset)
+template <typename S>
+void
+build_key_common(const S &state,
+                 const std::vector<FlowCacheRecorder::Input> &inputs,
+                 std::string *key) {
+  using Kind = FlowCacheRecorder::Input::Kind;
+  key->clear();
+  for (const auto &in : inputs) {
+    const bool valid = state.is_valid(in.header);
+    // no need to include the value of a MATCH_FIELD if the header is invalid,
+    // the match key uses zeros in that case; all fields have a fixed width so
+    // there is no ambiguity
+    if (in.kind != Kind::FIELD) key->push_back(valid ? '\x01' : '\x00');
+    if (in.kind == Kind::FIELD || (in.kind == Kind::MATCH_FIELD && valid)) {
+      const auto &bytes = state.get_bytes(in.header, in.field_offset);
+      key->append(bytes.data(), bytes.size());
+    }
+  }
+}
+
+struct PHVState {
+  explicit PHVState(const PHV &phv)
+      : phv(phv) { }
+
+  bool is_valid(header_id_t header) const {
+    return phv.get_header(header).is_valid();
+  }
+
+  ByteView get_bytes(header_id_t header, int field_offset) const {
+    return phv.get_field(header, field_offset).get_bytes();
+  }
+
+  const PHV &phv;
+};
+
+}  // namespace
+
+FlowCache::FlowCache(size_t max_entries)
+    : max_entries(max_entries) { }
+
+void
+FlowCache::invalidate_all() {
+  generation.fetch_add(1, std::memory_order_release);
+}
+
+void
+FlowCache::flush() {
+  TelemetryTimer timer(&telemetry.flush_ns);
+  if (Telemetry::is_enabled()) {
+    telemetry.flushes.increment();
+    telemetry.flushed_entries.increment(num_entries);
+  }
+  subtables.clear();
+  num_entries = 0;
+  telemetry.entries.store(0, std::memory_order_relaxed);
+}
+
+void
+FlowCache::build_key(const PHV &phv, const std::vector<Input> &inputs,
+                     std::string *key) {
+  build_key_common(PHVState(phv), inputs, key);
+}
+
+const FlowCache::Result *
+FlowCache::lookup(const PHV &phv) {
+  for (const auto &subtable : subtables) {
+    build_key(phv, subtable.inputs, &key_buffer);
+    auto it = subtable.entries.find(key_buffer);
+    if (it != subtable.entries.end()) return &it->second;
+  }
+  return nullptr;
+}
+
+// invalidations first, in case the validated headers belong to the same
+// header unions
+void
+FlowCache::replay(const Result &result, Packet *pkt) {
+  PHV *phv = pkt->get_phv();
+  for (const auto header : result.invalidated)
+    phv->get_header(header).mark_invalid();
+  for (const auto header : result.validated)
+    phv->get_header(header).mark_valid();
+  for (const auto &w : result.writes) {
+    phv->get_field(w.header, w.field_offset).set_bytes(
+        w.value.data(), static_cast<int>(w.value.size()));
+  }
+  for (const auto &p : result.register_deltas)
+    pkt->set_register(p.first, pkt->get_register(p.first) + p.second);
+}
+
+void
+FlowCache::insert(std::vector<Input> inputs, std::string key, Result result) {
+  if (num_entries >= max_entries) flush();
+  auto it = std::find_if(
+      subtables.begin(), subtables.end(),
+      [&inputs](const Subtable &s) { return s.inputs == inputs; });
+  if (it == subtables.end()) {
+    subtables.emplace_back(std::move(inputs));
+    it = subtables.end() - 1;
+  }
+  if (it->entries.emplace(std::move(key), std::move(result)).second) {
+    num_entries++;
+    telemetry.entries.store(num_entries, std::memory_order_relaxed);
+  }
+}
+
+void
+FlowCache::miss(Pipeline *pipeline, Packet *pkt, uint64_t gen) {
+  TelemetryTimer timer(&telemetry.miss_ns);
+  PHV *phv = pkt->get_phv();
+  const PacketSnapshot before(*phv, pkt);
+  FlowCacheRecorder recorder(*phv);
+  {
+    FlowCacheRecorder::Scope scope(&recorder);
+    pipeline->apply(pkt);
+  }
+
+  auto uncacheable = [this, pkt](const char *reason) {
+    BMLOG_DEBUG_PKT(*pkt, "Flow cache: traversal cannot be cached ({})",
+                    reason);
+    if (Telemetry::is_enabled()) telemetry.uncacheable.increment();
+  };
+  if (!recorder.is_cacheable() || pkt->is_marked_for_exit())
+    return uncacheable("stateful or unsupported operation");
+  // a table was modified while the packet was going through the pipeline,
+  // the result may be a mix of the old and new entries
+  if (generation.load(std::memory_order_acquire) != gen)
+    return uncacheable("concurrent table update");
+
+  Result result;
+  size_t field_idx = 0;
+  for (header_id_t header = 0;
+       header < static_cast<header_id_t>(phv->num_headers()); header++) {
+    const Header &hdr = phv->get_header(header);
+    if (hdr.is_valid() != before.valid[header]) {
+      auto &changed = hdr.is_valid() ? result.validated : result.invalidated;
+      changed.push_back(header);
+    }
+    for (size_t offset = 0; offset < hdr.size(); offset++, field_idx++) {
+      const Field &f = hdr[offset];
+      const auto &bytes = f.get_bytes();
+      if (bytes == before.fields[field_idx]) continue;
+      if (f.is_VL()) return uncacheable("variable-length field write");
+      result.writes.push_back({header, static_cast<int>(offset),
+                               std::string(bytes.data(), bytes.size())});
+    }
+  }
+  for (size_t i = 0; i < before.registers.size(); i++) {
+    const uint64_t delta = pkt->get_register(i) - before.registers[i];
+    if (delta != 0) result.register_deltas.emplace_back(i, delta);
+  }
+
+  // the key is computed from the values before the traversal
+  auto inputs = recorder.get_inputs();
+  std::string key;
+  build_key_common(before, inputs, &key);
+  insert(std::move(inputs), std::move(key), std::move(result));
+}
+
+void
+FlowCache::apply(Pipeline *pipeline, Packet *pkt) {
+  const uint64_t gen = generation.load(std::memory_order_acquire);
+  if (gen != cache_generation || pipeline != cache_pipeline) {
+    if (num_entries > 0) flush();
+    cache_generation = gen;
+    cache_pipeline = pipeline;
+  }
+
+  const Result *result = lookup(*pkt->get_phv());
+  if (result) {
+    if (Telemetry::is_enabled()) telemetry.hits.increment();
+    BMLOG_DEBUG_PKT(*pkt, "Pipeline '{}': flow cache hit, applying {} field "
+                    "writes", pipeline->get_name(), result->writes.size());
+    replay(*result, pkt);
+    return;
+  }
+  if (Telemetry::is_enabled()) telemetry.misses.increment();
+  miss(pipeline, pkt, gen);
+}
+
+}  // namespace bm
@@ -0,0 +1,122 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <bm/bm_sim/group_selection.h>
+
+#include <numeric>  // for std::iota
+#include <utility>
+#include <vector>
+
+namespace bm {
+
+namespace {
+
+size_t round_up_pow2(size_t v) {
+  size_t p = 1;
+  while (p < v) p <<= 1;
+  return p;
+}
+
+// ties are broken using the member handle, so that the mapping does not
+// depend on the iteration order of the map
+template <typename M, typename Cmp>
+typename M::iterator find_member(M *mbr_buckets, Cmp better) {
+  auto best = mbr_buckets->end();
+  for (auto it = mbr_buckets->begin(); it != mbr_buckets->end(); ++it) {
+    if (best == mbr_buckets->end() ||
+        better(it->second.size(), best->second.size()) ||
+        (it->second.size() == best->second.size() && it->first < best->first))
+      best = it;
+  }
+  return best;
+}
+
+}  // namespace
+
+ResilientGroupSelector::ResilientGroupSelector(size_t nb_buckets)
+    : bucket_mask(round_up_pow2(nb_buckets) - 1) { }
+
+void
+ResilientGroupSelector::add_member_to_group(grp_hdl_t grp, mbr_hdl_t mbr) {
+  if (grp >= groups.size()) groups.resize(grp + 1);
+  auto &group = groups[grp];
+  auto &mbr_buckets = group.mbr_buckets;
+  if (mbr_buckets.find(mbr) != mbr_buckets.end()) return;
+  auto &mine = mbr_buckets[mbr];
+
+  const size_t nb_buckets = get_nb_buckets();
+  if (mbr_buckets.size() == 1) {
+    group.buckets.assign(nb_buckets, mbr);
+    mine.resize(nb_buckets);
+    std::iota(mine.begin(), mine.end(), 0);
+    return;
+  }
+
+  // the existing members have the same number of buckets (up to one), taking
+  // from the ones with the most preserves that property
+  const size_t target = nb_buckets / mbr_buckets.size();
+  while (mine.size() < target) {
+    auto donor = find_member(&mbr_buckets, [](size_t a, size_t b) {
+        return a > b; });
+    auto &theirs = donor->second;
+    const size_t bucket = theirs.back();
+    theirs.pop_back();
+    group.buckets[bucket] = mbr;
+    mine.push_back(bucket);
+  }
+}
+
+void
+ResilientGroupSelector::remove_member_from_group(grp_hdl_t grp,
+                                                 mbr_hdl_t mbr) {
+  if (grp >= groups.size()) return;
+  auto &group = groups[grp];
+  auto &mbr_buckets = group.mbr_buckets;
+  auto it = mbr_buckets.find(mbr);
+  if (it == mbr_buckets.end()) return;
+  const std::vector<size_t> orphans(std::move(it->second));
+  mbr_buckets.erase(it);
+
+  if (mbr_buckets.empty()) {
+    group.buckets.clear();
+    return;
+  }
+
+  // the other buckets are not remapped
+  for (const size_t bucket : orphans) {
+    auto heir = find_member(&mbr_buckets, [](size_t a, size_t b) {
+        return a < b; });
+    group.buckets[bucket] = heir->first;
+    heir->second.push_back(bucket);
+  }
+}
+
+void
+ResilientGroupSelector::reset() {
+  groups.clear();
+}
+
+std::vector<ResilientGroupSelector::mbr_hdl_t>
+ResilientGroupSelector::get_buckets(grp_hdl_t grp) const {
+  if (grp >= groups.size()) return {};
+  return groups[grp].buckets;
+}
+
+}  // namespace bm
@@ -77,6 +77,24 @@ HeaderType::HeaderType(const std::string &name, p4object_id_t id)
     : NamedP4Object(name, id) {
   const auto &fmap = HiddenFMap::map();
   for (auto p : fmap) fields_info.push_back(p.second);
+  update_storage_layout();
+}
+
+// fields are laid out in order, each one starting on a byte boundary; the
+// layout is recomputed every time a field is added, since the hidden fields
+// always come last
+void
+HeaderType::update_storage_layout() {
+  storage_offsets.clear();
+  storage_nbytes = 0;
+  for (const auto &f_info : fields_info) {
+    if (f_info.is_VL) {
+      storage_offsets.push_back(-1);
+      continue;
+    }
+    storage_offsets.push_back(static_cast<int>(storage_nbytes));
+    storage_nbytes += (f_info.bitwidth + 7) / 8;
+  }
 }
 
 int
@@ -87,6 +105,7 @@ HeaderType::push_back_field(const std::string &field_name, int field_bit_width,
   fields_info.insert(
       pos,
       {field_name, field_bit_width, is_signed, is_saturating, is_VL, false});
+  update_storage_layout();
   return offset;
 }
 
@@ -135,22 +154,31 @@ HeaderType::get_VL_max_header_bytes() const {
 Header::Header(const std::string &name, p4object_id_t id,
                const HeaderType &header_type,
                const std::set<int> &arith_offsets,
-               const bool metadata)
-    : NamedP4Object(name, id), header_type(header_type), metadata(metadata) {
+               const bool metadata, char *storage)
+    : NamedP4Object(name, id), header_type(header_type), storage(storage),
+      metadata(metadata) {
   // header_type_id = header_type.get_type_id();
+  fields.reserve(header_type.get_num_fields());
   for (int i = 0; i < header_type.get_num_fields(); i++) {
     const auto &finfo = header_type.get_finfo(i);
     bool arith_flag = true;
     if (arith_offsets.find(i) == arith_offsets.end()) {
       arith_flag = false;
     }
+    char *f_storage = nullptr;
+    if (storage && !finfo.is_VL)
+      f_storage = storage + header_type.get_storage_offset(i);
     fields.emplace_back(finfo.bitwidth, this, arith_flag, finfo.is_signed,
-                        finfo.is_hidden, finfo.is_VL, finfo.is_saturating);
+                        finfo.is_hidden, finfo.is_VL, finfo.is_saturating,
+                        f_storage);
     uint64_t field_unique_id = id;
     field_unique_id <<= 32;
     field_unique_id |= i;
     fields.back().set_id(field_unique_id);
-    if (!finfo.is_hidden) nbytes_packet += fields.back().get_nbits();
+    if (!finfo.is_hidden) {
+      nbytes_packet += fields.back().get_nbits();
+      fields.back().set_parent_modified_flag(&modified);
+    }
   }
   assert(nbytes_packet % 8 == 0);
   nbytes_packet /= 8;
@@ -218,15 +246,24 @@ Header::set_written_to(bool written_to_value) {
 
 void
 Header::extract(const char *data, const PHV &phv) {
-  if (is_VL_header()) return extract_VL(data, phv);
-  int hdr_offset = 0;
-  for (Field &f : fields) {
-    if (f.is_hidden()) break;  // all hidden fields are at the end
-    hdr_offset += f.extract(data, hdr_offset);
-    data += hdr_offset / 8;
-    hdr_offset = hdr_offset % 8;
+  const char *start = data;
+  if (is_VL_header()) {
+    extract_VL(data, phv);
+  } else {
+    int hdr_offset = 0;
+    for (Field &f : fields) {
+      if (f.is_hidden()) break;  // all hidden fields are at the end
+      hdr_offset += f.extract(data, hdr_offset);
+      data += hdr_offset / 8;
+      hdr_offset = hdr_offset % 8;
+    }
+    mark_valid();
   }
-  mark_valid();
+  // the field values now match the packet bytes, which the PHV keeps around
+  // until the deparser runs
+  packet_offset = phv.get_parse_offset(start);
+  packet_gen = phv.parse_gen;
+  modified = (packet_offset < 0);
 }
 
 template <typename Fn>
@@ -298,6 +335,10 @@ Header::get_field_full_name(int field_offset) const {
 
 void
 Header::swap_values(Header *other) {
+  // swapping the field values marks both headers as modified, but the packet
+  // bytes simply move with the values
+  bool my_modified = modified;
+  bool other_modified = other->modified;
   std::swap(valid, other->valid);
   // cannot do that, would invalidate references
   // std::swap(fields, other.fields);
@@ -305,6 +346,10 @@ Header::swap_values(Header *other) {
     fields[i].swap_values(&other->fields[i]);
   // in case header has a VL field
   std::swap(nbytes_packet, other->nbytes_packet);
+  std::swap(packet_offset, other->packet_offset);
+  std::swap(packet_gen, other->packet_gen);
+  modified = other_modified;
+  other->modified = my_modified;
 }
 
 void
@@ -313,6 +358,19 @@ Header::copy_fields(const Header &src) {
     fields[f].copy_value(src.fields[f]);
   // in case header has a VL field
   nbytes_packet = src.nbytes_packet;
+  packet_offset = src.packet_offset;
+  packet_gen = src.packet_gen;
+  modified = src.modified;
+}
+
+void
+Header::copy_fields_no_storage(const Header &src) {
+  for (size_t f = 0; f < fields.size(); f++)
+    fields[f].copy_value_no_storage(src.fields[f]);
+  nbytes_packet = src.nbytes_packet;
+  packet_offset = src.packet_offset;
+  packet_gen = src.packet_gen;
+  modified = src.modified;
 }
 
 bool
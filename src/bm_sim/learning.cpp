@@ -28,20 +28,38 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
 #include <unordered_map>
 #include <unordered_set>
 #include <chrono>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <utility>
 
 #include <cassert>
+#include <cstring>
 
 namespace bm {
 
 static_assert(sizeof(LearnEngineIface::msg_hdr_t) == 32u,
               "Invalid size for learning notification header");
 
+constexpr size_t LearnEngineIface::default_max_unacked;
+
+namespace {
+
+// a distinct index for each thread calling learn()
+size_t staging_slot_index() {
+  static std::atomic<size_t> next_index{0};
+  static thread_local const size_t index = next_index++;
+  return index;
+}
+
+}  // namespace
+
 class LearnEngine final : public LearnEngineIface {
  public:
   using LearnEngineIface::list_id_t;
@@ -49,6 +67,7 @@ class LearnEngine final : public LearnEngineIface {
   using LearnEngineIface::LearnErrorCode;
   using LearnEngineIface::msg_hdr_t;
   using LearnEngineIface::LearnCb;
+  using LearnEngineIface::ListStats;
 
   explicit LearnEngine(int device_id = 0, int cxt_id = 0);
 
@@ -73,6 +92,12 @@ class LearnEngine final : public LearnEngineIface {
   LearnErrorCode list_set_max_samples(list_id_t list_id,
                                       size_t max_samples) override;
 
+  LearnErrorCode list_set_max_unacked(list_id_t list_id,
+                                      size_t max_unacked) override;
+
+  LearnErrorCode list_get_stats(list_id_t list_id,
+                                ListStats *stats) const override;
+
   //! Performs learning on the packet. Needs to be called by the target after a
   //! learning-enabled pipeline has been applied on the packet. See the simple
   //! switch implementation for an example.
@@ -125,11 +150,16 @@ class LearnEngine final : public LearnEngineIface {
   using LearnFilter = std::unordered_set<ByteContainer, ByteContainerKeyHash>;
 
  private:
-  struct FilterPtrs {
-    size_t unacked_count{0};
-    std::vector<LearnFilter::iterator> buffer{};
-  };
-
+  // Samples go through 3 stages:
+  //   - add_sample(), called by the packet processing threads, checks the
+  //     filter and appends new samples to a staging slot; it only takes the
+  //     locks of a filter shard and of a staging slot, which are never held
+  //     for long
+  //   - the transmit thread moves staged samples to the backlog and sends them
+  //     in batches of up to max_samples, as soon as a batch is full or the
+  //     oldest sample has waited for the timeout
+  //   - sent samples are kept in sent_buffers, and stay in the filter, until
+  //     they are acked
   class LearnList {
    public:
     enum class LearnMode {NONE, WRITER, CB};
@@ -152,11 +182,15 @@ class LearnEngine final : public LearnEngineIface {
 
     void set_max_samples(size_t max_samples);
 
+    void set_max_unacked(size_t max_unacked);
+
     void add_sample(const PHV &phv);
 
     void ack(buffer_id_t buffer_id, const std::vector<int> &sample_ids);
     void ack_buffer(buffer_id_t buffer_id);
 
+    void get_stats(ListStats *stats) const;
+
     void reset_state();
 
     LearnList(const LearnList &other) = delete;
@@ -168,9 +202,40 @@ class LearnEngine final : public LearnEngineIface {
     using MutexType = std::mutex;
     using LockType = std::unique_lock<MutexType>;
 
+    static constexpr size_t nb_filter_shards = 16;
+    static constexpr size_t nb_staging_slots = 8;
+
+    struct FilterShard {
+      MutexType mutex{};
+      LearnFilter samples{};
+    };
+
+    struct StagedSample {
+      ByteContainer sample;
+      clock::time_point time;
+    };
+
+    // a packet processing thread always uses the same slot
+    struct StagingSlot {
+      MutexType mutex{};
+      std::vector<StagedSample> samples{};
+      std::atomic<uint64_t> learned{0};
+      std::atomic<uint64_t> filtered{0};
+      std::atomic<uint64_t> overflows{0};
+    };
+
+    struct SentBuffer {
+      size_t unacked_count{0};
+      std::vector<ByteContainer> samples{};
+      std::vector<bool> acked{};
+    };
+
    private:
-    void swap_buffers();
-    void process_full_buffer(LockType &lock);  // NOLINT(runtime/references)
+    FilterShard &get_shard(const ByteContainer &sample);
+    void filter_erase(const ByteContainer &sample);
+    void notify_transmit_thread();
+    void drain_staging();
+    bool buffer_ready(clock::time_point now) const;
     void buffer_transmit_loop();
     void buffer_transmit();
 
@@ -183,22 +248,24 @@ class LearnEngine final : public LearnEngineIface {
     int cxt_id;
 
     LearnSampleBuilder builder{};
-    std::vector<char> buffer{};
-    buffer_id_t buffer_id{0};
-    // size_t sample_size{0};
-    size_t num_samples{0};
-    size_t max_samples;
-    clock::time_point buffer_started{};
-    clock::time_point last_sent{};
+    // read by add_sample() without the mutex
+    std::atomic<size_t> max_samples;
+    std::atomic<size_t> max_unacked_per_shard{0};
     milliseconds timeout;
     bool with_timeout;
 
-    LearnFilter filter{};
-    std::unordered_map<buffer_id_t, FilterPtrs> old_buffers{};
+    std::array<FilterShard, nb_filter_shards> filter_shards;
+    std::array<StagingSlot, nb_staging_slots> staging_slots;
+    // number of staged samples not sent yet, only used by add_sample() to
+    // decide when to wake up the transmit thread; it can be temporarily off
+    // by a few samples as staging and counting are not done atomically
+    std::atomic<int64_t> unsent{0};
+
+    std::deque<StagedSample> backlog{};
+    buffer_id_t buffer_id{0};
+    std::unordered_map<buffer_id_t, SentBuffer> sent_buffers{};
+    uint64_t notifications{0};
 
-    std::vector<char> buffer_tmp{};
-    size_t num_samples_tmp{0};
-    mutable std::condition_variable b_can_swap{};
     mutable std::condition_variable b_can_send{};
     std::thread transmit_thread{};
     bool stop_transmit_thread{false};
@@ -216,6 +283,7 @@ class LearnEngine final : public LearnEngineIface {
 
  private:
   LearnList *get_learn_list(list_id_t list_id);
+  const LearnList *get_learn_list(list_id_t list_id) const;
 
   int device_id{};
   int cxt_id{};
@@ -248,17 +316,17 @@ void
 LearnEngine::LearnSampleBuilder::operator()(const PHV &phv,
                                             ByteContainer *sample) const {
   for (const LearnSampleEntry &entry : entries) {
-    const ByteContainer *bytes = nullptr;
+    ByteView bytes;
     switch (entry.tag) {
     case LearnSampleEntry::FIELD:
-      bytes = &phv.get_field(entry.field.header,
-                             entry.field.offset).get_bytes();
+      bytes = phv.get_field(entry.field.header,
+                            entry.field.offset).get_bytes();
       break;
     case LearnSampleEntry::CONSTANT:
-      bytes = &constants[entry.constant.offset];
+      bytes = constants[entry.constant.offset].view();
       break;
     }
-    sample->append(*bytes);
+    sample->append(bytes);
     // buffer.insert(buffer.end(), bytes->begin(), bytes->end());
   }
 }
@@ -266,7 +334,9 @@ LearnEngine::LearnSampleBuilder::operator()(const PHV &phv,
 LearnEngine::LearnList::LearnList(list_id_t list_id, int device_id, int cxt_id,
                                   size_t max_samples, unsigned int timeout)
     : list_id(list_id), device_id(device_id), cxt_id(cxt_id),
-      max_samples(max_samples), timeout(timeout), with_timeout(timeout > 0) { }
+      max_samples(max_samples), timeout(timeout), with_timeout(timeout > 0) {
+  set_max_unacked(default_max_unacked);
+}
 
 void
 LearnEngine::LearnList::init() {
@@ -280,7 +350,7 @@ LearnEngine::LearnList::~LearnList() {
     stop_transmit_thread = true;
   }
   b_can_send.notify_all();
-  transmit_thread.join();
+  if (transmit_thread.joinable()) transmit_thread.join();
 }
 
 void
@@ -318,35 +388,48 @@ LearnEngine::LearnList::push_back_constant(const std::string &hexstring) {
 
 void
 LearnEngine::LearnList::set_timeout(unsigned int timeout_ms) {
-  LockType lock(mutex);
-  timeout = milliseconds(timeout_ms);
-  with_timeout = (timeout_ms > 0);
+  {
+    LockType lock(mutex);
+    timeout = milliseconds(timeout_ms);
+    with_timeout = (timeout_ms > 0);
+  }
+  b_can_send.notify_one();
 }
 
 void
 LearnEngine::LearnList::set_max_samples(size_t nb_samples) {
-  LockType lock(mutex);
-  max_samples = nb_samples;
-  if (num_samples > 0 && num_samples >= max_samples) {
-    process_full_buffer(lock);
+  {
+    LockType lock(mutex);
+    max_samples = nb_samples;
   }
+  // there may already be enough samples waiting to fill a buffer
+  b_can_send.notify_one();
 }
 
 void
-LearnEngine::LearnList::swap_buffers() {
-  buffer_tmp.swap(buffer);
-  num_samples_tmp = num_samples;
-  num_samples = 0;
-  buffer_id++;
+LearnEngine::LearnList::set_max_unacked(size_t max_unacked) {
+  max_unacked_per_shard =
+      (max_unacked + nb_filter_shards - 1) / nb_filter_shards;
+}
+
+LearnEngine::LearnList::FilterShard &
+LearnEngine::LearnList::get_shard(const ByteContainer &sample) {
+  return filter_shards[ByteContainerKeyHash()(sample) % nb_filter_shards];
 }
 
 void
-LearnEngine::LearnList::process_full_buffer(LockType &lock) {
-  while (buffer_tmp.size() != 0) {
-    b_can_swap.wait(lock);
-  }
-  swap_buffers();
+LearnEngine::LearnList::filter_erase(const ByteContainer &sample) {
+  FilterShard &shard = get_shard(sample);
+  LockType lock(shard.mutex);
+  shard.samples.erase(sample);
+}
 
+void
+LearnEngine::LearnList::notify_transmit_thread() {
+  // acquiring the mutex ensures that the transmit thread is either waiting or
+  // has not checked the staging slots yet; the transmit thread never holds it
+  // while sending a notification
+  { LockType lock(mutex); }
   b_can_send.notify_one();
 }
 
@@ -358,58 +441,89 @@ LearnEngine::LearnList::add_sample(const PHV &phv) {
 
   BMLOG_TRACE("Learning sample for list id {}", list_id);
 
-  LockType lock(mutex);
+  StagingSlot &slot = staging_slots[staging_slot_index() % nb_staging_slots];
 
-  const auto it = filter.find(sample);
-  if (it != filter.end()) return;
-
-  buffer.insert(buffer.end(), sample.begin(), sample.end());
-  num_samples++;
-  auto filter_it = filter.insert(filter.end(), std::move(sample));
-  FilterPtrs &filter_ptrs = old_buffers[buffer_id];
-  filter_ptrs.unacked_count++;
-  filter_ptrs.buffer.push_back(filter_it);
-
-  if (num_samples == 1 && max_samples > 1) {
-    buffer_started = clock::now();
-    // wake transmit thread to update cond var wait time
-    b_can_send.notify_one();
-  } else if (num_samples >= max_samples) {
-    process_full_buffer(lock);
+  {
+    FilterShard &shard = get_shard(sample);
+    LockType lock(shard.mutex);
+    if (shard.samples.find(sample) != shard.samples.end()) {
+      slot.filtered.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    if (shard.samples.size() >= max_unacked_per_shard) {
+      slot.overflows.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    shard.samples.insert(sample);
+  }
+
+  {
+    LockType lock(slot.mutex);
+    slot.samples.push_back({std::move(sample), clock::now()});
   }
+  slot.learned.fetch_add(1, std::memory_order_relaxed);
+
+  // the transmit thread needs to be woken up to start the timeout for the
+  // first sample and when a buffer is full
+  const auto nb_unsent = unsent.fetch_add(1) + 1;
+  if (nb_unsent == 1 || nb_unsent == static_cast<int64_t>(max_samples))
+    notify_transmit_thread();
+}
+
+void
+LearnEngine::LearnList::drain_staging() {
+  for (auto &slot : staging_slots) {
+    LockType lock(slot.mutex);
+    for (auto &staged : slot.samples) backlog.push_back(std::move(staged));
+    slot.samples.clear();
+  }
+}
+
+bool
+LearnEngine::LearnList::buffer_ready(clock::time_point now) const {
+  if (backlog.empty()) return false;
+  if (backlog.size() >= max_samples) return true;
+  return with_timeout && now >= backlog.front().time + timeout;
 }
 
 void
 LearnEngine::LearnList::buffer_transmit() {
-  size_t num_samples_to_send;
   LockType lock(mutex);
+  drain_staging();
   clock::time_point now = clock::now();
-  while (!stop_transmit_thread &&
-         buffer_tmp.size() == 0 &&
-         (!with_timeout ||
-          num_samples == 0 ||
-          now < (buffer_started + timeout))) {
-    if (with_timeout && num_samples > 0) {
-      b_can_send.wait_until(lock, buffer_started + timeout);
+  while (!stop_transmit_thread && !buffer_ready(now)) {
+    if (with_timeout && !backlog.empty()) {
+      b_can_send.wait_until(lock, backlog.front().time + timeout);
     } else {
       b_can_send.wait(lock);
     }
+    drain_staging();
     now = clock::now();
   }
 
   if (stop_transmit_thread) return;
 
-  if (buffer_tmp.size() == 0) {  // timeout -> we need to swap here
-    num_samples_to_send = num_samples;
-    swap_buffers();
-  } else {  // buffer full -> swapping was already done
-    // maybe max_samples was modified in between, so it would not be safe to do
-    // this
-    // num_samples_to_send = max_samples;
-    num_samples_to_send = num_samples_tmp;
+  // if more than max_samples samples are waiting (e.g. because the controller
+  // is slow to process notifications), the remaining ones will be sent right
+  // away by the next call
+  size_t num_samples_to_send = backlog.size();
+  if (max_samples > 0 && num_samples_to_send > max_samples)
+    num_samples_to_send = max_samples;
+
+  std::vector<char> buffer;
+  const buffer_id_t sent_buffer_id = buffer_id++;
+  SentBuffer &sent = sent_buffers[sent_buffer_id];
+  sent.unacked_count = num_samples_to_send;
+  sent.acked.resize(num_samples_to_send, false);
+  for (size_t i = 0; i < num_samples_to_send; i++) {
+    auto &sample = backlog.front().sample;
+    buffer.insert(buffer.end(), sample.begin(), sample.end());
+    sent.samples.push_back(std::move(sample));
+    backlog.pop_front();
   }
+  unsent.fetch_sub(static_cast<int64_t>(num_samples_to_send));
+  notifications++;
 
-  last_sent = now;
   writer_busy = true;
 
   lock.unlock();
@@ -421,25 +535,23 @@ LearnEngine::LearnList::buffer_transmit() {
   msg_hdr.switch_id = device_id;
   msg_hdr.cxt_id = cxt_id;
   msg_hdr.list_id = list_id;
-  msg_hdr.buffer_id = buffer_id - 1;
+  msg_hdr.buffer_id = sent_buffer_id;
   msg_hdr.num_samples = static_cast<unsigned int>(num_samples_to_send);
 
   BMLOG_TRACE("Sending learning notification for list id {} (buffer id {})",
               msg_hdr.list_id, msg_hdr.buffer_id);
 
   if (learn_mode == LearnMode::WRITER) {
-    // do not forget the -1 !!!
-    // swap_buffers() is in charge of incrementing the count
     TransportIface::MsgBuf buf_hdr =
       {reinterpret_cast<char *>(&msg_hdr), sizeof(msg_hdr)};
     TransportIface::MsgBuf buf_samples =
-      {buffer_tmp.data(), static_cast<unsigned int>(buffer_tmp.size())};
+      {buffer.data(), static_cast<unsigned int>(buffer.size())};
 
     writer->send_msgs({buf_hdr, buf_samples});  // no lock for I/O
   } else if (learn_mode == LearnMode::CB) {
-    std::unique_ptr<char[]> buf(new char[buffer_tmp.size()]);
-    std::copy(buffer_tmp.begin(), buffer_tmp.end(), &buf[0]);
-    cb_fn(msg_hdr, buffer_tmp.size(), std::move(buf), cb_cookie);
+    std::unique_ptr<char[]> buf(new char[buffer.size()]);
+    std::copy(buffer.begin(), buffer.end(), &buf[0]);
+    cb_fn(msg_hdr, buffer.size(), std::move(buf), cb_cookie);
   } else {
     assert(learn_mode == LearnMode::NONE);
   }
@@ -448,10 +560,6 @@ LearnEngine::LearnList::buffer_transmit() {
 
   writer_busy = false;
   can_change_writer.notify_all();
-
-  buffer_tmp.clear();
-
-  b_can_swap.notify_one();
 }
 
 void
@@ -466,17 +574,21 @@ void
 LearnEngine::LearnList::ack(buffer_id_t buffer_id,
                             const std::vector<int> &sample_ids) {
   LockType lock(mutex);
-  auto it = old_buffers.find(buffer_id);
-  // assert(it != old_buffers.end());
+  auto it = sent_buffers.find(buffer_id);
+  // assert(it != sent_buffers.end());
   // we assume that this was acked already, and simply return
-  if (it == old_buffers.end())
+  if (it == sent_buffers.end())
     return;
-  FilterPtrs &filter_ptrs = it->second;
+  SentBuffer &sent = it->second;
   for (int sample_id : sample_ids) {
-    // what happens if bad input :(
-    filter.erase(filter_ptrs.buffer[sample_id]);
-    if (--filter_ptrs.unacked_count == 0) {
-      old_buffers.erase(it);
+    if (sample_id < 0 || static_cast<size_t>(sample_id) >= sent.samples.size())
+      continue;
+    if (sent.acked[sample_id]) continue;
+    sent.acked[sample_id] = true;
+    filter_erase(sent.samples[sample_id]);
+    if (--sent.unacked_count == 0) {
+      sent_buffers.erase(it);
+      return;
     }
   }
 }
@@ -484,34 +596,51 @@ LearnEngine::LearnList::ack(buffer_id_t buffer_id,
 void
 LearnEngine::LearnList::ack_buffer(buffer_id_t buffer_id) {
   LockType lock(mutex);
-  auto it = old_buffers.find(buffer_id);
-  // assert(it != old_buffers.end());
+  auto it = sent_buffers.find(buffer_id);
+  // assert(it != sent_buffers.end());
   // we assume that this was acked already, and simply return
-  if (it == old_buffers.end())
+  if (it == sent_buffers.end())
     return;
-  FilterPtrs &filter_ptrs = it->second;
-  // we optimize for this case (no learning occured since the buffer as sent out
-  // and the ack clears out the filter
-  if (filter_ptrs.unacked_count == filter.size()) {
-    filter.clear();
-  } else {  // slow: linear in the number of elements acked
-    for (const auto &sample_it : filter_ptrs.buffer) {
-      filter.erase(sample_it);
-    }
+  SentBuffer &sent = it->second;
+  for (size_t i = 0; i < sent.samples.size(); i++) {
+    if (!sent.acked[i]) filter_erase(sent.samples[i]);
+  }
+  sent_buffers.erase(it);
+}
+
+void
+LearnEngine::LearnList::get_stats(ListStats *stats) const {
+  stats->samples = 0;
+  stats->filtered = 0;
+  stats->overflows = 0;
+  for (const auto &slot : staging_slots) {
+    stats->samples += slot.learned;
+    stats->filtered += slot.filtered;
+    stats->overflows += slot.overflows;
   }
-  old_buffers.erase(it);
+  LockType lock(mutex);
+  stats->notifications = notifications;
 }
 
 void
 LearnEngine::LearnList::reset_state() {
   LockType lock(mutex);
-  buffer.clear();
+  for (auto &slot : staging_slots) {
+    LockType slot_lock(slot.mutex);
+    slot.samples.clear();
+    slot.learned = 0;
+    slot.filtered = 0;
+    slot.overflows = 0;
+  }
+  for (auto &shard : filter_shards) {
+    LockType shard_lock(shard.mutex);
+    shard.samples.clear();
+  }
+  unsent = 0;
+  backlog.clear();
   buffer_id = 0;
-  num_samples = 0;
-  num_samples_tmp = 0;
-  filter.clear();
-  old_buffers.clear();
-  buffer_tmp.clear();
+  sent_buffers.clear();
+  notifications = 0;
 }
 
 LearnEngine::LearnEngine(int device_id, int cxt_id)
@@ -523,6 +652,12 @@ LearnEngine::get_learn_list(list_id_t list_id) {
   return it == learn_lists.end() ? nullptr : it->second.get();
 }
 
+const LearnEngine::LearnList *
+LearnEngine::get_learn_list(list_id_t list_id) const {
+  auto it = learn_lists.find(list_id);
+  return it == learn_lists.end() ? nullptr : it->second.get();
+}
+
 void
 LearnEngine::list_create(list_id_t list_id, size_t max_samples,
                          unsigned int timeout_ms) {
@@ -610,6 +745,22 @@ LearnEngine::list_set_max_samples(list_id_t list_id, size_t max_samples) {
   return SUCCESS;
 }
 
+LearnEngine::LearnErrorCode
+LearnEngine::list_set_max_unacked(list_id_t list_id, size_t max_unacked) {
+  LearnList *list = get_learn_list(list_id);
+  if (!list) return INVALID_LIST_ID;
+  list->set_max_unacked(max_unacked);
+  return SUCCESS;
+}
+
+LearnEngine::LearnErrorCode
+LearnEngine::list_get_stats(list_id_t list_id, ListStats *stats) const {
+  const LearnList *list = get_learn_list(list_id);
+  if (!list) return INVALID_LIST_ID;
+  list->get_stats(stats);
+  return SUCCESS;
+}
+
 void
 LearnEngine::learn(list_id_t list_id, const Packet &pkt) {
   // TODO(antonin) : event logging
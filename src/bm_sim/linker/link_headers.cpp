@@ -214,6 +214,20 @@ HeaderUIDTable::link_new_header_id(const std::string& p4_name,
 }
 
 
+ObjectLinkStateCode
+HeaderUIDTable::get_linked_header_id(const std::string& p4_name,
+                                     header_id_t header_id,
+                                     header_id_t& rp_header_id_out) const {
+  LinkValueState<header_id_t> link_state;
+  auto ret = header_ids_link_table.get_p4object_link(p4_name, header_id,
+                                                     link_state);
+  if (ret != TableRetCode::SUCCESS)
+    return ObjectLinkStateCode::HEADER_LINK_FAILED;
+  rp_header_id_out = link_state.value;
+  return ObjectLinkStateCode::HEADER_LINKED;
+}
+
+
 void 
 HeaderUIDTable::get_linked_header_ids_map(
                 std::unordered_map<std::string, header_id_t>& out) const {
@@ -0,0 +1,220 @@
+/*
+ * Hardik Soni (hardik.soni@inria.fr)
+ *
+ */
+
+//! @file link_tables.cpp
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <bm/bm_sim/logger.h>
+#include <bm/bm_sim/tables.h>
+#include <bm/bm_linker/link_tables.h>
+
+namespace bm {
+
+constexpr size_t LinkTables::tenant_id_bytes;
+
+size_t
+LinkTables::LinkedTable::get_size() const {
+  size_t size = 0;
+  for (const auto& tenant : tenants)
+    size += tenant.second.size;
+  return size;
+}
+
+// Headers linked through the parser are identified by their linker header id,
+// the others (e.g. metadata) by their linker header type and their name, which
+// means that metadata are only merged if they have the same name in both
+// programs.
+bool
+LinkTables::get_header_uid(const P4ObjectsLinkerExt* p4objects_ext,
+                           header_id_t header_id, std::string& uid) const {
+  const std::string& p4_name = p4objects_ext->get_p4_name();
+  header_id_t rp_header_id;
+  if (header_uid_table_->get_linked_header_id(p4_name, header_id, rp_header_id)
+      == ObjectLinkStateCode::HEADER_LINKED) {
+    uid = "h" + std::to_string(rp_header_id);
+    return true;
+  }
+  const HeaderType* header_type =
+    p4objects_ext->get_header_type_of_header_id(header_id);
+  if (header_type == nullptr)
+    return false;
+  p4object_name_t linker_type_name;
+  if (header_type_uid_table_->get_linker_header_type(
+        p4_name, header_type->get_name(), linker_type_name)
+      != ObjectLinkStateCode::HEADER_TYPE_DEF_MATCH)
+    return false;
+  uid = "m" + linker_type_name + "/"
+        + p4objects_ext->get_header_name(header_id);
+  return true;
+}
+
+// Returns false if the table cannot be shared. The action names are program
+// specific and are not part of the signature, only the parameter bitwidths of
+// each action are: entries of different tenants never reference each other's
+// actions.
+bool
+LinkTables::get_table_signature(const P4ObjectsLinkerExt* p4objects_ext,
+                                const MatchActionTable* table,
+                                linker_uid_t& signature) const {
+  const MatchTableAbstract* match_table = table->get_match_table();
+  if (match_table->get_table_type() != MatchTableType::SIMPLE ||
+      match_table->has_lookup_side_effects())
+    return false;
+
+  signature = "k=";
+  for (const auto& f : match_table->get_match_key_builder().get_key_fields()) {
+    std::string header_uid;
+    if (!get_header_uid(p4objects_ext, f.header, header_uid))
+      return false;
+    signature += header_uid + "." + std::to_string(f.f_offset) + ":"
+                 + MatchKeyParam::type_to_string(f.mtype) + ":"
+                 + std::to_string(f.nbits) + ":" + f.mask.to_hex() + ";";
+  }
+
+  std::vector<std::string> action_params;
+  const auto& p4objects = p4objects_ext->get_p4objects();
+  for (const auto& t_action : p4objects->t_actions_map) {
+    if (t_action.first.first != table->get_name()) continue;
+    const ActionFn* action_fn = t_action.second;
+    const auto& bitwidths = action_fn->get_param_bitwidths();
+    if (bitwidths.size() != action_fn->get_num_params())
+      return false;
+    std::string params = "(";
+    for (const auto bitwidth : bitwidths)
+      params += std::to_string(bitwidth) + ",";
+    action_params.push_back(params + ")");
+  }
+  std::sort(action_params.begin(), action_params.end());
+  signature += "a=";
+  for (const auto& params : action_params)
+    signature += params + ";";
+  return true;
+}
+
+ObjectLinkStateCode
+LinkTables::link_tables(std::shared_ptr<P4ObjectsLinkerExt> p4objects_ext) {
+  TRACE_START;
+  const std::string& p4_name = p4objects_ext->get_p4_name();
+  auto tenant = tenant_ids.find(p4_name);
+  if (tenant == tenant_ids.end()) {
+    tenant = tenant_ids.emplace(
+      p4_name, static_cast<tenant_id_t>(tenant_ids.size())).first;
+  }
+  const tenant_id_t tenant_id = tenant->second;
+
+  const auto& p4objects = p4objects_ext->get_p4objects();
+  for (const auto& name_table : p4objects->match_action_tables_map) {
+    const p4object_name_t& table_name = name_table.first;
+    const MatchActionTable* table = name_table.second.get();
+    const auto* match_table = table->get_match_table();
+
+    linker_uid_t signature;
+    bool shareable = get_table_signature(p4objects_ext.get(), table,
+                                         signature);
+
+    p4object_name_t linker_table_name;
+    auto search = shareable ? signature_table_map.find(signature)
+                            : signature_table_map.end();
+    if (search != signature_table_map.end() &&
+        linked_tables[search->second].tenants.count(p4_name) == 0) {
+      linker_table_name = search->second;
+    } else {
+      linker_table_name = get_new_table_name();
+      if (shareable && search == signature_table_map.end())
+        signature_table_map.emplace(signature, linker_table_name);
+      linked_tables[linker_table_name] = {linker_table_name, signature,
+                                          shareable, {}};
+    }
+
+    auto ret = tables_link_table.insert_p4objects_link(
+                 p4_name, table_name, linker_table_name,
+                 ObjectLinkStateCode::TABLE_LINKED);
+    if (ret != TableRetCode::SUCCESS) {
+      TRACE_PRINT_CONST(p4_name + "." + table_name + " already linked");
+      TRACE_END;
+      return ObjectLinkStateCode::TABLE_LINK_FAILED;
+    }
+
+    TenantTable tenant_table{table_name, tenant_id, 0, ""};
+    tenant_table.size = match_table->get_size();
+    if (const auto* simple_table =
+        dynamic_cast<const MatchTable*>(match_table)) {
+      MatchTable::Entry default_entry;
+      if (simple_table->get_default_entry(&default_entry) ==
+          MatchErrorCode::SUCCESS)
+        tenant_table.default_action = default_entry.action_fn->get_name();
+    }
+    linked_tables[linker_table_name].tenants.emplace(p4_name, tenant_table);
+    TRACE_PRINT_CONST(p4_name + "." + table_name + " linked to "
+                      + linker_table_name);
+  }
+  TRACE_END;
+  return ObjectLinkStateCode::TABLE_LINKED;
+}
+
+ObjectLinkStateCode
+LinkTables::get_linked_table(const std::string& p4_name,
+                             const p4object_name_t& table_name,
+                             const LinkedTable*& out) const {
+  LinkValueState<p4object_name_t> link_state;
+  if (tables_link_table.get_p4object_link(p4_name, table_name, link_state)
+      != TableRetCode::SUCCESS)
+    return ObjectLinkStateCode::TABLE_LINK_FAILED;
+  out = &linked_tables.at(link_state.value);
+  return (out->tenants.size() > 1) ? ObjectLinkStateCode::TABLE_SHARED
+                                   : ObjectLinkStateCode::TABLE_LINKED;
+}
+
+ObjectLinkStateCode
+LinkTables::get_linked_match_key(const std::string& p4_name,
+                                 const p4object_name_t& table_name,
+                                 const std::vector<MatchKeyParam>& match_key,
+                                 std::vector<MatchKeyParam>& out) const {
+  const LinkedTable* linked_table;
+  if (get_linked_table(p4_name, table_name, linked_table)
+      == ObjectLinkStateCode::TABLE_LINK_FAILED)
+    return ObjectLinkStateCode::TABLE_LINK_FAILED;
+  const tenant_id_t tenant_id = linked_table->tenants.at(p4_name).tenant_id;
+
+  // network byte order, like all the other match key fields
+  std::string prefix(tenant_id_bytes, '\x00');
+  for (size_t i = 0; i < tenant_id_bytes; i++)
+    prefix[tenant_id_bytes - 1 - i] = static_cast<char>(tenant_id >> (8 * i));
+
+  out.clear();
+  out.reserve(match_key.size() + 1);
+  out.emplace_back(MatchKeyParam::Type::EXACT, std::move(prefix));
+  out.insert(out.end(), match_key.begin(), match_key.end());
+  return ObjectLinkStateCode::TABLE_LINKED;
+}
+
+ObjectLinkStateCode
+LinkTables::get_tenant_id(const std::string& p4_name, tenant_id_t& out) const {
+  const auto search = tenant_ids.find(p4_name);
+  if (search == tenant_ids.end())
+    return ObjectLinkStateCode::TABLE_LINK_FAILED;
+  out = search->second;
+  return ObjectLinkStateCode::TABLE_LINKED;
+}
+
+std::string
+LinkTables::to_string() {
+  std::string str = tables_link_table.to_string() + "\nlinked_tables: {";
+  for (const auto& name_table : linked_tables) {
+    str += "[" + name_table.first + ", " + name_table.second.signature + ":(";
+    for (const auto& tenant : name_table.second.tenants) {
+      str += tenant.first + "." + tenant.second.table_name + ", ";
+    }
+    str += ")]\n";
+  }
+  str += "}";
+  return str;
+}
+
+}  // namespace bm
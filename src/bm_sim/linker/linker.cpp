@@ -5,6 +5,7 @@
 
 //! @file linker.cpp
 
+#include <future>
 #include <istream>
 #include <ostream>
 #include <string>
@@ -21,7 +22,8 @@ namespace bm {
 Linker::Linker()
   : header_types_uid_table_(std::make_shared<HeaderTypeUIDTable> ()),
     header_uid_table_(std::make_shared<HeaderUIDTable> (header_types_uid_table_)),
-    parser_linker(header_types_uid_table_, header_uid_table_) {
+    parser_linker(header_types_uid_table_, header_uid_table_),
+    table_linker(header_types_uid_table_, header_uid_table_) {
    
 }
 
@@ -38,13 +40,18 @@ Linker::add_p4objects(const std::string& p4_name,
   ObjectLinkStateCode error_code;
 
   // initialize the extended data structures for new p4 program
+  // They only depend on the new program (e.g. topological ordering of its
+  // parse states), so they are computed while its header types are linked.
   std::shared_ptr<P4ObjectsLinkerExt> p4objects_linker_ext = 
     std::make_shared<P4ObjectsLinkerExt> (p4_name, p4objects);
-  p4objects_linker_ext->init_extended_objects();
+  auto ext_init = std::async(std::launch::async, [&p4objects_linker_ext]() {
+    p4objects_linker_ext->init_extended_objects();
+  });
   
   /**********************Linking Starts****************/
   // Add HeaderType objects and store the map with __name__ key
   error_code = init_header_types_linking(p4_name, p4objects->header_types_map);
+  ext_init.get();
   if (error_code != ObjectLinkStateCode::HEADER_TYPE_DEF_MATCH) 
     return nullptr;
   header_types_uid_table_->get_linker_header_types_map(
@@ -70,6 +77,12 @@ Linker::add_p4objects(const std::string& p4_name,
       merged_p4objects->header_types_map[name_type.second].get();
   }
 
+  // Link tables, once all the header ids are known
+  error_code = table_linker.link_tables(p4objects_linker_ext);
+  if (error_code != ObjectLinkStateCode::TABLE_LINKED)
+    return nullptr;
+  TRACE_PRINT(table_linker.to_string());
+
   p4object_ = merged_p4objects;
   p4objects_linker_ext_.reset(new P4ObjectsLinkerExt("Linker", merged_p4objects));
   p4objects_linker_ext_->init_extended_objects();
@@ -20,32 +20,350 @@
 
 #include <bm/bm_sim/logger.h>
 
+#include <bm/spdlog/sinks/file_sinks.h>
 #include <bm/spdlog/sinks/null_sink.h>
+#include <bm/spdlog/sinks/stdout_sinks.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace bm {
 
+namespace {
+
+// Single-producer single-consumer ring of log records. The producer is the
+// thread which owns the ring, the consumer is the background thread of the
+// logger.
+class LogRing {
+ public:
+  struct Record {
+    spdlog::level::level_enum level;
+    spdlog::log_clock::time_point time;
+    size_t thread_id;
+    // the message is copied to the string of the slot, whose capacity is kept
+    // when the slot is reused: in steady state, there is no memory allocation
+    std::string msg;
+  };
+
+  explicit LogRing(size_t size)
+      : slots(new Record[size]), mask(size - 1) { }
+
+  // returns false (and counts a drop) if the ring is full
+  bool push(const spdlog::details::log_msg &msg) {
+    const size_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) > mask) {
+      dropped.store(dropped.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+      return false;
+    }
+    auto &slot = slots[h & mask];
+    slot.level = msg.level;
+    slot.time = msg.time;
+    slot.thread_id = msg.thread_id;
+    slot.msg.assign(msg.raw.data(), msg.raw.size());
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // calls f(record) for every record in the ring, returns the number of
+  // records consumed
+  template <typename F>
+  size_t consume(F f) {
+    const size_t t = tail.load(std::memory_order_relaxed);
+    const size_t h = head.load(std::memory_order_acquire);
+    for (size_t i = t; i != h; i++) f(slots[i & mask]);
+    tail.store(h, std::memory_order_release);
+    return h - t;
+  }
+
+  uint64_t get_dropped() const {
+    return dropped.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::unique_ptr<Record[]> slots;
+  const size_t mask;
+  // the padding keeps producer and consumer indices in different cache lines
+  char pad0[64];
+  std::atomic<size_t> head{0};
+  std::atomic<uint64_t> dropped{0};
+  char pad1[64];
+  std::atomic<size_t> tail{0};
+};
+
+// The rings of an AsyncLogger. When a thread exits, its ring is released: the
+// background thread drains it one last time and then moves it to the free
+// list, so that it is no longer scanned, and it is re-used by the next thread
+// which needs a ring. There is therefore at most one ring per running thread.
+class LogRingPool {
+ public:
+  explicit LogRingPool(size_t ring_size)
+      : ring_size(ring_size) { }
+
+  LogRing *acquire() {
+    std::unique_lock<std::mutex> lock(mutex);
+    LogRing *ring;
+    if (free_rings.empty()) {
+      all_rings.emplace_back(new LogRing(ring_size));
+      ring = all_rings.back().get();
+    } else {
+      ring = free_rings.back();
+      free_rings.pop_back();
+    }
+    active_rings.push_back(ring);
+    return ring;
+  }
+
+  // called by the thread which owned the ring, once it will no longer use it
+  void release(LogRing *ring) {
+    std::unique_lock<std::mutex> lock(mutex);
+    released_rings.push_back(ring);
+  }
+
+  // returns the rings to drain; the ones in *released have been released by
+  // their thread and can be reclaimed once drained
+  void get_rings(std::vector<LogRing *> *rings,
+                 std::vector<LogRing *> *released) const {
+    std::unique_lock<std::mutex> lock(mutex);
+    *rings = active_rings;
+    *released = released_rings;
+  }
+
+  // the rings must have been drained after they were returned in *released by
+  // get_rings()
+  void reclaim(const std::vector<LogRing *> &released) {
+    if (released.empty()) return;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (auto ring : released) {
+      active_rings.erase(
+          std::find(active_rings.begin(), active_rings.end(), ring));
+      released_rings.erase(
+          std::find(released_rings.begin(), released_rings.end(), ring));
+      free_rings.push_back(ring);
+    }
+  }
+
+  // includes the drops of the rings of exited threads
+  uint64_t get_dropped() const {
+    std::unique_lock<std::mutex> lock(mutex);
+    uint64_t dropped = 0;
+    for (const auto &ring : all_rings) dropped += ring->get_dropped();
+    return dropped;
+  }
+
+  size_t get_num_rings() const {
+    std::unique_lock<std::mutex> lock(mutex);
+    return all_rings.size();
+  }
+
+ private:
+  const size_t ring_size;
+  mutable std::mutex mutex{};
+  std::vector<std::unique_ptr<LogRing> > all_rings{};
+  std::vector<LogRing *> active_rings{};
+  std::vector<LogRing *> released_rings{};
+  std::vector<LogRing *> free_rings{};
+};
+
+// The rings used by a thread, one per AsyncLogger; they are released when the
+// thread exits, unless the logger was destroyed first.
+class ThreadLogRings {
+ public:
+  ~ThreadLogRings() {
+    for (const auto &e : entries) {
+      if (auto pool = e.pool.lock()) pool->release(e.ring);
+    }
+  }
+
+  LogRing *get(const std::shared_ptr<LogRingPool> &pool) {
+    for (const auto &e : entries) {
+      // compares the control blocks, which cannot be re-used while we hold a
+      // weak_ptr, unlike the address of a destroyed pool
+      if (!e.pool.owner_before(pool) && !pool.owner_before(e.pool))
+        return e.ring;
+    }
+    entries.erase(
+        std::remove_if(entries.begin(), entries.end(),
+                       [](const Entry &e) { return e.pool.expired(); }),
+        entries.end());
+    entries.push_back({pool, pool->acquire()});
+    return entries.back().ring;
+  }
+
+ private:
+  struct Entry {
+    std::weak_ptr<LogRingPool> pool;
+    LogRing *ring;
+  };
+
+  std::vector<Entry> entries{};
+};
+
+thread_local ThreadLogRings thread_log_rings;
+
+// spdlog logger which only formats the user message (i.e. substitutes the
+// arguments) in the calling thread. The log pattern (timestamp, thread id,
+// ...) is applied, and the sinks are called, by the background thread.
+class AsyncLogger : public spdlog::logger {
+ public:
+  AsyncLogger(const std::string &name, spdlog::sink_ptr sink,
+              size_t ring_size)
+      : spdlog::logger(name, sink),
+        pool(std::make_shared<LogRingPool>(ring_size)) {
+    out_msg.logger_name = name;
+    thread = std::thread(&AsyncLogger::drain_loop, this);
+  }
+
+  ~AsyncLogger() {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      stop = true;
+    }
+    cv.notify_one();
+    thread.join();
+    drain();
+  }
+
+  Logger::Stats get_stats() const {
+    return {logged.load(std::memory_order_relaxed), pool->get_dropped(),
+            pool->get_num_rings()};
+  }
+
+ private:
+  void _log_msg(spdlog::details::log_msg &msg) override {
+    thread_log_rings.get(pool)->push(msg);
+  }
+
+  // only called by the background thread (or by the destructor, once it is
+  // gone)
+  void write(spdlog::details::log_msg *msg) {
+    _formatter->format(*msg);
+    for (auto &sink : _sinks) sink->log(*msg);
+  }
+
+  size_t drain() {
+    std::vector<LogRing *> rings, released;
+    pool->get_rings(&rings, &released);
+    const uint64_t dropped = pool->get_dropped();
+    size_t count = 0;
+    for (auto ring : rings) {
+      count += ring->consume([this](const LogRing::Record &record) {
+          out_msg.raw.clear();
+          out_msg.formatted.clear();
+          out_msg.level = record.level;
+          out_msg.time = record.time;
+          out_msg.thread_id = record.thread_id;
+          out_msg.raw << fmt::StringRef(record.msg.data(), record.msg.size());
+          write(&out_msg);
+      });
+    }
+    pool->reclaim(released);
+    logged.store(logged.load(std::memory_order_relaxed) + count,
+                 std::memory_order_relaxed);
+    if (dropped != reported_dropped && should_log(spdlog::level::warn)) {
+      spdlog::details::log_msg msg(spdlog::level::warn);
+      msg.logger_name = name();
+      msg.time = spdlog::details::os::now();
+      msg.thread_id = spdlog::details::os::thread_id();
+      msg.raw << (dropped - reported_dropped)
+              << " log messages dropped because a ring buffer was full";
+      write(&msg);
+      reported_dropped = dropped;
+    }
+    return count;
+  }
+
+  void drain_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stop) {
+      lock.unlock();
+      auto count = drain();
+      lock.lock();
+      // only sleep when there was nothing to write
+      if (count == 0) cv.wait_for(lock, std::chrono::milliseconds(1));
+    }
+  }
+
+  std::shared_ptr<LogRingPool> pool;
+  std::mutex mutex{};
+  std::condition_variable cv{};
+  bool stop{false};
+  std::atomic<uint64_t> logged{0};
+  // only accessed by the background thread
+  spdlog::details::log_msg out_msg{spdlog::level::off};
+  uint64_t reported_dropped{0};
+  std::thread thread{};
+};
+
+}  // namespace
+
+constexpr size_t Logger::default_ring_size;
+
 spdlog::logger *Logger::logger = nullptr;
+spdlog::sink_ptr Logger::sink = nullptr;
+size_t Logger::async_ring_size = 0;
 
 void
-Logger::set_logger_console() {
+Logger::set_logger(spdlog::sink_ptr new_sink) {
   unset_logger();
-  auto logger_ = spdlog::stdout_logger_mt("bmv2");
+  std::shared_ptr<spdlog::logger> logger_;
+  if (async_ring_size > 0) {
+    logger_ = std::make_shared<AsyncLogger>("bmv2", new_sink, async_ring_size);
+  } else {
+    logger_ = std::make_shared<spdlog::logger>("bmv2", new_sink);
+  }
+  spdlog::register_logger(logger_);
   logger = logger_.get();
+  sink = std::move(new_sink);
   set_pattern();
-  logger_->set_level(to_spd_level(LogLevel::DEBUG));
+}
+
+void
+Logger::set_logger_console() {
+  set_logger(spdlog::sinks::stdout_sink_mt::instance());
+  logger->set_level(to_spd_level(LogLevel::DEBUG));
 }
 
 void
 Logger::set_logger_file(const std::string &filename, bool force_flush) {
-  unset_logger();
-  auto logger_ = spdlog::rotating_logger_mt("bmv2", filename,
-                                            1024 * 1024 * 5, 3, force_flush);
-  logger = logger_.get();
-  set_pattern();
-  logger_->set_level(to_spd_level(LogLevel::DEBUG));
+  set_logger(std::make_shared<spdlog::sinks::rotating_file_sink_mt>(
+      filename, "txt", 1024 * 1024 * 5, 3, force_flush));
+  logger->set_level(to_spd_level(LogLevel::DEBUG));
+}
+
+void
+Logger::set_logger_sink(spdlog::sink_ptr sink) {
+  set_logger(std::move(sink));
+  logger->set_level(to_spd_level(LogLevel::DEBUG));
+}
+
+void
+Logger::enable_async(size_t ring_size) {
+  if (async_ring_size > 0) return;
+  size_t size = 1;
+  while (size < ring_size) size <<= 1;
+  async_ring_size = size;
+  // re-creates the current logger, if any, in asynchronous mode
+  if (sink == nullptr) return;
+  const auto level = get()->level();
+  set_logger(sink);
+  logger->set_level(level);
+}
+
+Logger::Stats
+Logger::get_stats() {
+  auto async_logger = dynamic_cast<AsyncLogger *>(get());
+  if (async_logger == nullptr) return {0, 0, 0};
+  return async_logger->get_stats();
 }
 
 void
@@ -23,7 +23,12 @@
 #include <bm/bm_sim/lookup_structures.h>
 #include <bm/bm_sim/match_key_types.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <algorithm>  // for std::swap
+#include <cstring>
 #include <unordered_map>
 #include <vector>
 #include <tuple>
@@ -96,53 +101,268 @@ class LPMTrieStructure : public LPMLookupStructure {
   LPMTrie trie;
 };
 
-class ExactMap : public ExactLookupStructure {
+// Open-addressing hash table used for exact matches, loosely modeled after
+// Swiss tables. Keys are stored inline in fixed-size slots (key bytes followed
+// by the 32-bit handle), so a successful lookup usually touches one cache line
+// of control bytes and one slot. Slots are organized in groups of 16, each slot
+// having a control byte which is either ctrl_empty, ctrl_deleted or the 7 low
+// bits of the key hash. A lookup compares the 7-bit tag against the 16 control
+// bytes of a group at once (with SSE2 when available) and only compares keys
+// for matching tags. Probing moves from group to group and stops at the first
+// group with an empty slot.
+class ExactHashTable : public ExactLookupStructure {
  public:
-  explicit ExactMap(size_t size) {
-    entries_map.reserve(size);
+  ExactHashTable(size_t size, size_t nbytes_key)
+      : key_width(nbytes_key),
+        slot_size(nbytes_key + sizeof(slot_handle_t)) {
+    allocate(capacity_for(size));
   }
 
   bool lookup(const ByteContainer &key,
               internal_handle_t *handle) const override {
-    const auto entry_it = entries_map.find(key);
-    if (entry_it == entries_map.end()) {
-      return false;  // Nothing found
-    } else {
-      *handle = entry_it->second;
-      return true;
+    if (key.size() != key_width) return false;
+    const char *slot = find(key.data(), hash_key(key.data()));
+    if (slot == nullptr) return false;
+    *handle = get_handle(slot);
+    return true;
+  }
+
+  void lookup_batch(size_t n, const ByteContainer *keys,
+                    internal_handle_t *handles, bool *hits) const override {
+    // hash and prefetch a window of keys before probing, so that the cache
+    // misses of the different lookups overlap
+    constexpr size_t window = 8;
+    uint64_t hashes[window] = {};
+    for (size_t base = 0; base < n; base += window) {
+      const size_t m = std::min(window, n - base);
+      for (size_t i = 0; i < m; i++) {
+        const auto &key = keys[base + i];
+        if (key.size() != key_width) continue;
+        hashes[i] = hash_key(key.data());
+        const size_t g = (hashes[i] >> 7) & group_mask;
+        __builtin_prefetch(&ctrl[g * group_size]);
+        __builtin_prefetch(&slots[g * group_size * slot_size]);
+      }
+      for (size_t i = 0; i < m; i++) {
+        const auto &key = keys[base + i];
+        const char *slot = (key.size() == key_width) ?
+            find(key.data(), hashes[i]) : nullptr;
+        hits[base + i] = (slot != nullptr);
+        if (slot != nullptr) handles[base + i] = get_handle(slot);
+      }
     }
   }
 
   bool entry_exists(const ExactMatchKey &key) const override {
-    return entries_map.find(key.data) != entries_map.end();
+    return key.data.size() == key_width &&
+        find(key.data.data(), hash_key(key.data.data())) != nullptr;
   }
 
   bool retrieve_handle(const ExactMatchKey &key,
                        internal_handle_t *handle) const override {
-    const auto it = entries_map.find(key.data);
-    if (it == entries_map.cend()) return false;
-    *handle = it->second;
-    return true;
+    return lookup(key.data, handle);
   }
 
   void add_entry(const ExactMatchKey &key,
                  internal_handle_t handle) override {
-    entries_map[key.data] = handle;  // key is copied, which is not great
+    assert(key.data.size() == key_width);
+    assert(handle <= std::numeric_limits<slot_handle_t>::max());
+    const uint64_t h = hash_key(key.data.data());
+    char *slot = const_cast<char *>(find(key.data.data(), h));
+    if (slot == nullptr) {
+      if ((num_entries + num_deleted + 1) * 8 > capacity * 7) {
+        // if the table is mostly full of tombstones, rehashing in place is
+        // enough
+        const bool grow = (num_entries + 1) * 16 > capacity * 7;
+        rehash(grow ? capacity * 2 : capacity);
+      }
+      slot = insert(key.data.data(), h);
+    }
+    set_handle(slot, handle);
   }
 
   void delete_entry(const ExactMatchKey &key) override {
-    entries_map.erase(key.data);
+    if (key.data.size() != key_width) return;
+    const char *slot = find(key.data.data(), hash_key(key.data.data()));
+    if (slot == nullptr) return;
+    const size_t idx = (slot - slots.data()) / slot_size;
+    const size_t g = idx / group_size;
+    // if the group still has an empty slot, no probe sequence can go past it,
+    // so there is no need for a tombstone
+    if (match_empty(&ctrl[g * group_size]) != 0) {
+      ctrl[idx] = ctrl_empty;
+    } else {
+      ctrl[idx] = ctrl_deleted;
+      num_deleted++;
+    }
+    num_entries--;
   }
 
   void clear() override {
-    entries_map.clear();
+    std::fill(ctrl.begin(), ctrl.end(), ctrl_empty);
+    num_entries = 0;
+    num_deleted = 0;
   }
 
  private:
-  std::unordered_map<ByteContainer, internal_handle_t, ByteContainerKeyHash>
-    entries_map{};
+  // MatchUnit handles are indices in the entry vector, 32 bits are enough
+  using slot_handle_t = uint32_t;
+
+  static constexpr size_t group_size = 16;
+  static constexpr uint8_t ctrl_empty = 0x80;
+  static constexpr uint8_t ctrl_deleted = 0xfe;
+
+  static size_t capacity_for(size_t size) {
+    // max load factor is 7/8
+    size_t capacity = group_size;
+    while (capacity * 7 < size * 8) capacity <<= 1;
+    return capacity;
+  }
+
+  // 64-bit finalizer from MurmurHash3
+  static uint64_t fmix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+  }
+
+  uint64_t hash_key(const char *key) const {
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ key_width;
+    size_t i = 0;
+    for (; i + 8 <= key_width; i += 8) {
+      uint64_t v;
+      std::memcpy(&v, key + i, 8);
+      h = fmix64(h ^ v);
+    }
+    if (i < key_width) {
+      uint64_t v = 0;
+      std::memcpy(&v, key + i, key_width - i);
+      h = fmix64(h ^ v);
+    }
+    return h;
+  }
+
+  // bit i of the result is set iff ctrl byte i of the group is equal to tag
+  static uint32_t match_tag(const uint8_t *group, uint8_t tag) {
+#ifdef __SSE2__
+    const __m128i ctrl_v = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(group));
+    return static_cast<uint32_t>(_mm_movemask_epi8(
+        _mm_cmpeq_epi8(ctrl_v, _mm_set1_epi8(static_cast<char>(tag)))));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < group_size; i++)
+      mask |= static_cast<uint32_t>(group[i] == tag) << i;
+    return mask;
+#endif
+  }
+
+  static uint32_t match_empty(const uint8_t *group) {
+    return match_tag(group, ctrl_empty);
+  }
+
+  // empty or deleted slots have their most significant bit set
+  static uint32_t match_free(const uint8_t *group) {
+#ifdef __SSE2__
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(group))));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < group_size; i++)
+      mask |= static_cast<uint32_t>(group[i] >> 7) << i;
+    return mask;
+#endif
+  }
+
+  static int lowest_bit(uint32_t mask) {
+    return __builtin_ctz(mask);
+  }
+
+  const char *find(const char *key, uint64_t h) const {
+    const uint8_t tag = h & 0x7f;
+    size_t g = (h >> 7) & group_mask;
+    for (size_t step = 1; ; step++) {
+      const uint8_t *group = &ctrl[g * group_size];
+      for (uint32_t m = match_tag(group, tag); m != 0; m &= m - 1) {
+        const char *slot = &slots[(g * group_size + lowest_bit(m)) * slot_size];
+        if (std::memcmp(slot, key, key_width) == 0) return slot;
+      }
+      if (match_empty(group) != 0) return nullptr;
+      // triangular probing visits every group since num_groups is a power of 2
+      g = (g + step) & group_mask;
+    }
+  }
+
+  // assumes the key is not present and that there is at least one free slot
+  char *insert(const char *key, uint64_t h) {
+    size_t g = (h >> 7) & group_mask;
+    for (size_t step = 1; ; step++) {
+      const uint32_t m = match_free(&ctrl[g * group_size]);
+      if (m != 0) {
+        const size_t idx = g * group_size + lowest_bit(m);
+        if (ctrl[idx] == ctrl_deleted) num_deleted--;
+        ctrl[idx] = h & 0x7f;
+        char *slot = &slots[idx * slot_size];
+        std::memcpy(slot, key, key_width);
+        num_entries++;
+        return slot;
+      }
+      g = (g + step) & group_mask;
+    }
+  }
+
+  internal_handle_t get_handle(const char *slot) const {
+    slot_handle_t handle;
+    std::memcpy(&handle, slot + key_width, sizeof(handle));
+    return handle;
+  }
+
+  void set_handle(char *slot, internal_handle_t handle) {
+    const auto h = static_cast<slot_handle_t>(handle);
+    std::memcpy(slot + key_width, &h, sizeof(h));
+  }
+
+  void allocate(size_t new_capacity) {
+    capacity = new_capacity;
+    group_mask = capacity / group_size - 1;
+    ctrl.assign(capacity, ctrl_empty);
+    slots.assign(capacity * slot_size, 0);
+    num_entries = 0;
+    num_deleted = 0;
+  }
+
+  void rehash(size_t new_capacity) {
+    std::vector<uint8_t> old_ctrl;
+    std::vector<char> old_slots;
+    old_ctrl.swap(ctrl);
+    old_slots.swap(slots);
+    allocate(new_capacity);
+    for (size_t idx = 0; idx < old_ctrl.size(); idx++) {
+      if (old_ctrl[idx] & 0x80) continue;  // empty or deleted
+      const char *old_slot = &old_slots[idx * slot_size];
+      char *slot = insert(old_slot, hash_key(old_slot));
+      std::memcpy(slot + key_width, old_slot + key_width,
+                  sizeof(slot_handle_t));
+    }
+  }
+
+  const size_t key_width;
+  const size_t slot_size;
+  size_t capacity{0};
+  size_t group_mask{0};
+  size_t num_entries{0};
+  size_t num_deleted{0};
+  std::vector<uint8_t> ctrl{};
+  std::vector<char> slots{};
 };
 
+constexpr size_t ExactHashTable::group_size;
+constexpr uint8_t ExactHashTable::ctrl_empty;
+constexpr uint8_t ExactHashTable::ctrl_deleted;
+
 template <size_t S = 64>
 class TernaryCache {
  public:
@@ -522,8 +742,8 @@ LookupStructureFactory::create<RangeMatchKey>(
 
 std::unique_ptr<ExactLookupStructure>
 LookupStructureFactory::create_for_exact(size_t size, size_t nbytes_key) {
-  (void) nbytes_key;
-  return std::unique_ptr<ExactLookupStructure>(new ExactMap(size));
+  return std::unique_ptr<ExactLookupStructure>(
+      new ExactHashTable(size, nbytes_key));
 }
 
 std::unique_ptr<LPMLookupStructure>
@@ -22,13 +22,16 @@
 #include <bm/bm_sim/match_tables.h>
 #include <bm/bm_sim/logger.h>
 #include <bm/bm_sim/event_logger.h>
+#include <bm/bm_sim/flow_cache.h>
 #include <bm/bm_sim/lookup_structures.h>
 #include <bm/bm_sim/P4Objects.h>
 
+#include <algorithm>  // for std::min
 #include <string>
 #include <vector>
 #include <iostream>
 #include <limits>  // std::numeric_limits
+#include <stdexcept>
 
 namespace bm {
 
@@ -98,7 +101,11 @@ MatchTableAbstract::apply_action(Packet *pkt) {
 
   ReadLock lock = lock_read();
 
+  TelemetryTimer lookup_timer(&telemetry.lookup_ns);
   const ActionEntry &action_entry = lookup(*pkt, &hit, &handle);
+  lookup_timer.stop();
+  if (Telemetry::is_enabled())
+    (hit ? telemetry.hits : telemetry.misses).increment();
 
   // TODO(antonin): I hate this part, which requires this class to know that the
   // lower 24 bits of the handle are used as an index. Is is expected that few
@@ -133,14 +140,44 @@ MatchTableAbstract::apply_action(Packet *pkt) {
 
   BMLOG_DEBUG_PKT(*pkt, "Action entry is {}", action_entry);
 
+  if (auto recorder = FlowCacheRecorder::get())
+    recorder->record_table(*this, action_entry.action_fn.get_action_fn());
+
   action_entry.action_fn(pkt);
 
   return hit ? action_entry.next_node : next_node_miss;
 }
 
+MatchTableAbstract::WriteLock
+MatchTableAbstract::lock_write_entries() const {
+  WriteLock lock(t_mutex);
+  version++;
+  // only invalidate once we hold the lock: a flow cache miss which looked up
+  // the table before the update is guaranteed to see the new generation when
+  // it completes, and will not be cached
+  FlowCache::invalidate_all();
+  return lock;
+}
+
+std::vector<entry_handle_t>
+MatchTableAbstract::get_page_handles(size_t max_entries,
+                                     EntryCursor *cursor) const {
+  std::vector<entry_handle_t> handles;
+  if (cursor->done) return handles;
+  const uint64_t current_version = version;
+  if (cursor->position == 0)  // first page
+    cursor->version = current_version;
+  else if (cursor->version != current_version)
+    cursor->modified = true;
+  handles.reserve(std::min(max_entries, get_num_entries()));
+  cursor->done = match_unit_->get_handles_page(&cursor->position, max_entries,
+                                               &handles);
+  return handles;
+}
+
 void
 MatchTableAbstract::reset_state() {
-  WriteLock lock = lock_write();
+  WriteLock lock = lock_write_entries();
   reset_state_();
 }
 
@@ -157,7 +194,7 @@ MatchTableAbstract::serialize(std::ostream *out) const {
 
 void
 MatchTableAbstract::deserialize(std::istream *in, const P4Objects &objs) {
-  WriteLock lock = lock_write();
+  WriteLock lock = lock_write_entries();
   std::string name_sentinel; (*in) >> name_sentinel;
   assert(name_sentinel == name);
   std::string next_node_miss_name; (*in) >> next_node_miss_name;
@@ -171,7 +208,14 @@ MatchTableAbstract::deserialize(std::istream *in, const P4Objects &objs) {
 void
 MatchTableAbstract::set_next_node(p4object_id_t action_id,
                                   const ControlFlowNode *next_node) {
-  next_nodes[action_id] = next_node;
+  assert(action_id >= 0);
+  const auto idx = static_cast<size_t>(action_id);
+  if (idx >= next_nodes.size()) {
+    next_nodes.resize(idx + 1, nullptr);
+    has_next_node.resize(idx + 1, false);
+  }
+  next_nodes[idx] = next_node;
+  has_next_node[idx] = true;
 }
 
 void
@@ -199,7 +243,7 @@ void
 MatchTableAbstract::set_direct_meters(MeterArray *meter_array,
                                       header_id_t target_header,
                                       int target_offset) {
-  WriteLock lock = lock_write();
+  WriteLock lock = lock_write_entries();
   match_unit_->set_direct_meters(meter_array);
   meter_target_header = target_header;
   meter_target_offset = target_offset;
@@ -271,6 +315,13 @@ MatchTableAbstract::set_entry_ttl(entry_handle_t handle, unsigned int ttl_ms) {
   return match_unit_->set_entry_ttl(handle, ttl_ms);
 }
 
+void
+MatchTableAbstract::enable_ageing() {
+  // invalidates the flow caches, which may hold lookups in this table
+  WriteLock lock = lock_write_entries();
+  with_ageing = true;
+}
+
 void
 MatchTableAbstract::sweep_entries(std::vector<entry_handle_t> *entries) const {
   ReadLock lock = lock_read();  // TODO(antonin): how to avoid this?
@@ -289,18 +340,43 @@ MatchTableAbstract::handles_end() const {
   return handle_iterator(this, match_unit_->handles_end());
 }
 
+namespace {
+
+const ControlFlowNode *
+lookup_next_node(const std::vector<const ControlFlowNode *> &next_nodes,
+                 const std::vector<bool> &has_next_node,
+                 p4object_id_t action_id) {
+  const auto idx = static_cast<size_t>(action_id);
+  if (action_id < 0 || idx >= next_nodes.size() || !has_next_node[idx])
+    throw std::out_of_range("no next node for action");
+  return next_nodes[idx];
+}
+
+}  // namespace
+
 const ControlFlowNode *
 MatchTableAbstract::get_next_node(p4object_id_t action_id) const {
   if (has_next_node_hit)
     return next_node_hit;
-  return next_nodes.at(action_id);
+  return lookup_next_node(next_nodes, has_next_node, action_id);
 }
 
 const ControlFlowNode *
 MatchTableAbstract::get_next_node_default(p4object_id_t action_id) const {
   if (has_next_node_miss)
     return next_node_miss;
-  return next_nodes.at(action_id);
+  return lookup_next_node(next_nodes, has_next_node, action_id);
+}
+
+std::vector<const ControlFlowNode *>
+MatchTableAbstract::get_next_nodes() const {
+  std::vector<const ControlFlowNode *> nodes;
+  for (size_t i = 0; i < next_nodes.size(); i++)
+    if (has_next_node[i]) nodes.push_back(next_nodes[i]);
+  if (has_next_node_hit) nodes.push_back(next_node_hit);
+  nodes.push_back(next_node_miss);
+  nodes.push_back(next_node_miss_default);
+  return nodes;
 }
 
 void
@@ -358,7 +434,7 @@ MatchTable::add_entry(const std::vector<MatchKeyParam> &match_key,
   MatchErrorCode rc = MatchErrorCode::SUCCESS;
 
   {
-    WriteLock lock = lock_write();
+    WriteLock lock = lock_write_entries();
 
     rc = match_unit->add_entry(
         match_key,
@@ -391,7 +467,7 @@ MatchTable::delete_entry(entry_handle_t handle) {
   MatchErrorCode rc = MatchErrorCode::SUCCESS;
 
   {
-    WriteLock lock = lock_write();
+    WriteLock lock = lock_write_entries();
     rc = match_unit->delete_entry(handle);
   }
 
@@ -419,7 +495,7 @@ MatchTable::modify_entry(entry_handle_t handle,
   MatchErrorCode rc = MatchErrorCode::SUCCESS;
 
   {
-    WriteLock lock = lock_write();
+    WriteLock lock = lock_write_entries();
     rc = match_unit->modify_entry(
         handle, ActionEntry(std::move(action_fn_entry), next_node));
   }
@@ -435,6 +511,82 @@ MatchTable::modify_entry(entry_handle_t handle,
   return rc;
 }
 
+MatchErrorCode
+MatchTable::add_or_refresh_entry(const std::vector<MatchKeyParam> &match_key,
+                                 const ActionFn *action_fn,
+                                 ActionData action_data,
+                                 unsigned int ttl_ms,
+                                 entry_handle_t *handle, bool *added) {
+  if (immutable_entries) return MatchErrorCode::IMMUTABLE_TABLE_ENTRIES;
+  if (ttl_ms > 0 && !with_ageing) return MatchErrorCode::AGEING_DISABLED;
+
+  if (action_data.size() != action_fn->get_num_params())
+    return MatchErrorCode::BAD_ACTION_DATA;
+
+  *added = false;
+
+  auto is_same = [this, action_fn, &action_data](entry_handle_t h) {
+    const ActionEntry *value;
+    if (match_unit->get_value(h, &value) != MatchErrorCode::SUCCESS)
+      return false;
+    const auto &current = value->action_fn;
+    return current.get_action_fn() == action_fn &&
+        current.get_action_data().action_data == action_data.action_data;
+  };
+
+  // common case: the entry was already learned; refreshing the timestamp is
+  // what a lookup does, so the read lock is enough, and we avoid invalidating
+  // the flow caches
+  {
+    ReadLock lock = lock_read();
+    if (match_unit->retrieve_handle(match_key, handle) ==
+        MatchErrorCode::SUCCESS && is_same(*handle)) {
+      auto &meta = match_unit->get_entry_meta(*handle);
+      if (ttl_ms == 0 || meta.timeout_ms == ttl_ms) {
+        if (ttl_ms > 0) meta.ts.set(Packet::clock::now());
+        return MatchErrorCode::SUCCESS;
+      }
+    }
+  }
+
+  const ControlFlowNode *next_node = get_next_node(action_fn->get_id());
+
+  MatchErrorCode rc = MatchErrorCode::SUCCESS;
+
+  {
+    WriteLock lock = lock_write_entries();
+
+    // the entry may have been added / removed since we released the read lock
+    rc = match_unit->retrieve_handle(match_key, handle);
+    if (rc == MatchErrorCode::SUCCESS) {
+      if (!is_same(*handle)) {
+        rc = match_unit->modify_entry(
+            *handle,
+            ActionEntry(ActionFnEntry(action_fn, std::move(action_data)),
+                        next_node));
+      }
+    } else {
+      rc = match_unit->add_entry(
+          match_key,
+          ActionEntry(ActionFnEntry(action_fn, std::move(action_data)),
+                      next_node),
+          handle);
+      *added = (rc == MatchErrorCode::SUCCESS);
+    }
+    if (rc == MatchErrorCode::SUCCESS && ttl_ms > 0)
+      rc = match_unit->set_entry_ttl(*handle, ttl_ms);
+  }
+
+  if (rc == MatchErrorCode::SUCCESS) {
+    BMLOG_DEBUG("Entry {} {} in table '{}' by the data plane",
+                *handle, *added ? "added" : "refreshed", get_name());
+  } else {
+    BMLOG_ERROR("Error when trying to learn entry in table '{}'", get_name());
+  }
+
+  return rc;
+}
+
 MatchErrorCode
 MatchTable::set_default_action(const ActionFn *action_fn,
                                ActionData action_data) {
@@ -451,7 +603,7 @@ MatchTable::set_default_action(const ActionFn *action_fn,
   next_node_miss = next_node;
 
   {
-    WriteLock lock = lock_write();
+    WriteLock lock = lock_write_entries();
     default_entry = ActionEntry(std::move(action_fn_entry), next_node);
   }
 
@@ -537,6 +689,20 @@ MatchTable::get_entries() const {
   return entries;
 }
 
+std::vector<MatchTable::Entry>
+MatchTable::get_entries_page(size_t max_entries,
+                              EntryCursor *cursor) const {
+  ReadLock lock = lock_read();
+  const auto handles = get_page_handles(max_entries, cursor);
+  std::vector<Entry> entries(handles.size());
+  for (size_t idx = 0; idx < handles.size(); idx++) {
+    MatchErrorCode rc = get_entry_(handles[idx], &entries[idx]);
+    _BM_UNUSED(rc);
+    assert(rc == MatchErrorCode::SUCCESS);
+  }
+  return entries;
+}
+
 MatchErrorCode
 MatchTable::get_default_entry(Entry *entry) const {
   ReadLock lock = lock_read();
@@ -678,7 +844,7 @@ MatchTableIndirect::add_entry(const std::vector<MatchKeyParam> &match_key,
   MatchErrorCode rc = MatchErrorCode::SUCCESS;
 
   {
-    WriteLock lock = lock_write();
+    WriteLock lock = lock_write_entries();
 
     if (!action_profile->is_valid_mbr(mbr)) {
       rc = MatchErrorCode::INVALID_MBR_HANDLE;
@@ -704,7 +870,7 @@ MatchTableIndirect::delete_entry(entry_handle_t handle) {
   MatchErrorCode rc = MatchErrorCode::SUCCESS;
 
   {
-    WriteLock lock = lock_write();
+    WriteLock lock = lock_write_entries();
 
     const IndirectIndex *index;
     rc = match_unit->get_value(handle, &index);
@@ -731,7 +897,7 @@ MatchTableIndirect::modify_entry(entry_handle_t handle, mbr_hdl_t mbr) {
   MatchErrorCode rc = MatchErrorCode::SUCCESS;
 
   {
-    WriteLock lock = lock_write();
+    WriteLock lock = lock_write_entries();
 
     const IndirectIndex *index;
     rc = match_unit->get_value(handle, &index);
@@ -766,7 +932,7 @@ MatchTableIndirect::set_default_member(mbr_hdl_t mbr) {
   MatchErrorCode rc = MatchErrorCode::SUCCESS;
 
   {
-    WriteLock lock = lock_write();
+    WriteLock lock = lock_write_entries();
 
     if (!action_profile->is_valid_mbr(mbr)) {
       rc = MatchErrorCode::INVALID_MBR_HANDLE;
@@ -834,6 +1000,20 @@ MatchTableIndirect::get_entries() const {
   return entries;
 }
 
+std::vector<MatchTableIndirect::Entry>
+MatchTableIndirect::get_entries_page(size_t max_entries,
+                                      EntryCursor *cursor) const {
+  ReadLock lock = lock_read();
+  const auto handles = get_page_handles(max_entries, cursor);
+  std::vector<Entry> entries(handles.size());
+  for (size_t idx = 0; idx < handles.size(); idx++) {
+    MatchErrorCode rc = get_entry_(handles[idx], &entries[idx]);
+    _BM_UNUSED(rc);
+    assert(rc == MatchErrorCode::SUCCESS);
+  }
+  return entries;
+}
+
 MatchErrorCode
 MatchTableIndirect::get_default_entry(Entry *entry) const {
   ReadLock lock = lock_read();
@@ -913,7 +1093,7 @@ MatchTableIndirectWS::add_entry_ws(const std::vector<MatchKeyParam> &match_key,
   MatchErrorCode rc = MatchErrorCode::SUCCESS;
 
   {
-    WriteLock lock = lock_write();
+    WriteLock lock = lock_write_entries();
 
     if (!action_profile->is_valid_grp(grp))
       rc = MatchErrorCode::INVALID_GRP_HANDLE;
@@ -943,7 +1123,7 @@ MatchTableIndirectWS::modify_entry_ws(entry_handle_t handle, grp_hdl_t grp) {
   MatchErrorCode rc;
 
   {
-    WriteLock lock = lock_write();
+    WriteLock lock = lock_write_entries();
 
     const IndirectIndex *index;
     rc = match_unit->get_value(handle, &index);
@@ -981,7 +1161,7 @@ MatchTableIndirectWS::set_default_group(grp_hdl_t grp) {
   MatchErrorCode rc = MatchErrorCode::SUCCESS;
 
   {
-    WriteLock lock = lock_write();
+    WriteLock lock = lock_write_entries();
 
     if (!action_profile->is_valid_grp(grp)) {
       rc = MatchErrorCode::INVALID_GRP_HANDLE;
@@ -1055,6 +1235,20 @@ MatchTableIndirectWS::get_entries() const {
   return entries;
 }
 
+std::vector<MatchTableIndirectWS::Entry>
+MatchTableIndirectWS::get_entries_page(size_t max_entries,
+                                        EntryCursor *cursor) const {
+  ReadLock lock = lock_read();
+  const auto handles = get_page_handles(max_entries, cursor);
+  std::vector<Entry> entries(handles.size());
+  for (size_t idx = 0; idx < handles.size(); idx++) {
+    MatchErrorCode rc = get_entry_(handles[idx], &entries[idx]);
+    _BM_UNUSED(rc);
+    assert(rc == MatchErrorCode::SUCCESS);
+  }
+  return entries;
+}
+
 MatchErrorCode
 MatchTableIndirectWS::get_default_entry(Entry *entry) const {
   ReadLock lock = lock_read();
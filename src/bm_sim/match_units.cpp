@@ -28,6 +28,7 @@
 
 #include <limits>
 #include <string>
+#include <utility>
 #include <vector>
 #include <algorithm>  // for std::copy, std::max
 #include <iostream>
@@ -99,6 +100,29 @@ std::ostream& operator<<(std::ostream &out, const MatchKeyParam &p) {
   return out;
 }
 
+std::vector<std::pair<header_id_t, int> >
+MatchKeyBuilder::get_inputs() const {
+  std::vector<std::pair<header_id_t, int> > inputs;
+  for (const auto &in : key_input) {
+    inputs.emplace_back(
+        in.header, (in.mtype == MatchKeyParam::Type::VALID) ? -1 : in.f_offset);
+  }
+  return inputs;
+}
+
+std::vector<MatchKeyBuilder::KeyFieldDesc>
+MatchKeyBuilder::get_key_fields() const {
+  std::vector<KeyFieldDesc> fields;
+  // once built, key_input is in implementation order, while masks and names
+  // are still in P4 order
+  for (size_t i = 0; i < key_input.size(); i++) {
+    const auto &in = key_input[built ? key_mapping[i] : i];
+    fields.push_back({in.header, in.f_offset, in.mtype, in.nbits, masks[i],
+                      name_map.get(i)});
+  }
+  return fields;
+}
+
 void
 MatchKeyBuilder::build() {
   if (built) return;
@@ -139,6 +163,22 @@ MatchKeyBuilder::build() {
     std::copy(masks.at(i).begin(), masks.at(i).end(),
               big_mask.begin() + key_offsets.at(i));
 
+  copy_ops.clear();
+  for (size_t i = 0; i < key_input.size(); i++) {
+    const auto &in = key_input[i];
+    KeyCopyOp op;
+    op.header = in.header;
+    op.f_offset = in.f_offset;
+    op.key_offset = offsets[i];
+    op.nbytes = nbits_to_nbytes(in.nbits);
+    op.is_valid_op = (in.mtype == MatchKeyParam::Type::VALID);
+    auto mask_start = big_mask.begin() + op.key_offset;
+    op.masked = has_big_mask &&
+        std::any_of(mask_start, mask_start + op.nbytes,
+                    [](char c) { return c != '\xff'; });
+    copy_ops.push_back(op);
+  }
+
   built = true;
 }
 
@@ -190,11 +230,10 @@ MatchKeyBuilder::apply_big_mask(ByteContainer *key) const {
 }
 
 void
-MatchKeyBuilder::operator()(const PHV &phv, ByteContainer *key) const {
+MatchKeyBuilder::build_key_generic(const PHV &phv, ByteContainer *key) const {
+  key->clear();
   for (const auto &in : key_input) {
     const Header &header = phv.get_header(in.header);
-    // if speed is an issue here, I can probably come up with something faster
-    // (with a switch statement maybe)
     if (in.mtype == MatchKeyParam::Type::VALID) {
       key->push_back(header.is_valid() ? '\x01' : '\x00');
     } else {
@@ -215,6 +254,49 @@ MatchKeyBuilder::operator()(const PHV &phv, ByteContainer *key) const {
     key->apply_mask(big_mask);
 }
 
+void
+MatchKeyBuilder::operator()(const PHV &phv, ByteContainer *key) const {
+  if (!built) {
+    build_key_generic(phv, key);
+    return;
+  }
+  // the key is usually a thread-local buffer re-used from one lookup to the
+  // next, in which case it already has the right size and this is a no-op
+  key->resize(nbytes_key);
+  char *dst = key->data();
+  for (const auto &op : copy_ops) {
+    const Header &header = phv.get_header(op.header);
+    char *out = dst + op.key_offset;
+    if (op.is_valid_op) {
+      *out = header.is_valid() ? '\x01' : '\x00';
+      if (op.masked) *out &= big_mask[op.key_offset];
+      continue;
+    }
+    // see build_key_generic() for an explanation
+    if (!header.is_valid() && !header[op.f_offset].is_hidden()) {
+      std::memset(out, 0, op.nbytes);
+      continue;
+    }
+    // the field bytes are read directly from the PHV arena, unless the field
+    // is a variable-length field (or the header is not backed by a PHV arena)
+    const char *bytes = header.get_field_storage(op.f_offset);
+    if (!bytes) {
+      const ByteView field_bytes = header[op.f_offset].get_bytes();
+      if (field_bytes.size() != op.nbytes) {
+        build_key_generic(phv, key);
+        return;
+      }
+      bytes = field_bytes.data();
+    }
+    if (op.masked) {
+      const char *mask = big_mask.data() + op.key_offset;
+      for (size_t i = 0; i < op.nbytes; i++) out[i] = bytes[i] & mask[i];
+    } else {
+      std::memcpy(out, bytes, op.nbytes);
+    }
+  }
+}
+
 std::vector<std::string>
 MatchKeyBuilder::key_to_fields(const ByteContainer &key) const {
   std::vector<std::string> fields;
@@ -638,6 +720,17 @@ MatchUnitAbstract_::handles_end() const {
   return handle_iterator(this, handles.end());
 }
 
+bool
+MatchUnitAbstract_::get_handles_page(uint64_t *position, size_t max_handles,
+                                     std::vector<entry_handle_t> *page) const {
+  auto it = handles.lower_bound(*position);
+  for (; it != handles.end() && max_handles > 0; ++it, --max_handles)
+    page->push_back(HANDLE_SET(entry_meta.at(*it).version, *it));
+  if (it == handles.end()) return true;
+  *position = *it;
+  return false;
+}
+
 MatchUnitAbstract_::MatchUnitAbstract_(size_t size,
                                        const MatchKeyBuilder &key_builder)
     : size(size), nbytes_key(key_builder.get_nbytes_key()),
@@ -785,7 +878,6 @@ template<typename V>
 typename MatchUnitAbstract<V>::MatchUnitLookup
 MatchUnitAbstract<V>::lookup(const Packet &pkt) {
   static thread_local ByteContainer key;
-  key.clear();
   build_key(*pkt.get_phv(), &key);
 
   // BMLOG_DEBUG_PKT(pkt, "Looking up key {}", key_to_string(key));
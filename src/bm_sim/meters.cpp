@@ -23,6 +23,10 @@
 #include <bm/bm_sim/packet.h>
 
 #include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <string>
 
@@ -39,29 +43,145 @@ Meter::clock::time_point time_init = Meter::clock::now();
 
 }  // namespace
 
-MeterErrorCode
+Meter::MeterRate::MeterRate(const MeterRate &other)
+    : valid(other.valid.load()), info_rate(other.info_rate.load()),
+      burst_size(other.burst_size.load()),
+      watermark(other.watermark.load()) { }
+
+Meter::MeterRate &
+Meter::MeterRate::operator=(const MeterRate &other) {
+  valid = other.valid.load();
+  info_rate = other.info_rate.load();
+  burst_size = other.burst_size.load();
+  watermark = other.watermark.load();
+  return *this;
+}
+
+Meter::Meter(Meter &&other) noexcept
+    : type(other.type), m_mutex(std::move(other.m_mutex)),
+      rates(std::move(other.rates)), configured(other.configured.load()) { }
+
+Meter &
+Meter::operator=(Meter &&other) noexcept {
+  type = other.type;
+  m_mutex = std::move(other.m_mutex);
+  rates = std::move(other.rates);
+  configured = other.configured.load();
+  return *this;
+}
+
+void
 Meter::set_rate(size_t idx, const rate_config_t &config) {
   MeterRate &rate = rates[idx];
   rate.valid = true;
   rate.info_rate = config.info_rate;
   rate.burst_size = config.burst_size;
-  rate.tokens = config.burst_size;
-  rate.tokens_last = 0u;
-  rate.color = (idx + 1);
-  if (idx > 0) {
-    MeterRate &prev_rate = rates[idx - 1];
-    if (prev_rate.info_rate > rate.info_rate) return INVALID_INFO_RATE_VALUE;
+  // the bucket starts full
+  rate.watermark = -static_cast<int64_t>(config.burst_size);
+}
+
+namespace {
+
+// Each thread which executes meters owns a slot, in which it publishes the
+// meter it is currently executing. Slots are padded to their own cache line
+// and only written by their owner, so execute() does not contend with other
+// threads; the (rare) rate updates pay instead for scanning all the slots.
+struct ExecutionSlot {
+  char pad0[64];
+  std::atomic<const Meter *> meter{nullptr};
+  char pad1[64];
+};
+
+// slots are never freed, they are re-used by new threads when a thread exits
+class ExecutionSlots {
+ public:
+  static ExecutionSlots *get() {
+    // leaked on purpose, as it may be accessed by thread_local destructors
+    static ExecutionSlots *slots = new ExecutionSlots();
+    return slots;
+  }
+
+  ExecutionSlot *acquire() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!free_slots.empty()) {
+      auto slot = free_slots.back();
+      free_slots.pop_back();
+      return slot;
+    }
+    slots.emplace_back(new ExecutionSlot());
+    return slots.back().get();
+  }
+
+  void release(ExecutionSlot *slot) {
+    std::lock_guard<std::mutex> lock(mutex);
+    free_slots.push_back(slot);
+  }
+
+  std::vector<ExecutionSlot *> get_all() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<ExecutionSlot *> all;
+    for (const auto &slot : slots) all.push_back(slot.get());
+    return all;
+  }
+
+ private:
+  std::mutex mutex{};
+  std::vector<std::unique_ptr<ExecutionSlot> > slots{};
+  std::vector<ExecutionSlot *> free_slots{};
+};
+
+struct ThreadExecutionSlot {
+  ThreadExecutionSlot()
+      : slot(ExecutionSlots::get()->acquire()) { }
+
+  ~ThreadExecutionSlot() {
+    ExecutionSlots::get()->release(slot);
+  }
+
+  ExecutionSlot *slot;
+};
+
+thread_local ThreadExecutionSlot thread_slot;
+
+struct ExecutionGuard {
+  explicit ExecutionGuard(const Meter *meter)
+      : slot(thread_slot.slot),
+        prev(slot->meter.load(std::memory_order_relaxed)) {
+    slot->meter.store(meter);
+  }
+
+  ~ExecutionGuard() {
+    slot->meter.store(prev, std::memory_order_release);
+  }
+
+  ExecutionSlot *slot;
+  const Meter *prev;
+};
+
+}  // namespace
+
+// The execution slots and the configured flag form a Dekker-style handshake,
+// hence the sequentially-consistent operations: either execute() sees
+// configured == false and does not touch the rates, or the meter it published
+// in its thread's slot is seen here and we wait for it to complete. Without
+// this, an execution which started before the change could store a watermark
+// computed with the old rate after the new rate was written, which could leave
+// the meter RED for a long time.
+void
+Meter::stop_executions() {
+  configured.store(false);
+  for (auto slot : ExecutionSlots::get()->get_all()) {
+    while (slot->meter.load() == this) std::this_thread::yield();
   }
-  return SUCCESS;
 }
 
 MeterErrorCode
 Meter::reset_rates() {
   auto lock = unique_lock();
+  stop_executions();
   for (MeterRate &rate : rates) {
     rate.valid = false;
   }
-  configured = false;
   return SUCCESS;
 }
 
@@ -69,12 +189,15 @@ Meter::color_t
 Meter::execute(const Packet &pkt, color_t pre_color) {
   color_t packet_color = 0;
 
-  if (!configured) return packet_color;
+  // see stop_executions()
+  ExecutionGuard guard(this);
+  if (!configured.load()) return packet_color;
 
   clock::time_point now = clock::now();
   int64_t micros_since_init = duration_cast<ticks>(now - time_init).count();
 
-  auto lock = unique_lock();
+  const int64_t input = (type == MeterType::PACKETS) ?
+      1 : static_cast<int64_t>(pkt.get_ingress_length());
 
   /* I tried to make this as accurate as I could. Everything is computed
      compared to a single time point (init). I do not use the interval since
@@ -82,22 +205,36 @@ Meter::execute(const Packet &pkt, color_t pre_color) {
      approximations. Maybe this is an overkill or I am underestimating the code
      I wrote for BMv1.
      The only thing that could go wrong is if tokens_since_init grew too large,
-     but I think it would take years even at high throughput */
-  for (MeterRate &rate : rates) {
-    uint64_t tokens_since_init =
-      static_cast<uint64_t>(micros_since_init * rate.info_rate);
-    assert(tokens_since_init >= rate.tokens_last);
-    size_t new_tokens = tokens_since_init - rate.tokens_last;
-    rate.tokens_last = tokens_since_init;
-    rate.tokens = std::min(rate.tokens + new_tokens, rate.burst_size);
-
-    size_t input = (type == MeterType::PACKETS) ? 1u : pkt.get_ingress_length();
+     but I think it would take years even at high throughput.
+     Refilling the bucket is implicit (see MeterRate): there is nothing to
+     write back when the packet does not conform to the rate, and a conforming
+     packet only needs to bump the watermark. Threads may observe
+     micros_since_init values which are not monotonic with respect to the
+     watermark updates of other threads, which is why we take the max instead
+     of asserting. */
+  for (size_t i = 0; i < rates.size(); i++) {
+    MeterRate &rate = rates[i];
+    const int64_t tokens_since_init = static_cast<int64_t>(
+        micros_since_init * rate.info_rate.load(std::memory_order_relaxed));
+    const int64_t burst_size = static_cast<int64_t>(
+        rate.burst_size.load(std::memory_order_relaxed));
+    const int64_t full_watermark = tokens_since_init - burst_size;
+
+    int64_t watermark = rate.watermark.load(std::memory_order_relaxed);
+    bool conform;
+    while (true) {
+      const int64_t refilled = std::max(watermark, full_watermark);
+      conform = (tokens_since_init - refilled >= input);
+      if (!conform) break;
+      if (rate.watermark.compare_exchange_weak(watermark, refilled + input,
+                                               std::memory_order_relaxed)) {
+        break;
+      }
+    }
 
-    if (rate.tokens < input) {
-      packet_color = rate.color;
+    if (!conform) {
+      packet_color = static_cast<color_t>(rates.size() - i);
       break;
-    } else {
-      rate.tokens -= input;
     }
   }
 
@@ -107,7 +244,7 @@ Meter::execute(const Packet &pkt, color_t pre_color) {
 void
 Meter::serialize(std::ostream *out) const {
   auto lock = unique_lock();
-  (*out) << configured << "\n";
+  (*out) << configured.load() << "\n";
   if (configured) {
     for (const auto &rate : rates)
       (*out) << rate.info_rate << " " << rate.burst_size << "\n";
@@ -117,8 +254,10 @@ Meter::serialize(std::ostream *out) const {
 void
 Meter::deserialize(std::istream *in) {
   auto lock = unique_lock();
-  (*in) >> configured;
-  if (configured) {
+  bool is_configured;
+  (*in) >> is_configured;
+  stop_executions();
+  if (is_configured) {
     for (size_t i = 0; i < rates.size(); i++) {
       rate_config_t config;
       (*in) >> config.info_rate;
@@ -126,6 +265,7 @@ Meter::deserialize(std::istream *in) {
       set_rate(i, config);
     }
   }
+  configured.store(is_configured, std::memory_order_release);
 }
 
 void
@@ -22,6 +22,8 @@
 #include <bm/bm_sim/event_logger.h>
 #include <bm/bm_sim/logger.h>
 #include <bm/bm_sim/P4Objects.h>
+#include <bm/bm_sim/pcap_file.h>
+#include <bm/bm_sim/thread_placement.h>
 
 #include <boost/program_options.hpp>
 
@@ -96,11 +98,33 @@ OptionsParser::parse(int argc, char *argv[], TargetParserIface *tp,
        "(interface X corresponds to two files X_in.pcap and X_out.pcap).  "
        "Argument is the time to wait (in seconds) before starting to process "
        "the packet files.")
+      ("pcap-replay", po::value<std::string>()->implicit_value("max"),
+       "Preload the --use-files input files in memory and replay them at "
+       "high rate. Pacing can be 'max' (default), 'pps=<rate>' or "
+       "'speed=<scale>' (respect timestamps, sped up by <scale>). Implies "
+       "--use-files.")
+      ("pcap-replay-burst", po::value<unsigned int>(),
+       "Number of packets injected back-to-back by --pcap-replay (default "
+       "32)")
+      ("pcap-replay-loops", po::value<unsigned int>(),
+       "Number of times the input files are replayed by --pcap-replay "
+       "(default 1)")
+#ifdef BMAFPACKET_ON
+      ("af-packet", po::value<unsigned int>()->implicit_value(1),
+       "Use AF_PACKET sockets with memory-mapped rings instead of libpcap "
+       "for interfaces. The optional argument is the number of receive "
+       "queues (threads) per interface, traffic is spread among them with "
+       "PACKET_FANOUT (default 1).")
+#endif
 #ifdef BMNANOMSG_ON
       ("packet-in", po::value<std::string>(),
        "Enable receiving packet on this (nanomsg) socket. "
        "The --interface options will be ignored.")
 #endif
+      ("packet-in-shm", po::value<std::string>(),
+       "Enable receiving packets through lock-free rings in this shared "
+       "memory segment (e.g. /bmv2-0), see bm_apps::ShmPacketInject. "
+       "The --interface options will be ignored.")
 #ifdef BMTHRIFT_ON
       ("thrift-port", po::value<int>(),
        "TCP port on which to run the Thrift runtime server")
@@ -110,6 +134,14 @@ OptionsParser::parse(int argc, char *argv[], TargetParserIface *tp,
       ("nanolog", po::value<std::string>(),
        "IPC socket to use for nanomsg pub/sub logs "
        "(default: no nanomsg logging")
+      ("nanolog-async",
+       "If used with '--nanolog', messages are buffered in per-thread ring "
+       "buffers and sent by a background thread; messages are dropped when a "
+       "ring buffer is full")
+      ("nanolog-sampling", po::value<std::vector<std::string> >()->composing(),
+       "<event-name>=<N>: If used with '--nanolog', only generate messages for "
+       "event <event-name> (e.g. 'table_hit') for 1 in N packets; N=0 disables "
+       "the event. Can appear multiple times")
       ("log-console",
        "Enable logging on stdout")
       ("log-file", po::value<std::string>(),
@@ -119,6 +151,10 @@ OptionsParser::parse(int argc, char *argv[], TargetParserIface *tp,
        "'trace', 'debug', 'info', 'warn', 'error', off'; default is 'trace'")
       ("log-flush", "If used with '--log-file', the logger will flush to disk "
        "after every log message")
+      ("log-async",
+       "If used with '--log-console' or '--log-file', messages are buffered in "
+       "per-thread ring buffers and formatted and written by a background "
+       "thread; messages are dropped when a ring buffer is full")
 #ifdef BMNANOMSG_ON
       ("notifications-addr", po::value<std::string>(),
        "Specify the nanomsg address to use for notifications "
@@ -134,6 +170,13 @@ OptionsParser::parse(int argc, char *argv[], TargetParserIface *tp,
 #endif
       ("restore-state", po::value<std::string>(),
        "Restore state from file")
+      ("cpu-affinity", po::value<std::vector<std::string> >()->composing(),
+       "<thread-class>=<core-list>: pin the target threads of the given "
+       "class to the given cores, e.g. 'egress=4-7' or 'ingress=2,3'. "
+       "Thread i of the class is pinned to the i-th core in the list (modulo "
+       "the list size) and allocates its memory from the local NUMA node. "
+       "Thread classes are target-specific (ingress, egress and transmit for "
+       "simple_switch). Can appear multiple times")
       ("dump-packet-data", po::value<size_t>(),
        "Specify how many bytes of packet data to dump upon receiving & sending "
        "a packet. We use the logger to dump the packet data, with log level "
@@ -254,6 +297,25 @@ OptionsParser::parse(int argc, char *argv[], TargetParserIface *tp,
     auto event_transport = TransportIface::make_nanomsg(event_logger_addr);
     event_transport->open();
     EventLogger::init(std::move(event_transport), device_id);
+    if (vm.count("nanolog-sampling")) {
+      for (const auto &sampling :
+               vm["nanolog-sampling"].as<std::vector<std::string> >()) {
+        const auto pos = sampling.find('=');
+        bool valid = (pos != std::string::npos);
+        try {
+          valid = valid && EventLogger::get()->set_sampling_rate(
+              sampling.substr(0, pos), std::stoul(sampling.substr(pos + 1)));
+        } catch (...) {
+          valid = false;
+        }
+        if (!valid) {
+          outstream << "Error: invalid --nanolog-sampling value '" << sampling
+                    << "'\n";
+          exit(1);
+        }
+      }
+    }
+    if (vm.count("nanolog-async")) EventLogger::get()->enable_async();
 #endif
   }
 
@@ -311,6 +373,15 @@ OptionsParser::parse(int argc, char *argv[], TargetParserIface *tp,
     }
   }
 
+  if (vm.count("log-async")) {
+    if (!log_requested) {
+      outstream << "Ignoring --log-async option because neither --log-console "
+                << "nor --log-file is specified\n";
+    } else {
+      log_async = true;
+    }
+  }
+
   if (vm.count("dump-packet-data")) {
     dump_packet_data = vm["dump-packet-data"].as<size_t>();
     if (dump_packet_data > 0 && log_level > Logger::LogLevel::INFO) {
@@ -321,6 +392,21 @@ OptionsParser::parse(int argc, char *argv[], TargetParserIface *tp,
     }
   }
 
+  if (vm.count("cpu-affinity")) {
+    const auto &specs = vm["cpu-affinity"].as<std::vector<std::string> >();
+    for (const auto &spec : specs) {
+      auto eq = spec.find('=');
+      std::vector<int> cores;
+      if (eq == 0 || eq == std::string::npos ||
+          !ThreadPlacement::parse_core_list(spec.substr(eq + 1), &cores)) {
+        outstream << "Invalid --cpu-affinity argument: '" << spec << "', "
+                  << "expected <thread-class>=<core-list>\n";
+        exit(1);
+      }
+      cpu_affinity[spec.substr(0, eq)] = cores;
+    }
+  }
+
   if (vm.count("interface")) {
     for (const auto &iface : vm["interface"].as<std::vector<interface> >()) {
       ifaces.add(iface.port, iface.name);
@@ -338,6 +424,37 @@ OptionsParser::parse(int argc, char *argv[], TargetParserIface *tp,
       wait_time = 0;
   }
 
+  if (vm.count("pcap-replay")) {
+    pcap_replay = true;
+    use_files = true;
+    pcap_replay_pacing = vm["pcap-replay"].as<std::string>();
+    PcapReplayConfig config;
+    if (!config.parsePacing(pcap_replay_pacing)) {
+      outstream << "Invalid pacing for --pcap-replay: '"
+                << pcap_replay_pacing << "'\n";
+      exit(1);
+    }
+  }
+
+  if (vm.count("pcap-replay-burst")) {
+    pcap_replay_burst = vm["pcap-replay-burst"].as<unsigned int>();
+    if (pcap_replay_burst == 0)
+      pcap_replay_burst = 1;
+  }
+
+  if (vm.count("pcap-replay-loops")) {
+    pcap_replay_loops = vm["pcap-replay-loops"].as<unsigned int>();
+  }
+
+#ifdef BMAFPACKET_ON
+  if (vm.count("af-packet")) {
+    af_packet = true;
+    af_packet_queues = vm["af-packet"].as<unsigned int>();
+    if (af_packet_queues == 0)
+      af_packet_queues = 1;
+  }
+#endif
+
 #ifdef BMNANOMSG_ON
   if (vm.count("packet-in")) {
     packet_in = true;
@@ -347,11 +464,29 @@ OptionsParser::parse(int argc, char *argv[], TargetParserIface *tp,
   }
 #endif
 
+  if (vm.count("packet-in-shm")) {
+    packet_in_shm = true;
+    packet_in_shm_name = vm["packet-in-shm"].as<std::string>();
+    ifaces.clear();
+  }
+
   if (use_files && packet_in) {
     outstream << "Error: --use-files and --packet-in are exclusive\n";
     exit(1);
   }
 
+  if (packet_in_shm && (use_files || packet_in)) {
+    outstream << "Error: --packet-in-shm cannot be used with --use-files or "
+              << "--packet-in\n";
+    exit(1);
+  }
+
+  if (af_packet && (use_files || packet_in || packet_in_shm || pcap)) {
+    outstream << "Error: --af-packet cannot be used with --use-files, "
+              << "--packet-in, --packet-in-shm or --pcap\n";
+    exit(1);
+  }
+
   if (vm.count("debugger-addr")) {
     debugger = true;
     debugger_addr = vm["debugger-addr"].as<std::string>();
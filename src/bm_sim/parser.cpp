@@ -271,7 +271,7 @@ ParserOpExtract::operator()(Packet *pkt, const char *data,
   auto phv = pkt->get_phv();
   auto &hdr = phv->get_header(header);
   BMELOG(parser_extract, *pkt, header);
-  BMLOG_DEBUG_PKT(*pkt, "Extracting header '{}'", hdr.get_name());
+  BMLOG_DEBUG_PKT(*pkt, "Extracting header '{}'", phv->get_header_name(header));
   check_enough_data_for_extract(*pkt, *bytes_parsed, hdr);
   hdr.extract(data, *phv);
   *bytes_parsed += hdr.get_nbytes_packet();
@@ -996,6 +996,7 @@ Parser::verify_checksums(const Packet &pkt) const {
 
 void
 Parser::parse(Packet *pkt) const {
+  TelemetryTimer timer(&latency_ns);
   BMELOG(parser_start, *pkt, *this);
   // TODO(antonin)
   // this is temporary while we experiment with the debugger
@@ -1009,6 +1010,8 @@ Parser::parse(Packet *pkt) const {
   if (!init_state) return;
   const ParseState *next_state = init_state;
   size_t bytes_parsed = 0;
+  PHV *phv = pkt->get_phv();
+  phv->start_parse(data);
   while (next_state) {
     try {
       next_state = (*next_state)(pkt, data, &bytes_parsed);
@@ -1021,6 +1024,7 @@ Parser::parse(Packet *pkt) const {
     }
     BMLOG_TRACE_PKT(*pkt, "Bytes parsed: {}", bytes_parsed);
   }
+  phv->end_parse(bytes_parsed);
   pkt->remove(bytes_parsed);
   verify_checksums(*pkt);
   BMELOG(parser_done, *pkt, *this);
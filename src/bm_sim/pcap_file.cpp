@@ -16,6 +16,7 @@
 #include <bm/bm_sim/pcap_file.h>
 #include <bm/bm_sim/logger.h>
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <thread>
@@ -23,7 +24,10 @@
 #include <iomanip>
 #include <sstream>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include <cstdlib>
 #include <cstring>
 
 namespace bm {
@@ -332,6 +336,149 @@ PcapFilesReader::set_packet_handler(const PacketHandler &hnd, void *ck) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+bool
+PcapReplayConfig::parsePacing(const std::string &str) {
+  auto parse_number = [&str](size_t prefix_len, double *v) {
+    const char *start = str.c_str() + prefix_len;
+    char *end = nullptr;
+    *v = std::strtod(start, &end);
+    return end != start && *end == '\0' && *v > 0;
+  };
+  if (str == "max") {
+    pacing = Pacing::MAX_RATE;
+    return true;
+  } else if (str.compare(0, 4, "pps=") == 0) {
+    pacing = Pacing::FIXED_PPS;
+    return parse_number(4, &pps);
+  } else if (str.compare(0, 6, "speed=") == 0) {
+    pacing = Pacing::TIMESTAMP;
+    return parse_number(6, &time_scale);
+  }
+  return false;
+}
+
+PcapReplayer::PcapReplayer(const PcapReplayConfig &config,
+                           unsigned wait_time_in_seconds)
+  : config(config),
+    wait_time_in_seconds(wait_time_in_seconds) {
+  if (this->config.burst_size == 0) this->config.burst_size = 1;
+}
+
+void
+PcapReplayer::addFile(unsigned port, std::string file) {
+  PcapFileIn pcap_file(port, file);
+  while (pcap_file.moveNext()) {
+    auto packet = pcap_file.current();
+    const struct timeval *ts = packet->getTime();
+    PacketRecord record;
+    record.port = port;
+    record.length = packet->getLength();
+    record.offset = data.size();
+    record.ts_ns = static_cast<uint64_t>(ts->tv_sec) * 1000000000u +
+        static_cast<uint64_t>(ts->tv_usec) * 1000u;
+    data.insert(data.end(), packet->getData(),
+                packet->getData() + record.length);
+    if (!packets.empty() && record.ts_ns < packets.back().ts_ns)
+      sorted = false;
+    packets.push_back(record);
+  }
+}
+
+uint64_t
+PcapReplayer::scheduledTime(size_t index, unsigned loop) const {
+  switch (config.pacing) {
+    case PcapReplayConfig::Pacing::MAX_RATE:
+      return 0;
+    case PcapReplayConfig::Pacing::FIXED_PPS:
+      return static_cast<uint64_t>(
+          (loop * packets.size() + index) * 1e9 / config.pps);
+    case PcapReplayConfig::Pacing::TIMESTAMP:
+      {
+        uint64_t first = packets.front().ts_ns;
+        uint64_t duration = packets.back().ts_ns - first;
+        uint64_t offset = loop * duration + (packets[index].ts_ns - first);
+        return static_cast<uint64_t>(offset / config.time_scale);
+      }
+  }
+  return 0;
+}
+
+void
+PcapReplayer::start() {
+  if (handler == nullptr)
+    pcap_fatal_error("No packet handler set when replaying packets");
+
+  // same order as PcapFilesReader: by timestamp, then by file
+  if (!sorted) {
+    std::stable_sort(packets.begin(), packets.end(),
+                     [](const PacketRecord &p1, const PacketRecord &p2) {
+                       return p1.ts_ns < p2.ts_ns; });
+    sorted = true;
+  }
+
+  if (wait_time_in_seconds > 0) {
+    BMLOG_DEBUG("Pcap replay: waiting for {} seconds", wait_time_in_seconds);
+    std::this_thread::sleep_for(std::chrono::seconds(wait_time_in_seconds));
+  }
+
+  BMLOG_DEBUG("Pcap replay: starting, {} packets", packets.size());
+  using clock = std::chrono::steady_clock;
+  const auto start_time = clock::now();
+  const auto late_threshold = std::chrono::milliseconds(1);
+  for (unsigned loop = 0; loop < config.loops && !packets.empty(); loop++) {
+    for (size_t i = 0; i < packets.size(); i += config.burst_size) {
+      if (config.pacing != PcapReplayConfig::Pacing::MAX_RATE) {
+        auto target = start_time +
+            std::chrono::nanoseconds(scheduledTime(i, loop));
+        auto now = clock::now();
+        if (target > now)
+          std::this_thread::sleep_until(target);
+        else if (now - target > late_threshold)
+          late_bursts++;
+      }
+      size_t end = std::min(packets.size(), i + config.burst_size);
+      uint64_t burst_bytes = 0;
+      for (size_t j = i; j < end; j++) {
+        const auto &packet = packets[j];
+        handler(packet.port, data.data() + packet.offset, packet.length,
+                cookie);
+        burst_bytes += packet.length;
+      }
+      packets_sent += end - i;
+      bytes_sent += burst_bytes;
+      elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          clock::now() - start_time).count();
+    }
+  }
+
+  auto stats = getStats();
+  Logger::get()->info(
+      "Pcap replay: injected {} packets ({} bytes) in {:.3f}s, {:.0f} pps, "
+      "{} late bursts", stats.packets, stats.bytes, stats.elapsed_seconds,
+      stats.pps(), stats.late_bursts);
+}
+
+PacketDispatcherIface::ReturnCode
+PcapReplayer::set_packet_handler(const PacketHandler &hnd, void *ck) {
+  assert(hnd);
+
+  handler = hnd;
+  cookie = ck;
+  return ReturnCode::SUCCESS;
+}
+
+PcapReplayStats
+PcapReplayer::getStats() const {
+  PcapReplayStats stats;
+  stats.packets = packets_sent;
+  stats.bytes = bytes_sent;
+  stats.elapsed_seconds = elapsed_ns / 1e9;
+  stats.late_bursts = late_bursts;
+  return stats;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 PcapFileOut::PcapFileOut(unsigned port, std::string filename)
   : PcapFileBase(port, filename) {
   pcap = pcap_open_dead(0, 0);
@@ -346,13 +493,26 @@ PcapFileOut::PcapFileOut(unsigned port, std::string filename)
 
 void
 PcapFileOut::writePacket(const char *data, unsigned length) {
+  struct timeval ts;
+  gettimeofday(&ts, NULL);
+  writePacket(data, length, ts);
+  flush();
+}
+
+void
+PcapFileOut::writePacket(const char *data, unsigned length,
+                         const struct timeval &ts) {
   struct pcap_pkthdr pkt_header;
   memset(&pkt_header, 0, sizeof(pkt_header));
-  gettimeofday(&pkt_header.ts, NULL);
+  pkt_header.ts = ts;
   pkt_header.caplen = length;
   pkt_header.len = length;
   pcap_dump(reinterpret_cast<unsigned char *>(dumper), &pkt_header,
             reinterpret_cast<const unsigned char *>(data));
+}
+
+void
+PcapFileOut::flush() {
   pcap_dump_flush(dumper);
 }
 
@@ -365,7 +525,18 @@ PcapFileOut::~PcapFileOut() {
 
 ////////////////////////////////////////////////////////////////////////////////
 
-PcapFilesWriter::PcapFilesWriter() {}
+PcapFilesWriter::PcapFilesWriter(bool async)
+  : async(async) {}
+
+PcapFilesWriter::~PcapFilesWriter() {
+  if (!writer_thread.joinable()) return;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    stop = true;
+  }
+  cv.notify_one();
+  writer_thread.join();
+}
 
 
 void
@@ -378,14 +549,55 @@ PcapFilesWriter::addFile(unsigned port, std::string file) {
 void
 PcapFilesWriter::send_packet(int port_num, const char *buffer, int len) {
   unsigned idx = port_num;
+  packet_count++;
 
   if (files.find(port_num) == files.end())
     // The behavior of the bmi_* library seems to be to ignore
     // packets sent to inexistent interfaces, so we replicate it here.
     return;
 
-  auto file = files.at(idx).get();
-  file->writePacket(buffer, len);
+  if (!async) {
+    auto file = files.at(idx).get();
+    file->writePacket(buffer, len);
+    return;
+  }
+
+  std::call_once(writer_started, [this]() {
+    writer_thread = std::thread(&PcapFilesWriter::writeLoop, this);
+  });
+  PendingPacket packet;
+  packet.port = idx;
+  gettimeofday(&packet.ts, NULL);
+  packet.data.assign(buffer, buffer + len);
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    pending.push_back(std::move(packet));
+  }
+  cv.notify_one();
+}
+
+void
+PcapFilesWriter::writeLoop() {
+  std::vector<PendingPacket> batch;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (!stop && pending.empty()) cv.wait(lock);
+      if (pending.empty()) return;  // stop requested and nothing left
+      batch.swap(pending);
+    }
+    for (const auto &packet : batch) {
+      files.at(packet.port)->writePacket(
+          packet.data.data(), packet.data.size(), packet.ts);
+    }
+    batch.clear();
+    // only flush once the queue has been drained
+    std::unique_lock<std::mutex> lock(mutex);
+    if (pending.empty()) {
+      lock.unlock();
+      for (auto &p : files) p.second->flush();
+    }
+  }
 }
 
 }  // namespace bm
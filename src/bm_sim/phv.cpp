@@ -21,17 +21,28 @@
 #include <bm/bm_sim/phv.h>
 #include <bm/bm_sim/logger.h>
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <set>
 
 namespace bm {
 
+constexpr size_t PHV::storage_alignment;
+
 PHV::PHV(size_t num_headers, size_t num_header_stacks,
-         size_t num_header_unions, size_t num_header_union_stacks)
-    : capacity(num_headers), capacity_stacks(num_header_stacks),
-      capacity_unions(num_header_unions),
+         size_t num_header_unions, size_t num_header_union_stacks,
+         size_t storage_nbytes)
+    : storage_nbytes(storage_nbytes), capacity(num_headers),
+      capacity_stacks(num_header_stacks), capacity_unions(num_header_unions),
       capacity_union_stacks(num_header_union_stacks) {
+  if (storage_nbytes > 0) {
+    // zero-initialized, like the value of a newly-constructed Field
+    storage_buffer.reset(new char[storage_nbytes + storage_alignment - 1]());
+    auto addr = reinterpret_cast<uintptr_t>(storage_buffer.get());
+    storage = storage_buffer.get() +
+        (storage_alignment - addr % storage_alignment) % storage_alignment;
+  }
   // this is needed, otherwise our references will not be valid anymore
   headers.reserve(num_headers);
   header_stacks.reserve(num_header_stacks);
@@ -45,6 +56,22 @@ PHV::reset() {
     h.mark_invalid();
     if (h.is_VL_header()) h.reset_VL_header();
   }
+  packet_bytes.clear();
+  parse_gen++;
+}
+
+void
+PHV::start_parse(const char *data) {
+  // invalidates the packet offsets of all previously-extracted headers
+  parse_gen++;
+  parse_base = data;
+}
+
+void
+PHV::end_parse(size_t nbytes) {
+  assert(parse_base);
+  packet_bytes.assign(parse_base, parse_base + nbytes);
+  parse_base = nullptr;
 }
 
 void
@@ -82,14 +109,21 @@ PHV::push_back_header(const std::string &header_name,
                       header_id_t header_index,
                       const HeaderType &header_type,
                       const std::set<int> &arith_offsets,
-                      const bool metadata) {
+                      const bool metadata, size_t storage_offset) {
   assert(header_index < static_cast<int>(capacity));
   assert(header_index == static_cast<int>(headers.size()));
+  char *header_storage = nullptr;
+  if (storage) {
+    assert(storage_offset + header_type.get_storage_nbytes() <=
+           storage_nbytes);
+    header_storage = storage + storage_offset;
+  }
   // cannot call push_back here, as the Header constructor passes "this" to the
   // Field constructor (i.e. Header cannot be moved or the pointer would be
   // invalid); this is not a very robust design
   headers.emplace_back(
-      header_name, header_index, header_type, arith_offsets, metadata);
+      header_name, header_index, header_type, arith_offsets, metadata,
+      header_storage);
   headers.back().set_packet_id(&packet_id);
 
   headers_map.emplace(header_name, get_header(header_index));
@@ -97,7 +131,7 @@ PHV::push_back_header(const std::string &header_name,
   for (int i = 0; i < header_type.get_num_fields(); i++) {
     const std::string name = header_name + "." + header_type.get_field_name(i);
     // std::cout << header_index << " " << i << " " << name << std::endl;
-    fields_map.emplace(name, get_field(header_index, i));
+    fields_map.emplace(name, std::make_pair(header_index, i));
   }
 
   if (header_type.is_VL_header()) {
@@ -119,10 +153,22 @@ PHV::push_back_header_stack(const std::string &header_stack_name,
   assert(header_stack_index < static_cast<int>(capacity_stacks));
   assert(header_stack_index == static_cast<int>(header_stacks.size()));
   HeaderStack header_stack(header_stack_name, header_stack_index);
+  // the VL expression of a header refers to the header by id, which would
+  // designate a different Header instance once the stack is rotated
+  bool circular = !header_ids.empty();
   for (header_id_t header_id : header_ids) {
     header_stack.set_next_element(get_header(header_id));
+    if (get_header(header_id).is_VL_header()) circular = false;
   }
+  header_stack.circular = circular;
   header_stacks.push_back(std::move(header_stack));
+  if (!circular) return;
+  size_t idx = 0;
+  for (header_id_t header_id : header_ids) {
+    auto &header = headers[header_id];
+    header.stack = &header_stacks.back();
+    header.stack_idx = idx++;
+  }
 }
 
 void
@@ -163,15 +209,15 @@ void
 PHV::add_field_alias(const std::string &from, const std::string &to) {
   // if an alias has the same name as an actual field, we give priority to the
   // alias definition; the future will tell use if this is the right choice...
-  auto &ref = get_field(to);
-  auto r = fields_map.emplace(from, ref);
-  if (!r.second) r.first->second = ref;
+  const auto loc = fields_map.at(to);
+  auto r = fields_map.emplace(from, loc);
+  if (!r.second) r.first->second = loc;
   // fields_map.emplace(from, ref);
 }
 
 const std::string
 PHV::get_field_name(header_id_t header_index, int field_offset) const {
-  return get_header(header_index).get_field_full_name(field_offset);
+  return headers[header_index].get_field_full_name(field_offset);
 }
 
 
@@ -180,9 +226,13 @@ PHVFactory::push_back_header(const std::string &header_name,
                              const header_id_t header_index,
                              const HeaderType &header_type,
                              const bool metadata) {
-  HeaderDesc desc(header_name, header_index, header_type, metadata);
+  // each header slot in the field arena is 8-byte aligned
+  HeaderDesc desc(header_name, header_index, header_type, metadata,
+                  storage_nbytes);
   // cannot use operator[] because it requires default constructibility
-  header_descs.insert(std::make_pair(header_index, desc));
+  auto r = header_descs.insert(std::make_pair(header_index, desc));
+  if (r.second)
+    storage_nbytes += (header_type.get_storage_nbytes() + 7) & ~size_t(7);
   for (int i = 0; i < header_type.get_num_fields(); i++) {
     field_names.insert(header_name + "." + header_type.get_field_name(i));
   }
@@ -313,13 +363,14 @@ std::unique_ptr<PHV>
 PHVFactory::create() const {
   std::unique_ptr<PHV> phv(new PHV(
       header_descs.size(), header_stack_descs.size(),
-      header_union_descs.size(), header_union_stack_descs.size()));
+      header_union_descs.size(), header_union_stack_descs.size(),
+      storage_nbytes));
 
   for (const auto &e : header_descs) {
     const auto &desc = e.second;
     phv->push_back_header(desc.name, desc.index,
                           desc.header_type, desc.arith_offsets,
-                          desc.metadata);
+                          desc.metadata, desc.storage_offset);
   }
 
   for (const auto &e : header_stack_descs) {
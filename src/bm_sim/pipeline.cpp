@@ -19,11 +19,20 @@
  */
 
 #include <bm/bm_sim/pipeline.h>
+#include <bm/bm_sim/conditionals.h>
+#include <bm/bm_sim/control_action.h>
+#include <bm/bm_sim/tables.h>
 #include <bm/bm_sim/event_logger.h>
 #include <bm/bm_sim/logger.h>
 #include <bm/bm_sim/debugger.h>
+#include <bm/bm_sim/flow_cache.h>
 #include <bm/bm_sim/packet.h>
 
+#include <algorithm>  // for std::find
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
 namespace bm {
 
 void
@@ -35,19 +44,146 @@ Pipeline::apply(Packet *pkt) {
       Debugger::PacketId::make(pkt->get_packet_id(), pkt->get_copy_id()),
       DBG_CTR_CONTROL | get_id());
   BMLOG_DEBUG_PKT(*pkt, "Pipeline '{}': start", get_name());
-  const ControlFlowNode *node = first_node;
+  if (steps.empty())
+    apply_from(first_node, pkt);
+  else
+    apply_compiled(pkt);
+  BMELOG(pipeline_done, *pkt, *this);
+  DEBUGGER_NOTIFY_CTR(
+      Debugger::PacketId::make(pkt->get_packet_id(), pkt->get_copy_id()),
+      DBG_CTR_EXIT(DBG_CTR_CONTROL) | get_id());
+  BMLOG_DEBUG_PKT(*pkt, "Pipeline '{}': end", get_name());
+}
+
+void
+Pipeline::apply_from(const ControlFlowNode *node, Packet *pkt) const {
   while (node) {
     if (pkt->is_marked_for_exit()) {
       BMLOG_DEBUG_PKT(*pkt, "Packet is marked for exit, interrupting pipeline");
       break;
     }
+    // the effects of other kinds of nodes are unknown, so they cannot be
+    // cached
+    auto recorder = FlowCacheRecorder::get();
+    if (recorder && typeid(*node) != typeid(Conditional) &&
+        typeid(*node) != typeid(ControlAction) &&
+        typeid(*node) != typeid(MatchActionTable)) {
+      recorder->set_uncacheable();
+    }
     node = (*node)(pkt);
   }
-  BMELOG(pipeline_done, *pkt, *this);
-  DEBUGGER_NOTIFY_CTR(
-      Debugger::PacketId::make(pkt->get_packet_id(), pkt->get_copy_id()),
-      DBG_CTR_EXIT(DBG_CTR_CONTROL) | get_id());
-  BMLOG_DEBUG_PKT(*pkt, "Pipeline '{}': end", get_name());
+}
+
+void
+Pipeline::apply_compiled(Packet *pkt) const {
+  int idx = 0;
+  while (idx >= 0) {
+    if (pkt->is_marked_for_exit()) {
+      BMLOG_DEBUG_PKT(*pkt, "Packet is marked for exit, interrupting pipeline");
+      return;
+    }
+    const auto &step = steps[idx];
+    const ControlFlowNode *next = nullptr;
+    // the qualified calls below are not virtual, compile() only uses these
+    // kinds for nodes with the exact dynamic type
+    switch (step.kind) {
+      case Step::Kind::CONDITIONAL:
+        idx = static_cast<const Conditional *>(step.node)->evaluate(pkt) ?
+            step.next[0] : step.next[1];
+        continue;
+      case Step::Kind::ACTION:
+        static_cast<const ControlAction *>(step.node)->execute(pkt);
+        idx = step.next[0];
+        continue;
+      case Step::Kind::TABLE:
+        next = static_cast<const MatchActionTable *>(step.node)
+            ->MatchActionTable::operator()(pkt);
+        break;
+      case Step::Kind::OTHER:
+        // successors unknown at compile time
+        apply_from(step.node, pkt);
+        return;
+    }
+    if (!next) return;
+    idx = -1;
+    for (const auto &p : step.table_next) {
+      if (p.first == next) {
+        idx = p.second;
+        break;
+      }
+    }
+    // the next node was not known at compile time (it can be changed at
+    // runtime with the debugger or when restoring a saved state)
+    if (idx < 0) {
+      apply_from(next, pkt);
+      return;
+    }
+  }
+}
+
+void
+Pipeline::compile() {
+  steps.clear();
+  if (!first_node) return;
+
+  std::vector<const ControlFlowNode *> nodes;
+  std::unordered_map<const ControlFlowNode *, int> indices;
+  auto visit = [&nodes, &indices](const ControlFlowNode *node) {
+    if (!node || indices.count(node)) return;
+    indices.emplace(node, static_cast<int>(nodes.size()));
+    nodes.push_back(node);
+  };
+
+  // breadth-first numbering, so that the nodes are laid out roughly in the
+  // order in which they are applied
+  visit(first_node);
+  for (size_t i = 0; i < nodes.size(); i++) {
+    const ControlFlowNode *node = nodes[i];
+    Step step;
+    step.node = node;
+    step.next = {{-1, -1}};
+    if (typeid(*node) == typeid(Conditional)) {
+      auto conditional = static_cast<const Conditional *>(node);
+      step.kind = Step::Kind::CONDITIONAL;
+      visit(conditional->get_next_node_if_true());
+      visit(conditional->get_next_node_if_false());
+    } else if (typeid(*node) == typeid(ControlAction)) {
+      step.kind = Step::Kind::ACTION;
+      visit(static_cast<const ControlAction *>(node)->get_next_node());
+    } else if (typeid(*node) == typeid(MatchActionTable)) {
+      step.kind = Step::Kind::TABLE;
+      auto table = static_cast<const MatchActionTable *>(node);
+      for (const auto next : table->get_match_table()->get_next_nodes())
+        visit(next);
+    } else {
+      step.kind = Step::Kind::OTHER;
+    }
+    steps.push_back(step);
+  }
+
+  auto index_of = [&indices](const ControlFlowNode *node) {
+    return node ? indices.at(node) : -1;
+  };
+  for (auto &step : steps) {
+    if (step.kind == Step::Kind::CONDITIONAL) {
+      auto conditional = static_cast<const Conditional *>(step.node);
+      step.next = {{index_of(conditional->get_next_node_if_true()),
+                    index_of(conditional->get_next_node_if_false())}};
+    } else if (step.kind == Step::Kind::ACTION) {
+      auto action = static_cast<const ControlAction *>(step.node);
+      step.next = {{index_of(action->get_next_node()), -1}};
+    } else if (step.kind == Step::Kind::TABLE) {
+      auto table = static_cast<const MatchActionTable *>(step.node);
+      for (const auto next : table->get_match_table()->get_next_nodes()) {
+        if (!next) continue;
+        auto p = std::make_pair(next, index_of(next));
+        if (std::find(step.table_next.begin(), step.table_next.end(), p) ==
+            step.table_next.end()) {
+          step.table_next.push_back(p);
+        }
+      }
+    }
+  }
 }
 
 }  // namespace bm
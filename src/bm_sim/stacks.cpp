@@ -23,6 +23,7 @@
 #include <bm/bm_sim/header_unions.h>
 
 #include <algorithm>  // std::min
+#include <stdexcept>
 #include <string>
 
 namespace bm {
@@ -36,6 +37,12 @@ size_t
 Stack<T>::pop_front() {
   if (next == 0) return 0u;
   next--;
+  if (circular) {
+    // the first element becomes the last one
+    get_element(0).mark_invalid();
+    base = (base + 1 == elements.size()) ? 0 : base + 1;
+    return 1u;
+  }
   for (size_t i = 0; i < next; i++) {
     elements[i].get().swap_values(&elements[i + 1].get());
   }
@@ -49,6 +56,13 @@ Stack<T>::pop_front(size_t num) {
   if (num == 0) return 0;
   size_t popped = std::min(next, num);
   next -= popped;
+  if (circular) {
+    if (popped == 0) return 0;
+    const size_t shift = std::min(num, elements.size());
+    for (size_t i = 0; i < shift; i++) get_element(i).mark_invalid();
+    base = (base + shift) % elements.size();
+    return popped;
+  }
   for (size_t i = 0; i < next; i++) {
     elements[i].get().swap_values(&elements[i + num].get());
   }
@@ -62,6 +76,12 @@ template <typename T>
 size_t
 Stack<T>::push_front() {
   if (next < elements.size()) next++;
+  if (circular) {
+    // the last element (discarded if the stack was full) becomes the first one
+    base = (base == 0) ? elements.size() - 1 : base - 1;
+    get_element(0).mark_valid();
+    return 1u;
+  }
   for (size_t i = next - 1; i > 0; i--) {
     elements[i].get().swap_values(&elements[i - 1].get());
   }
@@ -76,10 +96,15 @@ size_t
 Stack<T>::push_front(size_t num) {
   if (num == 0) return 0;
   next = std::min(elements.size(), next + num);
+  size_t pushed = std::min(elements.size(), num);
+  if (circular) {
+    base = (base + elements.size() - pushed) % elements.size();
+    for (size_t i = 0; i < pushed; i++) get_element(i).mark_valid();
+    return pushed;
+  }
   for (size_t i = next - 1; i > num - 1; i--) {
     elements[i].get().swap_values(&elements[i - num].get());
   }
-  size_t pushed = std::min(elements.size(), num);
   for (size_t i = 0; i < pushed; i++) {
     elements[i].get().mark_valid();
   }
@@ -91,7 +116,7 @@ size_t
 Stack<T>::pop_back() {
   if (next == 0) return 0u;
   next--;
-  elements[next].get().mark_invalid();
+  get_element(next).mark_invalid();
   return 1u;
 }
 
@@ -99,7 +124,7 @@ template <typename T>
 size_t
 Stack<T>::push_back() {
   if (next == elements.size()) return 0u;
-  elements[next].get().mark_valid();
+  get_element(next).mark_valid();
   next++;
   return 1u;
 }
@@ -126,46 +151,49 @@ template <typename T>
 void
 Stack<T>::reset() {
   next = 0;
+  base = 0;
 }
 
 template <typename T>
 T &
 Stack<T>::get_last() {
   assert(next > 0 && "stack empty");
-  return elements[next - 1];
+  return get_element(next - 1);
 }
 
 template <typename T>
 const T &
 Stack<T>::get_last() const {
   assert(next > 0 && "stack empty");
-  return elements[next - 1];
+  return get_element(next - 1);
 }
 
 template <typename T>
 T &
 Stack<T>::get_next() {
   assert(next < elements.size() && "stack full");
-  return elements[next];
+  return get_element(next);
 }
 
 template <typename T>
 const T &
 Stack<T>::get_next() const {
   assert(next < elements.size() && "stack full");
-  return elements[next];
+  return get_element(next);
 }
 
 template <typename T>
 T &
 Stack<T>::at(size_t idx) {
-  return elements.at(idx);
+  if (idx >= elements.size()) throw std::out_of_range("Stack::at");
+  return get_element(idx);
 }
 
 template <typename T>
 const T &
 Stack<T>::at(size_t idx) const {
-  return elements.at(idx);
+  if (idx >= elements.size()) throw std::out_of_range("Stack::at");
+  return get_element(idx);
 }
 
 template <typename T>
@@ -20,8 +20,10 @@
 
 #include <bm/bm_sim/stateful.h>
 
+#include <algorithm>  // std::min, std::find_if, std::lower_bound
 #include <iterator>  // std::distance
 #include <string>
+#include <utility>  // std::swap
 #include <vector>
 
 namespace bm {
@@ -37,9 +39,66 @@ Register::export_bytes() {
   register_array->notify(*this);
 }
 
+constexpr size_t RegisterArray::default_num_stripes;
+
+RegisterArray::UniqueLock::UniqueLock(const RegisterArray &register_array) {
+  if (register_array.sync_mode == SyncMode::LOCK_FREE) return;
+  stripes = register_array.stripes.get();
+  // always in the same order, to avoid deadlocks between concurrent callers
+  for (; num_locked < register_array.num_stripes; num_locked++)
+    stripes[num_locked].lock();
+}
+
+RegisterArray::UniqueLock::~UniqueLock() {
+  unlock();
+}
+
+RegisterArray::UniqueLock::UniqueLock(UniqueLock &&other) noexcept
+    : stripes(other.stripes), num_locked(other.num_locked) {
+  other.num_locked = 0;
+}
+
+RegisterArray::UniqueLock &
+RegisterArray::UniqueLock::operator=(UniqueLock &&other) noexcept {
+  unlock();
+  std::swap(stripes, other.stripes);
+  std::swap(num_locked, other.num_locked);
+  return *this;
+}
+
+void
+RegisterArray::UniqueLock::unlock() {
+  for (; num_locked > 0; num_locked--)
+    stripes[num_locked - 1].unlock();
+}
+
+// Acquires the stripe protecting a given index for the duration of a per-index
+// access, unless the calling thread already holds the array.
+class RegisterArray::IndexLock {
+ public:
+  IndexLock(const RegisterArray &register_array, size_t idx) {
+    if (!RegisterSync::is_held(&register_array, idx)) {
+      m = &register_array.stripe_for(idx);
+      m->lock();
+    }
+  }
+
+  ~IndexLock() {
+    if (m) m->unlock();
+  }
+
+  IndexLock(const IndexLock &other) = delete;
+  IndexLock &operator=(const IndexLock &other) = delete;
+
+ private:
+  std::mutex *m{nullptr};
+};
+
 RegisterArray::RegisterArray(const std::string &name, p4object_id_t id,
                              size_t size, int bitwidth)
-    : NamedP4Object(name, id), bitwidth(bitwidth) {
+    : NamedP4Object(name, id), bitwidth(bitwidth),
+      value_mask((bitwidth >= 64) ? ~0ull : ((1ull << bitwidth) - 1)),
+      stripes(new std::mutex[1]) {
   registers.reserve(size);
   for (size_t i = 0; i < size; i++)
     registers.emplace_back(bitwidth, this);
@@ -47,6 +106,10 @@ RegisterArray::RegisterArray(const std::string &name, p4object_id_t id,
 
 void
 RegisterArray::reset_state() {
+  if (sync_mode == SyncMode::LOCK_FREE) {
+    for (size_t i = 0; i < size(); i++) atomic_values[i].store(0);
+    return;
+  }
   // we build a new vector of registers, then swap, to avoid holding the lock
   // for too long
   std::vector<Register> registers_new;
@@ -56,10 +119,152 @@ RegisterArray::reset_state() {
   registers_new.reserve(s);
   for (size_t i = 0; i < s; i++)
     registers_new.emplace_back(bitwidth, this);
-  auto lock = UniqueLock();
+  auto lock = unique_lock();
   registers.swap(registers_new);
 }
 
+bool
+RegisterArray::set_sync_mode(SyncMode mode, size_t num_stripes) {
+  if (mode == SyncMode::LOCK_FREE && bitwidth > 64) return false;
+  if (mode == sync_mode && mode != SyncMode::STRIPED) return true;
+
+  const size_t s = size();
+  if (sync_mode == SyncMode::LOCK_FREE) {
+    for (size_t i = 0; i < s; i++)
+      registers[i].set(atomic_values[i].load());
+    atomic_values.reset();
+  }
+
+  size_t new_num_stripes = 1;
+  if (mode == SyncMode::STRIPED) {
+    num_stripes = std::min(std::max(num_stripes, size_t(1)), s);
+    while (new_num_stripes < num_stripes) new_num_stripes <<= 1;
+  }
+  if (new_num_stripes != this->num_stripes) {
+    stripes.reset(new std::mutex[new_num_stripes]);
+    this->num_stripes = new_num_stripes;
+    stripe_mask = new_num_stripes - 1;
+  }
+
+  if (mode == SyncMode::LOCK_FREE) {
+    atomic_values.reset(new std::atomic<uint64_t>[s]);
+    for (size_t i = 0; i < s; i++)
+      atomic_values[i].store(registers[i].get<uint64_t>());
+  }
+
+  sync_mode = mode;
+  return true;
+}
+
+void
+RegisterArray::read(size_t idx, Data *dst) const {
+  assert(idx < size());
+  if (sync_mode == SyncMode::LOCK_FREE) {
+    dst->set(atomic_values[idx].load(std::memory_order_relaxed));
+    return;
+  }
+  IndexLock lock(*this, idx);
+  dst->set(registers[idx]);
+}
+
+void
+RegisterArray::write(size_t idx, const Data &src) {
+  assert(idx < size());
+  if (sync_mode == SyncMode::LOCK_FREE) {
+    atomic_values[idx].store(src.get<uint64_t>() & value_mask,
+                             std::memory_order_relaxed);
+    notify(idx);
+    return;
+  }
+  IndexLock lock(*this, idx);
+  registers[idx].set(src);
+}
+
+uint64_t
+RegisterArray::load(size_t idx) const {
+  assert(idx < size() && bitwidth <= 64);
+  if (sync_mode == SyncMode::LOCK_FREE)
+    return atomic_values[idx].load(std::memory_order_relaxed);
+  IndexLock lock(*this, idx);
+  return registers[idx].get<uint64_t>();
+}
+
+void
+RegisterArray::store(size_t idx, uint64_t v) {
+  assert(idx < size() && bitwidth <= 64);
+  if (sync_mode == SyncMode::LOCK_FREE) {
+    atomic_values[idx].store(v & value_mask, std::memory_order_relaxed);
+    notify(idx);
+    return;
+  }
+  IndexLock lock(*this, idx);
+  registers[idx].set(v);
+}
+
+uint64_t
+RegisterArray::fetch_add(size_t idx, uint64_t v) {
+  assert(idx < size() && bitwidth <= 64);
+  if (sync_mode == SyncMode::LOCK_FREE) {
+    auto &value = atomic_values[idx];
+    uint64_t prev;
+    if (bitwidth == 64) {
+      prev = value.fetch_add(v, std::memory_order_relaxed);
+    } else {
+      // values are always kept truncated, so that compare_exchange works
+      prev = value.load(std::memory_order_relaxed);
+      while (!value.compare_exchange_weak(prev, (prev + v) & value_mask,
+                                          std::memory_order_relaxed)) { }
+    }
+    notify(idx);
+    return prev;
+  }
+  IndexLock lock(*this, idx);
+  auto &reg = registers[idx];
+  auto prev = reg.get<uint64_t>();
+  reg.set(prev + v);  // truncated by Register::export_bytes
+  return prev;
+}
+
+uint64_t
+RegisterArray::fetch_or(size_t idx, uint64_t v) {
+  assert(idx < size() && bitwidth <= 64);
+  if (sync_mode == SyncMode::LOCK_FREE) {
+    auto prev = atomic_values[idx].fetch_or(v & value_mask,
+                                            std::memory_order_relaxed);
+    notify(idx);
+    return prev;
+  }
+  IndexLock lock(*this, idx);
+  auto &reg = registers[idx];
+  auto prev = reg.get<uint64_t>();
+  reg.set(prev | v);
+  return prev;
+}
+
+bool
+RegisterArray::compare_exchange(size_t idx, uint64_t *expected,
+                                uint64_t desired) {
+  assert(idx < size() && bitwidth <= 64);
+  desired &= value_mask;
+  if (sync_mode == SyncMode::LOCK_FREE) {
+    if (!atomic_values[idx].compare_exchange_strong(
+            *expected, desired, std::memory_order_relaxed)) {
+      return false;
+    }
+    notify(idx);
+    return true;
+  }
+  IndexLock lock(*this, idx);
+  auto &reg = registers[idx];
+  auto current = reg.get<uint64_t>();
+  if (current != *expected) {
+    *expected = current;
+    return false;
+  }
+  reg.set(desired);
+  return true;
+}
+
 void
 RegisterArray::register_notifier(Notifier notifier) {
   notifiers.push_back(std::move(notifier));
@@ -67,20 +272,120 @@ RegisterArray::register_notifier(Notifier notifier) {
 
 void
 RegisterArray::notify(const Register &reg) const {
+  notify(std::distance(&registers[0], &reg));
+}
+
+void
+RegisterArray::notify(size_t idx) const {
   for (const auto &notifier : notifiers)
-    notifier(std::distance(&registers[0], &reg));
+    notifier(idx);
+}
+
+thread_local const RegisterSync::RegisterLocks *RegisterSync::held = nullptr;
+
+RegisterSync::RegisterLocks::~RegisterLocks() {
+  // the locks in v are released after this, which is fine since the stack is
+  // per-thread
+  if (sync) held = prev;
+}
+
+void
+RegisterSync::add(const RegisterArray *register_array, Access access,
+                  size_t idx) {
+  auto it = std::find_if(accesses.begin(), accesses.end(),
+                         [register_array](const ArrayAccess &a) {
+                           return a.register_array == register_array; });
+  if (it == accesses.end()) {
+    accesses.push_back({register_array, access, {}});
+    if (access == Access::INDICES) accesses.back().indices.push_back(idx);
+    return;
+  }
+  auto &a = *it;
+  if (a.access == Access::WHOLE) return;
+  if (access != a.access) {
+    // the array is held by the action and accessed through the per-index
+    // methods, so all of it has to be acquired
+    a.access = Access::WHOLE;
+    a.indices.clear();
+  } else if (access == Access::INDICES) {
+    auto pos = std::lower_bound(a.indices.begin(), a.indices.end(), idx);
+    if (pos == a.indices.end() || *pos != idx) a.indices.insert(pos, idx);
+  }
 }
 
 void
 RegisterSync::add_register_array(const RegisterArray *register_array) {
-  if (register_arrays.insert(register_array).second)
-    mutexes.push_back(&register_array->m_mutex);
+  add(register_array, Access::WHOLE, 0);
+}
+
+void
+RegisterSync::add_register_index(const RegisterArray *register_array,
+                                 size_t idx) {
+  add(register_array, Access::INDICES, idx);
+}
+
+void
+RegisterSync::add_register_array_unlocked(
+    const RegisterArray *register_array) {
+  add(register_array, Access::UNLOCKED, 0);
 }
 
 void
 RegisterSync::merge_from(const RegisterSync &other) {
-  for (auto register_array : other.register_arrays)
-    add_register_array(register_array);  // takes care of duplicates
+  // add takes care of duplicates
+  for (const auto &a : other.accesses) {
+    if (a.access == Access::INDICES) {
+      for (auto idx : a.indices) add(a.register_array, a.access, idx);
+    } else {
+      add(a.register_array, a.access, 0);
+    }
+  }
+}
+
+void
+RegisterSync::lock(RegisterLocks *RL) const {
+  if (accesses.empty()) return;
+  for (const auto &a : accesses) {
+    using SyncMode = RegisterArray::SyncMode;
+    const auto *register_array = a.register_array;
+    if (register_array->sync_mode == SyncMode::LOCK_FREE) continue;
+    if (a.access == Access::UNLOCKED) continue;
+    if (a.access == Access::WHOLE || register_array->num_stripes == 1) {
+      for (size_t i = 0; i < register_array->num_stripes; i++)
+        RL->v.emplace_back(register_array->stripes[i], std::defer_lock);
+      continue;
+    }
+    // several indices can map to the same stripe
+    const size_t first = RL->v.size();
+    for (auto idx : a.indices) {
+      auto *m = &register_array->stripe_for(idx);
+      auto held_it = std::find_if(
+          RL->v.begin() + first, RL->v.end(),
+          [m](const Lock &lock) { return lock.mutex() == m; });
+      if (held_it == RL->v.end()) RL->v.emplace_back(*m, std::defer_lock);
+    }
+  }
+  if (RL->v.empty()) return;
+  boost::lock(RL->v.begin(), RL->v.end());
+  RL->sync = this;
+  RL->prev = held;
+  held = RL;
+}
+
+bool
+RegisterSync::is_held(const RegisterArray *register_array, size_t idx) {
+  for (auto RL = held; RL != nullptr; RL = RL->prev) {
+    for (const auto &a : RL->sync->accesses) {
+      if (a.register_array != register_array) continue;
+      if (a.access == Access::WHOLE) return true;
+      if (a.access == Access::UNLOCKED) break;
+      const auto mask = register_array->stripe_mask;
+      for (auto i : a.indices)
+        if ((i & mask) == (idx & mask)) return true;
+      break;
+    }
+  }
+  return false;
 }
 
 }  // namespace bm
@@ -26,14 +26,18 @@
 #include <bm/bm_sim/debugger.h>
 #include <bm/bm_sim/event_logger.h>
 #include <bm/bm_sim/packet.h>
+#include <bm/bm_sim/pcap_file.h>
 
 #include <cassert>
 #include <fstream>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 #include <iostream>
 #include <streambuf>
 
+#include "jsoncpp/json.h"
 #include "md5.h"
 
 namespace bm {
@@ -45,6 +49,16 @@ packet_handler(int port_num, const char *buffer, int len, void *cookie) {
   static_cast<SwitchWContexts *>(cookie)->receive(port_num, buffer, len);
 }
 
+static PcapReplayConfig
+get_pcap_replay_config(const OptionsParser &parser) {
+  PcapReplayConfig config;
+  // already validated by the options parser
+  config.parsePacing(parser.pcap_replay_pacing);
+  config.burst_size = parser.pcap_replay_burst;
+  config.loops = parser.pcap_replay_loops;
+  return config;
+}
+
 // TODO(antonin): maybe a factory method would be more appropriate for Switch
 SwitchWContexts::SwitchWContexts(size_t nb_cxts, bool enable_swap)
   : DevMgr(),
@@ -109,6 +123,12 @@ SwitchWContexts::disable_config_swap() {
   enable_swap = false;
 }
 
+void
+SwitchWContexts::enable_resilient_group_selection(size_t nb_buckets) {
+  for (Context &c : contexts)
+    c.set_resilient_group_selection(nb_buckets);
+}
+
 void
 SwitchWContexts::add_required_field(const std::string &header_name,
                                   const std::string &field_name) {
@@ -227,6 +247,9 @@ SwitchWContexts::init_from_options_parser(
 
   event_logger_addr = parser.event_logger_addr;
 
+  if (parser.log_async)
+    Logger::enable_async();
+
   if (parser.console_logging)
     Logger::set_logger_console();
 
@@ -235,6 +258,10 @@ SwitchWContexts::init_from_options_parser(
 
   Logger::set_log_level(parser.log_level);
 
+  for (const auto &p : parser.cpu_affinity)
+    thread_placement.set_cores(p.first, p.second);
+  thread_placement.log_config();
+
   if (parser.no_p4)
     status = init_objects_empty(parser.device_id, transport);
   else
@@ -243,14 +270,25 @@ SwitchWContexts::init_from_options_parser(
 
   if (my_dev_mgr != nullptr)
     set_dev_mgr(std::move(my_dev_mgr));
+  else if (parser.pcap_replay)
+    set_dev_mgr_pcap_replay(get_pcap_replay_config(parser), parser.wait_time);
   else if (parser.use_files)
     set_dev_mgr_files(parser.wait_time);
 #ifdef BMNANOMSG_ON
   else if (parser.packet_in)
     set_dev_mgr_packet_in(device_id, parser.packet_in_addr, transport);
+#endif
+  else if (parser.packet_in_shm)
+    status = (set_dev_mgr_shm(device_id, parser.packet_in_shm_name,
+                              transport) == ReturnCode::SUCCESS) ? 0 : 1;
+#ifdef BMAFPACKET_ON
+  else if (parser.af_packet)
+    set_dev_mgr_af_packet(device_id, transport, parser.af_packet_queues);
 #endif
   else
     set_dev_mgr_bmi(device_id, transport);
+  // the shared memory segment could not be created
+  if (status != 0) return status;
 
   for (const auto &iface : parser.ifaces) {
     std::cout << "Adding interface " << iface.second
@@ -320,6 +358,13 @@ SwitchWContexts::load_new_config(const std::string &new_config) {
   return ErrorCode::SUCCESS;
 }
 
+RuntimeInterface::ErrorCode
+SwitchWContexts::load_new_objects(size_t cxt_id,
+                                  std::shared_ptr<P4Objects> p4objects) {
+  if (!enable_swap) return ErrorCode::CONFIG_SWAP_DISABLED;
+  return contexts.at(cxt_id).load_new_objects(std::move(p4objects));
+}
+
 RuntimeInterface::ErrorCode
 SwitchWContexts::swap_configs() {
   if (!enable_swap) return ErrorCode::CONFIG_SWAP_DISABLED;
@@ -367,6 +412,31 @@ SwitchWContexts::serialize(std::ostream *out) {
   return ErrorCode::SUCCESS;
 }
 
+std::string
+SwitchWContexts::get_telemetry() {
+  Json::Value root(Json::objectValue);
+  Json::Value &contexts_json = root["contexts"];
+  contexts_json = Json::Value(Json::arrayValue);
+  for (auto &cxt : contexts) {
+    Json::Value cxt_json(Json::objectValue);
+    cxt.dump_telemetry(&cxt_json);
+    contexts_json.append(cxt_json);
+  }
+  telemetry_registry.dump_json(&root);
+  Json::StyledWriter writer;
+  return writer.write(root);
+}
+
+RuntimeInterface::ErrorCode
+SwitchWContexts::reset_telemetry() {
+  for (auto &cxt : contexts) {
+    ErrorCode rc = cxt.reset_telemetry();
+    if (rc != ErrorCode::SUCCESS) return rc;
+  }
+  telemetry_registry.reset();
+  return ErrorCode::SUCCESS;
+}
+
 // we assume that this is not a "runtime" function, but is called when the
 // switch is starting. Thus no lock...
 int
@@ -0,0 +1,372 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <bm/bm_sim/telemetry.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#include "jsoncpp/json.h"
+
+namespace bm {
+
+constexpr size_t Telemetry::max_slots;
+constexpr int TelemetryHistogram::sub_bucket_bits;
+constexpr int TelemetryHistogram::max_value_bits;
+constexpr size_t TelemetryHistogram::nb_buckets;
+
+std::atomic<bool> Telemetry::enabled{true};
+
+size_t
+Telemetry::thread_slot() {
+  static std::atomic<size_t> next_slot{0};
+  static thread_local size_t slot =
+      next_slot.fetch_add(1, std::memory_order_relaxed) % max_slots;
+  return slot;
+}
+
+uint64_t
+TelemetryCounter::get() const {
+  uint64_t sum = 0;
+  for (const auto &slot : slots) sum += slot.v.load(std::memory_order_relaxed);
+  return sum;
+}
+
+void
+TelemetryCounter::reset() {
+  for (auto &slot : slots) slot.v.store(0, std::memory_order_relaxed);
+}
+
+namespace {
+
+constexpr uint64_t sub_bucket_count =
+    1ull << TelemetryHistogram::sub_bucket_bits;
+constexpr uint64_t max_recorded_value =
+    (1ull << TelemetryHistogram::max_value_bits) - 1;
+
+int msb(uint64_t v) {
+  return 63 - __builtin_clzll(v);
+}
+
+}  // namespace
+
+// values below sub_bucket_count get their own bucket; above, each power of 2
+// interval [2^k, 2^(k+1)) is split into sub_bucket_count buckets of equal width
+size_t
+TelemetryHistogram::bucket_index(uint64_t v) {
+  if (v < sub_bucket_count) return v;
+  if (v > max_recorded_value) v = max_recorded_value;
+  const int shift = msb(v) - sub_bucket_bits;
+  return ((shift + 1) << sub_bucket_bits) +
+      ((v >> shift) - sub_bucket_count);
+}
+
+uint64_t
+TelemetryHistogram::bucket_lowest(size_t idx) {
+  if (idx < sub_bucket_count) return idx;
+  const int shift = (idx >> sub_bucket_bits) - 1;
+  const uint64_t mantissa = (idx & (sub_bucket_count - 1)) + sub_bucket_count;
+  return mantissa << shift;
+}
+
+uint64_t
+TelemetryHistogram::bucket_highest(size_t idx) {
+  if (idx < sub_bucket_count) return idx;
+  const int shift = (idx >> sub_bucket_bits) - 1;
+  return bucket_lowest(idx) + (1ull << shift) - 1;
+}
+
+TelemetryHistogram::TelemetryHistogram() = default;
+
+TelemetryHistogram::~TelemetryHistogram() {
+  for (auto &s : slots) delete s.load(std::memory_order_relaxed);
+}
+
+TelemetryHistogram::Slot *
+TelemetryHistogram::allocate_slot(std::atomic<Slot *> *s) {
+  Slot *slot = new Slot();
+  Slot *expected = nullptr;
+  if (s->compare_exchange_strong(expected, slot, std::memory_order_acq_rel)) {
+    return slot;
+  }
+  // another thread sharing the same slot index was faster
+  delete slot;
+  return expected;
+}
+
+TelemetryHistogram::Snapshot
+TelemetryHistogram::get_snapshot() const {
+  Snapshot snapshot;
+  snapshot.buckets.resize(nb_buckets, 0);
+  for (const auto &s : slots) {
+    const Slot *slot = s.load(std::memory_order_acquire);
+    if (!slot) continue;
+    for (size_t i = 0; i < nb_buckets; i++) {
+      uint64_t c = slot->buckets[i].load(std::memory_order_relaxed);
+      snapshot.buckets[i] += c;
+      // the count is computed from the buckets to be consistent with them,
+      // even if a value is being recorded concurrently
+      snapshot.count += c;
+    }
+    snapshot.sum += slot->sum.load(std::memory_order_relaxed);
+  }
+  return snapshot;
+}
+
+void
+TelemetryHistogram::reset() {
+  for (auto &s : slots) {
+    Slot *slot = s.load(std::memory_order_acquire);
+    if (!slot) continue;
+    for (auto &b : slot->buckets) b.store(0, std::memory_order_relaxed);
+    slot->count.store(0, std::memory_order_relaxed);
+    slot->sum.store(0, std::memory_order_relaxed);
+  }
+}
+
+uint64_t
+TelemetryHistogram::Snapshot::min() const {
+  for (size_t i = 0; i < buckets.size(); i++)
+    if (buckets[i] > 0) return bucket_lowest(i);
+  return 0;
+}
+
+uint64_t
+TelemetryHistogram::Snapshot::max() const {
+  for (size_t i = buckets.size(); i > 0; i--)
+    if (buckets[i - 1] > 0) return bucket_highest(i - 1);
+  return 0;
+}
+
+double
+TelemetryHistogram::Snapshot::mean() const {
+  return (count == 0) ? 0. : static_cast<double>(sum) / count;
+}
+
+uint64_t
+TelemetryHistogram::Snapshot::percentile(double p) const {
+  if (count == 0) return 0;
+  p = std::min(std::max(p, 0.), 100.);
+  uint64_t rank = static_cast<uint64_t>(std::ceil(p / 100. * count));
+  rank = std::max(rank, static_cast<uint64_t>(1));
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < buckets.size(); i++) {
+    cumulative += buckets[i];
+    if (cumulative >= rank) return bucket_highest(i);
+  }
+  return max();
+}
+
+void
+TelemetryHistogram::Snapshot::dump_json(Json::Value *out) const {
+  (*out)["count"] = Json::Value(Json::UInt64(count));
+  (*out)["mean"] = Json::Value(mean());
+  (*out)["min"] = Json::Value(Json::UInt64(min()));
+  (*out)["max"] = Json::Value(Json::UInt64(max()));
+  (*out)["p50"] = Json::Value(Json::UInt64(percentile(50.)));
+  (*out)["p90"] = Json::Value(Json::UInt64(percentile(90.)));
+  (*out)["p99"] = Json::Value(Json::UInt64(percentile(99.)));
+  (*out)["p999"] = Json::Value(Json::UInt64(percentile(99.9)));
+}
+
+void
+TableTelemetry::dump_json(Json::Value *out) const {
+  (*out)["hits"] = Json::Value(Json::UInt64(hits.get()));
+  (*out)["misses"] = Json::Value(Json::UInt64(misses.get()));
+  lookup_ns.get_snapshot().dump_json(&(*out)["lookup_ns"]);
+}
+
+void
+TableTelemetry::reset() {
+  hits.reset();
+  misses.reset();
+  lookup_ns.reset();
+}
+
+void
+QueueTelemetry::dump_json(Json::Value *out) const {
+  (*out)["enqueued"] = Json::Value(Json::UInt64(enqueued.get()));
+  (*out)["dropped"] = Json::Value(Json::UInt64(dropped.get()));
+  depth.get_snapshot().dump_json(&(*out)["depth"]);
+  sojourn_ns.get_snapshot().dump_json(&(*out)["sojourn_ns"]);
+}
+
+void
+QueueTelemetry::reset() {
+  enqueued.reset();
+  dropped.reset();
+  depth.reset();
+  sojourn_ns.reset();
+}
+
+void
+FlowCacheTelemetry::dump_json(Json::Value *out) const {
+  const uint64_t nb_hits = hits.get();
+  const uint64_t nb_lookups = nb_hits + misses.get();
+  (*out)["hits"] = Json::Value(Json::UInt64(nb_hits));
+  (*out)["misses"] = Json::Value(Json::UInt64(nb_lookups - nb_hits));
+  (*out)["hit_rate"] = Json::Value(
+      (nb_lookups == 0) ? 0. : static_cast<double>(nb_hits) / nb_lookups);
+  (*out)["uncacheable"] = Json::Value(Json::UInt64(uncacheable.get()));
+  (*out)["entries"] = Json::Value(
+      Json::UInt64(entries.load(std::memory_order_relaxed)));
+  (*out)["flushes"] = Json::Value(Json::UInt64(flushes.get()));
+  (*out)["flushed_entries"] = Json::Value(Json::UInt64(flushed_entries.get()));
+  flush_ns.get_snapshot().dump_json(&(*out)["flush_ns"]);
+  miss_ns.get_snapshot().dump_json(&(*out)["miss_ns"]);
+}
+
+void
+FlowCacheTelemetry::reset() {
+  hits.reset();
+  misses.reset();
+  uncacheable.reset();
+  flushes.reset();
+  flushed_entries.reset();
+  flush_ns.reset();
+  miss_ns.reset();
+}
+
+ThreadActivity::ThreadActivity(const std::string &name)
+    : name(name), start_ns(Telemetry::now_ns()) { }
+
+void
+ThreadActivity::idle_begin() {
+  if (!Telemetry::is_enabled()) return;
+  idle_since_ns.store(Telemetry::now_ns(), std::memory_order_relaxed);
+}
+
+void
+ThreadActivity::idle_end() {
+  uint64_t since = idle_since_ns.load(std::memory_order_relaxed);
+  if (since == 0) return;
+  // only account for the part of the idle period after the last reset
+  since = std::max(since, start_ns.load(std::memory_order_relaxed));
+  uint64_t now = Telemetry::now_ns();
+  if (now > since) idle_ns.fetch_add(now - since, std::memory_order_relaxed);
+  idle_since_ns.store(0, std::memory_order_relaxed);
+}
+
+uint64_t
+ThreadActivity::get_idle_ns(uint64_t now) const {
+  uint64_t idle = idle_ns.load(std::memory_order_relaxed);
+  uint64_t since = idle_since_ns.load(std::memory_order_relaxed);
+  if (since != 0) {
+    // the thread is currently idle
+    since = std::max(since, start_ns.load(std::memory_order_relaxed));
+    if (now > since) idle += now - since;
+  }
+  return idle;
+}
+
+uint64_t
+ThreadActivity::get_idle_ns() const {
+  return get_idle_ns(Telemetry::now_ns());
+}
+
+uint64_t
+ThreadActivity::get_busy_ns() const {
+  uint64_t now = Telemetry::now_ns();
+  uint64_t elapsed = now - start_ns.load(std::memory_order_relaxed);
+  uint64_t idle = get_idle_ns(now);
+  return (elapsed > idle) ? (elapsed - idle) : 0;
+}
+
+void
+ThreadActivity::dump_json(Json::Value *out) const {
+  uint64_t now = Telemetry::now_ns();
+  uint64_t elapsed = now - start_ns.load(std::memory_order_relaxed);
+  uint64_t idle = std::min(get_idle_ns(now), elapsed);
+  uint64_t busy = elapsed - idle;
+  (*out)["name"] = Json::Value(name);
+  (*out)["busy_ns"] = Json::Value(Json::UInt64(busy));
+  (*out)["idle_ns"] = Json::Value(Json::UInt64(idle));
+  (*out)["busy_ratio"] = Json::Value(
+      (elapsed == 0) ? 0. : static_cast<double>(busy) / elapsed);
+}
+
+void
+ThreadActivity::reset() {
+  idle_ns.store(0, std::memory_order_relaxed);
+  start_ns.store(Telemetry::now_ns(), std::memory_order_relaxed);
+}
+
+ThreadActivity *
+TelemetryRegistry::register_thread(const std::string &name) {
+  std::lock_guard<std::mutex> lock(mutex);
+  threads.emplace_back(new ThreadActivity(name));
+  return threads.back().get();
+}
+
+void
+TelemetryRegistry::register_queue(const std::string &name,
+                                  QueueTelemetry *queue) {
+  std::lock_guard<std::mutex> lock(mutex);
+  queues.emplace_back(name, queue);
+}
+
+void
+TelemetryRegistry::register_flow_cache(const std::string &name,
+                                       FlowCacheTelemetry *flow_cache) {
+  std::lock_guard<std::mutex> lock(mutex);
+  flow_caches.emplace_back(name, flow_cache);
+}
+
+void
+TelemetryRegistry::dump_json(Json::Value *out) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  Json::Value &threads_json = (*out)["threads"];
+  threads_json = Json::Value(Json::arrayValue);
+  for (const auto &thread : threads) {
+    Json::Value thread_json;
+    thread->dump_json(&thread_json);
+    threads_json.append(thread_json);
+  }
+  Json::Value &queues_json = (*out)["queues"];
+  queues_json = Json::Value(Json::arrayValue);
+  for (const auto &p : queues) {
+    if (p.second->enqueued.get() == 0 && p.second->dropped.get() == 0)
+      continue;
+    Json::Value queue_json;
+    queue_json["name"] = Json::Value(p.first);
+    p.second->dump_json(&queue_json);
+    queues_json.append(queue_json);
+  }
+  Json::Value &flow_caches_json = (*out)["flow_caches"];
+  flow_caches_json = Json::Value(Json::arrayValue);
+  for (const auto &p : flow_caches) {
+    if (p.second->hits.get() == 0 && p.second->misses.get() == 0) continue;
+    Json::Value flow_cache_json;
+    flow_cache_json["name"] = Json::Value(p.first);
+    p.second->dump_json(&flow_cache_json);
+    flow_caches_json.append(flow_cache_json);
+  }
+}
+
+void
+TelemetryRegistry::reset() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto &thread : threads) thread->reset();
+  for (auto &p : queues) p.second->reset();
+  for (auto &p : flow_caches) p.second->reset();
+}
+
+}  // namespace bm
@@ -0,0 +1,224 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <bm/bm_sim/thread_placement.h>
+#include <bm/bm_sim/logger.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bm {
+
+namespace {
+
+// parses a non-negative decimal integer, rejecting anything else (including
+// signs, whitespace and values which do not fit in an int)
+bool parse_int(const char *str, int *v) {
+  if (*str < '0' || *str > '9') return false;
+  char *end = nullptr;
+  errno = 0;
+  long res = std::strtol(str, &end, 10);  // NOLINT(runtime/int)
+  if (errno == ERANGE || *end != '\0' || res > INT_MAX) return false;
+  *v = static_cast<int>(res);
+  return true;
+}
+
+bool parse_int(const std::string &str, int *v) {
+  return parse_int(str.c_str(), v);
+}
+
+// larger than any core id we expect to see, but small enough to keep a range
+// like "0-2000000000" from taking forever to expand
+constexpr int max_core_id = 65535;
+
+std::string core_list_str(const std::vector<int> &cores) {
+  std::ostringstream ss;
+  for (size_t i = 0; i < cores.size(); i++) {
+    if (i > 0) ss << ",";
+    ss << cores[i];
+  }
+  return ss.str();
+}
+
+#ifdef __linux__
+
+// the number of entries in the directory which are named <prefix><number>,
+// or -1 if the directory cannot be opened
+int count_numbered_entries(const std::string &dir_path, const char *prefix,
+                           int *first = nullptr) {
+  DIR *dir = opendir(dir_path.c_str());
+  if (!dir) return -1;
+  int count = 0;
+  const size_t prefix_len = std::strlen(prefix);
+  while (struct dirent *entry = readdir(dir)) {
+    int v;
+    if (std::strncmp(entry->d_name, prefix, prefix_len) != 0) continue;
+    if (!parse_int(entry->d_name + prefix_len, &v)) continue;
+    if (count++ == 0 && first) *first = v;
+  }
+  closedir(dir);
+  return count;
+}
+
+int nb_numa_nodes() {
+  static const int nb = count_numbered_entries("/sys/devices/system/node",
+                                               "node");
+  return nb;
+}
+
+// from linux/mempolicy.h, which is not always available
+constexpr int mpol_preferred = 1;
+
+bool prefer_numa_node(int node) {
+#ifdef SYS_set_mempolicy
+  using nodemask_t = unsigned long;  // NOLINT(runtime/int)
+  if (node < 0 || node >= static_cast<int>(sizeof(nodemask_t) * 8))
+    return false;
+  nodemask_t mask = static_cast<nodemask_t>(1) << node;
+  // the kernel expects maxnode to be one more than the number of bits
+  return syscall(SYS_set_mempolicy, mpol_preferred, &mask,
+                 sizeof(mask) * 8 + 1) == 0;
+#else
+  (void) node;
+  return false;
+#endif
+}
+
+#endif  // __linux__
+
+}  // namespace
+
+bool
+ThreadPlacement::parse_core_list(const std::string &str,
+                                 std::vector<int> *cores) {
+  std::vector<int> result;
+  std::set<int> seen;
+  std::istringstream ss(str);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    int first, last;
+    auto dash = range.find('-');
+    if (dash == std::string::npos) {
+      if (!parse_int(range, &first)) return false;
+      last = first;
+    } else if (!parse_int(range.substr(0, dash), &first) ||
+               !parse_int(range.substr(dash + 1), &last) || last < first) {
+      return false;
+    }
+    if (last > max_core_id) return false;
+    for (int core = first; core <= last; core++)
+      if (seen.insert(core).second) result.push_back(core);
+  }
+  if (result.empty()) return false;
+  *cores = std::move(result);
+  return true;
+}
+
+int
+ThreadPlacement::get_numa_node(int core) {
+#ifdef __linux__
+  int node = -1;
+  if (count_numbered_entries(
+          "/sys/devices/system/cpu/cpu" + std::to_string(core), "node",
+          &node) > 0) {
+    return node;
+  }
+#else
+  (void) core;
+#endif
+  return -1;
+}
+
+void
+ThreadPlacement::set_cores(const std::string &thread_class,
+                           std::vector<int> cores) {
+  cores_by_class[thread_class] = std::move(cores);
+}
+
+bool
+ThreadPlacement::has_cores(const std::string &thread_class) const {
+  return cores_by_class.find(thread_class) != cores_by_class.end();
+}
+
+int
+ThreadPlacement::place_current_thread(const std::string &thread_class,
+                                      size_t index) const {
+  auto it = cores_by_class.find(thread_class);
+  if (it == cores_by_class.end()) {
+    Logger::get()->debug("Thread '{}' #{} is not pinned", thread_class, index);
+    return -1;
+  }
+  const int core = it->second.at(index % it->second.size());
+#ifdef __linux__
+  if (core >= CPU_SETSIZE) {
+    Logger::get()->error("Cannot pin thread '{}' #{} to core {}: invalid core",
+                         thread_class, index, core);
+    return -1;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(core, &set);
+  int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (rc != 0) {
+    Logger::get()->error("Cannot pin thread '{}' #{} to core {}: {}",
+                         thread_class, index, core, std::strerror(rc));
+    return -1;
+  }
+  const int node = get_numa_node(core);
+  bool local_alloc = (nb_numa_nodes() > 1) && prefer_numa_node(node);
+  Logger::get()->info("Thread '{}' #{} pinned to core {} (NUMA node {}{})",
+                      thread_class, index, core, node,
+                      local_alloc ? ", local memory allocation" : "");
+  return core;
+#else
+  Logger::get()->warn("Cannot pin thread '{}' #{} to core {}: not supported "
+                      "on this platform", thread_class, index, core);
+  return -1;
+#endif
+}
+
+void
+ThreadPlacement::log_config() const {
+  for (const auto &p : cores_by_class) {
+    std::set<int> nodes;
+    for (int core : p.second) nodes.insert(get_numa_node(core));
+    std::vector<int> nodes_v(nodes.begin(), nodes.end());
+    Logger::get()->info("'{}' threads will be pinned to cores {} (NUMA nodes "
+                        "{})", p.first, core_list_str(p.second),
+                        core_list_str(nodes_v));
+  }
+}
+
+}  // namespace bm
@@ -0,0 +1,67 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#ifndef BM_SIM_TX_BATCHER_H_
+#define BM_SIM_TX_BATCHER_H_
+
+#include <chrono>
+
+namespace bm {
+
+// Decides when the kernel needs to be notified of the packets queued for
+// transmission (e.g. in an AF_PACKET TX ring): once batch_size packets are
+// pending, or once the oldest pending packet has waited for max_delay, so that
+// packets do not sit in the ring when the traffic is low. The caller is in
+// charge of the synchronization and of calling expired() periodically.
+class TxBatcher {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  TxBatcher(unsigned int batch_size, clock::duration max_delay)
+      : batch_size(batch_size ? batch_size : 1), max_delay(max_delay) { }
+
+  // to be called for every packet queued, returns true if the pending packets
+  // need to be flushed right away
+  bool add(clock::time_point now) {
+    if (pending++ == 0) oldest = now;
+    return pending >= batch_size;
+  }
+
+  // returns true if some packets are pending and the oldest one has waited for
+  // at least max_delay
+  bool expired(clock::time_point now) const {
+    return pending > 0 && (now - oldest) >= max_delay;
+  }
+
+  // to be called once the pending packets have been flushed
+  void flushed() { pending = 0; }
+
+  unsigned int get_pending() const { return pending; }
+
+ private:
+  unsigned int batch_size;
+  clock::duration max_delay;
+  unsigned int pending{0};
+  clock::time_point oldest{};
+};
+
+}  // namespace bm
+
+#endif  // BM_SIM_TX_BATCHER_H_
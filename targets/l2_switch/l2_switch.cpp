@@ -26,17 +26,22 @@
 #include <bm/bm_sim/event_logger.h>
 #include <bm/bm_sim/logger.h>
 #include <bm/bm_sim/simple_pre.h>
+#include <bm/bm_sim/dp_learning.h>
+#include <bm/bm_sim/target_parser.h>
 
 #include <bm/bm_runtime/bm_runtime.h>
 
 #include <unistd.h>
 
+#include <atomic>
 #include <iostream>
 #include <memory>
 #include <thread>
 #include <fstream>
 #include <string>
 #include <chrono>
+#include <tuple>
+#include <vector>
 
 using bm::Switch;
 using bm::Queue;
@@ -63,7 +68,8 @@ class SimpleSwitch : public Switch {
   }
 
   int receive_(int port_num, const char *buffer, int len) override {
-    static int pkt_id = 0;
+    // may be called concurrently by the receive threads, see DevMgr
+    static std::atomic<int> pkt_id(0);
 
     auto packet = new_packet_ptr(port_num, pkt_id++, len,
                                  bm::PacketBuffer(2048, buffer, len));
@@ -74,6 +80,15 @@ class SimpleSwitch : public Switch {
     return 0;
   }
 
+  // Learns MAC addresses in the data plane: the smac and dmac entries for an
+  // unknown source are added by the switch itself, without waiting for the
+  // controller, which is still notified through the learn engine. If ttl_ms is
+  // not 0, ageing is enabled for smac and dmac and the learned entries are
+  // removed by the switch once they expire. The smac and dmac entries for an
+  // address are removed together, so that it is learned again by the next
+  // packet it sends. Must be called after the switch has been initialized.
+  void enable_dp_learning(unsigned int max_rate, unsigned int ttl_ms);
+
   void start_and_return_() override {
     std::thread t1(&SimpleSwitch::pipeline_thread, this);
     t1.detach();
@@ -89,8 +104,42 @@ class SimpleSwitch : public Switch {
   Queue<std::unique_ptr<Packet> > input_buffer;
   Queue<std::unique_ptr<Packet> > output_buffer;
   std::shared_ptr<McSimplePre> pre;
+  std::unique_ptr<bm::DataPlaneLearner> dp_learner{nullptr};
 };
 
+void SimpleSwitch::enable_dp_learning(unsigned int max_rate,
+                                      unsigned int ttl_ms) {
+  // allow up to one second worth of learning events in a burst
+  dp_learner.reset(new bm::DataPlaneLearner(max_rate, max_rate));
+  auto smac = dynamic_cast<bm::MatchTable *>(get_match_table("smac"));
+  auto dmac = dynamic_cast<bm::MatchTable *>(get_match_table("dmac"));
+  assert(smac && dmac);
+  using field_t = bm::DataPlaneLearner::field_t;
+  field_t src_addr, ingress_port;
+  std::tie(src_addr.first, src_addr.second) =
+      get_field_info("ethernet", "srcAddr");
+  std::tie(ingress_port.first, ingress_port.second) =
+      get_field_info("standard_metadata", "ingress_port");
+  dp_learner->add_rule(smac, {src_addr}, get_action("smac", "_nop"), {},
+                       ttl_ms);
+  dp_learner->add_rule(dmac, {src_addr}, get_action("dmac", "forward"),
+                       {ingress_port}, ttl_ms);
+  if (ttl_ms == 0) return;
+  // the tables do not support timeouts in the JSON, as the ageing timestamps
+  // are only needed with data plane learning
+  auto ageing_monitor = get_ageing_monitor();
+  for (auto table : {smac, dmac}) {
+    table->enable_ageing();
+    ageing_monitor->add_table(table);
+  }
+  auto learner = dp_learner.get();
+  ageing_monitor->register_ageing_cb(
+      [learner](bm::MatchTableAbstract *table,
+                const std::vector<bm::entry_handle_t> &handles) {
+        learner->remove_aged_entries(table, handles);
+      });
+}
+
 void SimpleSwitch::transmit_thread() {
   while (1) {
     std::unique_ptr<Packet> packet;
@@ -134,6 +183,7 @@ void SimpleSwitch::pipeline_thread() {
     BMLOG_DEBUG_PKT(*packet, "Mgid is {}", mgid);
 
     if (learn_id > 0) {
+      if (dp_learner) dp_learner->learn(*packet.get());
       get_learn_engine()->learn(learn_id, *packet.get());
       phv->get_field("intrinsic_metadata.learn_id").set(0);
     }
@@ -169,13 +219,47 @@ void SimpleSwitch::pipeline_thread() {
 /* Switch instance */
 
 static SimpleSwitch *simple_switch;
+static bm::TargetParserBasic *l2_switch_parser;
 
 int
 main(int argc, char* argv[]) {
   simple_switch = new SimpleSwitch();
-  int status = simple_switch->init_from_command_line_options(argc, argv);
+  l2_switch_parser = new bm::TargetParserBasic();
+  l2_switch_parser->add_flag_option(
+      "dp-learning",
+      "learn MAC addresses in the data plane, without waiting for the "
+      "controller");
+  l2_switch_parser->add_int_option(
+      "dp-learning-rate",
+      "maximum number of MAC addresses learned in the data plane per second "
+      "(default 10000, 0 means no limit)");
+  l2_switch_parser->add_int_option(
+      "dp-learning-ttl",
+      "timeout in ms for the entries learned in the data plane (default 0, "
+      "no timeout)");
+  int status = simple_switch->init_from_command_line_options(
+      argc, argv, l2_switch_parser);
   if (status != 0) std::exit(status);
 
+  bool dp_learning = false;
+  if (l2_switch_parser->get_flag_option("dp-learning", &dp_learning)
+      != bm::TargetParserBasic::ReturnCode::SUCCESS)
+    std::exit(1);
+  if (dp_learning) {
+    auto get_uint_option = [](const std::string &name, int default_v) {
+      int v = default_v;
+      auto rc = l2_switch_parser->get_int_option(name, &v);
+      if (rc == bm::TargetParserBasic::ReturnCode::OPTION_NOT_PROVIDED)
+        v = default_v;
+      else if (rc != bm::TargetParserBasic::ReturnCode::SUCCESS || v < 0)
+        std::exit(1);
+      return static_cast<unsigned int>(v);
+    };
+    simple_switch->enable_dp_learning(
+        get_uint_option("dp-learning-rate", 10000),
+        get_uint_option("dp-learning-ttl", 0));
+  }
+
   int thrift_port = simple_switch->get_runtime_port();
   bm_runtime::start_server(simple_switch, thrift_port);
 
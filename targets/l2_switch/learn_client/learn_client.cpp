@@ -65,6 +65,9 @@ void learn_cb(const bm_apps::LearnListener::MsgInfo &msg_info,
         client->bm_mt_add_entry(0, t_name, match_params, a_name, action_data,
                                 options);
       } catch (runtime::InvalidTableOperation &ito) {
+        // the entry may already have been learned by the switch itself
+        if (ito.code == runtime::TableOperationErrorCode::DUPLICATE_ENTRY)
+          return;
         auto what = runtime::_TableOperationErrorCode_VALUES_TO_NAMES.find(
             ito.code)->second;
         std::cout << "Invalid table (" << t_name << ") operation ("
@@ -13,10 +13,13 @@
 #include <bm/bm_sim/packet.h>
 
 #include <cassert>
+#include <chrono>
 #include <fstream>
+#include <future>
 #include <string>
 #include <vector>
 #include <iostream>
+#include <sstream>
 #include <streambuf>
 
 
@@ -25,12 +28,67 @@
 namespace ls {
 
 
+namespace {
+
+uint64_t
+get_duration_us(std::chrono::steady_clock::time_point start) {
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+  return duration_cast<microseconds>(
+           std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+
+// One add_config() request. The JSON is parsed by its own thread, the result
+// is then consumed by the link thread. status is protected by jobs_mutex.
+struct LinkerSwitch::LinkJob {
+  std::string program_name;
+  std::string config;
+  ConfigStatus status{};
+  std::future<std::shared_ptr<bm::P4Objects> > parsed{};
+};
+
+
+const char *
+LinkerSwitch::ConfigStatus::state_to_string(State state) {
+  switch (state) {
+    case State::NONE: return "NONE";
+    case State::QUEUED: return "QUEUED";
+    case State::PARSING: return "PARSING";
+    case State::LINKING: return "LINKING";
+    case State::PUBLISHING: return "PUBLISHING";
+    case State::DONE: return "DONE";
+    case State::FAILED: return "FAILED";
+  }
+  return "UNKNOWN";
+}
+
+
 // Linker Switch class
-// TODO: Sure, nothing to be done in CTOR??
 LinkerSwitch::LinkerSwitch()
   : bm::Switch(true) { 
 //  : bm::SwitchWContexts(true) { 
   TRACE_START;
+  link_thread = std::thread(&LinkerSwitch::link_loop, this);
+}
+
+
+LinkerSwitch::~LinkerSwitch() {
+  {
+    std::unique_lock<std::mutex> lock(jobs_mutex);
+    stop_link_thread = true;
+  }
+  jobs_cv.notify_one();
+  link_thread.join();
+  // the jobs which were not picked up by the link thread are reported, so that
+  // they do not look as if they were still running
+  for (auto &job : jobs_queue) {
+    job->parsed.wait();
+    set_failed(job.get(), "the switch was stopped before linking the program");
+  }
+  jobs_queue.clear();
 }
 
 
@@ -39,28 +97,186 @@ LinkerSwitch::add_config(const std::string &program_name,
                          const std::string &config) {
   TRACE_START;
   TRACE_PRINT(program_name);
+  auto job = std::make_shared<LinkJob>();
+  job->program_name = program_name;
+  job->config = config;
+  job->status.state = ConfigStatus::State::PARSING;
+
+  {
+    std::unique_lock<std::mutex> lock(jobs_mutex);
+    auto search = jobs.find(program_name);
+    if (search != jobs.end()) {
+      const auto state = search->second->status.state;
+      if (state != ConfigStatus::State::DONE &&
+          state != ConfigStatus::State::FAILED) {
+        TRACE_PRINT_CONST("a config is already being added for this program")
+        TRACE_END;
+        return RuntimeInterface::ErrorCode::ONGOING_SWAP;
+      }
+    }
+    jobs[program_name] = job;
+  }
+
+  // Parsing does not touch the linker, so the configs of different programs
+  // are parsed in parallel, and in parallel with the link thread.
+  job->parsed = std::async(std::launch::async,
+                           &LinkerSwitch::parse_config, this, job.get());
+
+  {
+    std::unique_lock<std::mutex> lock(jobs_mutex);
+    jobs_queue.push_back(job);
+  }
+  jobs_cv.notify_one();
+
+  TRACE_END;
+  return RuntimeInterface::ErrorCode::SUCCESS;
+}
+
+
+LinkerSwitch::ConfigStatus
+LinkerSwitch::get_config_status(const std::string &program_name) const {
+  std::unique_lock<std::mutex> lock(jobs_mutex);
+  auto search = jobs.find(program_name);
+  if (search == jobs.end())
+    return ConfigStatus();
+  return search->second->status;
+}
+
+
+void
+LinkerSwitch::set_state(LinkJob *job, ConfigStatus::State state) {
+  std::unique_lock<std::mutex> lock(jobs_mutex);
+  job->status.state = state;
+}
+
+
+void
+LinkerSwitch::set_failed(LinkJob *job, const std::string &error) {
+  bm::Logger::get()->error("Cannot add config for program {}: {}",
+                           job->program_name, error);
+  std::unique_lock<std::mutex> lock(jobs_mutex);
+  job->status.state = ConfigStatus::State::FAILED;
+  job->status.error = error;
+}
+
+
+// Runs in its own thread, returns nullptr if the JSON is invalid
+std::shared_ptr<bm::P4Objects>
+LinkerSwitch::parse_config(LinkJob *job) {
+  const auto start = std::chrono::steady_clock::now();
   std::shared_ptr<bm::P4Objects> p4objects = 
     std::make_shared<bm::P4Objects>(std::cout, true);
 
-  std::istringstream is(config); 
+  std::istringstream is(job->config); 
+
+  int rc = 1;
+  try {
+    rc = p4objects->init_objects(&is, get_lookup_factory(), device_id, 0u, 
+                                 notifications_transport, required_fields, 
+                                 arith_objects);
+  } catch (const std::exception& e) {
+    // e.g. the JSON reader error, the link thread must not see it
+    TRACE_PRINT_CONST("Exception");
+    TRACE_PRINT(e.what());
+  }
+
+  std::unique_lock<std::mutex> lock(jobs_mutex);
+  job->status.parse_us = get_duration_us(start);
+  job->config.clear();
+  if (rc != 0)
+    return nullptr;
+  // waiting for the link thread
+  job->status.state = ConfigStatus::State::QUEUED;
+  return p4objects;
+}
+
 
-  int rc = p4objects->init_objects(&is, get_lookup_factory(), device_id, 0u, 
-                                   notifications_transport, required_fields, 
-                                   arith_objects);
+// The Linker keeps the state of all the programs added so far, so the
+// programs are linked one at a time, in the order of the add_config() calls.
+void
+LinkerSwitch::link_loop() {
+  while (true) {
+    std::shared_ptr<LinkJob> job;
+    {
+      std::unique_lock<std::mutex> lock(jobs_mutex);
+      jobs_cv.wait(lock, [this]() {
+        return stop_link_thread || !jobs_queue.empty();
+      });
+      if (stop_link_thread) return;
+      job = jobs_queue.front();
+      jobs_queue.pop_front();
+    }
 
-  if (rc != 0) {
-    TRACE_PRINT_CONST("new p4objects initiation failed")
-    TRACE_END;
-    return RuntimeInterface::ErrorCode::SUCCESS;
+    std::shared_ptr<bm::P4Objects> p4objects = job->parsed.get();
+    if (p4objects == nullptr) {
+      set_failed(job.get(), "invalid JSON config");
+      continue;
+    }
+    TRACE_PRINT_CONST("new p4objects initiated")
+
+    set_state(job.get(), ConfigStatus::State::LINKING);
+    const auto start = std::chrono::steady_clock::now();
+    // these returns new merged P4 object
+    std::shared_ptr<bm::P4Objects> new_p4objects;
+    try {
+      new_p4objects = link_program(job->program_name, p4objects);
+    } catch (const std::exception& e) {
+      TRACE_PRINT_CONST("Exception");
+      TRACE_PRINT(e.what());
+    }
+    {
+      std::unique_lock<std::mutex> lock(jobs_mutex);
+      job->status.link_us = get_duration_us(start);
+    }
+    if (new_p4objects == nullptr) {
+      set_failed(job.get(), "program cannot be linked");
+      continue;
+    }
+    program_name_p4objects_map[job->program_name] = 
+      std::make_shared<PacketProramControlBlock>(job->program_name, p4objects);
+    linker_p4objects = new_p4objects;
+
+    publish(job.get(), new_p4objects);
   }
-  TRACE_PRINT_CONST("new p4objects initiated")
-  
-  // these returns new merged P4 object
-  std::shared_ptr<bm::P4Objects> new_p4objects = linker.add_p4objects(
-                                                   program_name, p4objects);
-  
-  TRACE_END;
-  return RuntimeInterface::ErrorCode::SUCCESS;
+}
+
+
+std::shared_ptr<bm::P4Objects>
+LinkerSwitch::link_program(const std::string &program_name,
+                           std::shared_ptr<bm::P4Objects> p4objects) {
+  return linker.add_p4objects(program_name, p4objects);
+}
+
+
+void
+LinkerSwitch::publish(LinkJob *job, std::shared_ptr<bm::P4Objects> merged) {
+  // The linker does not merge the control flows yet: swapping in a program
+  // without pipelines would leave the data plane with nothing to run.
+  if (merged->get_parser_rt("parser") == nullptr ||
+      merged->get_deparser_rt("deparser") == nullptr ||
+      merged->get_pipeline_rt("ingress") == nullptr ||
+      merged->get_pipeline_rt("egress") == nullptr) {
+    std::unique_lock<std::mutex> lock(jobs_mutex);
+    job->status.state = ConfigStatus::State::DONE;
+    job->status.error = "linked program is incomplete, not published";
+    return;
+  }
+
+  set_state(job, ConfigStatus::State::PUBLISHING);
+  const auto start = std::chrono::steady_clock::now();
+  // only waits for the packets which are using the current program
+  auto rc = load_new_objects(0, merged);
+  if (rc == RuntimeInterface::ErrorCode::SUCCESS)
+    rc = bm::SwitchWContexts::swap_configs();
+  std::unique_lock<std::mutex> lock(jobs_mutex);
+  job->status.publish_us = get_duration_us(start);
+  if (rc != RuntimeInterface::ErrorCode::SUCCESS) {
+    job->status.state = ConfigStatus::State::FAILED;
+    job->status.error = "cannot swap in the linked program";
+    return;
+  }
+  job->status.state = ConfigStatus::State::DONE;
+  job->status.published = true;
 }
 
 
@@ -21,6 +21,9 @@
 #include <vector>
 #include <iosfwd>
 #include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 
 #include <bm/bm_sim/P4Objects.h>
@@ -58,8 +61,40 @@ class LinkerSwitch : public bm::Switch {
   //! See SwitchWContexts::SwitchWContexts()
   explicit LinkerSwitch();
 
+  ~LinkerSwitch();
+
+  //! Status of the background job started by add_config() for a program
+  struct ConfigStatus {
+    enum class State {
+      NONE,
+      QUEUED,
+      PARSING,
+      LINKING,
+      PUBLISHING,
+      DONE,
+      FAILED
+    };
+
+    State state{State::NONE};
+    //! true if the merged program was swapped in
+    bool published{false};
+    std::string error{};
+    //! duration of each stage, in microseconds
+    uint64_t parse_us{0};
+    uint64_t link_us{0};
+    uint64_t publish_us{0};
+
+    static const char *state_to_string(State state);
+  };
+
   // ---------- RuntimeInterface 
 
+  //! Returns as soon as the job is queued: the JSON is parsed in a separate
+  //! thread (the configs of several programs can be parsed in parallel), then
+  //! the programs are linked one at a time, in order, by the link thread.
+  //! The merged program is published through the config swap machinery, so
+  //! packets are processed with the previous program until the swap. Returns
+  //! ONGOING_SWAP if a job for \p program_name is still running.
   virtual RuntimeInterface::ErrorCode
   add_config(const std::string &program_name, 
              const std::string &config);
@@ -67,6 +102,9 @@ class LinkerSwitch : public bm::Switch {
   virtual RuntimeInterface::ErrorCode
   delete_config(const std::string &program_name);
 
+  //! Returns the status of the last add_config() job for \p program_name
+  ConfigStatus get_config_status(const std::string &program_name) const;
+
 
   bm::MatchErrorCode
   mt_get_num_entries(size_t cxt_id,
@@ -310,6 +348,33 @@ class LinkerSwitch : public bm::Switch {
     return contexts.at(cxt_id).mt_get_entries<MatchTableIndirectWS>(table_name);
   }
 
+  MatchErrorCode
+  mt_get_entries_page(size_t cxt_id, const std::string &table_name,
+                      size_t max_entries,
+                      MatchTableAbstract::EntryCursor *cursor,
+                      std::vector<MatchTable::Entry> *entries) const override {
+    return contexts.at(cxt_id).mt_get_entries_page<MatchTable>(
+        table_name, max_entries, cursor, entries);
+  }
+
+  MatchErrorCode
+  mt_indirect_get_entries_page(
+      size_t cxt_id, const std::string &table_name, size_t max_entries,
+      MatchTableAbstract::EntryCursor *cursor,
+      std::vector<MatchTableIndirect::Entry> *entries) const override {
+    return contexts.at(cxt_id).mt_get_entries_page<MatchTableIndirect>(
+        table_name, max_entries, cursor, entries);
+  }
+
+  MatchErrorCode
+  mt_indirect_ws_get_entries_page(
+      size_t cxt_id, const std::string &table_name, size_t max_entries,
+      MatchTableAbstract::EntryCursor *cursor,
+      std::vector<MatchTableIndirectWS::Entry> *entries) const override {
+    return contexts.at(cxt_id).mt_get_entries_page<MatchTableIndirectWS>(
+        table_name, max_entries, cursor, entries);
+  }
+
   MatchErrorCode
   mt_get_entry(size_t cxt_id, const std::string &table_name,
                entry_handle_t handle, MatchTable::Entry *entry) const override {
@@ -599,6 +664,16 @@ class LinkerSwitch : public bm::Switch {
   }
   */
 
+ protected:
+  //! Links \p p4objects, the parsed config of \p program_name, with the
+  //! programs linked so far and returns the merged program, which is then
+  //! published. Returns nullptr if the program cannot be linked. Called by the
+  //! link thread only; a derived class overriding it must not be destroyed
+  //! while a job is being linked.
+  virtual std::shared_ptr<bm::P4Objects> link_program(
+      const std::string &program_name,
+      std::shared_ptr<bm::P4Objects> p4objects);
+
  private:
   int init_objects_(std::istream *is, int dev_id,
                    std::shared_ptr<bm::TransportIface> transport) override;
@@ -608,9 +683,25 @@ class LinkerSwitch : public bm::Switch {
   std::unordered_map<std::string, std::shared_ptr<PacketProramControlBlock> > 
     program_name_p4objects_map{};
 
+  struct LinkJob;
+
+  std::shared_ptr<bm::P4Objects> parse_config(LinkJob *job);
+  void link_loop();
+  void publish(LinkJob *job, std::shared_ptr<bm::P4Objects> merged);
+  void set_state(LinkJob *job, ConfigStatus::State state);
+  void set_failed(LinkJob *job, const std::string &error);
+
+  // only used by the link thread, once the switch is initialized
   bm::Linker linker;
   std::shared_ptr<bm::P4Objects> linker_p4objects;
 
+  mutable std::mutex jobs_mutex{};
+  std::condition_variable jobs_cv{};
+  std::deque<std::shared_ptr<LinkJob> > jobs_queue{};
+  // last job for each program
+  std::unordered_map<std::string, std::shared_ptr<LinkJob> > jobs{};
+  bool stop_link_thread{false};
+  std::thread link_thread{};
 };
 
 }  // namespace sl
@@ -51,6 +51,20 @@ class LinkerSwitchAPI(runtime_CLI.RuntimeAPI):
         ret = self.lswitch_client.p4_program_config_delete(program_name)
         print ret
 
+    @runtime_CLI.handle_bad_input
+    def do_p4_program_config_status(self, line):
+        "Show the status of the last config added for a program : \
+                p4_program_config_status <program name>"
+        args = line.split()
+        self.exactly_n_args(args, 1)
+        status = self.lswitch_client.p4_program_config_status(args[0])
+        print "state:", status.state
+        print "published:", status.published
+        if status.error:
+            print "error:", status.error
+        print "parse: {} us, link: {} us, publish: {} us".format(
+            status.parse_us, status.link_us, status.publish_us)
+
 def main():
     args = runtime_CLI.get_parser().parse_args()
 
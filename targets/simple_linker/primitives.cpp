@@ -296,11 +296,15 @@ class count : public ActionPrimitive<CounterArray &, const Data &> {
 
 REGISTER_PRIMITIVE(count);
 
+// the register primitives only use the per-index RegisterArray methods, which
+// lock the index they access themselves (only its stripe for striped arrays)
 class register_read
   : public ActionPrimitive<Field &, const RegisterArray &, const Data &> {
   void operator ()(Field &dst, const RegisterArray &src, const Data &idx) {
-    dst.set(src[idx.get_uint()]);
+    src.read(idx.get_uint(), &dst);
   }
+
+  bool manages_register_sync() const override { return true; }
 };
 
 REGISTER_PRIMITIVE(register_read);
@@ -308,12 +312,27 @@ REGISTER_PRIMITIVE(register_read);
 class register_write
   : public ActionPrimitive<RegisterArray &, const Data &, const Data &> {
   void operator ()(RegisterArray &dst, const Data &idx, const Data &src) {
-    dst[idx.get_uint()].set(src);
+    dst.write(idx.get_uint(), src);
   }
+
+  bool manages_register_sync() const override { return true; }
 };
 
 REGISTER_PRIMITIVE(register_write);
 
+// atomically adds src to the register (wrapping around on overflow), which
+// makes it usable with lock-free arrays; the array must be at most 64-bit wide
+class register_add
+  : public ActionPrimitive<RegisterArray &, const Data &, const Data &> {
+  void operator ()(RegisterArray &dst, const Data &idx, const Data &src) {
+    dst.fetch_add(idx.get_uint(), src.get_uint64());
+  }
+
+  bool manages_register_sync() const override { return true; }
+};
+
+REGISTER_PRIMITIVE(register_add);
+
 // I cannot name this "truncate" and register it with the usual
 // REGISTER_PRIMITIVE macro, because of a name conflict:
 //
@@ -17,6 +17,7 @@
 
 #include <unistd.h>
 
+#include <atomic>
 #include <iostream>
 #include <memory>
 #include <thread>
@@ -33,6 +34,7 @@ using bm::PHV;
 using bm::Parser;
 using bm::Deparser;
 using bm::Pipeline;
+using bm::ThreadActivity;
 
 
 class SimpleLinker : public ls::LinkerSwitch {
@@ -45,7 +47,8 @@ class SimpleLinker : public ls::LinkerSwitch {
   }
 
   int receive_(int port_num, const char *buffer, int len) override {
-    static int pkt_id = 0;
+    // may be called concurrently by the receive threads, see DevMgr
+    static std::atomic<int> pkt_id(0);
 
     auto packet = new_packet_ptr(port_num, pkt_id++, len,
                                  bm::PacketBuffer(2048, buffer, len));
@@ -73,9 +76,14 @@ class SimpleLinker : public ls::LinkerSwitch {
 };
 
 void SimpleLinker::transmit_thread() {
+  place_thread("transmit");
+  auto activity = get_telemetry_registry()->register_thread("transmit");
   while (1) {
     std::unique_ptr<Packet> packet;
-    output_buffer.pop_back(&packet);
+    {
+      ThreadActivity::IdleScope idle(activity);
+      output_buffer.pop_back(&packet);
+    }
     BMELOG(packet_out, *packet);
     BMLOG_DEBUG_PKT(*packet, "Transmitting packet of size {} out of port {}",
                     packet->get_data_size(), packet->get_egress_port());
@@ -85,20 +93,21 @@ void SimpleLinker::transmit_thread() {
 }
 
 void SimpleLinker::pipeline_thread() {
-  // Linker Switch never invalidates original pointer, but may modify parser,
-  // deparser and pipelines by locking them.
-  // Hence, locks are applied in parse, apply and deparse function of these
-  // objects.
-  // TODO: revisit here, if the original pointers are required to change
-  Pipeline *ingress_mau = this->get_pipeline("ingress");
-  Pipeline *egress_mau = this->get_pipeline("egress");
-  Parser *parser = this->get_parser("parser");
-  Deparser *deparser = this->get_deparser("deparser");
+  // The linked program is swapped in by the link thread (see
+  // LinkerSwitch::add_config), which invalidates the parser, deparser and
+  // pipelines. A swap only happens once all the packets of the previous
+  // program are gone, so these are looked up again for every packet, like in
+  // simple_switch.
   PHV *phv;
+  place_thread("pipeline");
+  auto activity = get_telemetry_registry()->register_thread("pipeline");
 
   while (1) {
     std::unique_ptr<Packet> packet;
-    input_buffer.pop_back(&packet);
+    {
+      ThreadActivity::IdleScope idle(activity);
+      input_buffer.pop_back(&packet);
+    }
     phv = packet->get_phv();
 
     int ingress_port = packet->get_ingress_port();
@@ -106,7 +115,8 @@ void SimpleLinker::pipeline_thread() {
     BMLOG_DEBUG_PKT(*packet, "Processing packet received on port {}",
                     ingress_port);
 
-    //TODO: change pointers here, if original pointers are required to change
+    Parser *parser = this->get_parser("parser");
+    Pipeline *ingress_mau = this->get_pipeline("ingress");
     parser->parse(packet.get());
     ingress_mau->apply(packet.get());
 
@@ -118,6 +128,8 @@ void SimpleLinker::pipeline_thread() {
     } else {
       packet->set_egress_port(egress_spec);
       phv->get_field("standard_metadata.egress_port").set(egress_spec);
+      Pipeline *egress_mau = this->get_pipeline("egress");
+      Deparser *deparser = this->get_deparser("deparser");
       egress_mau->apply(packet.get());
       deparser->deparse(packet.get());
       output_buffer.push_front(std::move(packet));
@@ -0,0 +1,199 @@
+/*
+ * Hardik Soni (hardik.soni@inria.fr)
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "linker_switch.h"
+
+namespace fs = boost::filesystem;
+
+using ConfigStatus = ls::LinkerSwitch::ConfigStatus;
+using State = ConfigStatus::State;
+using bm::RuntimeInterface;
+
+namespace {
+
+std::string read_config(const std::string &name) {
+  fs::path config_path = fs::path(TESTDATADIR) / fs::path(name);
+  std::ifstream fs(config_path.string());
+  std::stringstream ss;
+  ss << fs.rdbuf();
+  return ss.str();
+}
+
+// The Linker does not merge control flows yet, so the parsed program is used as
+// the merged one, which lets the tests go through the publish step. The link
+// thread can be held in link_program() to observe the state of the other jobs.
+class LinkerSwitchStub : public ls::LinkerSwitch {
+ public:
+  int receive_(int port_num, const char *buffer, int len) override {
+    (void) port_num; (void) buffer; (void) len;
+    return 0;
+  }
+
+  void start_and_return_() override { }
+
+  void hold() {
+    std::unique_lock<std::mutex> lock(mutex);
+    held = true;
+  }
+
+  void release() {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      held = false;
+    }
+    cv.notify_all();
+  }
+
+  // waits until link_program() has been called for n programs
+  bool wait_for_linked(size_t n) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return cv.wait_for(lock, std::chrono::seconds(5),
+                       [this, n]() { return linked.size() >= n; });
+  }
+
+  std::vector<std::string> get_linked() {
+    std::unique_lock<std::mutex> lock(mutex);
+    return linked;
+  }
+
+ protected:
+  std::shared_ptr<bm::P4Objects> link_program(
+      const std::string &program_name,
+      std::shared_ptr<bm::P4Objects> p4objects) override {
+    std::unique_lock<std::mutex> lock(mutex);
+    linked.push_back(program_name);
+    cv.notify_all();
+    cv.wait(lock, [this]() { return !held; });
+    if (program_name == "unlinkable") return nullptr;
+    return p4objects;
+  }
+
+ private:
+  std::mutex mutex{};
+  std::condition_variable cv{};
+  bool held{false};
+  std::vector<std::string> linked{};
+};
+
+}  // namespace
+
+class LinkerSwitchTest : public ::testing::Test {
+ protected:
+  LinkerSwitchTest()
+      : config(read_config("minimal.json")) { }
+
+  virtual void SetUp() {
+    ASSERT_EQ(0, sw.init_objects_empty(0, nullptr));
+  }
+
+  // polls the status of the program until its job is over
+  ConfigStatus wait_for_job(const std::string &program_name) {
+    auto status = sw.get_config_status(program_name);
+    for (int i = 0; i < 500; i++) {
+      if (status.state == State::DONE || status.state == State::FAILED) break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      status = sw.get_config_status(program_name);
+    }
+    return status;
+  }
+
+  // polls the status of the program until it reaches the given state
+  bool wait_for_state(const std::string &program_name, State state) {
+    for (int i = 0; i < 500; i++) {
+      if (sw.get_config_status(program_name).state == state) return true;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+  }
+
+  std::string config;
+  LinkerSwitchStub sw{};
+};
+
+TEST_F(LinkerSwitchTest, Publish) {
+  ASSERT_EQ(State::NONE, sw.get_config_status("p1").state);
+  ASSERT_EQ(nullptr, sw.get_pipeline("ingress"));
+
+  ASSERT_EQ(RuntimeInterface::ErrorCode::SUCCESS, sw.add_config("p1", config));
+  const auto status = wait_for_job("p1");
+  ASSERT_EQ(State::DONE, status.state);
+  ASSERT_TRUE(status.published);
+  ASSERT_EQ("", status.error);
+
+  // swapped in
+  ASSERT_NE(nullptr, sw.get_parser("parser"));
+  ASSERT_NE(nullptr, sw.get_pipeline("ingress"));
+  ASSERT_NE(nullptr, sw.get_pipeline("egress"));
+  ASSERT_NE(nullptr, sw.get_deparser("deparser"));
+}
+
+TEST_F(LinkerSwitchTest, Ordering) {
+  sw.hold();
+  ASSERT_EQ(RuntimeInterface::ErrorCode::SUCCESS, sw.add_config("p1", config));
+  ASSERT_TRUE(sw.wait_for_linked(1));
+  ASSERT_EQ(State::LINKING, sw.get_config_status("p1").state);
+  // the job of p1 is still running
+  ASSERT_EQ(RuntimeInterface::ErrorCode::ONGOING_SWAP,
+            sw.add_config("p1", config));
+
+  ASSERT_EQ(RuntimeInterface::ErrorCode::SUCCESS, sw.add_config("p2", config));
+  ASSERT_EQ(RuntimeInterface::ErrorCode::SUCCESS, sw.add_config("p3", config));
+  // parsed, waiting for the link thread
+  ASSERT_TRUE(wait_for_state("p2", State::QUEUED));
+  ASSERT_TRUE(wait_for_state("p3", State::QUEUED));
+  ASSERT_EQ(1u, sw.get_linked().size());
+
+  sw.release();
+  for (const auto &program_name : {"p1", "p2", "p3"}) {
+    const auto status = wait_for_job(program_name);
+    ASSERT_EQ(State::DONE, status.state) << program_name;
+    ASSERT_TRUE(status.published) << program_name;
+  }
+  const std::vector<std::string> expected_order({"p1", "p2", "p3"});
+  ASSERT_EQ(expected_order, sw.get_linked());
+
+  // the previous job of p1 is over
+  ASSERT_EQ(RuntimeInterface::ErrorCode::SUCCESS, sw.add_config("p1", config));
+  ASSERT_EQ(State::DONE, wait_for_job("p1").state);
+}
+
+TEST_F(LinkerSwitchTest, InvalidJson) {
+  ASSERT_EQ(RuntimeInterface::ErrorCode::SUCCESS, sw.add_config("p1", "{"));
+  const auto status = wait_for_job("p1");
+  ASSERT_EQ(State::FAILED, status.state);
+  ASSERT_FALSE(status.published);
+  ASSERT_EQ("invalid JSON config", status.error);
+  // never reaches the link thread
+  ASSERT_TRUE(sw.get_linked().empty());
+  ASSERT_EQ(nullptr, sw.get_pipeline("ingress"));
+
+  // a failed job does not prevent adding the program again
+  ASSERT_EQ(RuntimeInterface::ErrorCode::SUCCESS, sw.add_config("p1", config));
+  ASSERT_EQ(State::DONE, wait_for_job("p1").state);
+}
+
+TEST_F(LinkerSwitchTest, LinkError) {
+  ASSERT_EQ(RuntimeInterface::ErrorCode::SUCCESS,
+            sw.add_config("unlinkable", config));
+  const auto status = wait_for_job("unlinkable");
+  ASSERT_EQ(State::FAILED, status.state);
+  ASSERT_FALSE(status.published);
+  ASSERT_EQ("program cannot be linked", status.error);
+  ASSERT_EQ(nullptr, sw.get_pipeline("ingress"));
+}
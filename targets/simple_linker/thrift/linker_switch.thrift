@@ -7,9 +7,22 @@
 namespace cpp lswitch_runtime
 namespace py lswitch_runtime
 
+// status of the last p4_program_config_add for a program, durations are in
+// microseconds
+struct ProgramConfigStatus {
+  1:string state,
+  2:bool published,
+  3:string error,
+  4:i64 parse_us,
+  5:i64 link_us,
+  6:i64 publish_us
+}
+
 service LinkerSwitch {
 
+  // returns as soon as the config is queued, see p4_program_config_status
   i32 p4_program_config_add(1:string program_name, 2:string config_str);
   i32 p4_program_config_delete(1:string program_name);
+  ProgramConfigStatus p4_program_config_status(1:string program_name);
 
 }
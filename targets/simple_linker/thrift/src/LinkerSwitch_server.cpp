@@ -39,8 +39,21 @@ class LinkerSwitchHandler : virtual public LinkerSwitchIf {
 
     bm::Logger::get()->trace("p4_program_config_add");
     bm::Logger::get()->trace(__func__);
-    switch_->add_config(program_name, config_str);
-    return 0;
+    return static_cast<int32_t>(
+      switch_->add_config(program_name, config_str));
+  }
+
+  void p4_program_config_status(ProgramConfigStatus& _return,
+                                const std::string& program_name) {
+    bm::Logger::get()->trace(__func__);
+    const auto status = switch_->get_config_status(program_name);
+    _return.state = ls::LinkerSwitch::ConfigStatus::state_to_string(
+                      status.state);
+    _return.published = status.published;
+    _return.error = status.error;
+    _return.parse_us = static_cast<int64_t>(status.parse_us);
+    _return.link_us = static_cast<int64_t>(status.link_us);
+    _return.publish_us = static_cast<int64_t>(status.publish_us);
   }
 
   int32_t p4_program_config_delete(const std::string& program_name) {
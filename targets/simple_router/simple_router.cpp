@@ -30,6 +30,7 @@
 
 #include <unistd.h>
 
+#include <atomic>
 #include <iostream>
 #include <memory>
 #include <thread>
@@ -55,7 +56,8 @@ class SimpleSwitch : public Switch {
   }
 
   int receive_(int port_num, const char *buffer, int len) override {
-    static int pkt_id = 0;
+    // may be called concurrently by the receive threads, see DevMgr
+    static std::atomic<int> pkt_id(0);
 
     if (this->do_swap() == 0)  // a swap took place
       swap_happened = true;
@@ -83,7 +85,7 @@ class SimpleSwitch : public Switch {
  private:
   Queue<std::unique_ptr<Packet> > input_buffer;
   Queue<std::unique_ptr<Packet> > output_buffer;
-  bool swap_happened{false};
+  std::atomic<bool> swap_happened{false};
 };
 
 void SimpleSwitch::transmit_thread() {
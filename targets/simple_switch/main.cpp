@@ -41,6 +41,14 @@ main(int argc, char* argv[]) {
   simple_switch_parser = new bm::TargetParserBasic();
   simple_switch_parser->add_flag_option("enable-swap",
                                         "enable JSON swapping at runtime");
+  simple_switch_parser->add_int_option(
+      "flow-cache-size",
+      "cache the effect of the ingress pipeline for up to this number of "
+      "flows (0, the default, disables the cache)");
+  simple_switch_parser->add_int_option(
+      "resilient-hashing-buckets",
+      "select action profile members with resilient hashing, using this number "
+      "of buckets per group (0, the default, keeps the default selection)");
   int status = simple_switch->init_from_command_line_options(
       argc, argv, simple_switch_parser);
   if (status != 0) std::exit(status);
@@ -51,6 +59,33 @@ main(int argc, char* argv[]) {
     std::exit(1);
   if (enable_swap_flag) simple_switch->enable_config_swap();
 
+  int flow_cache_size = 0;
+  {
+    auto rc = simple_switch_parser->get_int_option("flow-cache-size",
+                                                   &flow_cache_size);
+    if (rc == bm::TargetParserBasic::ReturnCode::OPTION_NOT_PROVIDED)
+      flow_cache_size = 0;
+    else if (rc != bm::TargetParserBasic::ReturnCode::SUCCESS ||
+             flow_cache_size < 0)
+      std::exit(1);
+  }
+  if (flow_cache_size > 0) simple_switch->enable_flow_cache(flow_cache_size);
+
+  int resilient_hashing_buckets = 0;
+  {
+    auto rc = simple_switch_parser->get_int_option("resilient-hashing-buckets",
+                                                   &resilient_hashing_buckets);
+    if (rc == bm::TargetParserBasic::ReturnCode::OPTION_NOT_PROVIDED)
+      resilient_hashing_buckets = 0;
+    else if (rc != bm::TargetParserBasic::ReturnCode::SUCCESS ||
+             resilient_hashing_buckets < 0)
+      std::exit(1);
+  }
+  if (resilient_hashing_buckets > 0) {
+    simple_switch->enable_resilient_group_selection(
+        resilient_hashing_buckets);
+  }
+
   int thrift_port = simple_switch->get_runtime_port();
   bm_runtime::start_server(simple_switch, thrift_port);
   using ::sswitch_runtime::SimpleSwitchIf;
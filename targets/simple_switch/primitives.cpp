@@ -25,6 +25,7 @@
 #include <bm/bm_sim/meters.h>
 #include <bm/bm_sim/packet.h>
 #include <bm/bm_sim/phv.h>
+#include <bm/bm_sim/P4Objects.h>
 
 #include <random>
 #include <thread>
@@ -40,11 +41,21 @@ using bm::CounterArray;
 using bm::RegisterArray;
 using bm::NamedCalculation;
 using bm::HeaderStack;
+using bm::ActionParam;
+using bm::ActionFusedOp;
+using bm::ActionEngineState;
+using bm::Packet;
 
 class modify_field : public ActionPrimitive<Data &, const Data &> {
   void operator ()(Data &dst, const Data &src) {
     bm::core::assign()(dst, src);
   }
+
+  bool fuse(const ActionParam *args, ActionFusedOp *op) override {
+    return bm::core::assign().fuse(args, op);
+  }
+
+  bool is_flow_cacheable() const override { return true; }
 };
 
 REGISTER_PRIMITIVE(modify_field);
@@ -69,6 +80,46 @@ class add_to_field : public ActionPrimitive<Field &, const Data &> {
   void operator ()(Field &f, const Data &d) {
     f.add(f, d);
   }
+
+  static void add_const(const ActionFusedOp &, ActionEngineState *state,
+                        const ActionParam *args) {
+    Field &f = state->phv.get_field(args[0].field.header,
+                                    args[0].field.field_offset);
+    f.add(f, state->const_values[args[1].const_offset]);
+  }
+
+  static void add_action_data(const ActionFusedOp &, ActionEngineState *state,
+                              const ActionParam *args) {
+    Field &f = state->phv.get_field(args[0].field.header,
+                                    args[0].field.field_offset);
+    f.add(f, state->action_data.get(args[1].action_data_offset));
+  }
+
+  static void add_field(const ActionFusedOp &, ActionEngineState *state,
+                        const ActionParam *args) {
+    Field &f = state->phv.get_field(args[0].field.header,
+                                    args[0].field.field_offset);
+    f.add(f, state->phv.get_field(args[1].field.header,
+                                  args[1].field.field_offset));
+  }
+
+  bool fuse(const ActionParam *args, ActionFusedOp *op) override {
+    switch (args[1].tag) {
+      case ActionParam::CONST:
+        op->fn = add_const;
+        return true;
+      case ActionParam::ACTION_DATA:
+        op->fn = add_action_data;
+        return true;
+      case ActionParam::FIELD:
+        op->fn = add_field;
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  bool is_flow_cacheable() const override { return true; }
 };
 
 REGISTER_PRIMITIVE(add_to_field);
@@ -77,6 +128,8 @@ class subtract_from_field : public ActionPrimitive<Field &, const Data &> {
   void operator ()(Field &f, const Data &d) {
     f.sub(f, d);
   }
+
+  bool is_flow_cacheable() const override { return true; }
 };
 
 REGISTER_PRIMITIVE(subtract_from_field);
@@ -85,6 +138,8 @@ class add : public ActionPrimitive<Data &, const Data &, const Data &> {
   void operator ()(Data &f, const Data &d1, const Data &d2) {
     f.add(d1, d2);
   }
+
+  bool is_flow_cacheable() const override { return true; }
 };
 
 REGISTER_PRIMITIVE(add);
@@ -93,6 +148,8 @@ class subtract : public ActionPrimitive<Data &, const Data &, const Data &> {
   void operator ()(Data &f, const Data &d1, const Data &d2) {
     f.sub(d1, d2);
   }
+
+  bool is_flow_cacheable() const override { return true; }
 };
 
 REGISTER_PRIMITIVE(subtract);
@@ -101,6 +158,8 @@ class bit_xor : public ActionPrimitive<Data &, const Data &, const Data &> {
   void operator ()(Data &f, const Data &d1, const Data &d2) {
     f.bit_xor(d1, d2);
   }
+
+  bool is_flow_cacheable() const override { return true; }
 };
 
 REGISTER_PRIMITIVE(bit_xor);
@@ -109,6 +168,8 @@ class bit_or : public ActionPrimitive<Data &, const Data &, const Data &> {
   void operator ()(Data &f, const Data &d1, const Data &d2) {
     f.bit_or(d1, d2);
   }
+
+  bool is_flow_cacheable() const override { return true; }
 };
 
 REGISTER_PRIMITIVE(bit_or);
@@ -117,6 +178,8 @@ class bit_and : public ActionPrimitive<Data &, const Data &, const Data &> {
   void operator ()(Data &f, const Data &d1, const Data &d2) {
     f.bit_and(d1, d2);
   }
+
+  bool is_flow_cacheable() const override { return true; }
 };
 
 REGISTER_PRIMITIVE(bit_and);
@@ -126,6 +189,8 @@ class shift_left :
   void operator ()(Data &f, const Data &d1, const Data &d2) {
     f.shift_left(d1, d2);
   }
+
+  bool is_flow_cacheable() const override { return true; }
 };
 
 REGISTER_PRIMITIVE(shift_left);
@@ -135,6 +200,8 @@ class shift_right :
   void operator ()(Data &f, const Data &d1, const Data &d2) {
     f.shift_right(d1, d2);
   }
+
+  bool is_flow_cacheable() const override { return true; }
 };
 
 REGISTER_PRIMITIVE(shift_right);
@@ -146,6 +213,41 @@ class drop : public ActionPrimitive<> {
       get_field("intrinsic_metadata.mcast_grp").set(0);
     }
   }
+
+  // the fields are resolved once in fuse(), instead of being looked up by name
+  // for every packet
+  static void drop_fused(const ActionFusedOp &op, ActionEngineState *state,
+                         const ActionParam *) {
+    state->phv.get_field(op.bound[0].field.header,
+                         op.bound[0].field.field_offset).set(511);
+    if (op.bound[1].tag == ActionParam::FIELD) {
+      state->phv.get_field(op.bound[1].field.header,
+                           op.bound[1].field.field_offset).set(0);
+    }
+  }
+
+  bool fuse(const ActionParam *, ActionFusedOp *op) override {
+    auto *p4objects = get_p4objects();
+    if (p4objects == nullptr ||
+        !p4objects->field_exists("standard_metadata", "egress_spec")) {
+      return false;
+    }
+    auto bind_field = [p4objects](const char *hdr, const char *f,
+                                  ActionParam *param) {
+      const auto info = p4objects->field_info(hdr, f);
+      param->tag = ActionParam::FIELD;
+      param->field = {std::get<0>(info), std::get<1>(info)};
+    };
+    bind_field("standard_metadata", "egress_spec", &op->bound[0]);
+    if (p4objects->field_exists("intrinsic_metadata", "mcast_grp"))
+      bind_field("intrinsic_metadata", "mcast_grp", &op->bound[1]);
+    else
+      op->bound[1].tag = ActionParam::CONST;  // no field to reset
+    op->fn = drop_fused;
+    return true;
+  }
+
+  bool is_flow_cacheable() const override { return true; }
 };
 
 REGISTER_PRIMITIVE(drop);
@@ -170,15 +272,32 @@ REGISTER_PRIMITIVE(generate_digest);
 
 class add_header : public ActionPrimitive<Header &> {
   void operator ()(Header &hdr) {
+    add(hdr, &get_packet());
+  }
+
+  static void add(Header &hdr, Packet *packet) {
     // TODO(antonin): reset header to 0?
     if (!hdr.is_valid()) {
       hdr.reset();
       hdr.mark_valid();
       // updated the length packet register (register 0)
-      auto &packet = get_packet();
-      packet.set_register(0, packet.get_register(0) + hdr.get_nbytes_packet());
+      packet->set_register(0,
+                           packet->get_register(0) + hdr.get_nbytes_packet());
     }
   }
+
+  static void add_fused(const ActionFusedOp &, ActionEngineState *state,
+                        const ActionParam *args) {
+    add(state->phv.get_header(args[0].header), &state->pkt);
+  }
+
+  bool fuse(const ActionParam *args, ActionFusedOp *op) override {
+    if (args[0].tag != ActionParam::HEADER) return false;
+    op->fn = add_fused;
+    return true;
+  }
+
+  bool is_flow_cacheable() const override { return true; }
 };
 
 REGISTER_PRIMITIVE(add_header);
@@ -187,19 +306,38 @@ class add_header_fast : public ActionPrimitive<Header &> {
   void operator ()(Header &hdr) {
     hdr.mark_valid();
   }
+
+  bool is_flow_cacheable() const override { return true; }
 };
 
 REGISTER_PRIMITIVE(add_header_fast);
 
 class remove_header : public ActionPrimitive<Header &> {
   void operator ()(Header &hdr) {
+    remove(hdr, &get_packet());
+  }
+
+  static void remove(Header &hdr, Packet *packet) {
     if (hdr.is_valid()) {
       // updated the length packet register (register 0)
-      auto &packet = get_packet();
-      packet.set_register(0, packet.get_register(0) - hdr.get_nbytes_packet());
+      packet->set_register(0,
+                           packet->get_register(0) - hdr.get_nbytes_packet());
       hdr.mark_invalid();
     }
   }
+
+  static void remove_fused(const ActionFusedOp &, ActionEngineState *state,
+                           const ActionParam *args) {
+    remove(state->phv.get_header(args[0].header), &state->pkt);
+  }
+
+  bool fuse(const ActionParam *args, ActionFusedOp *op) override {
+    if (args[0].tag != ActionParam::HEADER) return false;
+    op->fn = remove_fused;
+    return true;
+  }
+
+  bool is_flow_cacheable() const override { return true; }
 };
 
 REGISTER_PRIMITIVE(remove_header);
@@ -208,6 +346,8 @@ class copy_header : public ActionPrimitive<Header &, const Header &> {
   void operator ()(Header &dst, const Header &src) {
     bm::core::assign_header()(dst, src);
   }
+
+  bool is_flow_cacheable() const override { return true; }
 };
 
 REGISTER_PRIMITIVE(copy_header);
@@ -275,6 +415,8 @@ class no_op : public ActionPrimitive<> {
   void operator ()() {
     // nothing
   }
+
+  bool is_flow_cacheable() const override { return true; }
 };
 
 REGISTER_PRIMITIVE(no_op);
@@ -296,11 +438,15 @@ class count : public ActionPrimitive<CounterArray &, const Data &> {
 
 REGISTER_PRIMITIVE(count);
 
+// the register primitives only use the per-index RegisterArray methods, which
+// lock the index they access themselves (only its stripe for striped arrays)
 class register_read
   : public ActionPrimitive<Field &, const RegisterArray &, const Data &> {
   void operator ()(Field &dst, const RegisterArray &src, const Data &idx) {
-    dst.set(src[idx.get_uint()]);
+    src.read(idx.get_uint(), &dst);
   }
+
+  bool manages_register_sync() const override { return true; }
 };
 
 REGISTER_PRIMITIVE(register_read);
@@ -308,12 +454,27 @@ REGISTER_PRIMITIVE(register_read);
 class register_write
   : public ActionPrimitive<RegisterArray &, const Data &, const Data &> {
   void operator ()(RegisterArray &dst, const Data &idx, const Data &src) {
-    dst[idx.get_uint()].set(src);
+    dst.write(idx.get_uint(), src);
   }
+
+  bool manages_register_sync() const override { return true; }
 };
 
 REGISTER_PRIMITIVE(register_write);
 
+// atomically adds src to the register (wrapping around on overflow), which
+// makes it usable with lock-free arrays; the array must be at most 64-bit wide
+class register_add
+  : public ActionPrimitive<RegisterArray &, const Data &, const Data &> {
+  void operator ()(RegisterArray &dst, const Data &idx, const Data &src) {
+    dst.fetch_add(idx.get_uint(), src.get_uint64());
+  }
+
+  bool manages_register_sync() const override { return true; }
+};
+
+REGISTER_PRIMITIVE(register_add);
+
 // I cannot name this "truncate" and register it with the usual
 // REGISTER_PRIMITIVE macro, because of a name conflict:
 //
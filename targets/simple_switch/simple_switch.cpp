@@ -24,6 +24,7 @@
 
 #include <unistd.h>
 
+#include <atomic>
 #include <iostream>
 #include <fstream>
 #include <string>
@@ -111,6 +112,11 @@ SimpleSwitch::SimpleSwitch(int max_port, bool enable_swap)
   force_arith_field("intrinsic_metadata", "egress_rid");
   force_arith_field("intrinsic_metadata", "recirculate_flag");
 
+  for (int port = 0; port < max_port; port++) {
+    get_telemetry_registry()->register_queue(
+        "egress_" + std::to_string(port), egress_buffers.get_telemetry(port));
+  }
+
   import_primitives();
 }
 
@@ -118,7 +124,8 @@ SimpleSwitch::SimpleSwitch(int max_port, bool enable_swap)
 
 int
 SimpleSwitch::receive_(int port_num, const char *buffer, int len) {
-  static int pkt_id = 0;
+  // may be called concurrently by the receive threads, see DevMgr
+  static std::atomic<int> pkt_id(0);
 
   // this is a good place to call this, because blocking this thread will not
   // block the processing of existing packet instances, which is a requirement
@@ -222,11 +229,23 @@ SimpleSwitch::set_transmit_fn(TransmitFn fn) {
   my_transmit_fn = std::move(fn);
 }
 
+void
+SimpleSwitch::enable_flow_cache(size_t max_entries) {
+  flow_cache.reset(new bm::FlowCache(max_entries));
+  get_telemetry_registry()->register_flow_cache("ingress",
+                                                flow_cache->get_telemetry());
+}
+
 void
 SimpleSwitch::transmit_thread() {
+  place_thread("transmit");
+  auto activity = get_telemetry_registry()->register_thread("transmit");
   while (1) {
     std::unique_ptr<Packet> packet;
-    output_buffer.pop_back(&packet);
+    {
+      ThreadActivity::IdleScope idle(activity);
+      output_buffer.pop_back(&packet);
+    }
     BMELOG(packet_out, *packet);
     BMLOG_DEBUG_PKT(*packet, "Transmitting packet of size {} out of port {}",
                     packet->get_data_size(), packet->get_egress_port());
@@ -300,9 +319,14 @@ void
 SimpleSwitch::ingress_thread() {
   PHV *phv;
 
+  place_thread("ingress");
+  auto activity = get_telemetry_registry()->register_thread("ingress");
   while (1) {
     std::unique_ptr<Packet> packet;
-    input_buffer.pop_back(&packet);
+    {
+      ThreadActivity::IdleScope idle(activity);
+      input_buffer.pop_back(&packet);
+    }
 
     // TODO(antonin): only update these if swapping actually happened?
     Parser *parser = this->get_parser("parser");
@@ -325,7 +349,10 @@ SimpleSwitch::ingress_thread() {
     const Packet::buffer_state_t packet_in_state = packet->save_buffer_state();
     parser->parse(packet.get());
 
-    ingress_mau->apply(packet.get());
+    if (flow_cache)
+      flow_cache->apply(ingress_mau, packet.get());
+    else
+      ingress_mau->apply(packet.get());
 
     packet->reset_exit();
 
@@ -438,10 +465,16 @@ void
 SimpleSwitch::egress_thread(size_t worker_id) {
   PHV *phv;
 
+  place_thread("egress", worker_id);
+  auto activity = get_telemetry_registry()->register_thread(
+      "egress_" + std::to_string(worker_id));
   while (1) {
     std::unique_ptr<Packet> packet;
     size_t port;
-    egress_buffers.pop_back(worker_id, &port, &packet);
+    {
+      ThreadActivity::IdleScope idle(activity);
+      egress_buffers.pop_back(worker_id, &port, &packet);
+    }
 
     Deparser *deparser = this->get_deparser("deparser");
     Pipeline *egress_mau = this->get_pipeline("egress");
@@ -26,6 +26,7 @@
 #include <bm/bm_sim/packet.h>
 #include <bm/bm_sim/switch.h>
 #include <bm/bm_sim/event_logger.h>
+#include <bm/bm_sim/flow_cache.h>
 #include <bm/bm_sim/simple_pre_lag.h>
 
 #include <memory>
@@ -63,6 +64,7 @@ using bm::Field;
 using bm::FieldList;
 using bm::packet_id_t;
 using bm::p4object_id_t;
+using bm::ThreadActivity;
 
 
 class SimpleSwitch : public Switch {
@@ -111,6 +113,9 @@ class SimpleSwitch : public Switch {
 
   void set_transmit_fn(TransmitFn fn);
 
+  // has to be called before the switch is started
+  void enable_flow_cache(size_t max_entries);
+
  private:
   static constexpr size_t nb_egress_threads = 4u;
 
@@ -172,6 +177,8 @@ class SimpleSwitch : public Switch {
   clock::time_point start;
   std::unordered_map<mirror_id_t, int> mirroring_map;
   bool with_queueing_metadata{false};
+  // only accessed by the ingress thread, nullptr if disabled
+  std::unique_ptr<bm::FlowCache> flow_cache{nullptr};
 };
 
 #endif  // SIMPLE_SWITCH_SIMPLE_SWITCH_H_
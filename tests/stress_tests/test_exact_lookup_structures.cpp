@@ -0,0 +1,199 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+// Compares the default exact lookup structure with the std::unordered_map-based
+// implementation it replaced, for 6-byte (MAC address) and 13-byte (5-tuple)
+// keys: lookup rate (one at a time and batched) and memory used per entry.
+
+#include <bm/bm_sim/lookup_structures.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// used to measure memory usage, this program is single-threaded
+size_t allocated_bytes = 0;
+
+}  // namespace
+
+void *operator new(size_t size) {
+  // store the size in front of the block so that delete can account for it
+  void *p = std::malloc(size + sizeof(max_align_t));
+  if (!p) throw std::bad_alloc();
+  *static_cast<size_t *>(p) = size;
+  allocated_bytes += size;
+  return static_cast<char *>(p) + sizeof(max_align_t);
+}
+
+void operator delete(void *p) noexcept {
+  if (!p) return;
+  void *base = static_cast<char *>(p) - sizeof(max_align_t);
+  allocated_bytes -= *static_cast<size_t *>(base);
+  std::free(base);
+}
+
+namespace {
+
+using bm::ByteContainer;
+using bm::ExactLookupStructure;
+using bm::ExactMatchKey;
+using bm::internal_handle_t;
+
+// the exact lookup structure used before the open-addressing hash table
+class UnorderedMapStructure : public ExactLookupStructure {
+ public:
+  explicit UnorderedMapStructure(size_t size) {
+    entries_map.reserve(size);
+  }
+
+  bool lookup(const ByteContainer &key,
+              internal_handle_t *handle) const override {
+    const auto it = entries_map.find(key);
+    if (it == entries_map.end()) return false;
+    *handle = it->second;
+    return true;
+  }
+
+  bool entry_exists(const ExactMatchKey &key) const override {
+    return entries_map.find(key.data) != entries_map.end();
+  }
+
+  bool retrieve_handle(const ExactMatchKey &key,
+                       internal_handle_t *handle) const override {
+    return lookup(key.data, handle);
+  }
+
+  void add_entry(const ExactMatchKey &key,
+                 internal_handle_t handle) override {
+    entries_map[key.data] = handle;
+  }
+
+  void delete_entry(const ExactMatchKey &key) override {
+    entries_map.erase(key.data);
+  }
+
+  void clear() override {
+    entries_map.clear();
+  }
+
+ private:
+  std::unordered_map<ByteContainer, internal_handle_t,
+                     bm::ByteContainerKeyHash> entries_map{};
+};
+
+using clock = std::chrono::high_resolution_clock;
+
+double elapsed_s(clock::time_point start) {
+  return std::chrono::duration<double>(clock::now() - start).count();
+}
+
+void run(const std::string &name, std::unique_ptr<ExactLookupStructure> s,
+         size_t size_before, const std::vector<ExactMatchKey> &entries,
+         const std::vector<ByteContainer> &lookups) {
+  for (size_t i = 0; i < entries.size(); i++) s->add_entry(entries[i], i);
+  const double bytes_per_entry =
+      static_cast<double>(allocated_bytes - size_before) / entries.size();
+
+  internal_handle_t handle;
+  size_t hits = 0;
+  auto start = clock::now();
+  for (const auto &key : lookups) hits += s->lookup(key, &handle);
+  const double single_s = elapsed_s(start);
+
+  constexpr size_t batch_size = 32;
+  std::vector<internal_handle_t> handles(batch_size);
+  std::unique_ptr<bool[]> batch_hits(new bool[batch_size]);
+  size_t hits_batch = 0;
+  start = clock::now();
+  for (size_t i = 0; i + batch_size <= lookups.size(); i += batch_size) {
+    s->lookup_batch(batch_size, &lookups[i], handles.data(), batch_hits.get());
+    for (size_t j = 0; j < batch_size; j++) hits_batch += batch_hits[j];
+  }
+  const double batch_s = elapsed_s(start);
+
+  std::cout << "  " << name << ": "
+            << bytes_per_entry << " bytes / entry, "
+            << static_cast<size_t>(lookups.size() / single_s / 1e3)
+            << " K lookups / s, "
+            << static_cast<size_t>(lookups.size() / batch_s / 1e3)
+            << " K batched lookups / s ("
+            << hits << " / " << hits_batch << " hits)\n";
+}
+
+void bench(size_t key_width, size_t num_entries, size_t num_lookups) {
+  std::cout << key_width << "-byte keys, " << num_entries << " entries, "
+            << num_lookups << " lookups\n";
+
+  std::mt19937_64 gen(key_width);
+  std::vector<ExactMatchKey> entries(num_entries);
+  for (auto &entry : entries) {
+    for (size_t b = 0; b < key_width; b++)
+      entry.data.push_back(static_cast<char>(gen()));
+  }
+  // 90% hits
+  std::vector<ByteContainer> lookups;
+  lookups.reserve(num_lookups);
+  std::uniform_int_distribution<size_t> dis(0, num_entries - 1);
+  for (size_t i = 0; i < num_lookups; i++) {
+    if (i % 10 == 0) {
+      ByteContainer key;
+      for (size_t b = 0; b < key_width; b++)
+        key.push_back(static_cast<char>(gen()));
+      lookups.push_back(std::move(key));
+    } else {
+      lookups.push_back(entries[dis(gen)].data);
+    }
+  }
+
+  bm::LookupStructureFactory factory;
+  {
+    auto size_before = allocated_bytes;
+    run("default (open addressing)",
+        factory.create_for_exact(num_entries, key_width), size_before,
+        entries, lookups);
+  }
+  {
+    auto size_before = allocated_bytes;
+    run("std::unordered_map",
+        std::unique_ptr<ExactLookupStructure>(
+            new UnorderedMapStructure(num_entries)),
+        size_before, entries, lookups);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  size_t num_entries = 1000000;
+  if (argc > 1) num_entries = std::stoul(argv[1]);
+  size_t num_lookups = 10 * num_entries;
+  if (argc > 2) num_lookups = std::stoul(argv[2]);
+
+  bench(6, num_entries, num_lookups);  // MAC address
+  bench(13, num_entries, num_lookups);  // IPv4 5-tuple
+}
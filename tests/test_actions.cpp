@@ -670,6 +670,142 @@ TEST_F(ActionsTest, Jump) {
   EXPECT_EQ(0xaa, f32.get<int>());
 }
 
+TEST_F(ActionsTest, CompiledJump) {
+  auto primitive_if = ActionOpcodesMap::get_instance()->get_primitive(
+      "_jump_if_zero");
+  auto primitive_else = ActionOpcodesMap::get_instance()->get_primitive(
+      "_jump");
+  auto primitive_assign = ActionOpcodesMap::get_instance()->get_primitive(
+      "assign");
+
+  // same as above, but the assignments are fused
+  testActionFn.push_back_primitive(primitive_if.get());
+  testActionFn.parameter_push_back_field(testHeader1, 2);  // f8
+  testActionFn.parameter_push_back_const(Data(3));
+  testActionFn.push_back_primitive(primitive_assign.get());
+  testActionFn.parameter_push_back_field(testHeader1, 0);  // f32
+  testActionFn.parameter_push_back_const(Data(0xaa));
+  testActionFn.push_back_primitive(primitive_else.get());
+  testActionFn.parameter_push_back_const(Data(4));
+  testActionFn.push_back_primitive(primitive_assign.get());
+  testActionFn.parameter_push_back_field(testHeader1, 0);  // f32
+  testActionFn.parameter_push_back_const(Data(0xbb));
+  testActionFn.compile();
+  ASSERT_TRUE(testActionFn.is_compiled());
+
+  auto &f8 = phv->get_field(testHeader1, 2);
+  auto &f32 = phv->get_field(testHeader1, 0);
+
+  f8.set(0);
+  testActionFnEntry(pkt.get());
+  EXPECT_EQ(0xbb, f32.get<int>());
+
+  f8.set(1);
+  testActionFnEntry(pkt.get());
+  EXPECT_EQ(0xaa, f32.get<int>());
+}
+
+TEST_F(ActionsTest, CompiledAssign) {
+  auto primitive_assign = ActionOpcodesMap::get_instance()->get_primitive(
+      "assign");
+
+  testActionFn.push_back_primitive(primitive_assign.get());
+  testActionFn.parameter_push_back_field(testHeader2, 0);  // f32
+  testActionFn.parameter_push_back_field(testHeader1, 0);  // f32
+  testActionFn.push_back_primitive(primitive_assign.get());
+  testActionFn.parameter_push_back_field(testHeader2, 3);  // f16
+  testActionFn.parameter_push_back_field(testHeader1, 0);  // f32
+  testActionFn.push_back_primitive(primitive_assign.get());
+  testActionFn.parameter_push_back_field(testHeader2, 2);  // f8
+  testActionFn.parameter_push_back_action_data(0);
+  testActionFn.push_back_primitive(primitive_assign.get());
+  testActionFn.parameter_push_back_field(testHeader2, 4);  // f128
+  testActionFn.parameter_push_back_const(Data("0x0102030405060708090a"));
+  testActionFn.compile();
+  testActionFnEntry.push_back_action_data(0x1ab);
+
+  phv->get_field(testHeader1, 0).set(0xabcdef12);
+
+  testActionFnEntry(pkt.get());
+
+  const auto &f32 = phv->get_field(testHeader2, 0);
+  const auto &f16 = phv->get_field(testHeader2, 3);
+  const auto &f8 = phv->get_field(testHeader2, 2);
+  const auto &f128 = phv->get_field(testHeader2, 4);
+  EXPECT_EQ(0xabcdef12u, f32.get_uint());
+  EXPECT_EQ(ByteContainer("0xabcdef12"), f32.get_bytes());
+  EXPECT_EQ(0xef12u, f16.get_uint());
+  EXPECT_EQ(ByteContainer("0xef12"), f16.get_bytes());
+  EXPECT_EQ(0xabu, f8.get_uint());
+  EXPECT_EQ(Data("0x0102030405060708090a"), f128);
+}
+
+namespace {
+
+// counts how many times each implementation is used
+class FusedIncrement : public ActionPrimitive<Field &> {
+ public:
+  void operator ()(Field &f) override {
+    f.add(f, Data(1));
+    interpreted++;
+  }
+
+  bool fuse(const ActionParam *args, ActionFusedOp *op) override {
+    if (!enable_fuse) return false;
+    op->bound[0] = args[0];
+    op->fn = [](const ActionFusedOp &op, ActionEngineState *state,
+                const ActionParam *) {
+      Field &f = state->phv.get_field(op.bound[0].field.header,
+                                      op.bound[0].field.field_offset);
+      f.add(f, Data(1));
+      fused++;
+    };
+    return true;
+  }
+
+  bool enable_fuse{true};
+  int interpreted{0};
+  static int fused;
+};
+
+int FusedIncrement::fused = 0;
+
+}  // namespace
+
+TEST_F(ActionsTest, CompiledCustomPrimitive) {
+  FusedIncrement primitive;
+  FusedIncrement::fused = 0;
+  testActionFn.push_back_primitive(&primitive);
+  testActionFn.parameter_push_back_field(testHeader1, 3);  // f16
+  testActionFn.push_back_primitive(&primitive);
+  testActionFn.parameter_push_back_field(testHeader1, 3);  // f16
+  auto &f16 = phv->get_field(testHeader1, 3);
+  f16.set(0);
+
+  // not compiled yet
+  testActionFnEntry(pkt.get());
+  EXPECT_EQ(2u, f16.get_uint());
+  EXPECT_EQ(2, primitive.interpreted);
+  EXPECT_EQ(0, FusedIncrement::fused);
+
+  testActionFn.compile();
+  testActionFnEntry(pkt.get());
+  EXPECT_EQ(4u, f16.get_uint());
+  EXPECT_EQ(2, primitive.interpreted);
+  EXPECT_EQ(2, FusedIncrement::fused);
+
+  // pushing a new primitive discards the compiled sequence
+  primitive.enable_fuse = false;
+  testActionFn.push_back_primitive(&primitive);
+  testActionFn.parameter_push_back_field(testHeader1, 3);  // f16
+  EXPECT_FALSE(testActionFn.is_compiled());
+  testActionFn.compile();
+  testActionFnEntry(pkt.get());
+  EXPECT_EQ(7u, f16.get_uint());
+  EXPECT_EQ(5, primitive.interpreted);
+  EXPECT_EQ(2, FusedIncrement::fused);
+}
+
 template <typename Primitive>
 class ActionsStringParamTest : public ActionsTest {
  protected:
@@ -953,3 +1089,125 @@ TEST_F(ActionsTestRegisterProtection, SequentialAdvanced) {
   ASSERT_LT(expected_timedelta * 0.95, timedelta);
   ASSERT_GT(expected_timedelta * 1.2, timedelta);
 }
+
+// accesses a single index through the per-index RegisterArray methods and opts
+// out of the action-wide register lock
+class IndexedAddAndSpin
+  : public ActionPrimitive<RegisterArray &, const Data &, const Data &> {
+  void operator ()(RegisterArray &register_array, const Data &idx,
+                   const Data &ts) {
+    register_array.fetch_add(idx.get_uint(), 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(ts.get_uint()));
+  }
+
+  bool manages_register_sync() const override { return true; }
+};
+
+// the actions reference the same register, but only through a primitive which
+// accesses distinct indices, so parallel execution
+TEST_F(ActionsTestRegisterProtection, ParallelIndexed) {
+  IndexedAddAndSpin primitive;
+  ActionFn action_fn_a("indexed_a", 2, 0);
+  ActionFn action_fn_b("indexed_b", 3, 0);
+  unsigned int idx = 0;
+  for (auto action_fn : {&action_fn_a, &action_fn_b}) {
+    action_fn->push_back_primitive(&primitive);
+    action_fn->parameter_push_back_register_array(&register_array_1);
+    action_fn->parameter_push_back_const(Data(idx++));
+    action_fn->parameter_push_back_const(Data(msecs_to_sleep));
+  }
+  ActionFnEntry entry_a(&action_fn_a);
+  ActionFnEntry entry_b(&action_fn_b);
+
+  ASSERT_TRUE(register_array_1.set_sync_mode(
+      RegisterArray::SyncMode::STRIPED));
+
+  using clock = std::chrono::system_clock;
+  clock::time_point start = clock::now();
+
+  std::thread t(&ActionFnEntry::operator(), &entry_a, pkt.get());
+  entry_b(pkt.get());
+  t.join();
+
+  clock::time_point end = clock::now();
+
+  auto timedelta = std::chrono::duration_cast<std::chrono::milliseconds>(
+      end - start).count();
+
+  ASSERT_EQ(1u, register_array_1.load(0));
+  ASSERT_EQ(1u, register_array_1.load(1));
+
+  constexpr unsigned int expected_timedelta = msecs_to_sleep;
+
+  ASSERT_LT(expected_timedelta * 0.95, timedelta);
+  ASSERT_GT(expected_timedelta * 1.2, timedelta);
+}
+
+// the same action uses the array through both a legacy primitive (which
+// requires the action-wide lock) and the per-index methods: the per-index
+// methods must not try to acquire the lock a second time
+TEST_F(ActionsTestRegisterProtection, MixedAccess) {
+  IndexedAddAndSpin primitive;
+  ActionFn action_fn("mixed", 2, 0);
+  configure_one_action(&action_fn, &register_array_1);
+  action_fn.push_back_primitive(&primitive);
+  action_fn.parameter_push_back_register_array(&register_array_1);
+  action_fn.parameter_push_back_const(Data(1));
+  action_fn.parameter_push_back_const(Data(0));
+  ActionFnEntry entry(&action_fn);
+
+  for (auto mode : {RegisterArray::SyncMode::ARRAY_LOCK,
+                    RegisterArray::SyncMode::STRIPED}) {
+    ASSERT_TRUE(register_array_1.set_sync_mode(mode, 4));
+    register_array_1.store(1, 0);
+    entry(pkt.get());
+    ASSERT_EQ(1u, register_array_1.load(1));
+    ASSERT_EQ(msecs_to_sleep, register_array_1.load(0));
+  }
+}
+
+// the actions reference distinct registers of the same array with a constant
+// index: they are executed sequentially if the array has a single lock, and in
+// parallel if the registers belong to different stripes
+TEST_F(ActionsTestRegisterProtection, RegisterRefModes) {
+  SetAndSpin primitive;
+  ActionFn action_fn_a("ref_a", 2, 0);
+  ActionFn action_fn_b("ref_b", 3, 0);
+  unsigned int idx = 0;
+  for (auto action_fn : {&action_fn_a, &action_fn_b}) {
+    action_fn->push_back_primitive(&primitive);
+    action_fn->parameter_push_back_register_ref(&register_array_1, idx++);
+    action_fn->parameter_push_back_const(Data(0xab));
+    action_fn->parameter_push_back_const(Data(msecs_to_sleep));
+  }
+  ActionFnEntry entry_a(&action_fn_a);
+  ActionFnEntry entry_b(&action_fn_b);
+
+  using SyncMode = RegisterArray::SyncMode;
+  for (auto mode : {SyncMode::ARRAY_LOCK, SyncMode::STRIPED}) {
+    ASSERT_TRUE(register_array_1.set_sync_mode(mode, 4));
+    register_array_1.store(0, 0);
+    register_array_1.store(1, 0);
+
+    using clock = std::chrono::system_clock;
+    clock::time_point start = clock::now();
+
+    std::thread t(&ActionFnEntry::operator(), &entry_a, pkt.get());
+    entry_b(pkt.get());
+    t.join();
+
+    clock::time_point end = clock::now();
+
+    auto timedelta = std::chrono::duration_cast<std::chrono::milliseconds>(
+        end - start).count();
+
+    ASSERT_EQ(0xabu, register_array_1.load(0));
+    ASSERT_EQ(0xabu, register_array_1.load(1));
+
+    const unsigned int expected_timedelta =
+        (mode == SyncMode::ARRAY_LOCK) ? msecs_to_sleep * 2 : msecs_to_sleep;
+
+    ASSERT_LT(expected_timedelta * 0.95, timedelta);
+    ASSERT_GT(expected_timedelta * 1.2, timedelta);
+  }
+}
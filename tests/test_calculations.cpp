@@ -260,6 +260,56 @@ TEST_F(CalculationTest, WithPayload) {
   ASSERT_EQ(expected, actual);
 }
 
+// the first packet has both headers valid (pre-computed copy plan is used),
+// the second one only has the first header valid (we need to fall back to the
+// generic deparsing code)
+TEST_F(CalculationTest, InvalidHeader) {
+  BufBuilder builder;
+
+  builder.push_back_field(testHeader1, 0);  // f16
+  builder.push_back_field(testHeader2, 4);  // f5
+  builder.push_back_field(testHeader1, 3);  // f32_2
+
+  Calculation calc(builder, "xxh64");
+
+  unsigned char pkt_buf[2 * header_size];
+
+  for (size_t i = 0; i < sizeof(pkt_buf); i++) {
+    pkt_buf[i] = dis(gen);
+  }
+
+  Packet pkt = get_pkt((const char *) pkt_buf, sizeof(pkt_buf));
+  parser.parse(&pkt);
+
+  const uint64_t f5 = pkt_buf[header_size + 16] >> 3;
+  uint64_t f32_2 = 0;
+  for (size_t i = 12; i < 16; i++) f32_2 = (f32_2 << 8) | pkt_buf[i];
+
+  {
+    // f16, f5, f32_2: 53 bits -> 7 bytes
+    unsigned char buf[7];
+    std::copy(&pkt_buf[0], &pkt_buf[2], &buf[0]);
+    uint64_t v = (f5 << 32) | f32_2;
+    v <<= 3;  // padding at the end
+    for (int i = 0; i < 5; i++)
+      buf[2 + i] = static_cast<unsigned char>(v >> (8 * (4 - i)));
+    auto expected = hash::xxh64(reinterpret_cast<const char *>(buf),
+                                sizeof(buf));
+    ASSERT_EQ(expected, calc.output(pkt));
+  }
+
+  pkt.get_phv()->get_header(testHeader2).mark_invalid();
+
+  {
+    unsigned char buf[6];
+    std::copy(&pkt_buf[0], &pkt_buf[2], &buf[0]);
+    std::copy(&pkt_buf[12], &pkt_buf[16], &buf[2]);
+    auto expected = hash::xxh64(reinterpret_cast<const char *>(buf),
+                                sizeof(buf));
+    ASSERT_EQ(expected, calc.output(pkt));
+  }
+}
+
 // this test helped catch a bug in Field::deparse (for some alignments,
 // deparsing was overwriting previous bits)
 TEST_F(CalculationTest, Extra) {
@@ -21,8 +21,10 @@
 #include <gtest/gtest.h>
 
 #include <bm/bm_sim/actions.h>
+#include <bm/bm_sim/conditionals.h>
 #include <bm/bm_sim/control_action.h>
 #include <bm/bm_sim/packet.h>
+#include <bm/bm_sim/pipeline.h>
 
 using namespace bm;
 
@@ -82,3 +84,108 @@ TEST_F(ControlActionTest, Call) {
   EXPECT_EQ(&dummy_next_node, next_node);
   EXPECT_EQ(1u, count_primitive.get());
 }
+
+namespace {
+
+// forwards the packet to the next node, without any processing
+struct ForwardNode : public ControlFlowNode {
+  explicit ForwardNode(const ControlFlowNode *next)
+      : ControlFlowNode("forward", 0), next(next) { }
+
+  const ControlFlowNode *operator()(Packet *) const override {
+    visits++;
+    return next;
+  }
+
+  const ControlFlowNode *next;
+  mutable int visits{0};
+};
+
+}  // namespace
+
+// the pipeline implements:
+// if (h.f8 == 1) { a(); } else { b(); forward(); }
+// if (h.f8 != 2) { c(); }
+class PipelineTest : public ::testing::TestWithParam<bool> {
+ protected:
+  count count_a, count_b, count_c;
+  ActionFn action_a, action_b, action_c;
+  ControlAction call_a, call_b, call_c;
+  Conditional cond_1, cond_2;
+  ForwardNode forward;
+  Pipeline pipeline;
+
+  PHVFactory phv_factory;
+  HeaderType testHeaderType;
+  header_id_t testHeader{0};
+  std::unique_ptr<PHVSourceIface> phv_source{nullptr};
+
+  PipelineTest()
+      : action_a("a", 0, 0), action_b("b", 1, 0), action_c("c", 2, 0),
+        call_a("call_a", 0), call_b("call_b", 1), call_c("call_c", 2),
+        cond_1("cond_1", 0), cond_2("cond_2", 1),
+        forward(&cond_2),
+        pipeline("pipeline", 0, &cond_1),
+        testHeaderType("test_t", 0),
+        phv_source(PHVSourceIface::make_phv_source()) {
+    testHeaderType.push_back_field("f8", 8);
+    phv_factory.push_back_header("h", testHeader, testHeaderType);
+  }
+
+  virtual void SetUp() {
+    action_a.push_back_primitive(&count_a);
+    action_b.push_back_primitive(&count_b);
+    action_c.push_back_primitive(&count_c);
+    call_a.set_action(&action_a);
+    call_b.set_action(&action_b);
+    call_c.set_action(&action_c);
+
+    cond_1.push_back_load_field(testHeader, 0);
+    cond_1.push_back_load_const(Data(1));
+    cond_1.push_back_op(ExprOpcode::EQ_DATA);
+    cond_1.build();
+    cond_1.set_next_node_if_true(&call_a);
+    cond_1.set_next_node_if_false(&call_b);
+    call_a.set_next_node(&cond_2);
+    call_b.set_next_node(&forward);
+
+    cond_2.push_back_load_field(testHeader, 0);
+    cond_2.push_back_load_const(Data(2));
+    cond_2.push_back_op(ExprOpcode::NEQ_DATA);
+    cond_2.build();
+    cond_2.set_next_node_if_true(&call_c);
+
+    phv_source->set_phv_factory(0, &phv_factory);
+
+    if (GetParam()) pipeline.compile();
+  }
+
+  void apply(int f8) {
+    auto pkt = Packet::make_new(64, PacketBuffer(128), phv_source.get());
+    pkt.get_phv()->get_field(testHeader, 0).set(f8);
+    pipeline.apply(&pkt);
+  }
+};
+
+TEST_P(PipelineTest, Apply) {
+  apply(1);
+  EXPECT_EQ(1u, count_a.get());
+  EXPECT_EQ(0u, count_b.get());
+  EXPECT_EQ(1u, count_c.get());
+  EXPECT_EQ(0, forward.visits);
+
+  apply(2);
+  EXPECT_EQ(1u, count_a.get());
+  EXPECT_EQ(1u, count_b.get());
+  EXPECT_EQ(1u, count_c.get());
+  EXPECT_EQ(1, forward.visits);
+
+  apply(3);
+  EXPECT_EQ(1u, count_a.get());
+  EXPECT_EQ(2u, count_b.get());
+  EXPECT_EQ(2u, count_c.get());
+  EXPECT_EQ(2, forward.visits);
+}
+
+INSTANTIATE_TEST_CASE_P(PipelineTestCompiled, PipelineTest,
+                        ::testing::Bool());
@@ -17,20 +17,26 @@
 
 #include <bm/bm_sim/dev_mgr.h>
 #include <bm/bm_sim/port_monitor.h>
+#include <bm/bm_sim/shm_ring.h>
 #include <bm/bm_apps/packet_pipe.h>
+#include <bm/bm_apps/shm_packet_pipe.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
+#include <cstring>
 #include <iostream>
 #include <map>
 #include <unordered_map>
 #include <thread>
 #include <mutex>
+#include <numeric>
 #include <condition_variable>
 #include <string>
 #include <vector>
 
+#include "tx_batcher.h"
 #include "utils.h"
 
 using namespace bm;
@@ -255,6 +261,110 @@ class PacketInReceiver {
   mutable std::condition_variable can_read{};
 };
 
+// the rings do not trust the indices written by the other side
+TEST(ShmRing, InvalidIndices) {
+  constexpr uint32_t nb_slots = 4;
+  constexpr uint32_t slot_size = 64;
+  std::vector<char> slots(nb_slots * slot_size);
+  const char data[] = {'\x0a', '\xba'};
+  const ShmRing::MsgDesc msg{ShmPacketChannel::MSG_TYPE_PACKET_IN, 1,
+                             sizeof(data), data};
+  size_t nb_msgs = 0;
+  auto count = [&nb_msgs](const ShmRing::ShmMsgHdr &, const char *) {
+    nb_msgs++;
+  };
+
+  {
+    ShmRing::Indices indices{};
+    ShmRing producer(&indices, slots.data(), nb_slots, slot_size);
+    ShmRing consumer(&indices, slots.data(), nb_slots, slot_size);
+    ASSERT_EQ(1u, producer.push_batch(&msg, 1));
+    ASSERT_EQ(1u, consumer.pop_batch(16, count));
+    ASSERT_EQ(1u, nb_msgs);
+    // the producer claims to have written more messages than there are slots
+    indices.head += nb_slots + 1;
+    ASSERT_EQ(0u, consumer.pop_batch(16, count));
+    ASSERT_TRUE(consumer.has_peer_error());
+    ASSERT_EQ(1u, nb_msgs);
+    // the error is sticky
+    indices.head = 1;
+    ASSERT_EQ(0u, consumer.pop_batch(16, count));
+  }
+
+  {
+    ShmRing::Indices indices{};
+    ShmRing producer(&indices, slots.data(), nb_slots, slot_size);
+    ShmRing consumer(&indices, slots.data(), nb_slots, slot_size);
+    ASSERT_EQ(1u, producer.push_batch(&msg, 1));
+    ASSERT_EQ(1u, consumer.pop_batch(16, count));
+    // the producer index goes back
+    indices.head = 0;
+    ASSERT_EQ(0u, consumer.pop_batch(16, count));
+    ASSERT_TRUE(consumer.has_peer_error());
+  }
+
+  {
+    ShmRing::Indices indices{};
+    ShmRing producer(&indices, slots.data(), nb_slots, slot_size);
+    for (uint32_t i = 0; i < nb_slots; i++)
+      ASSERT_EQ(1u, producer.push_batch(&msg, 1));
+    // the consumer claims to have consumed messages which were never written
+    indices.tail = nb_slots + 1;
+    ASSERT_EQ(0u, producer.push_batch(&msg, 1));
+    ASSERT_TRUE(producer.has_peer_error());
+    // the shared index is only written by the consumer, our copy is not
+    ASSERT_EQ(nb_slots, indices.head);
+  }
+}
+
+// used by the af_packet device manager to decide when to notify the kernel of
+// the packets written to the TX ring
+TEST(TxBatcher, BatchAndFlush) {
+  using clock = TxBatcher::clock;
+  constexpr auto max_delay = std::chrono::milliseconds(1);
+  TxBatcher batcher(4, max_delay);
+  const auto t0 = clock::now();
+
+  ASSERT_FALSE(batcher.expired(t0 + max_delay));
+  for (int i = 0; i < 3; i++) ASSERT_FALSE(batcher.add(t0));
+  ASSERT_EQ(3u, batcher.get_pending());
+  // the batch is full
+  ASSERT_TRUE(batcher.add(t0));
+  batcher.flushed();
+  ASSERT_EQ(0u, batcher.get_pending());
+  ASSERT_FALSE(batcher.expired(t0 + max_delay));
+
+  // the delay is counted from the oldest pending packet
+  ASSERT_FALSE(batcher.add(t0));
+  ASSERT_FALSE(batcher.add(t0 + max_delay / 2));
+  ASSERT_FALSE(batcher.expired(t0 + max_delay / 2));
+  ASSERT_TRUE(batcher.expired(t0 + max_delay));
+  batcher.flushed();
+  ASSERT_FALSE(batcher.expired(t0 + 2 * max_delay));
+}
+
+TEST(TxBatcher, NoBatching) {
+  TxBatcher batcher(1, std::chrono::milliseconds(1));
+  ASSERT_TRUE(batcher.add(TxBatcher::clock::now()));
+  batcher.flushed();
+  // 0 is the same as 1
+  TxBatcher batcher_0(0, std::chrono::milliseconds(1));
+  ASSERT_TRUE(batcher_0.add(TxBatcher::clock::now()));
+}
+
+// is here because DevMgr has a protected destructor
+class ShmSwitch : public DevMgr { };
+
+TEST(ShmDevMgr, CreateError) {
+  ShmSwitch sw;
+  // not a valid POSIX shared memory object name
+  ASSERT_EQ(DevMgr::ReturnCode::ERROR,
+            sw.set_dev_mgr_shm(0, "/invalid/name"));
+  // no device manager was set, another one can be used instead
+  ASSERT_EQ(DevMgr::ReturnCode::SUCCESS,
+            sw.set_dev_mgr_shm(0, "/test_shm_create_error_abc123"));
+}
+
 #ifdef BMNANOMSG_ON
 
 // is here because DevMgr has a protected destructor
@@ -445,6 +555,203 @@ TEST_F(PacketInDevMgrPortStatusTest, Status) {
   check_and_reset_counts(0u, 1u, 0u, 0u);
 }
 
+class ShmDevMgrTest : public ::testing::Test {
+ protected:
+  static constexpr size_t kMaxBufferSize = 512;
+  static constexpr unsigned int kNbSlots = 256;
+
+  // packets carry their sequence number
+  struct SeqReceiver {
+    void receive(int port_num, const char *buffer, int len, void *cookie) {
+      (void) port_num;
+      (void) cookie;
+      uint32_t seq;
+      if (len != sizeof(seq)) return;
+      std::memcpy(&seq, buffer, sizeof(seq));
+      if (seq != count) in_order = false;
+      count++;
+    }
+
+    bool wait_for(uint32_t expected, unsigned int timeout_ms = 5000) {
+      for (unsigned int i = 0; i < timeout_ms && count < expected; i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      return count == expected;
+    }
+
+    std::atomic<uint32_t> count{0};
+    std::atomic<bool> in_order{true};
+  };
+
+  ShmDevMgrTest()
+      : packet_inject(shm_name) { }
+
+  void SetUp_(bool enforce_ports) {
+    // 0 is device id
+    sw.set_dev_mgr_shm(0, shm_name, nullptr, enforce_ports, kNbSlots);
+    sw.start();
+    ASSERT_TRUE(packet_inject.start());
+  }
+
+  virtual void SetUp() {
+    SetUp_(false);
+  }
+
+  void set_receivers(PacketInReceiver *r_switch, PacketInReceiver *r_lib) {
+    using std::placeholders::_1; using std::placeholders::_2;
+    using std::placeholders::_3; using std::placeholders::_4;
+    sw.set_packet_handler(
+        std::bind(&PacketInReceiver::receive, r_switch, _1, _2, _3, _4),
+        nullptr);
+    packet_inject.set_packet_receiver(
+        std::bind(&PacketInReceiver::receive, r_lib, _1, _2, _3, _4),
+        nullptr);
+  }
+
+  void set_receivers(SeqReceiver *r_switch, SeqReceiver *r_lib) {
+    using std::placeholders::_1; using std::placeholders::_2;
+    using std::placeholders::_3; using std::placeholders::_4;
+    sw.set_packet_handler(
+        std::bind(&SeqReceiver::receive, r_switch, _1, _2, _3, _4), nullptr);
+    packet_inject.set_packet_receiver(
+        std::bind(&SeqReceiver::receive, r_lib, _1, _2, _3, _4), nullptr);
+  }
+
+  bool check_recv(PacketInReceiver *receiver,
+                  int send_port, const char *send_buffer, size_t size,
+                  unsigned int timeout_ms = 1000) {
+    char recv_buffer[kMaxBufferSize];
+    memset(recv_buffer, 0, sizeof(recv_buffer));
+    if (size > sizeof(recv_buffer)) return false;
+    int recv_port = -1;
+    if (!receiver->read(recv_buffer, size, &recv_port, timeout_ms))
+      return false;
+    if (recv_port != send_port) return false;
+    return !memcmp(recv_buffer, send_buffer, size);
+  }
+
+  const std::string shm_name = "/test_shm_packet_in_abc123";
+
+  ShmSwitch sw;
+
+  bm_apps::ShmPacketInject packet_inject;
+};
+
+TEST_F(ShmDevMgrTest, PacketInTest) {
+  PacketInReceiver recv_switch{kMaxBufferSize};
+  PacketInReceiver recv_lib{kMaxBufferSize};
+  set_receivers(&recv_switch, &recv_lib);
+  constexpr int port = 2;
+  const char pkt[] = {'\x0a', '\xba'};
+  // switch -> lib
+  sw.transmit_fn(port, pkt, sizeof(pkt));
+  ASSERT_TRUE(check_recv(&recv_lib, port, pkt, sizeof(pkt)));
+  ASSERT_EQ(PacketInReceiver::Status::CAN_RECEIVE, recv_switch.check_status());
+  // lib -> switch
+  ASSERT_TRUE(packet_inject.send(port, pkt, sizeof(pkt)));
+  ASSERT_TRUE(check_recv(&recv_switch, port, pkt, sizeof(pkt)));
+  ASSERT_EQ(PacketInReceiver::Status::CAN_RECEIVE, recv_lib.check_status());
+}
+
+TEST_F(ShmDevMgrTest, Batch) {
+  SeqReceiver recv_switch, recv_lib;
+  set_receivers(&recv_switch, &recv_lib);
+  constexpr int port = 1;
+  // many more packets than there are slots in the rings
+  constexpr uint32_t num_pkts = 100000;
+  constexpr size_t batch_size = 32;
+  std::vector<uint32_t> seqs(num_pkts);
+  std::iota(seqs.begin(), seqs.end(), 0);
+  std::vector<bm_apps::ShmPacketInject::Packet> pkts;
+  for (const auto &seq : seqs) {
+    pkts.push_back({port, reinterpret_cast<const char *>(&seq),
+                    static_cast<int>(sizeof(seq))});
+  }
+  size_t sent = 0;
+  while (sent < num_pkts) {
+    const size_t n = std::min(batch_size, num_pkts - sent);
+    const size_t pushed = packet_inject.send_batch(&pkts[sent], n);
+    if (pushed < n) std::this_thread::yield();
+    sent += pushed;
+  }
+  ASSERT_TRUE(recv_switch.wait_for(num_pkts));
+  ASSERT_TRUE(recv_switch.in_order);
+
+  // the switch drops the packets when the ring is full
+  for (uint32_t seq = 0; seq < kNbSlots; seq++)
+    sw.transmit_fn(port, reinterpret_cast<const char *>(&seq), sizeof(seq));
+  ASSERT_TRUE(recv_lib.wait_for(kNbSlots));
+  ASSERT_TRUE(recv_lib.in_order);
+}
+
+TEST_F(ShmDevMgrTest, Errors) {
+  const std::vector<char> big_pkt(packet_inject.get_max_packet_size() + 1);
+  ASSERT_FALSE(packet_inject.send(1, big_pkt.data(), big_pkt.size()));
+  ASSERT_TRUE(packet_inject.send(1, big_pkt.data(), big_pkt.size() - 1));
+
+  bm_apps::ShmPacketInject bad_inject("/test_shm_packet_in_does_not_exist");
+  ASSERT_FALSE(bad_inject.start());
+  ASSERT_EQ(0, bad_inject.get_max_packet_size());
+  const char pkt[] = {'\x0a', '\xba'};
+  ASSERT_FALSE(bad_inject.send(1, pkt, sizeof(pkt)));
+}
+
+// packets whose length (which is written by the external process) does not fit
+// in a slot are dropped
+TEST_F(ShmDevMgrTest, InvalidLength) {
+  PacketInReceiver recv_switch{kMaxBufferSize};
+  PacketInReceiver recv_lib{kMaxBufferSize};
+  set_receivers(&recv_switch, &recv_lib);
+  auto channel = ShmPacketChannel::open(shm_name);
+  ASSERT_NE(nullptr, channel);
+  // packet_inject is the producer of this ring, but it has not sent anything
+  // yet, so we can act as the producer instead
+  ShmRing *ring = channel->to_switch();
+  constexpr int port = 1;
+  const char pkt[] = {'\x0a', '\xba'};
+  const std::vector<ShmRing::MsgDesc> msgs = {
+    {ShmPacketChannel::MSG_TYPE_PACKET_IN, port, ring->max_data_size() + 1,
+     nullptr},
+    {ShmPacketChannel::MSG_TYPE_PACKET_IN, port, 0x80000000u, nullptr},
+    {ShmPacketChannel::MSG_TYPE_PACKET_IN, port, sizeof(pkt), pkt}};
+  ASSERT_EQ(msgs.size(), ring->push_batch(msgs.data(), msgs.size()));
+  // only the valid packet is received
+  ASSERT_TRUE(check_recv(&recv_switch, port, pkt, sizeof(pkt)));
+  ASSERT_EQ(PacketInReceiver::Status::CAN_RECEIVE, recv_switch.check_status());
+}
+
+class ShmDevMgrPortStatusTest : public ShmDevMgrTest {
+ protected:
+  virtual void SetUp() {
+    SetUp_(true);
+  }
+};
+
+TEST_F(ShmDevMgrPortStatusTest, Basic) {
+  PacketInReceiver recv_switch{kMaxBufferSize};
+  PacketInReceiver recv_lib{kMaxBufferSize};
+  set_receivers(&recv_switch, &recv_lib);
+  constexpr int port = 2;
+  const char pkt[] = {'\x0a', '\xba'};
+  ASSERT_TRUE(packet_inject.send(port, pkt, sizeof(pkt)));
+  ASSERT_FALSE(check_recv(&recv_switch, port, pkt, sizeof(pkt), 100));
+  // port messages and packets share the ring and are processed in order
+  packet_inject.port_add(port);
+  ASSERT_TRUE(packet_inject.send(port, pkt, sizeof(pkt)));
+  ASSERT_TRUE(check_recv(&recv_switch, port, pkt, sizeof(pkt)));
+  ASSERT_TRUE(sw.port_is_up(port));
+  packet_inject.port_bring_down(port);
+  ASSERT_TRUE(packet_inject.send(port, pkt, sizeof(pkt)));
+  ASSERT_FALSE(check_recv(&recv_switch, port, pkt, sizeof(pkt), 100));
+  ASSERT_FALSE(sw.port_is_up(port));
+  packet_inject.port_bring_up(port);
+  ASSERT_TRUE(packet_inject.send(port, pkt, sizeof(pkt)));
+  ASSERT_TRUE(check_recv(&recv_switch, port, pkt, sizeof(pkt)));
+  packet_inject.port_remove(port);
+  ASSERT_TRUE(packet_inject.send(port, pkt, sizeof(pkt)));
+  ASSERT_FALSE(check_recv(&recv_switch, port, pkt, sizeof(pkt), 100));
+  ASSERT_EQ(0u, sw.get_port_info().size());
+}
+
 #endif  // BMNANOMSG_ON
 
 struct PMActive { };
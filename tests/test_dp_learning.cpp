@@ -0,0 +1,349 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <bm/bm_sim/ageing.h>
+#include <bm/bm_sim/dp_learning.h>
+#include <bm/bm_sim/match_tables.h>
+#include <bm/bm_sim/phv_source.h>
+#include <bm/bm_sim/transport.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace bm;
+
+// Google Test fixture for data plane learning tests
+class DataPlaneLearningTest : public ::testing::Test {
+ protected:
+  PHVFactory phv_factory;
+
+  MatchKeyBuilder key_builder;
+  std::unique_ptr<MatchTable> table;
+
+  HeaderType testHeaderType;
+  header_id_t testHeader1{0}, testHeader2{1};
+  ActionFn action_fn;
+
+  std::unique_ptr<PHVSourceIface> phv_source{nullptr};
+
+  DataPlaneLearningTest()
+      : testHeaderType("test_t", 0),
+        action_fn("forward", 0, 1),
+        phv_source(PHVSourceIface::make_phv_source()) {
+    testHeaderType.push_back_field("f16", 16);
+    testHeaderType.push_back_field("f48", 48);
+    phv_factory.push_back_header("test1", testHeader1, testHeaderType);
+    phv_factory.push_back_header("test2", testHeader2, testHeaderType);
+
+    key_builder.push_back_field(testHeader1, 1, 48, MatchKeyParam::Type::EXACT);
+
+    using MUExact = MatchUnitExact<ActionEntry>;
+
+    LookupStructureFactory factory;
+
+    std::unique_ptr<MUExact> match_unit(new MUExact(4, key_builder, &factory));
+
+    // counters disabled, ageing enabled
+    table = std::unique_ptr<MatchTable>(
+      new MatchTable("test_table", 0, std::move(match_unit), false, true));
+    table->set_next_node(0, nullptr);
+  }
+
+  virtual void SetUp() {
+    phv_source->set_phv_factory(0, &phv_factory);
+  }
+
+  Packet get_pkt(const std::string &mac, unsigned int port) {
+    // dummy packet, won't be parsed
+    Packet packet = Packet::make_new(128, PacketBuffer(256), phv_source.get());
+    PHV *phv = packet.get_phv();
+    phv->get_header(testHeader1).mark_valid();
+    phv->get_header(testHeader2).mark_valid();
+    phv->get_field(testHeader1, 1).set(mac.data(), mac.size());
+    phv->get_field(testHeader2, 0).set(port);
+    return packet;
+  }
+
+  void add_rule(DataPlaneLearner *learner, unsigned int ttl_ms = 0) {
+    learner->add_rule(table.get(), {{testHeader1, 1}}, &action_fn,
+                      {{testHeader2, 0}}, ttl_ms);
+  }
+
+  // returns the port the MAC was learned on, or -1
+  int learned_port(const std::string &mac) {
+    Packet pkt = get_pkt(mac, 0);
+    bool hit;
+    entry_handle_t handle;
+    table->lookup(pkt, &hit, &handle);
+    if (!hit) return -1;
+    MatchTable::Entry entry;
+    EXPECT_EQ(MatchErrorCode::SUCCESS, table->get_entry(handle, &entry));
+    return entry.action_data.get(0).get_int();
+  }
+};
+
+TEST_F(DataPlaneLearningTest, AddOrRefreshEntry) {
+  std::vector<MatchKeyParam> match_key;
+  match_key.emplace_back(MatchKeyParam::Type::EXACT,
+                         std::string("\x00\x01\x02\x03\x04\x05", 6));
+  ActionData action_data;
+  action_data.push_back_action_data(3);
+  entry_handle_t handle_1, handle_2;
+  bool added;
+
+  ASSERT_EQ(MatchErrorCode::SUCCESS,
+            table->add_or_refresh_entry(match_key, &action_fn, action_data, 0,
+                                        &handle_1, &added));
+  ASSERT_TRUE(added);
+  ASSERT_EQ(1u, table->get_num_entries());
+
+  ASSERT_EQ(MatchErrorCode::SUCCESS,
+            table->add_or_refresh_entry(match_key, &action_fn, action_data,
+                                        1000, &handle_2, &added));
+  ASSERT_FALSE(added);
+  ASSERT_EQ(handle_1, handle_2);
+  MatchTable::Entry entry;
+  ASSERT_EQ(MatchErrorCode::SUCCESS, table->get_entry(handle_1, &entry));
+  ASSERT_EQ(1000u, entry.timeout_ms);
+
+  // the action data is updated
+  ActionData new_action_data;
+  new_action_data.push_back_action_data(4);
+  ASSERT_EQ(MatchErrorCode::SUCCESS,
+            table->add_or_refresh_entry(match_key, &action_fn,
+                                        new_action_data, 1000, &handle_2,
+                                        &added));
+  ASSERT_FALSE(added);
+  ASSERT_EQ(handle_1, handle_2);
+  ASSERT_EQ(MatchErrorCode::SUCCESS, table->get_entry(handle_1, &entry));
+  ASSERT_EQ(4, entry.action_data.get(0).get_int());
+  ASSERT_EQ(1u, table->get_num_entries());
+
+  ASSERT_EQ(MatchErrorCode::BAD_ACTION_DATA,
+            table->add_or_refresh_entry(match_key, &action_fn, ActionData(),
+                                        0, &handle_2, &added));
+}
+
+TEST_F(DataPlaneLearningTest, AgeingDisabled) {
+  using MUExact = MatchUnitExact<ActionEntry>;
+  LookupStructureFactory factory;
+  std::unique_ptr<MUExact> match_unit(new MUExact(4, key_builder, &factory));
+  MatchTable table_no_ageing("test_table_2", 1, std::move(match_unit));
+
+  std::vector<MatchKeyParam> match_key;
+  match_key.emplace_back(MatchKeyParam::Type::EXACT, std::string(6, '\x00'));
+  ActionData action_data;
+  action_data.push_back_action_data(1);
+  entry_handle_t handle;
+  bool added;
+  ASSERT_EQ(MatchErrorCode::AGEING_DISABLED,
+            table_no_ageing.add_or_refresh_entry(
+                match_key, &action_fn, action_data, 1000, &handle, &added));
+}
+
+TEST_F(DataPlaneLearningTest, Learn) {
+  DataPlaneLearner learner;
+  add_rule(&learner, 1000);
+
+  const std::string mac_1("\x0a\x0b\x0c\x0d\x0e\x01", 6);
+  const std::string mac_2("\x0a\x0b\x0c\x0d\x0e\x02", 6);
+  ASSERT_EQ(-1, learned_port(mac_1));
+
+  ASSERT_TRUE(learner.learn(get_pkt(mac_1, 1)));
+  ASSERT_EQ(1, learned_port(mac_1));
+  // already learned
+  ASSERT_FALSE(learner.learn(get_pkt(mac_1, 1)));
+  // station moved
+  ASSERT_FALSE(learner.learn(get_pkt(mac_1, 2)));
+  ASSERT_EQ(2, learned_port(mac_1));
+
+  ASSERT_TRUE(learner.learn(get_pkt(mac_2, 3)));
+  ASSERT_EQ(3, learned_port(mac_2));
+  ASSERT_EQ(2u, table->get_num_entries());
+
+  // invalid key header, rule skipped
+  Packet pkt = get_pkt(std::string(6, '\xff'), 4);
+  pkt.get_phv()->get_header(testHeader1).mark_invalid();
+  ASSERT_FALSE(learner.learn(pkt));
+
+  // table is full
+  for (char c = 0; c < 3; c++)
+    learner.learn(get_pkt(std::string(6, c), 5));
+  ASSERT_EQ(4u, table->get_num_entries());
+
+  const auto stats = learner.get_stats();
+  ASSERT_EQ(4u, stats.added);
+  ASSERT_EQ(2u, stats.refreshed);
+  ASSERT_EQ(0u, stats.rate_limited);
+  ASSERT_EQ(1u, stats.errors);
+}
+
+TEST_F(DataPlaneLearningTest, Ageing) {
+  DataPlaneLearner learner;
+  add_rule(&learner, 100);
+
+  const std::string mac("\x0a\x0b\x0c\x0d\x0e\x01", 6);
+  ASSERT_TRUE(learner.learn(get_pkt(mac, 1)));
+
+  std::vector<entry_handle_t> aged;
+  table->sweep_entries(&aged);
+  ASSERT_TRUE(aged.empty());
+
+  // learning the entry again refreshes its timestamp
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  ASSERT_FALSE(learner.learn(get_pkt(mac, 1)));
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  table->sweep_entries(&aged);
+  ASSERT_TRUE(aged.empty());
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  table->sweep_entries(&aged);
+  ASSERT_EQ(1u, aged.size());
+}
+
+TEST_F(DataPlaneLearningTest, RateLimit) {
+  // 1 event per second, burst of 2
+  DataPlaneLearner learner(1, 2);
+  add_rule(&learner);
+
+  for (char c = 0; c < 4; c++)
+    learner.learn(get_pkt(std::string(6, c), 1));
+  ASSERT_EQ(2u, table->get_num_entries());
+  const auto stats = learner.get_stats();
+  ASSERT_EQ(2u, stats.added);
+  ASSERT_EQ(2u, stats.rate_limited);
+}
+
+TEST_F(DataPlaneLearningTest, RemoveAgedEntries) {
+  DataPlaneLearner learner;
+  add_rule(&learner, 50);
+
+  const std::string mac_1("\x0a\x0b\x0c\x0d\x0e\x01", 6);
+  const std::string mac_2("\x0a\x0b\x0c\x0d\x0e\x02", 6);
+  ASSERT_TRUE(learner.learn(get_pkt(mac_1, 1)));
+  ASSERT_TRUE(learner.learn(get_pkt(mac_2, 2)));
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  std::vector<entry_handle_t> aged;
+  table->sweep_entries(&aged);
+  ASSERT_EQ(2u, aged.size());
+
+  // not one of the learner's tables
+  using MUExact = MatchUnitExact<ActionEntry>;
+  LookupStructureFactory factory;
+  std::unique_ptr<MUExact> match_unit(new MUExact(4, key_builder, &factory));
+  MatchTable other_table("other_table", 1, std::move(match_unit));
+  ASSERT_EQ(0u, learner.remove_aged_entries(&other_table, aged));
+  ASSERT_EQ(2u, table->get_num_entries());
+
+  // mac_2 is learned again after the sweep and is not removed
+  ASSERT_FALSE(learner.learn(get_pkt(mac_2, 2)));
+  ASSERT_EQ(1u, learner.remove_aged_entries(table.get(), aged));
+  ASSERT_EQ(-1, learned_port(mac_1));
+  ASSERT_EQ(2, learned_port(mac_2));
+  ASSERT_EQ(1u, learner.get_stats().aged_out);
+
+  // mac_1 can be learned again
+  ASSERT_TRUE(learner.learn(get_pkt(mac_1, 3)));
+  ASSERT_EQ(3, learned_port(mac_1));
+}
+
+// entries learned with the same key by different rules age as one unit, even
+// if one of them keeps on being hit (e.g. smac and dmac in l2_switch)
+TEST_F(DataPlaneLearningTest, RemoveLinkedEntries) {
+  using MUExact = MatchUnitExact<ActionEntry>;
+  LookupStructureFactory factory;
+  std::unique_ptr<MUExact> match_unit(new MUExact(4, key_builder, &factory));
+  MatchTable src_table("src_table", 1, std::move(match_unit), false, true);
+  src_table.set_next_node(1, nullptr);
+  ActionFn nop("nop", 1, 0);
+
+  DataPlaneLearner learner;
+  learner.add_rule(&src_table, {{testHeader1, 1}}, &nop, {}, 50);
+  add_rule(&learner, 50);
+
+  const std::string mac("\x0a\x0b\x0c\x0d\x0e\x01", 6);
+  ASSERT_TRUE(learner.learn(get_pkt(mac, 1)));
+  ASSERT_EQ(1u, src_table.get_num_entries());
+  ASSERT_EQ(1u, table->get_num_entries());
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  // the source entry is hit, but the other one expires
+  bool hit;
+  entry_handle_t handle;
+  src_table.lookup(get_pkt(mac, 1), &hit, &handle);
+  ASSERT_TRUE(hit);
+  std::vector<entry_handle_t> aged;
+  src_table.sweep_entries(&aged);
+  ASSERT_TRUE(aged.empty());
+  table->sweep_entries(&aged);
+  ASSERT_EQ(1u, aged.size());
+
+  ASSERT_EQ(2u, learner.remove_aged_entries(table.get(), aged));
+  ASSERT_EQ(0u, src_table.get_num_entries());
+  ASSERT_EQ(0u, table->get_num_entries());
+  ASSERT_EQ(2u, learner.get_stats().aged_out);
+
+  // so that the next packet from mac triggers learning again
+  ASSERT_TRUE(learner.learn(get_pkt(mac, 2)));
+  ASSERT_EQ(2, learned_port(mac));
+}
+
+// the table does not support ageing initially, as is the case for l2_switch,
+// and the learned entries are removed through the AgeingMonitor callback
+TEST_F(DataPlaneLearningTest, AgeingMonitorCallback) {
+  using MUExact = MatchUnitExact<ActionEntry>;
+  LookupStructureFactory factory;
+  std::unique_ptr<MUExact> match_unit(new MUExact(4, key_builder, &factory));
+  MatchTable table_no_ageing("test_table_2", 1, std::move(match_unit));
+  table_no_ageing.set_next_node(0, nullptr);
+  ASSERT_FALSE(table_no_ageing.has_lookup_side_effects());
+
+  DataPlaneLearner learner;
+  learner.add_rule(&table_no_ageing, {{testHeader1, 1}}, &action_fn,
+                   {{testHeader2, 0}}, 50);
+  const std::string mac("\x0a\x0b\x0c\x0d\x0e\x01", 6);
+  // ttl requires ageing support
+  ASSERT_FALSE(learner.learn(get_pkt(mac, 1)));
+  ASSERT_EQ(1u, learner.get_stats().errors);
+
+  table_no_ageing.enable_ageing();
+  ASSERT_TRUE(table_no_ageing.has_lookup_side_effects());
+  auto ageing_monitor = AgeingMonitorIface::make(
+      0, 0, TransportIface::make_dummy(), 10);
+  ageing_monitor->add_table(&table_no_ageing);
+  ageing_monitor->register_ageing_cb(
+      [&learner](MatchTableAbstract *table,
+                 const std::vector<entry_handle_t> &handles) {
+        learner.remove_aged_entries(table, handles);
+      });
+
+  ASSERT_TRUE(learner.learn(get_pkt(mac, 1)));
+  ASSERT_EQ(1u, table_no_ageing.get_num_entries());
+  for (int i = 0; i < 100 && table_no_ageing.get_num_entries() > 0; i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  ASSERT_EQ(0u, table_no_ageing.get_num_entries());
+  ASSERT_EQ(1u, learner.get_stats().aged_out);
+}
@@ -0,0 +1,237 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <bm/bm_sim/event_logger.h>
+#include <bm/bm_sim/packet.h>
+#include <bm/bm_sim/phv.h>
+#include <bm/bm_sim/phv_source.h>
+#include <bm/bm_sim/transport.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace bm;
+
+namespace {
+
+// records the type and packet id of every message sent
+class TransportRecorder : public TransportIface {
+ public:
+  struct Msg {
+    int type;
+    uint64_t packet_id;
+  };
+
+  std::vector<Msg> get_msgs() const {
+    std::unique_lock<std::mutex> lock(mutex);
+    return msgs;
+  }
+
+  // while blocked, send() does not return
+  void set_blocked(bool b) {
+    std::unique_lock<std::mutex> lock(mutex);
+    blocked = b;
+    unblocked.notify_all();
+  }
+
+ private:
+  int open_() override { return 0; }
+
+  int send_(const std::string &msg) const override {
+    return send_(msg.data(), static_cast<int>(msg.size()));
+  }
+
+  int send_(const char *msg, int len) const override {
+    // see msg_hdr_t in event_logger.cpp
+    static constexpr int hdr_size = 3 * sizeof(int) + 3 * sizeof(uint64_t);
+    EXPECT_GE(len, hdr_size);
+    Msg m;
+    std::memcpy(&m.type, msg, sizeof(m.type));
+    std::memcpy(&m.packet_id, msg + 3 * sizeof(int) + sizeof(uint64_t),
+                sizeof(m.packet_id));
+    std::unique_lock<std::mutex> lock(mutex);
+    unblocked.wait(lock, [this] { return !blocked; });
+    msgs.push_back(m);
+    return 0;
+  }
+
+  int send_msgs_(
+      const std::initializer_list<std::string> &msgs) const override {
+    for (const auto &msg : msgs) send_(msg);
+    return 0;
+  }
+
+  int send_msgs_(const std::initializer_list<MsgBuf> &msgs) const override {
+    for (const auto &msg : msgs) send_(msg.buf, msg.len);
+    return 0;
+  }
+
+  mutable std::mutex mutex{};
+  mutable std::condition_variable unblocked{};
+  mutable std::vector<Msg> msgs{};
+  bool blocked{false};
+};
+
+}  // namespace
+
+class EventLoggerTest : public ::testing::Test {
+ protected:
+  PHVFactory phv_factory;
+  std::unique_ptr<PHVSourceIface> phv_source{nullptr};
+  TransportRecorder *transport{nullptr};
+  std::unique_ptr<EventLogger> event_logger{nullptr};
+
+  EventLoggerTest()
+      : phv_source(PHVSourceIface::make_phv_source()) { }
+
+  virtual void SetUp() {
+    phv_source->set_phv_factory(0, &phv_factory);
+    transport = new TransportRecorder();
+    event_logger.reset(new EventLogger(
+        std::unique_ptr<TransportIface>(transport)));
+  }
+
+  Packet get_pkt(packet_id_t id) {
+    return Packet::make_new(0, 0, id, 0, 0, PacketBuffer(64),
+                            phv_source.get());
+  }
+
+  // waits for the background thread to send all the messages
+  std::vector<TransportRecorder::Msg> wait_for_msgs(size_t expected) {
+    using clock = std::chrono::steady_clock;
+    const auto deadline = clock::now() + std::chrono::seconds(5);
+    while (transport->get_msgs().size() < expected && clock::now() < deadline)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return transport->get_msgs();
+  }
+};
+
+TEST_F(EventLoggerTest, Sync) {
+  auto pkt = get_pkt(7);
+  event_logger->packet_in(pkt);
+  event_logger->packet_out(pkt);
+  auto msgs = transport->get_msgs();
+  ASSERT_EQ(2u, msgs.size());
+  EXPECT_EQ(EventLogger::PACKET_IN, msgs[0].type);
+  EXPECT_EQ(EventLogger::PACKET_OUT, msgs[1].type);
+  EXPECT_EQ(7u, msgs[0].packet_id);
+  EXPECT_EQ(2u, event_logger->get_stats().sent);
+}
+
+TEST_F(EventLoggerTest, Sampling) {
+  ASSERT_TRUE(event_logger->set_sampling_rate("packet_in", 4));
+  ASSERT_FALSE(event_logger->set_sampling_rate("bad_event", 4));
+  event_logger->set_sampling_rate(EventLogger::PACKET_OUT, 0);
+  for (packet_id_t id = 0; id < 16; id++) {
+    auto pkt = get_pkt(id);
+    event_logger->packet_in(pkt);
+    event_logger->packet_out(pkt);
+  }
+  auto msgs = transport->get_msgs();
+  ASSERT_EQ(4u, msgs.size());
+  for (size_t i = 0; i < msgs.size(); i++) {
+    EXPECT_EQ(EventLogger::PACKET_IN, msgs[i].type);
+    EXPECT_EQ(i * 4, msgs[i].packet_id);
+  }
+}
+
+TEST_F(EventLoggerTest, Async) {
+  constexpr size_t num_threads = 4;
+  constexpr size_t num_pkts = 100;
+  event_logger->enable_async();
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < num_threads; t++) {
+    threads.emplace_back([this, t] {
+      for (size_t i = 0; i < num_pkts; i++) {
+        auto pkt = get_pkt(t * num_pkts + i);
+        event_logger->packet_in(pkt);
+      }
+    });
+  }
+  for (auto &t : threads) t.join();
+  auto msgs = wait_for_msgs(num_threads * num_pkts);
+  ASSERT_EQ(num_threads * num_pkts, msgs.size());
+  // messages from a given thread are sent in order
+  std::vector<uint64_t> last(num_threads, 0);
+  for (const auto &msg : msgs) {
+    auto t = msg.packet_id / num_pkts;
+    EXPECT_LE(last[t], msg.packet_id);
+    last[t] = msg.packet_id;
+  }
+  auto stats = event_logger->get_stats();
+  EXPECT_EQ(num_threads * num_pkts, stats.sent);
+  EXPECT_EQ(0u, stats.dropped);
+}
+
+// the ring of a thread which exited is re-used by the next thread, and a
+// thread logging to several loggers keeps one ring per logger
+TEST_F(EventLoggerTest, AsyncRingReuse) {
+  constexpr size_t num_threads = 8;
+  event_logger->enable_async();
+  for (size_t t = 0; t < num_threads; t++) {
+    std::thread thread([this, t] { event_logger->packet_in(get_pkt(t)); });
+    thread.join();
+  }
+  wait_for_msgs(num_threads);
+  EXPECT_EQ(1u, event_logger->get_stats().rings);
+
+  auto transport_2 = new TransportRecorder();
+  EventLogger event_logger_2{std::unique_ptr<TransportIface>(transport_2)};
+  event_logger_2.enable_async();
+  for (packet_id_t id = 0; id < 4; id++) {
+    event_logger->packet_in(get_pkt(id));
+    event_logger_2.packet_in(get_pkt(id));
+  }
+  ASSERT_EQ(num_threads + 4, wait_for_msgs(num_threads + 4).size());
+  for (int i = 0; i < 5000 && transport_2->get_msgs().size() < 4; i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  ASSERT_EQ(4u, transport_2->get_msgs().size());
+  // the main thread re-used the ring released by the last thread
+  EXPECT_EQ(1u, event_logger->get_stats().rings);
+  EXPECT_EQ(1u, event_logger_2.get_stats().rings);
+}
+
+TEST_F(EventLoggerTest, AsyncOverflow) {
+  constexpr size_t ring_size = 16;
+  constexpr size_t num_pkts = 10000;
+  event_logger->enable_async(ring_size);
+  // the background thread cannot send anything, so at most ring_size + 1
+  // messages (including the one being sent) can be accepted
+  transport->set_blocked(true);
+  for (size_t i = 0; i < num_pkts; i++) {
+    auto pkt = get_pkt(i);
+    event_logger->packet_in(pkt);
+  }
+  auto stats = event_logger->get_stats();
+  transport->set_blocked(false);
+  // destroying the logger flushes the remaining messages
+  event_logger.reset(nullptr);
+  auto msgs = transport->get_msgs();
+  ASSERT_LE(num_pkts - ring_size - 1, stats.dropped);
+  ASSERT_EQ(num_pkts, msgs.size() + stats.dropped);
+}
@@ -0,0 +1,323 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <bm/bm_sim/actions.h>
+#include <bm/bm_sim/conditionals.h>
+#include <bm/bm_sim/control_action.h>
+#include <bm/bm_sim/flow_cache.h>
+#include <bm/bm_sim/meters.h>
+#include <bm/bm_sim/packet.h>
+#include <bm/bm_sim/pipeline.h>
+#include <bm/bm_sim/tables.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "jsoncpp/json.h"
+
+using namespace bm;
+
+namespace {
+
+struct set_field : public ActionPrimitive<Field &, const Data &> {
+  void operator ()(Field &f, const Data &d) {
+    f.set(d);
+  }
+
+  bool is_flow_cacheable() const override { return true; }
+};
+
+struct add_field : public ActionPrimitive<Field &, const Data &> {
+  void operator ()(Field &f, const Data &d) {
+    f.add(f, d);
+  }
+
+  bool is_flow_cacheable() const override { return true; }
+};
+
+struct invalidate : public ActionPrimitive<Header &> {
+  void operator ()(Header &hdr) {
+    hdr.mark_invalid();
+  }
+
+  bool is_flow_cacheable() const override { return true; }
+};
+
+// not cacheable, as it updates some state outside of the PHV
+struct count : public ActionPrimitive<> {
+  void operator ()() { c++; }
+
+  size_t c{0};
+};
+
+}  // namespace
+
+// the pipeline implements:
+// table fwd {
+//   key = { h.dst : exact; }
+//   actions = { set_port; set_port_count; }
+// }
+// if (meta.port == 3) { strip(); }
+// where set_port(p) does meta.port = p; h.ttl = h.ttl + 255 (i.e. - 1)
+// and strip() invalidates h
+class FlowCacheTest : public ::testing::Test {
+ protected:
+  PHVFactory phv_factory;
+  HeaderType hType, metaType;
+  header_id_t h{0}, meta{1};
+  set_field set_field_primitive;
+  add_field add_field_primitive;
+  invalidate invalidate_primitive;
+  count count_primitive;
+  ActionFn set_port, set_port_count, strip;
+  ControlAction call_strip;
+  Conditional cond;
+  LookupStructureFactory lookup_factory;
+  std::unique_ptr<MatchActionTable> fwd{nullptr};
+  std::unique_ptr<Pipeline> pipeline{nullptr};
+  std::unique_ptr<PHVSourceIface> phv_source{nullptr};
+
+  FlowCacheTest()
+      : hType("h_t", 0), metaType("meta_t", 1),
+        set_port("set_port", 0, 1), set_port_count("set_port_count", 1, 1),
+        strip("strip", 2, 0),
+        call_strip("call_strip", 0), cond("cond", 0),
+        phv_source(PHVSourceIface::make_phv_source()) {
+    hType.push_back_field("dst", 16);
+    hType.push_back_field("src", 16);
+    hType.push_back_field("ttl", 8);
+    metaType.push_back_field("port", 16);
+    phv_factory.push_back_header("h", h, hType);
+    phv_factory.push_back_header("meta", meta, metaType, true);
+  }
+
+  virtual void SetUp() {
+    for (auto action : {&set_port, &set_port_count}) {
+      action->push_back_primitive(&set_field_primitive);
+      action->parameter_push_back_field(meta, 0);
+      action->parameter_push_back_action_data(0);
+      action->push_back_primitive(&add_field_primitive);
+      action->parameter_push_back_field(h, 2);
+      action->parameter_push_back_const(Data(255));
+    }
+    set_port_count.push_back_primitive(&count_primitive);
+    strip.push_back_primitive(&invalidate_primitive);
+    strip.parameter_push_back_header(h);
+    call_strip.set_action(&strip);
+
+    cond.push_back_load_field(meta, 0);
+    cond.push_back_load_const(Data(3));
+    cond.push_back_op(ExprOpcode::EQ_DATA);
+    cond.build();
+    cond.set_next_node_if_true(&call_strip);
+
+    MatchKeyBuilder key_builder;
+    key_builder.push_back_field(h, 0, 16, MatchKeyParam::Type::EXACT);
+    fwd = MatchActionTable::create_match_action_table<MatchTable>(
+        "exact", "fwd", 0, 16, key_builder, false, false, &lookup_factory);
+    get_table()->set_next_node(set_port.get_id(), &cond);
+    get_table()->set_next_node(set_port_count.get_id(), &cond);
+    get_table()->set_next_node_miss_default(&cond);
+
+    pipeline.reset(new Pipeline("ingress", 0, fwd.get()));
+    pipeline->compile();
+
+    phv_source->set_phv_factory(0, &phv_factory);
+  }
+
+  MatchTable *get_table() {
+    return static_cast<MatchTable *>(fwd->get_match_table());
+  }
+
+  entry_handle_t add_entry(int dst, int port, const ActionFn *action) {
+    std::string key("\x00\x00", 2);
+    key[1] = static_cast<char>(dst);
+    std::vector<MatchKeyParam> match_key;
+    match_key.emplace_back(MatchKeyParam::Type::EXACT, key);
+    ActionData action_data;
+    action_data.push_back_action_data(port);
+    entry_handle_t handle;
+    EXPECT_EQ(MatchErrorCode::SUCCESS, get_table()->add_entry(
+        match_key, action, std::move(action_data), &handle));
+    return handle;
+  }
+
+  Packet get_pkt(int dst, int src, int ttl) {
+    auto pkt = Packet::make_new(64, PacketBuffer(128), phv_source.get());
+    PHV *phv = pkt.get_phv();
+    phv->get_header(h).mark_valid();
+    phv->get_field(h, 0).set(dst);
+    phv->get_field(h, 1).set(src);
+    phv->get_field(h, 2).set(ttl);
+    phv->get_field(meta, 0).set(0);
+    return pkt;
+  }
+
+  // sends the same packet through the pipeline and the cache, and checks that
+  // they agree; returns the PHV produced by the cache
+  const PHV *check(FlowCache *cache, int dst, int src, int ttl) {
+    auto expected = get_pkt(dst, src, ttl);
+    pipeline->apply(&expected);
+    last_pkt.reset(new Packet(get_pkt(dst, src, ttl)));
+    cache->apply(pipeline.get(), last_pkt.get());
+    const PHV *phv = last_pkt->get_phv();
+    for (header_id_t hdr : {h, meta}) {
+      EXPECT_EQ(expected.get_phv()->get_header(hdr).is_valid(),
+                phv->get_header(hdr).is_valid());
+    }
+    for (int f = 0; f < 3; f++) {
+      EXPECT_EQ(expected.get_phv()->get_field(h, f).get_uint(),
+                phv->get_field(h, f).get_uint());
+    }
+    EXPECT_EQ(expected.get_phv()->get_field(meta, 0).get_uint(),
+              phv->get_field(meta, 0).get_uint());
+    return phv;
+  }
+
+  std::unique_ptr<Packet> last_pkt{nullptr};
+};
+
+TEST_F(FlowCacheTest, HitReplaysTraversal) {
+  FlowCache cache;
+  auto t = cache.get_telemetry();
+  add_entry(1, 2, &set_port);
+  add_entry(2, 3, &set_port);
+
+  auto phv = check(&cache, 1, 7, 64);
+  ASSERT_EQ(2u, phv->get_field(meta, 0).get_uint());
+  ASSERT_EQ(63u, phv->get_field(h, 2).get_uint());
+  ASSERT_EQ(1u, t->misses.get());
+  ASSERT_EQ(1u, cache.get_num_entries());
+
+  // h.src is not consulted by the pipeline
+  phv = check(&cache, 1, 8, 64);
+  ASSERT_EQ(2u, phv->get_field(meta, 0).get_uint());
+  ASSERT_EQ(8u, phv->get_field(h, 1).get_uint());
+  ASSERT_EQ(1u, t->hits.get());
+
+  // h.ttl is
+  check(&cache, 1, 7, 32);
+  ASSERT_EQ(2u, t->misses.get());
+
+  // different branch, which invalidates h; strip() takes the whole header as
+  // a parameter, so all its fields are now consulted
+  phv = check(&cache, 2, 7, 64);
+  ASSERT_FALSE(phv->get_header(h).is_valid());
+  check(&cache, 2, 9, 64);
+  phv = check(&cache, 2, 7, 64);
+  ASSERT_FALSE(phv->get_header(h).is_valid());
+  ASSERT_EQ(2u, t->hits.get());
+
+  // table miss
+  check(&cache, 5, 7, 64);
+  check(&cache, 5, 7, 64);
+  ASSERT_EQ(3u, t->hits.get());
+  ASSERT_EQ(5u, t->misses.get());
+  ASSERT_EQ(5u, cache.get_num_entries());
+
+  Json::Value root;
+  t->dump_json(&root);
+  ASSERT_DOUBLE_EQ(3. / 8., root["hit_rate"].asDouble());
+  ASSERT_EQ(5u, root["entries"].asUInt64());
+}
+
+TEST_F(FlowCacheTest, TableUpdateInvalidates) {
+  FlowCache cache;
+  auto t = cache.get_telemetry();
+  auto handle = add_entry(1, 2, &set_port);
+  check(&cache, 1, 7, 64);
+  check(&cache, 1, 7, 64);
+  ASSERT_EQ(1u, t->hits.get());
+
+  ActionData action_data;
+  action_data.push_back_action_data(3);
+  ASSERT_EQ(MatchErrorCode::SUCCESS, get_table()->modify_entry(
+      handle, &set_port, std::move(action_data)));
+  auto phv = check(&cache, 1, 7, 64);
+  ASSERT_EQ(3u, phv->get_field(meta, 0).get_uint());
+  ASSERT_FALSE(phv->get_header(h).is_valid());
+  ASSERT_EQ(1u, t->hits.get());
+  ASSERT_EQ(1u, t->flushes.get());
+  ASSERT_EQ(1u, t->flushed_entries.get());
+
+  // a config swap (or a different pipeline) also flushes the cache
+  FlowCache::invalidate_all();
+  check(&cache, 1, 7, 64);
+  ASSERT_EQ(2u, t->flushes.get());
+}
+
+// only the updates which can change the result of a lookup flush the caches,
+// not the ones to counters or meters (such tables are never cached)
+TEST_F(FlowCacheTest, CounterAndMeterUpdatesDoNotInvalidate) {
+  MatchKeyBuilder key_builder;
+  key_builder.push_back_field(h, 0, 16, MatchKeyParam::Type::EXACT);
+  auto stats_mat = MatchActionTable::create_match_action_table<MatchTable>(
+      "exact", "stats", 1, 16, key_builder, true, false, &lookup_factory);
+  auto stats = static_cast<MatchTable *>(stats_mat->get_match_table());
+  stats->set_next_node(set_port.get_id(), nullptr);
+  MeterArray meter_array("meter_array", 0, Meter::MeterType::PACKETS, 2, 16);
+  stats->set_direct_meters(&meter_array, meta, 0);
+  std::vector<MatchKeyParam> match_key;
+  match_key.emplace_back(MatchKeyParam::Type::EXACT, std::string(2, '\x01'));
+  ActionData action_data;
+  action_data.push_back_action_data(2);
+  entry_handle_t stats_handle;
+  ASSERT_EQ(MatchErrorCode::SUCCESS, stats->add_entry(
+      match_key, &set_port, std::move(action_data), &stats_handle));
+
+  FlowCache cache;
+  auto t = cache.get_telemetry();
+  add_entry(1, 2, &set_port);
+  check(&cache, 1, 7, 64);
+  check(&cache, 1, 7, 64);
+  ASSERT_EQ(1u, t->hits.get());
+
+  ASSERT_EQ(MatchErrorCode::SUCCESS, stats->write_counters(stats_handle, 0, 0));
+  std::vector<Meter::rate_config_t> rates;
+  ASSERT_EQ(MatchErrorCode::SUCCESS,
+            stats->get_meter_rates(stats_handle, &rates));
+  check(&cache, 1, 7, 64);
+  ASSERT_EQ(2u, t->hits.get());
+  ASSERT_EQ(0u, t->flushes.get());
+}
+
+TEST_F(FlowCacheTest, StatefulActionBypass) {
+  FlowCache cache;
+  auto t = cache.get_telemetry();
+  add_entry(1, 2, &set_port_count);
+  for (int i = 0; i < 3; i++) check(&cache, 1, 7, 64);
+  // the primitive was executed for every packet
+  ASSERT_EQ(6u, count_primitive.c);
+  ASSERT_EQ(0u, t->hits.get());
+  ASSERT_EQ(3u, t->uncacheable.get());
+  ASSERT_EQ(0u, cache.get_num_entries());
+}
+
+TEST_F(FlowCacheTest, Capacity) {
+  FlowCache cache(2);
+  auto t = cache.get_telemetry();
+  add_entry(1, 2, &set_port);
+  for (int ttl = 10; ttl < 13; ttl++) check(&cache, 1, 7, ttl);
+  ASSERT_EQ(1u, t->flushes.get());
+  ASSERT_EQ(1u, cache.get_num_entries());
+}
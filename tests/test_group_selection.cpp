@@ -0,0 +1,181 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <bm/bm_sim/group_selection.h>
+
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+
+using namespace bm;
+
+using mbr_hdl_t = ResilientGroupSelector::mbr_hdl_t;
+using grp_hdl_t = ResilientGroupSelector::grp_hdl_t;
+
+namespace {
+
+// checks that all the members get the same number of buckets, up to one
+void check_balanced(const ResilientGroupSelector &selector, grp_hdl_t grp,
+                    const std::vector<mbr_hdl_t> &mbrs) {
+  std::map<mbr_hdl_t, size_t> counts;
+  for (auto mbr : mbrs) counts[mbr] = 0;
+  const auto buckets = selector.get_buckets(grp);
+  ASSERT_EQ(selector.get_nb_buckets(), buckets.size());
+  for (auto mbr : buckets) {
+    ASSERT_EQ(1u, counts.count(mbr));
+    counts[mbr]++;
+  }
+  auto minmax = std::minmax_element(
+      counts.begin(), counts.end(),
+      [](const std::pair<const mbr_hdl_t, size_t> &a,
+         const std::pair<const mbr_hdl_t, size_t> &b) {
+        return a.second < b.second; });
+  ASSERT_LE(minmax.second->second - minmax.first->second, 1u);
+}
+
+// number of buckets whose member changed
+size_t moved(const std::vector<mbr_hdl_t> &before,
+             const std::vector<mbr_hdl_t> &after) {
+  size_t count = 0;
+  for (size_t i = 0; i < before.size(); i++) count += (before[i] != after[i]);
+  return count;
+}
+
+}  // namespace
+
+TEST(ResilientGroupSelector, NbBuckets) {
+  ASSERT_EQ(4096u, ResilientGroupSelector().get_nb_buckets());
+  ASSERT_EQ(1024u, ResilientGroupSelector(1000).get_nb_buckets());
+  ASSERT_EQ(1u, ResilientGroupSelector(1).get_nb_buckets());
+}
+
+TEST(ResilientGroupSelector, Lookup) {
+  ResilientGroupSelector selector(16);
+  const grp_hdl_t grp = 3;
+  ASSERT_TRUE(selector.get_buckets(grp).empty());
+  selector.add_member_to_group(grp, 7);
+  for (unsigned int h = 0; h < 64; h++)
+    ASSERT_EQ(7u, selector.get_from_hash(grp, h));
+  selector.add_member_to_group(grp, 9);
+  const auto buckets = selector.get_buckets(grp);
+  for (unsigned int h = 0; h < 64; h++)
+    ASSERT_EQ(buckets[h % 16], selector.get_from_hash(grp, h));
+  check_balanced(selector, grp, {7, 9});
+}
+
+TEST(ResilientGroupSelector, MinimalDisruption) {
+  const size_t nb_buckets = 4096;
+  ResilientGroupSelector selector(nb_buckets);
+  const grp_hdl_t grp = 0;
+  std::vector<mbr_hdl_t> mbrs;
+  for (mbr_hdl_t mbr = 0; mbr < 8; mbr++) {
+    selector.add_member_to_group(grp, mbr);
+    mbrs.push_back(mbr);
+  }
+  check_balanced(selector, grp, mbrs);
+
+  // only the buckets of the removed member are remapped
+  auto before = selector.get_buckets(grp);
+  selector.remove_member_from_group(grp, 3);
+  mbrs.erase(std::find(mbrs.begin(), mbrs.end(), 3));
+  auto after = selector.get_buckets(grp);
+  check_balanced(selector, grp, mbrs);
+  for (size_t i = 0; i < nb_buckets; i++) {
+    if (before[i] == 3)
+      ASSERT_NE(3u, after[i]);
+    else
+      ASSERT_EQ(before[i], after[i]);
+  }
+
+  // only the buckets given to the new member are remapped
+  before = after;
+  selector.add_member_to_group(grp, 42);
+  mbrs.push_back(42);
+  after = selector.get_buckets(grp);
+  check_balanced(selector, grp, mbrs);
+  for (size_t i = 0; i < nb_buckets; i++) {
+    if (before[i] != after[i]) {
+      ASSERT_EQ(42u, after[i]);
+    }
+  }
+  ASSERT_EQ(nb_buckets / 8, moved(before, after));
+}
+
+TEST(ResilientGroupSelector, Churn) {
+  ResilientGroupSelector selector(256);
+  const grp_hdl_t grp = 1;
+  std::vector<mbr_hdl_t> mbrs;
+  for (mbr_hdl_t mbr = 0; mbr < 20; mbr++) {
+    selector.add_member_to_group(grp, mbr);
+    mbrs.push_back(mbr);
+    check_balanced(selector, grp, mbrs);
+  }
+  for (mbr_hdl_t mbr = 0; mbr < 20; mbr += 3) {
+    selector.remove_member_from_group(grp, mbr);
+    mbrs.erase(std::find(mbrs.begin(), mbrs.end(), mbr));
+    check_balanced(selector, grp, mbrs);
+  }
+  // adding an existing member / removing an unknown one is a no-op
+  auto before = selector.get_buckets(grp);
+  selector.add_member_to_group(grp, 1);
+  selector.remove_member_from_group(grp, 0);
+  selector.remove_member_from_group(grp + 1, 1);
+  ASSERT_EQ(before, selector.get_buckets(grp));
+
+  for (auto mbr : mbrs) selector.remove_member_from_group(grp, mbr);
+  ASSERT_TRUE(selector.get_buckets(grp).empty());
+}
+
+TEST(ResilientGroupSelector, ActionProfile) {
+  ActionProfile action_profile("act_prof", 0, true);
+  ResilientGroupSelector selector(64);
+  action_profile.set_group_selector(&selector);
+  ActionFn action_fn("action", 0, 0);
+
+  grp_hdl_t grp;
+  ASSERT_EQ(MatchErrorCode::SUCCESS, action_profile.create_group(&grp));
+  std::vector<mbr_hdl_t> mbrs(3);
+  for (auto &mbr : mbrs) {
+    ASSERT_EQ(MatchErrorCode::SUCCESS,
+              action_profile.add_member(&action_fn, ActionData(), &mbr));
+    ASSERT_EQ(MatchErrorCode::SUCCESS,
+              action_profile.add_member_to_group(mbr, grp));
+  }
+  check_balanced(selector, grp, mbrs);
+
+  ASSERT_EQ(MatchErrorCode::SUCCESS,
+            action_profile.remove_member_from_group(mbrs[0], grp));
+  check_balanced(selector, grp, {mbrs[1], mbrs[2]});
+
+  // the selector forgets about the members of deleted groups
+  ASSERT_EQ(MatchErrorCode::SUCCESS, action_profile.delete_group(grp));
+  ASSERT_TRUE(selector.get_buckets(grp).empty());
+
+  ASSERT_EQ(MatchErrorCode::SUCCESS, action_profile.create_group(&grp));
+  ASSERT_EQ(MatchErrorCode::SUCCESS,
+            action_profile.add_member_to_group(mbrs[0], grp));
+  check_balanced(selector, grp, {mbrs[0]});
+
+  action_profile.reset_state();
+  ASSERT_TRUE(selector.get_buckets(grp).empty());
+}
@@ -22,6 +22,7 @@
 
 #include <bm/bm_sim/phv.h>
 
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -58,6 +59,17 @@ class HeaderStackTest : public ::testing::Test {
     phv = phv_factory.create();
   }
 
+  // push_front / pop_front change the Header instance designated by the id of
+  // a stack element, which is why the tests below do not keep references to
+  // headers or fields across stack operations
+  bool is_valid(header_id_t header) const {
+    return phv->get_header(header).is_valid();
+  }
+
+  Field &get_f0(header_id_t header) {
+    return phv->get_field(header, 0);
+  }
+
   // virtual void TearDown() {}
 };
 
@@ -113,15 +125,7 @@ TEST_F(HeaderStackTest, PopBack) {
 TEST_F(HeaderStackTest, PushFront) {
   HeaderStack &stack = phv->get_header_stack(testHeaderStack);
 
-  Header &h0 = phv->get_header(testHeader_0);
-  Header &h1 = phv->get_header(testHeader_1);
-  Header &h2 = phv->get_header(testHeader_2);
-
-  ASSERT_FALSE(h0.is_valid());
-
-  Field &f0_0 = h0.get_field(0);
-  Field &f1_0 = h1.get_field(0);
-  Field &f2_0 = h2.get_field(0);
+  ASSERT_FALSE(is_valid(testHeader_0));
 
   unsigned int v0 = 10u; unsigned int v1 = 11u; unsigned int v2 = 12u;
 
@@ -129,60 +133,53 @@ TEST_F(HeaderStackTest, PushFront) {
 
   ASSERT_EQ(1u, stack.push_front());
   ASSERT_EQ(1u, stack.get_count());
-  ASSERT_TRUE(h0.is_valid());
-  f0_0.set(v0);
+  ASSERT_TRUE(is_valid(testHeader_0));
+  get_f0(testHeader_0).set(v0);
 
   ASSERT_EQ(1u, stack.push_front());
   ASSERT_EQ(2u, stack.get_count());
-  ASSERT_TRUE(h0.is_valid());
-  ASSERT_TRUE(h1.is_valid());
-  ASSERT_EQ(v0, f1_0.get_uint());
-  f0_0.set(v1);
+  ASSERT_TRUE(is_valid(testHeader_0));
+  ASSERT_TRUE(is_valid(testHeader_1));
+  ASSERT_EQ(v0, get_f0(testHeader_1).get_uint());
+  get_f0(testHeader_0).set(v1);
 
   ASSERT_EQ(1u, stack.push_front());
   ASSERT_EQ(3u, stack.get_count());
-  ASSERT_TRUE(h0.is_valid());
-  ASSERT_TRUE(h1.is_valid());
-  ASSERT_TRUE(h2.is_valid());
-  ASSERT_EQ(v0, f2_0.get_uint());
-  ASSERT_EQ(v1, f1_0.get_uint());
-  f0_0.set(v2);
+  ASSERT_TRUE(is_valid(testHeader_0));
+  ASSERT_TRUE(is_valid(testHeader_1));
+  ASSERT_TRUE(is_valid(testHeader_2));
+  ASSERT_EQ(v0, get_f0(testHeader_2).get_uint());
+  ASSERT_EQ(v1, get_f0(testHeader_1).get_uint());
+  get_f0(testHeader_0).set(v2);
 
   // we can do another push front, the last header will be discarded
   ASSERT_EQ(1u, stack.push_front());
   ASSERT_EQ(3u, stack.get_count());
-  ASSERT_TRUE(h0.is_valid());
-  ASSERT_TRUE(h1.is_valid());
-  ASSERT_TRUE(h2.is_valid());
-  ASSERT_EQ(v1, f2_0.get_uint());
-  ASSERT_EQ(v2, f1_0.get_uint());
+  ASSERT_TRUE(is_valid(testHeader_0));
+  ASSERT_TRUE(is_valid(testHeader_1));
+  ASSERT_TRUE(is_valid(testHeader_2));
+  ASSERT_EQ(v1, get_f0(testHeader_2).get_uint());
+  ASSERT_EQ(v2, get_f0(testHeader_1).get_uint());
 }
 
 TEST_F(HeaderStackTest, PushFrontNum) {
   HeaderStack &stack = phv->get_header_stack(testHeaderStack);
 
-  Header &h0 = phv->get_header(testHeader_0);
-  Header &h1 = phv->get_header(testHeader_1);
-  Header &h2 = phv->get_header(testHeader_2);
-
-  Field &f0_0 = h0.get_field(0);
-  Field &f2_0 = h2.get_field(0);
-
   unsigned int v0 = 10u;
 
   ASSERT_EQ(0u, stack.get_count());
 
   ASSERT_EQ(1u, stack.push_front());
   ASSERT_EQ(1u, stack.get_count());
-  ASSERT_TRUE(h0.is_valid());
-  f0_0.set(v0);
+  ASSERT_TRUE(is_valid(testHeader_0));
+  get_f0(testHeader_0).set(v0);
 
   ASSERT_EQ(2u, stack.push_front(2));
   ASSERT_EQ(3u, stack.get_count());
-  ASSERT_TRUE(h0.is_valid());
-  ASSERT_TRUE(h1.is_valid());
-  ASSERT_TRUE(h2.is_valid());
-  ASSERT_EQ(v0, f2_0.get_uint());
+  ASSERT_TRUE(is_valid(testHeader_0));
+  ASSERT_TRUE(is_valid(testHeader_1));
+  ASSERT_TRUE(is_valid(testHeader_2));
+  ASSERT_EQ(v0, get_f0(testHeader_2).get_uint());
 }
 
 TEST_F(HeaderStackTest, PopFront) {
@@ -190,35 +187,28 @@ TEST_F(HeaderStackTest, PopFront) {
 
   ASSERT_EQ(2u, stack.push_front(2));  // add 2 headers
 
-  Header &h0 = phv->get_header(testHeader_0);
-  Header &h1 = phv->get_header(testHeader_1);
-  Header &h2 = phv->get_header(testHeader_2);
-
-  ASSERT_TRUE(h0.is_valid());
-  ASSERT_TRUE(h1.is_valid());
-  ASSERT_FALSE(h2.is_valid());
-
-  Field &f0_0 = h0.get_field(0);
-  Field &f1_0 = h1.get_field(0);
+  ASSERT_TRUE(is_valid(testHeader_0));
+  ASSERT_TRUE(is_valid(testHeader_1));
+  ASSERT_FALSE(is_valid(testHeader_2));
 
   const unsigned int v0 = 10u; const unsigned int v1 = 11u;
   const std::string v1_hex("0x000b");
-  f0_0.set(v0); f1_0.set(v1);
+  get_f0(testHeader_0).set(v0); get_f0(testHeader_1).set(v1);
 
   ASSERT_EQ(2u, stack.get_count());
 
   ASSERT_EQ(1u, stack.pop_front());
   ASSERT_EQ(1u, stack.get_count());
-  ASSERT_FALSE(h2.is_valid());
-  ASSERT_FALSE(h1.is_valid());
-  ASSERT_EQ(v1, f0_0.get_uint());
-  ASSERT_EQ(ByteContainer(v1_hex), f0_0.get_bytes());
+  ASSERT_FALSE(is_valid(testHeader_2));
+  ASSERT_FALSE(is_valid(testHeader_1));
+  ASSERT_EQ(v1, get_f0(testHeader_0).get_uint());
+  ASSERT_EQ(ByteContainer(v1_hex), get_f0(testHeader_0).get_bytes());
 
   ASSERT_EQ(1u, stack.pop_front());
   ASSERT_EQ(0u, stack.get_count());
-  ASSERT_FALSE(h2.is_valid());
-  ASSERT_FALSE(h1.is_valid());
-  ASSERT_FALSE(h0.is_valid());
+  ASSERT_FALSE(is_valid(testHeader_2));
+  ASSERT_FALSE(is_valid(testHeader_1));
+  ASSERT_FALSE(is_valid(testHeader_0));
 
   ASSERT_EQ(0u, stack.pop_front());  // empty so nothing popped
   ASSERT_EQ(0u, stack.get_count());
@@ -229,39 +219,95 @@ TEST_F(HeaderStackTest, PopFrontNum) {
 
   ASSERT_EQ(3u, stack.push_front(3));  // add 3 headers
 
-  Header &h0 = phv->get_header(testHeader_0);
-  Header &h1 = phv->get_header(testHeader_1);
-  Header &h2 = phv->get_header(testHeader_2);
-
-  ASSERT_TRUE(h0.is_valid());
-  ASSERT_TRUE(h1.is_valid());
-  ASSERT_TRUE(h2.is_valid());
-
-  Field &f0_0 = h0.get_field(0);
-  Field &f1_0 = h1.get_field(0);
-  Field &f2_0 = h2.get_field(0);
+  ASSERT_TRUE(is_valid(testHeader_0));
+  ASSERT_TRUE(is_valid(testHeader_1));
+  ASSERT_TRUE(is_valid(testHeader_2));
 
   unsigned int v0 = 10u; unsigned int v1 = 11u; unsigned int v2 = 12u;
-  f0_0.set(v0); f1_0.set(v1); f2_0.set(v2);
+  get_f0(testHeader_0).set(v0);
+  get_f0(testHeader_1).set(v1);
+  get_f0(testHeader_2).set(v2);
 
   ASSERT_EQ(3u, stack.get_count());
 
   ASSERT_EQ(0u, stack.pop_front(0));
   ASSERT_EQ(3u, stack.get_count());
-  ASSERT_TRUE(h0.is_valid());
-  ASSERT_TRUE(h1.is_valid());
-  ASSERT_TRUE(h2.is_valid());
+  ASSERT_TRUE(is_valid(testHeader_0));
+  ASSERT_TRUE(is_valid(testHeader_1));
+  ASSERT_TRUE(is_valid(testHeader_2));
 
   ASSERT_EQ(2u, stack.pop_front(2));
   ASSERT_EQ(1u, stack.get_count());
-  ASSERT_TRUE(h0.is_valid());
-  ASSERT_FALSE(h1.is_valid());
-  ASSERT_FALSE(h2.is_valid());
-  ASSERT_EQ(v2, f0_0.get_uint());
+  ASSERT_TRUE(is_valid(testHeader_0));
+  ASSERT_FALSE(is_valid(testHeader_1));
+  ASSERT_FALSE(is_valid(testHeader_2));
+  ASSERT_EQ(v2, get_f0(testHeader_0).get_uint());
 
   ASSERT_EQ(1u, stack.pop_front(2));
   ASSERT_EQ(0u, stack.get_count());
-  ASSERT_FALSE(h0.is_valid());
-  ASSERT_FALSE(h1.is_valid());
-  ASSERT_FALSE(h2.is_valid());
+  ASSERT_FALSE(is_valid(testHeader_0));
+  ASSERT_FALSE(is_valid(testHeader_1));
+  ASSERT_FALSE(is_valid(testHeader_2));
+}
+
+TEST_F(HeaderStackTest, Rotation) {
+  HeaderStack &stack = phv->get_header_stack(testHeaderStack);
+  const header_id_t ids[] = {testHeader_0, testHeader_1, testHeader_2};
+
+  // the stack is used as a FIFO for a while, which rotates it several times
+  unsigned int v = 0u;
+  ASSERT_EQ(3u, stack.push_front(3));
+  for (auto h : ids) get_f0(h).set(v++);
+  for (int i = 0; i < 5; i++) {
+    ASSERT_EQ(1u, stack.push_front());
+    get_f0(testHeader_0).set(v++);
+  }
+  // values are found at the logical position, regardless of the rotation
+  ASSERT_EQ(3u, stack.get_count());
+  ASSERT_EQ(v - 1, get_f0(testHeader_0).get_uint());
+  ASSERT_EQ(v - 2, get_f0(testHeader_1).get_uint());
+  ASSERT_EQ(v - 3, get_f0(testHeader_2).get_uint());
+
+  // lookups by name are resolved the same way
+  ASSERT_EQ(&phv->get_header(testHeader_1), &phv->get_header("test_1"));
+  ASSERT_EQ(v - 2, phv->get_field("test_1.f16").get_uint());
+  ASSERT_EQ("test_1", phv->get_header_name(testHeader_1));
+
+  // so are the stack accessors
+  for (size_t i = 0; i < stack_depth; i++)
+    ASSERT_EQ(&phv->get_header(ids[i]), &stack.at(i));
+  ASSERT_THROW(stack.at(stack_depth), std::out_of_range);
+  ASSERT_EQ(&phv->get_header(testHeader_2), &stack.get_last());
+
+  ASSERT_EQ(1u, stack.pop_back());
+  ASSERT_FALSE(is_valid(testHeader_2));
+  ASSERT_EQ(&phv->get_header(testHeader_2), &stack.get_next());
+  ASSERT_EQ(1u, stack.pop_front());
+  ASSERT_EQ(1u, stack.get_count());
+  ASSERT_TRUE(is_valid(testHeader_0));
+  ASSERT_FALSE(is_valid(testHeader_1));
+  ASSERT_EQ(v - 2, get_f0(testHeader_0).get_uint());
+
+  // resetting the PHV undoes the rotation
+  phv->reset();
+  phv->reset_header_stacks();
+  ASSERT_EQ(0u, stack.get_count());
+  ASSERT_EQ(&phv->get_header(testHeader_0), &*phv->header_begin());
+}
+
+TEST_F(HeaderStackTest, CopyHeaders) {
+  HeaderStack &stack = phv->get_header_stack(testHeaderStack);
+  ASSERT_EQ(2u, stack.push_front(2));
+  get_f0(testHeader_0).set(10u);
+  get_f0(testHeader_1).set(11u);
+  ASSERT_EQ(1u, stack.push_front());
+  get_f0(testHeader_0).set(12u);
+
+  // the 2 PHVs do not have the same rotation
+  auto phv_copy = phv_factory.create();
+  phv_copy->copy_headers(*phv);
+  ASSERT_TRUE(phv_copy->get_header(testHeader_2).is_valid());
+  ASSERT_EQ(12u, phv_copy->get_field(testHeader_0, 0).get_uint());
+  ASSERT_EQ(10u, phv_copy->get_field(testHeader_1, 0).get_uint());
+  ASSERT_EQ(11u, phv_copy->get_field(testHeader_2, 0).get_uint());
 }
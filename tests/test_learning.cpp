@@ -27,6 +27,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 #include <mutex>
 #include <thread>
 #include <condition_variable>
@@ -553,3 +554,130 @@ TEST_F(LearningTest, OneSampleCbMode) {
   ASSERT_EQ((char) 0xa, data[0]);
   ASSERT_EQ((char) 0xba, data[1]);
 }
+
+TEST_F(LearningTest, Stats) {
+  LearnEngineIface::list_id_t list_id = 1;
+  size_t max_samples = 2; unsigned timeout_ms = 0;
+  learn_on_test1_f16(list_id, max_samples, timeout_ms);
+
+  Packet pkt = get_pkt();
+  Field &f = pkt.get_phv()->get_field(testHeader1, 0);
+  f.set("0xaba");
+  learn_engine->learn(list_id, pkt);
+  learn_engine->learn(list_id, pkt);
+  f.set("0xabb");
+  learn_engine->learn(list_id, pkt);
+  learn_writer->read(buffer, sizeof(buffer));
+
+  LearnEngineIface::ListStats stats;
+  ASSERT_EQ(LearnEngineIface::SUCCESS,
+            learn_engine->list_get_stats(list_id, &stats));
+  ASSERT_EQ(2u, stats.samples);
+  ASSERT_EQ(1u, stats.filtered);
+  ASSERT_EQ(0u, stats.overflows);
+  ASSERT_EQ(1u, stats.notifications);
+
+  ASSERT_EQ(LearnEngineIface::INVALID_LIST_ID,
+            learn_engine->list_get_stats(list_id + 1, &stats));
+
+  learn_engine->reset_state();
+  ASSERT_EQ(LearnEngineIface::SUCCESS,
+            learn_engine->list_get_stats(list_id, &stats));
+  ASSERT_EQ(0u, stats.samples);
+  ASSERT_EQ(0u, stats.notifications);
+}
+
+TEST_F(LearningTest, MaxUnacked) {
+  LearnEngineIface::list_id_t list_id = 1;
+  size_t max_samples = 1; unsigned timeout_ms = 0;
+  learn_on_test1_f16(list_id, max_samples, timeout_ms);
+  ASSERT_EQ(LearnEngineIface::SUCCESS,
+            learn_engine->list_set_max_unacked(list_id, 0));
+  ASSERT_EQ(LearnEngineIface::INVALID_LIST_ID,
+            learn_engine->list_set_max_unacked(list_id + 1, 0));
+
+  Packet pkt = get_pkt();
+  Field &f = pkt.get_phv()->get_field(testHeader1, 0);
+  f.set("0xaba");
+  learn_engine->learn(list_id, pkt);
+  sleep_for(milliseconds(100));
+  ASSERT_NE(MemoryAccessor::Status::CAN_READ, learn_writer->check_status());
+
+  LearnEngineIface::ListStats stats;
+  ASSERT_EQ(LearnEngineIface::SUCCESS,
+            learn_engine->list_get_stats(list_id, &stats));
+  ASSERT_EQ(0u, stats.samples);
+  ASSERT_EQ(1u, stats.overflows);
+
+  ASSERT_EQ(LearnEngineIface::SUCCESS,
+            learn_engine->list_set_max_unacked(list_id, 1024));
+  learn_engine->learn(list_id, pkt);
+  learn_writer->read(buffer, sizeof(buffer));
+  auto msg_hdr = reinterpret_cast<LearnEngineIface::msg_hdr_t *>(buffer);
+  ASSERT_EQ(0u, msg_hdr->buffer_id);
+  ASSERT_EQ(1u, msg_hdr->num_samples);
+}
+
+// learn() does not wait for the previous notifications to be processed, the
+// samples are batched instead
+TEST_F(LearningTest, SlowConsumer) {
+  LearnEngineIface::list_id_t list_id = 1;
+  size_t max_samples = 4; unsigned timeout_ms = 0;
+
+  struct Consumer {
+    std::mutex mutex{};
+    std::condition_variable cv{};
+    bool blocked{true};
+    std::vector<unsigned int> num_samples{};
+  } consumer;
+  auto cb = [](const LearnEngineIface::msg_hdr_t &hdr, size_t,
+               std::unique_ptr<char[]>, void *cookie) {
+    auto c = static_cast<Consumer *>(cookie);
+    std::unique_lock<std::mutex> lock(c->mutex);
+    c->num_samples.push_back(hdr.num_samples);
+    c->cv.notify_all();
+    while (c->blocked) c->cv.wait(lock);
+  };
+
+  learn_engine->list_create(list_id, max_samples, timeout_ms);
+  learn_engine->list_set_learn_cb(list_id, cb, &consumer);
+  learn_engine->list_push_back_field(list_id, testHeader1, 0);  // test1.f16
+  learn_engine->list_init(list_id);
+
+  Packet pkt = get_pkt();
+  Field &f = pkt.get_phv()->get_field(testHeader1, 0);
+  auto learn = [this, list_id, &f, &pkt](int start, int end) {
+    for (int c = start; c < end; c++) {
+      f.set(c);
+      learn_engine->learn(list_id, pkt);
+    }
+  };
+
+  // the first notification blocks
+  learn(0, 4);
+  {
+    std::unique_lock<std::mutex> lock(consumer.mutex);
+    while (consumer.num_samples.empty()) consumer.cv.wait(lock);
+  }
+  // this would previously block on the second buffer
+  learn(4, 14);
+  {
+    std::unique_lock<std::mutex> lock(consumer.mutex);
+    consumer.blocked = false;
+    consumer.cv.notify_all();
+    while (consumer.num_samples.size() < 3) consumer.cv.wait(lock);
+    ASSERT_EQ(std::vector<unsigned int>({4u, 4u, 4u}), consumer.num_samples);
+  }
+  // 2 samples are still waiting for the buffer to be full
+  sleep_for(milliseconds(100));
+  {
+    std::unique_lock<std::mutex> lock(consumer.mutex);
+    ASSERT_EQ(3u, consumer.num_samples.size());
+  }
+  learn(14, 16);
+  {
+    std::unique_lock<std::mutex> lock(consumer.mutex);
+    while (consumer.num_samples.size() < 4) consumer.cv.wait(lock);
+    ASSERT_EQ(4u, consumer.num_samples.back());
+  }
+}
@@ -0,0 +1,170 @@
+/*
+ * Hardik Soni (hardik.soni@inria.fr)
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <bm/bm_linker/linker.h>
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace bm;
+
+namespace {
+
+// One exact match on ethernet.dstAddr; the table and action names are
+// program specific and do not prevent the tables from being linked.
+std::string make_program(const std::string &table_name,
+                         const std::string &action_name,
+                         int port_bitwidth) {
+  std::string json = R"({
+  "header_types": [
+    {"name": "standard_metadata_t", "id": 0,
+     "fields": [["ingress_port", 9], ["egress_spec", 9], ["egress_port", 9],
+                ["_padding", 5]]},
+    {"name": "ethernet_t", "id": 1,
+     "fields": [["dstAddr", 48], ["srcAddr", 48], ["etherType", 16]]}
+  ],
+  "headers": [
+    {"name": "standard_metadata", "id": 0, "header_type": "standard_metadata_t",
+     "metadata": true},
+    {"name": "ethernet", "id": 1, "header_type": "ethernet_t",
+     "metadata": false}
+  ],
+  "parsers": [
+    {"name": "parser", "id": 0, "init_state": "start",
+     "parse_states": [
+       {"name": "start", "id": 0,
+        "parser_ops": [
+          {"op": "extract",
+           "parameters": [{"type": "regular", "value": "ethernet"}]}
+        ],
+        "transition_key": [],
+        "transitions": [
+          {"type": "default", "value": null, "mask": null, "next_state": null}
+        ]}
+     ]}
+  ],
+  "deparsers": [{"name": "deparser", "id": 0, "order": ["ethernet"]}],
+  "actions": [
+    {"name": "ACTION", "id": 0,
+     "runtime_data": [{"name": "port", "bitwidth": BITWIDTH}],
+     "primitives": []},
+    {"name": "nop", "id": 1, "runtime_data": [], "primitives": []}
+  ],
+  "pipelines": [
+    {"name": "ingress", "id": 0, "init_table": "TABLE",
+     "tables": [
+       {"name": "TABLE", "id": 0, "match_type": "exact", "type": "simple",
+        "max_size": 1024, "with_counters": false, "support_timeout": false,
+        "direct_meters": null,
+        "key": [
+          {"match_type": "exact", "target": ["ethernet", "dstAddr"],
+           "mask": null}
+        ],
+        "actions": ["ACTION", "nop"],
+        "next_tables": {"ACTION": null, "nop": null},
+        "base_default_next": null}
+     ],
+     "conditionals": []},
+    {"name": "egress", "id": 1, "init_table": null, "tables": [],
+     "conditionals": []}
+  ]
+})";
+  auto replace_all = [&json](const std::string &from, const std::string &to) {
+    for (auto pos = json.find(from); pos != std::string::npos;
+         pos = json.find(from, pos + to.size()))
+      json.replace(pos, from.size(), to);
+  };
+  replace_all("TABLE", table_name);
+  replace_all("ACTION", action_name);
+  replace_all("BITWIDTH", std::to_string(port_bitwidth));
+  return json;
+}
+
+}  // namespace
+
+class LinkerTest : public ::testing::Test {
+ protected:
+  std::shared_ptr<P4Objects> add_program(const std::string &p4_name,
+                                         const std::string &json) {
+    auto p4objects = std::make_shared<P4Objects>();
+    std::istringstream is(json);
+    if (p4objects->init_objects(&is, &factory) != 0) return nullptr;
+    return linker.add_p4objects(p4_name, p4objects);
+  }
+
+  static MatchKeyParam dst_addr(const char *addr) {
+    return MatchKeyParam(MatchKeyParam::Type::EXACT, std::string(addr, 6));
+  }
+
+  LookupStructureFactory factory{};
+  Linker linker{};
+};
+
+TEST_F(LinkerTest, SharedTable) {
+  ASSERT_NE(nullptr, add_program("p1", make_program("fwd", "set_port", 9)));
+  ASSERT_NE(nullptr, add_program("p2", make_program("l2", "forward", 9)));
+
+  const auto &table_linker = linker.get_table_linker();
+  const LinkTables::LinkedTable *linked_1, *linked_2;
+  ASSERT_EQ(ObjectLinkStateCode::TABLE_SHARED,
+            table_linker.get_linked_table("p1", "fwd", linked_1));
+  ASSERT_EQ(ObjectLinkStateCode::TABLE_SHARED,
+            table_linker.get_linked_table("p2", "l2", linked_2));
+  ASSERT_EQ(linked_1, linked_2);
+  ASSERT_EQ(1u, table_linker.get_num_linked_tables());
+  ASSERT_EQ(2048u, linked_1->get_size());
+
+  // the same key for both tenants is prefixed with a different tenant id
+  const std::vector<MatchKeyParam> key({dst_addr("\xaa\xbb\xcc\xdd\xee\xff")});
+  std::vector<MatchKeyParam> linked_key_1, linked_key_2;
+  ASSERT_EQ(ObjectLinkStateCode::TABLE_LINKED,
+            table_linker.get_linked_match_key("p1", "fwd", key,
+                                              linked_key_1));
+  ASSERT_EQ(ObjectLinkStateCode::TABLE_LINKED,
+            table_linker.get_linked_match_key("p2", "l2", key, linked_key_2));
+  LinkTables::tenant_id_t tenant_1, tenant_2;
+  ASSERT_EQ(ObjectLinkStateCode::TABLE_LINKED,
+            table_linker.get_tenant_id("p1", tenant_1));
+  ASSERT_EQ(ObjectLinkStateCode::TABLE_LINKED,
+            table_linker.get_tenant_id("p2", tenant_2));
+  ASSERT_NE(tenant_1, tenant_2);
+  for (const auto &linked : {std::make_pair(tenant_1, &linked_key_1),
+                             std::make_pair(tenant_2, &linked_key_2)}) {
+    const auto &linked_key = *linked.second;
+    ASSERT_EQ(2u, linked_key.size());
+    ASSERT_EQ(MatchKeyParam::Type::EXACT, linked_key.at(0).type);
+    // network byte order
+    std::string tenant_id(LinkTables::tenant_id_bytes, '\x00');
+    tenant_id.back() = static_cast<char>(linked.first);
+    ASSERT_EQ(tenant_id, linked_key.at(0).key);
+    ASSERT_EQ(key.at(0).key, linked_key.at(1).key);
+  }
+
+  std::vector<MatchKeyParam> linked_key;
+  ASSERT_EQ(ObjectLinkStateCode::TABLE_LINK_FAILED,
+            table_linker.get_linked_match_key("p1", "l2", key, linked_key));
+}
+
+TEST_F(LinkerTest, ActionParamWidthMismatch) {
+  ASSERT_NE(nullptr, add_program("p1", make_program("fwd", "set_port", 9)));
+  // same number of action parameters, but not the same bitwidth
+  ASSERT_NE(nullptr, add_program("p2", make_program("fwd", "set_port", 16)));
+
+  const auto &table_linker = linker.get_table_linker();
+  const LinkTables::LinkedTable *linked_1, *linked_2;
+  ASSERT_EQ(ObjectLinkStateCode::TABLE_LINKED,
+            table_linker.get_linked_table("p1", "fwd", linked_1));
+  ASSERT_EQ(ObjectLinkStateCode::TABLE_LINKED,
+            table_linker.get_linked_table("p2", "fwd", linked_2));
+  ASSERT_NE(linked_1, linked_2);
+  ASSERT_NE(linked_1->signature, linked_2->signature);
+  ASSERT_EQ(2u, table_linker.get_num_linked_tables());
+  ASSERT_EQ(1024u, linked_1->get_size());
+}
@@ -0,0 +1,189 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+
+#include <bm/bm_sim/logger.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace bm;
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+int evaluated = 0;
+
+int count_evaluation() {
+  return ++evaluated;
+}
+
+// while blocked, log() does not return
+class BlockingSink : public spdlog::sinks::sink {
+ public:
+  void log(const spdlog::details::log_msg &msg) override {
+    (void) msg;
+    std::unique_lock<std::mutex> lock(mutex);
+    unblocked.wait(lock, [this] { return !blocked; });
+  }
+
+  void flush() override { }
+
+  void set_blocked(bool b) {
+    std::unique_lock<std::mutex> lock(mutex);
+    blocked = b;
+    unblocked.notify_all();
+  }
+
+ private:
+  std::mutex mutex{};
+  std::condition_variable unblocked{};
+  bool blocked{false};
+};
+
+// waits for the background thread to process n messages
+Logger::Stats wait_for_stats(uint64_t n) {
+  auto stats = Logger::get_stats();
+  for (int i = 0; i < 1000 && stats.logged + stats.dropped < n; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    stats = Logger::get_stats();
+  }
+  return stats;
+}
+
+}  // namespace
+
+// The logger is a singleton, so the tests share its state: the tests run in
+// the order in which they are defined, and Async switches to asynchronous mode,
+// which cannot be undone, for the tests which follow it.
+
+TEST(Logger, MacroArgsNotEvaluated) {
+  Logger::set_log_level(Logger::LogLevel::INFO);
+  evaluated = 0;
+  BMLOG_DEBUG("{}", count_evaluation());
+  BMLOG_TRACE("{}", count_evaluation());
+  ASSERT_EQ(0, evaluated);
+  Logger::set_log_level(Logger::LogLevel::TRACE);
+  BMLOG_DEBUG("{}", count_evaluation());
+  BMLOG_TRACE("{}", count_evaluation());
+  int expected = 0;
+#ifdef BMLOG_DEBUG_ON
+  expected++;
+#endif
+#ifdef BMLOG_TRACE_ON
+  expected++;
+#endif
+  ASSERT_EQ(expected, evaluated);
+}
+
+TEST(Logger, Async) {
+  constexpr size_t num_threads = 4;
+  constexpr size_t num_msgs = 100;
+  auto path = fs::temp_directory_path() / fs::unique_path();
+  Logger::set_logger_file(path.string());
+  Logger::set_log_level(Logger::LogLevel::INFO);
+  // re-creates the file logger
+  Logger::enable_async();
+  EXPECT_EQ(spdlog::level::info, Logger::get()->level());
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < num_threads; t++) {
+    threads.emplace_back([t] {
+      for (size_t i = 0; i < num_msgs; i++)
+        Logger::get()->info("msg {} {}", t, i);
+      // filtered out, not counted
+      Logger::get()->debug("msg {}", t);
+    });
+  }
+  for (auto &t : threads) t.join();
+
+  auto stats = Logger::get_stats();
+  for (int i = 0; i < 1000; i++) {
+    if (stats.logged == num_threads * num_msgs) break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    stats = Logger::get_stats();
+  }
+  ASSERT_EQ(num_threads * num_msgs, stats.logged);
+  ASSERT_EQ(0u, stats.dropped);
+  Logger::get()->flush();
+
+  // messages from a given thread are written in order
+  std::vector<size_t> next(num_threads, 0);
+  std::ifstream fs(path.string() + ".txt");
+  std::string line;
+  size_t num_lines = 0;
+  while (std::getline(fs, line)) {
+    auto pos = line.find("msg ");
+    ASSERT_NE(std::string::npos, pos);
+    size_t t, i;
+    ASSERT_EQ(2, sscanf(line.c_str() + pos, "msg %zu %zu", &t, &i));
+    ASSERT_LT(t, num_threads);
+    EXPECT_EQ(next[t], i);
+    next[t] = i + 1;
+    num_lines++;
+  }
+  ASSERT_EQ(num_threads * num_msgs, num_lines);
+  fs::remove(path.string() + ".txt");
+}
+
+TEST(Logger, AsyncOverflow) {
+  // the ring size was set by the previous test
+  constexpr size_t ring_size = Logger::default_ring_size;
+  constexpr size_t num_msgs = ring_size * 2;
+  auto sink = std::make_shared<BlockingSink>();
+  sink->set_blocked(true);
+  Logger::set_logger_sink(sink);
+  Logger::set_log_level(Logger::LogLevel::INFO);
+  for (size_t i = 0; i < num_msgs; i++) Logger::get()->info("msg {}", i);
+  // the background thread cannot write anything, so at most ring_size + 1
+  // messages (including the one being written) can be accepted
+  auto stats = Logger::get_stats();
+  EXPECT_LE(num_msgs - ring_size - 1, stats.dropped);
+  sink->set_blocked(false);
+  stats = wait_for_stats(num_msgs);
+  ASSERT_EQ(num_msgs, stats.logged + stats.dropped);
+  ASSERT_LE(num_msgs - ring_size - 1, stats.dropped);
+}
+
+// the ring of a thread which exited is re-used once it has been drained
+TEST(Logger, AsyncRingReuse) {
+  constexpr size_t num_threads = 8;
+  Logger::set_logger_sink(std::make_shared<BlockingSink>());
+  Logger::set_log_level(Logger::LogLevel::INFO);
+  for (size_t t = 0; t < num_threads; t++) {
+    std::thread thread([t] { Logger::get()->info("msg {}", t); });
+    thread.join();
+    ASSERT_EQ(t + 1, wait_for_stats(t + 1).logged);
+    // leaves time for the background thread to reclaim the ring
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  auto stats = Logger::get_stats();
+  EXPECT_EQ(0u, stats.dropped);
+  EXPECT_EQ(1u, stats.rings);
+}
@@ -0,0 +1,123 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <bm/bm_sim/lookup_structures.h>
+
+#include <memory>
+#include <vector>
+
+using namespace bm;
+
+class ExactLookupStructureTest : public ::testing::TestWithParam<size_t> {
+ protected:
+  static constexpr size_t size = 1024;
+  LookupStructureFactory factory;
+  std::unique_ptr<ExactLookupStructure> structure{nullptr};
+
+  virtual void SetUp() {
+    structure = factory.create_for_exact(size, GetParam());
+  }
+
+  // generates a distinct key of the width given as test parameter
+  ExactMatchKey make_key(size_t i) const {
+    ExactMatchKey key;
+    for (size_t b = 0; b < GetParam(); b++)
+      key.data.push_back(static_cast<char>(i >> (8 * (b % sizeof(i)))));
+    return key;
+  }
+};
+
+constexpr size_t ExactLookupStructureTest::size;
+
+TEST_P(ExactLookupStructureTest, AddLookupDelete) {
+  // more entries than the requested size, to exercise table growth
+  const size_t num_entries = size * 3;
+  for (size_t i = 0; i < num_entries; i++)
+    structure->add_entry(make_key(i), i);
+
+  internal_handle_t handle;
+  for (size_t i = 0; i < num_entries; i++) {
+    const auto key = make_key(i);
+    ASSERT_TRUE(structure->entry_exists(key));
+    ASSERT_TRUE(structure->lookup(key.data, &handle));
+    ASSERT_EQ(i, handle);
+  }
+  ASSERT_FALSE(structure->lookup(make_key(num_entries).data, &handle));
+  // key of the wrong size
+  ASSERT_FALSE(structure->lookup(ByteContainer(GetParam() + 1), &handle));
+
+  // overwrite
+  structure->add_entry(make_key(7), 77);
+  ASSERT_TRUE(structure->retrieve_handle(make_key(7), &handle));
+  ASSERT_EQ(77u, handle);
+
+  for (size_t i = 0; i < num_entries; i += 2)
+    structure->delete_entry(make_key(i));
+  for (size_t i = 0; i < num_entries; i++)
+    ASSERT_EQ(i % 2 == 1, structure->entry_exists(make_key(i)));
+
+  // re-add in the freed (and possibly deleted) slots
+  for (size_t i = 0; i < num_entries; i += 2)
+    structure->add_entry(make_key(i), i);
+  for (size_t i = 0; i < num_entries; i += 3) {
+    ASSERT_TRUE(structure->lookup(make_key(i).data, &handle));
+    ASSERT_EQ(i == 7 ? 77u : i, handle);
+  }
+
+  structure->clear();
+  ASSERT_FALSE(structure->entry_exists(make_key(1)));
+}
+
+TEST_P(ExactLookupStructureTest, Churn) {
+  // repeatedly add and delete entries, which leaves tombstones behind
+  internal_handle_t handle;
+  for (size_t round = 0; round < 20; round++) {
+    for (size_t i = 0; i < size; i++)
+      structure->add_entry(make_key(round * size + i), i);
+    for (size_t i = 0; i < size; i++) {
+      ASSERT_TRUE(structure->lookup(make_key(round * size + i).data, &handle));
+      structure->delete_entry(make_key(round * size + i));
+    }
+  }
+  ASSERT_FALSE(structure->lookup(make_key(0).data, &handle));
+}
+
+TEST_P(ExactLookupStructureTest, Batch) {
+  for (size_t i = 0; i < size; i += 2)
+    structure->add_entry(make_key(i), i);
+
+  std::vector<ByteContainer> keys;
+  for (size_t i = 0; i < size; i++) keys.push_back(make_key(i).data);
+  std::vector<internal_handle_t> handles(size);
+  std::unique_ptr<bool[]> hits(new bool[size]);
+  structure->lookup_batch(size, keys.data(), handles.data(), hits.get());
+  for (size_t i = 0; i < size; i++) {
+    ASSERT_EQ(i % 2 == 0, hits[i]);
+    if (hits[i]) {
+      ASSERT_EQ(i, handles[i]);
+    }
+  }
+}
+
+INSTANTIATE_TEST_CASE_P(ExactLookupStructureKeyWidths,
+                        ExactLookupStructureTest,
+                        ::testing::Values(2, 6, 8, 13, 16, 20));
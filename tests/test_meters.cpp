@@ -28,6 +28,7 @@
 #include <thread>
 #include <chrono>
 #include <vector>
+#include <atomic>
 
 using namespace bm;
 
@@ -191,3 +192,117 @@ TEST_F(MetersTest, PreColor) {
   ASSERT_EQ(RED, meter.execute(pkt, RED));
   ASSERT_EQ(GREEN, meter.execute(pkt));
 }
+
+// Many threads executing the same meter, which is what happens with policers
+// on shared aggregates. This checks that the meter does not let more packets
+// through than the configured rates allow.
+TEST_F(MetersTest, Contention) {
+  const color_t GREEN = 0;
+  const color_t YELLOW = 1;
+  const color_t RED = 2;
+
+  Meter meter(MeterType::PACKETS, 2);
+  // committed : 1000 packets per second, burst size of 100
+  Meter::rate_config_t committed_rate = {0.001, 100};
+  // peak : 10000 packets per second, burst size of 500
+  Meter::rate_config_t peak_rate = {0.01, 500};
+  meter.set_rates({committed_rate, peak_rate});
+
+  const size_t nthreads = 4;
+  const size_t iterations = 100000;
+
+  std::vector<std::vector<size_t> > color_counts(
+      nthreads, std::vector<size_t>(3, 0));
+
+  Meter::reset_global_clock();
+  auto start = clock::now();
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < nthreads; t++) {
+    threads.emplace_back([this, t, &meter, &color_counts, iterations]() {
+      Packet pkt = get_pkt(128);
+      for (size_t i = 0; i < iterations; i++)
+        color_counts[t][meter.execute(pkt)]++;
+    });
+  }
+  for (auto &thread : threads) thread.join();
+
+  auto end = clock::now();
+  auto elapsed_us = static_cast<double>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          end - start).count());
+
+  size_t greens = 0, yellows = 0, reds = 0;
+  for (const auto &counts : color_counts) {
+    greens += counts[GREEN];
+    yellows += counts[YELLOW];
+    reds += counts[RED];
+  }
+  ASSERT_EQ(nthreads * iterations, greens + yellows + reds);
+
+  // tokens are generated by the meter based on its own clock, which started
+  // slightly before ours
+  const double slack = 2.0;
+  ASSERT_GT(greens, 0u);
+  ASSERT_LE(greens,
+            committed_rate.burst_size + committed_rate.info_rate * elapsed_us +
+            slack);
+  ASSERT_LE(greens + yellows,
+            peak_rate.burst_size + peak_rate.info_rate * elapsed_us + slack);
+}
+
+// Rates are changed while packets are being metered: executions never see a
+// mix of old and new rates, and in particular, the new token buckets are not
+// corrupted by executions which started with the old rates, i.e. they start
+// full after the last change.
+TEST_F(MetersTest, SetRatesWhileExecuting) {
+  const color_t GREEN = 0;
+
+  Meter meter(MeterType::PACKETS, 2);
+  // very high rates, which execute() multiplies by the number of microseconds
+  // since the meter clock started, and very low rates, for which a watermark
+  // computed with the high rates would keep the meter RED for a very long
+  // time; the burst size of the low rates is large enough for the executions
+  // which happen after the last change
+  const std::vector<Meter::rate_config_t> high_rates = {{1000000., 1000},
+                                                         {2000000., 2000}};
+  const std::vector<Meter::rate_config_t> low_rates = {{0.000001, 1000000000},
+                                                        {0.000002, 2000000000}};
+  ASSERT_EQ(Meter::SUCCESS, meter.set_rates(high_rates));
+
+  const size_t nthreads = 4;
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < nthreads; t++) {
+    threads.emplace_back([this, &meter, &stop]() {
+      Packet pkt = get_pkt(128);
+      while (!stop) meter.execute(pkt);
+    });
+  }
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_EQ(Meter::SUCCESS,
+              meter.set_rates((i % 2 == 0) ? low_rates : high_rates));
+  }
+  ASSERT_EQ(Meter::SUCCESS, meter.set_rates(low_rates));
+  stop = true;
+  for (auto &thread : threads) thread.join();
+
+  Packet pkt = get_pkt(128);
+  ASSERT_EQ(GREEN, meter.execute(pkt));
+}
+
+TEST_F(MetersTest, InvalidRatesLeaveMeterUntouched) {
+  Meter meter(MeterType::PACKETS, 2);
+  const std::vector<Meter::rate_config_t> rates = {{0.001, 100},
+                                                    {0.01, 500}};
+  ASSERT_EQ(Meter::SUCCESS, meter.set_rates(rates));
+  // committed rate greater than the peak rate
+  ASSERT_EQ(Meter::INVALID_INFO_RATE_VALUE,
+            meter.set_rates({{0.01, 100}, {0.001, 500}}));
+  const auto current_rates = meter.get_rates();
+  ASSERT_EQ(2u, current_rates.size());
+  for (size_t i = 0; i < rates.size(); i++) {
+    ASSERT_EQ(rates[i].info_rate, current_rates[i].info_rate);
+    ASSERT_EQ(rates[i].burst_size, current_rates[i].burst_size);
+  }
+}
@@ -23,6 +23,8 @@
 #include <boost/filesystem.hpp>
 
 #include <bm/bm_sim/P4Objects.h>
+#include <bm/bm_sim/packet.h>
+#include <bm/bm_sim/phv_source.h>
 
 #include <ctype.h>
 
@@ -307,6 +309,66 @@ TEST(P4Objects, TableDefaultEntry) {
   ASSERT_EQ(0xab, entry.action_data.get(0).get_int());
 }
 
+// the selectors installed by enable_resilient_group_selection() only remap the
+// flows of the removed member, unlike the default selection (hash modulo the
+// number of members)
+TEST(P4Objects, ResilientGroupSelection) {
+  std::stringstream is;
+  is << "{\"header_types\":[{\"name\":\"h_t\",\"id\":0,"
+     << "\"fields\":[[\"f\",8]]}],\"headers\":[{\"name\":\"h\",\"id\":0,"
+     << "\"header_type\":\"h_t\"}],\"pipelines\":[{\"name\":\"ingress\","
+     << "\"id\":0,\"init_table\":null,\"tables\":[],\"action_profiles\":"
+     << "[{\"name\":\"ap\",\"id\":0,\"max_size\":16,\"selector\":"
+     << "{\"algo\":\"identity\",\"input\":[{\"type\":\"field\","
+     << "\"value\":[\"h\",\"f\"]}]}}]}],\"actions\":[{\"name\":\"a0\","
+     << "\"id\":0,\"runtime_data\":[],\"primitives\":[]}]}";
+  P4Objects objects;
+  LookupStructureFactory factory;
+  ASSERT_EQ(0, objects.init_objects(&is, &factory));
+  objects.enable_resilient_group_selection(64);
+
+  auto action_profile = objects.get_action_profile("ap");
+  auto action_fn = objects.get_one_action_with_name("a0");
+  ActionProfile::grp_hdl_t grp;
+  ASSERT_EQ(MatchErrorCode::SUCCESS, action_profile->create_group(&grp));
+  std::vector<ActionProfile::mbr_hdl_t> mbrs(4);
+  for (auto &mbr : mbrs) {
+    ASSERT_EQ(MatchErrorCode::SUCCESS,
+              action_profile->add_member(action_fn, ActionData(), &mbr));
+    ASSERT_EQ(MatchErrorCode::SUCCESS,
+              action_profile->add_member_to_group(mbr, grp));
+  }
+
+  std::unique_ptr<PHVSourceIface> phv_source =
+      PHVSourceIface::make_phv_source();
+  phv_source->set_phv_factory(0, &objects.get_phv_factory());
+  auto pkt = Packet::make_new(phv_source.get());
+  auto &f = pkt.get_phv()->get_field("h.f");
+  const auto index = ActionProfile::IndirectIndex::make_grp_index(grp);
+  auto select_all = [&action_profile, &pkt, &f, &index]() {
+    std::vector<const ActionEntry *> selected;
+    for (int v = 0; v < 256; v++) {
+      f.set(v);
+      selected.push_back(&action_profile->lookup(pkt, index));
+    }
+    return selected;
+  };
+
+  const ActionEntry *removed = &action_profile->lookup(
+      pkt, ActionProfile::IndirectIndex::make_mbr_index(mbrs[3]));
+  const auto before = select_all();
+  ASSERT_EQ(MatchErrorCode::SUCCESS,
+            action_profile->remove_member_from_group(mbrs[3], grp));
+  const auto after = select_all();
+  for (size_t i = 0; i < before.size(); i++) {
+    if (before[i] != removed) {
+      ASSERT_EQ(before[i], after[i]);
+    } else {
+      ASSERT_NE(removed, after[i]);
+    }
+  }
+}
+
 TEST(P4Objects, ParseVset) {
   fs::path json_path = fs::path(TESTDATADIR) / fs::path("parse_vset.json");
   std::ifstream is(json_path.string());
@@ -1002,3 +1064,79 @@ TEST(P4Objects, LearnListIdFromName) {
   ASSERT_EQ(P4Objects::IdLookupErrorCode::SUCCESS, rc);
   EXPECT_EQ(id, queried_id);
 }
+
+TEST(P4Objects, RegisterSyncMode) {
+  auto create_json = [](const std::string &sync_mode, int bitwidth,
+                        const std::string &param_type, std::ostream *os) {
+    *os << "{\"register_arrays\":[{\"name\":\"r\",\"id\":0,\"size\":16,"
+        << "\"bitwidth\":" << bitwidth << ",\"sync_mode\":\"" << sync_mode
+        << "\",\"num_stripes\":8}]";
+    if (param_type.empty()) {
+      *os << "}";
+      return;
+    }
+    // register_write(r, 0, <param>)
+    const std::string register_ref(
+        "{\"type\":\"register\",\"value\":[\"r\","
+        "{\"type\":\"hexstr\",\"value\":\"0x1\"}]}");
+    const std::string one("{\"type\":\"hexstr\",\"value\":\"0x1\"}");
+    *os << ",\"actions\":[{\"name\":\"a\",\"id\":0,\"runtime_data\":[],"
+        << "\"primitives\":[{\"op\":\"register_write\",\"parameters\":["
+        << "{\"type\":\"register_array\",\"value\":\"r\"},"
+        << "{\"type\":\"hexstr\",\"value\":\"0x0\"},";
+    if (param_type == "register") {
+      *os << register_ref;
+    } else {
+      *os << "{\"type\":\"expression\",\"value\":{\"type\":\"expression\","
+          << "\"value\":{\"op\":\"+\",\"left\":" << register_ref
+          << ",\"right\":" << one << "}}}";
+    }
+    *os << "]}]}]}";
+  };
+  LookupStructureFactory factory;
+
+  {
+    std::stringstream is;
+    create_json("striped", 32, "register", &is);
+    P4Objects objects;
+    ASSERT_EQ(0, objects.init_objects(&is, &factory));
+    auto register_array = objects.get_register_array("r");
+    EXPECT_EQ(RegisterArray::SyncMode::STRIPED,
+              register_array->get_sync_mode());
+  }
+
+  for (const auto &param_type : {"register", "expression"}) {
+    std::stringstream is;
+    create_json("lock_free", 32, param_type, &is);
+    std::stringstream os;
+    P4Objects objects(os);
+    std::string expected(
+        "Register array 'r' uses sync_mode 'lock_free' and cannot be accessed "
+        "directly with an index\n");
+    ASSERT_NE(0, objects.init_objects(&is, &factory));
+    EXPECT_EQ(expected, os.str());
+  }
+
+  {
+    std::stringstream is;
+    create_json("lock_free", 128, "", &is);
+    std::stringstream os;
+    P4Objects objects(os);
+    std::string expected(
+        "sync_mode 'lock_free' requires a bitwidth <= 64 for register array "
+        "'r'\n");
+    ASSERT_NE(0, objects.init_objects(&is, &factory));
+    EXPECT_EQ(expected, os.str());
+  }
+
+  {
+    std::stringstream is;
+    create_json("bad_mode", 32, "", &is);
+    std::stringstream os;
+    P4Objects objects(os);
+    std::string expected(
+        "Invalid sync_mode 'bad_mode' for register array 'r'\n");
+    ASSERT_NE(0, objects.init_objects(&is, &factory));
+    EXPECT_EQ(expected, os.str());
+  }
+}
@@ -336,6 +336,80 @@ TEST_F(ParserTest, DeparseEthernetIPv4_Stress) {
   }
 }
 
+TEST_F(ParserTest, DeparseUnmodifiedHeaders) {
+  auto packet = get_tcp_pkt();
+  auto phv = packet.get_phv();
+  parse_and_check_no_error(&packet);
+
+  // headers which were just extracted can be deparsed by copying the original
+  // packet bytes
+  const auto &ethernet_hdr = phv->get_header(ethernetHeader);
+  const auto &ipv4_hdr = phv->get_header(ipv4Header);
+  const auto &tcp_hdr = phv->get_header(tcpHeader);
+  ASSERT_FALSE(ethernet_hdr.is_modified());
+  ASSERT_FALSE(ipv4_hdr.is_modified());
+  ASSERT_FALSE(tcp_hdr.is_modified());
+  const char *ethernet_bytes = phv->get_packet_bytes(ethernet_hdr);
+  ASSERT_NE(nullptr, ethernet_bytes);
+  ASSERT_EQ(ethernet_bytes + ethernet_hdr.get_nbytes_packet(),
+            phv->get_packet_bytes(ipv4_hdr));
+  ASSERT_EQ(0, memcmp(raw_tcp_pkt, ethernet_bytes, 14));
+  ASSERT_EQ(nullptr, phv->get_packet_bytes(phv->get_header(udpHeader)));
+
+  // marking a header valid / invalid does not modify its packet fields
+  phv->get_header(ipv4Header).mark_invalid();
+  phv->get_header(ipv4Header).mark_valid();
+  ASSERT_FALSE(ipv4_hdr.is_modified());
+
+  deparser.deparse(&packet);
+  ASSERT_EQ(sizeof(raw_tcp_pkt), packet.get_data_size());
+  ASSERT_EQ(0, memcmp(raw_tcp_pkt, packet.data(), sizeof(raw_tcp_pkt)));
+}
+
+TEST_F(ParserTest, DeparseModifiedHeader) {
+  auto packet = get_tcp_pkt();
+  auto phv = packet.get_phv();
+  parse_and_check_no_error(&packet);
+
+  auto &ipv4_ttl = phv->get_field(ipv4Header, 7);
+  ipv4_ttl.set(0x3f);
+  const auto &ipv4_hdr = phv->get_header(ipv4Header);
+  ASSERT_TRUE(ipv4_hdr.is_modified());
+  ASSERT_EQ(nullptr, phv->get_packet_bytes(ipv4_hdr));
+  ASSERT_FALSE(phv->get_header(tcpHeader).is_modified());
+
+  deparser.deparse(&packet);
+  std::vector<char> expected(raw_tcp_pkt, raw_tcp_pkt + sizeof(raw_tcp_pkt));
+  expected.at(14 + 8) = 0x3f;
+  ASSERT_EQ(expected.size(), packet.get_data_size());
+  ASSERT_EQ(0, memcmp(expected.data(), packet.data(), expected.size()));
+}
+
+TEST_F(ParserTest, DeparseReorderedHeaders) {
+  // the original packet bytes for tcp and ipv4 are not consecutive in the
+  // output, so they cannot be copied together
+  Deparser deparser_reorder("test_deparser_reorder", 1);
+  deparser_reorder.push_back_header(ethernetHeader);
+  deparser_reorder.push_back_header(tcpHeader);
+  deparser_reorder.push_back_header(ipv4Header);
+
+  auto packet = get_tcp_pkt();
+  parse_and_check_no_error(&packet);
+
+  deparser_reorder.deparse(&packet);
+  const size_t ethernet_size = 14, ipv4_size = 20, tcp_size = 20;
+  std::vector<char> expected;
+  const char *raw = reinterpret_cast<const char *>(raw_tcp_pkt);
+  const char *ipv4 = raw + ethernet_size;
+  const char *tcp = ipv4 + ipv4_size;
+  expected.insert(expected.end(), raw, ipv4);
+  expected.insert(expected.end(), tcp, tcp + tcp_size);
+  expected.insert(expected.end(), ipv4, tcp);
+  expected.insert(expected.end(), tcp + tcp_size, raw + sizeof(raw_tcp_pkt));
+  ASSERT_EQ(expected.size(), packet.get_data_size());
+  ASSERT_EQ(0, memcmp(expected.data(), packet.data(), expected.size()));
+}
+
 TEST(LookAhead, Peek) {
   ByteContainer res;
   // 1011 0101, 1001 1101, 1111 1101, 0001 0111, 1101 0101, 1101 0111
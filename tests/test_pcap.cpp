@@ -19,7 +19,10 @@
 
 #include <bm/bm_sim/pcap_file.h>
 
+#include <chrono>
 #include <string>
+#include <utility>
+#include <vector>
 // TODO(unknown): is this still needed?
 #include <cstdio>
 
@@ -237,3 +240,107 @@ TEST_F(PcapTest, Write) {
   Status comparison = comparator.compare(getFile1(), getTmpFile());
   ASSERT_EQ(Status::OK, comparison);
 }
+
+namespace {
+
+struct ReplayRecorder {
+  std::vector<std::pair<int, std::string> > packets{};
+
+  static void handler(int port_num, const char *buffer, int len,
+                      void *cookie) {
+    auto recorder = static_cast<ReplayRecorder *>(cookie);
+    recorder->packets.emplace_back(port_num, std::string(buffer, len));
+  }
+};
+
+}  // namespace
+
+TEST_F(PcapTest, ReplaySameOrderAsReader) {
+  ReplayRecorder expected;
+  PcapFilesReader reader(false, 0);
+  reader.addFile(0, getFile1());
+  reader.addFile(1, getFile2());
+  reader.set_packet_handler(ReplayRecorder::handler,
+                            static_cast<void *>(&expected));
+  reader.start();
+
+  ReplayRecorder actual;
+  PcapReplayConfig config;
+  config.burst_size = 7;
+  config.loops = 2;
+  PcapReplayer replayer(config, 0);
+  replayer.addFile(0, getFile1());
+  replayer.addFile(1, getFile2());
+  replayer.set_packet_handler(ReplayRecorder::handler,
+                              static_cast<void *>(&actual));
+  ASSERT_EQ(expected.packets.size(), replayer.numPackets());
+  replayer.start();
+
+  ASSERT_EQ(2 * expected.packets.size(), actual.packets.size());
+  for (size_t i = 0; i < actual.packets.size(); i++)
+    ASSERT_EQ(expected.packets[i % expected.packets.size()], actual.packets[i]);
+
+  auto stats = replayer.getStats();
+  ASSERT_EQ(actual.packets.size(), stats.packets);
+  uint64_t bytes = 0;
+  for (const auto &p : actual.packets) bytes += p.second.size();
+  ASSERT_EQ(bytes, stats.bytes);
+}
+
+TEST_F(PcapTest, ReplayFixedPps) {
+  PcapReplayConfig config;
+  ASSERT_TRUE(config.parsePacing("pps=1000"));
+  ASSERT_EQ(PcapReplayConfig::Pacing::FIXED_PPS, config.pacing);
+  config.burst_size = 1;
+  PcapReplayer replayer(config, 0);
+  replayer.addFile(0, getFile1());
+  replayer.set_packet_handler(packet_handler, static_cast<void *>(this));
+  const size_t num_packets = replayer.numPackets();
+  ASSERT_LT(1u, num_packets);
+
+  auto start = std::chrono::steady_clock::now();
+  replayer.start();
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  ASSERT_EQ(num_packets, static_cast<size_t>(received));
+  // the last packet cannot be sent before (num_packets - 1) ms
+  ASSERT_GE(std::chrono::duration_cast<std::chrono::milliseconds>(
+      elapsed).count(), static_cast<int64_t>(num_packets - 1));
+}
+
+TEST_F(PcapTest, ReplayParsePacing) {
+  PcapReplayConfig config;
+  ASSERT_TRUE(config.parsePacing("max"));
+  ASSERT_EQ(PcapReplayConfig::Pacing::MAX_RATE, config.pacing);
+  ASSERT_TRUE(config.parsePacing("speed=2.5"));
+  ASSERT_EQ(PcapReplayConfig::Pacing::TIMESTAMP, config.pacing);
+  ASSERT_EQ(2.5, config.time_scale);
+  ASSERT_FALSE(config.parsePacing("pps=abc"));
+  ASSERT_FALSE(config.parsePacing("pps=0"));
+  ASSERT_FALSE(config.parsePacing("fast"));
+}
+
+TEST_F(PcapTest, WriteAsync) {
+  using Status = PcapFileComparator::Status;
+
+  PcapFilesReader reader(false, 0);
+  reader.addFile(0, getFile1());
+  reader.addFile(1, getFile2());
+  reader.set_packet_handler(packet_handler, static_cast<void *>(this));
+
+  {
+    PcapFilesWriter writer(true);
+    setReceiver(&writer);
+    // only write packets for port 0, drop packets for port 1
+    writer.addFile(0, getTmpFile());
+
+    reader.start();
+    setReceiver(nullptr);
+    ASSERT_EQ(static_cast<uint64_t>(received), writer.packetCount());
+    // destroying the writer waits for all packets to be written
+  }
+
+  PcapFileComparator comparator(false);
+  Status comparison = comparator.compare(getFile1(), getTmpFile());
+  ASSERT_EQ(Status::OK, comparison);
+}
@@ -24,8 +24,11 @@
 
 #include <memory>
 #include <string>
+#include <utility>
 
 #include <cassert>
+#include <cstdint>
+#include <cstring>
 
 using namespace bm;
 
@@ -89,6 +92,48 @@ TEST_F(PHVTest, CopyHeaders) {
   ASSERT_EQ(f48, f48_2);
 }
 
+TEST_F(PHVTest, FieldStorage) {
+  // 2 + 6 + 1 ($valid$) bytes per header, rounded up to 16
+  ASSERT_EQ(9u, testHeaderType.get_storage_nbytes());
+  ASSERT_EQ(32u, phv_factory.get_storage_nbytes());
+  ASSERT_EQ(32u, phv->get_storage_nbytes());
+
+  const Header &hdr1 = phv->get_header(testHeader1);
+  const Header &hdr2 = phv->get_header(testHeader2);
+  const char *storage = hdr1.get_field_storage(0);
+  ASSERT_NE(nullptr, storage);
+  ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(storage) % 64);
+  ASSERT_EQ(storage + 2, hdr1.get_field_storage(1));
+  ASSERT_EQ(storage + 8, hdr1.get_field_storage(2));
+  ASSERT_EQ(storage + 16, hdr2.get_field_storage(0));
+
+  Field &f48 = phv->get_field(testHeader1, 1);
+  f48.set("0xaabbccddeeff");
+  ASSERT_EQ(storage + 2, f48.get_bytes().data());
+  ASSERT_EQ(ByteContainer("0xaabbccddeeff"), f48.get_bytes());
+  ASSERT_EQ(0, std::memcmp(storage + 2, "\xaa\xbb\xcc\xdd\xee\xff", 6));
+
+  // a moved PHV keeps its storage
+  PHV moved(std::move(*phv));
+  ASSERT_EQ(storage, moved.get_header(testHeader1).get_field_storage(0));
+}
+
+TEST_F(PHVTest, CopyHeadersInvalid) {
+  std::unique_ptr<PHV> phv_2 = phv_factory.create();
+
+  // the whole storage is copied, so invalid headers receive the field values
+  // as well, and the bytes and values of fields need to remain consistent
+  Field &f16 = phv->get_field(testHeader2, 0);
+  f16.set(0xaba);
+  phv_2->copy_headers(*phv);
+
+  const Field &f16_2 = phv_2->get_field(testHeader2, 0);
+  ASSERT_FALSE(phv_2->get_header(testHeader2).is_valid());
+  ASSERT_EQ(0xabau, f16_2.get_uint());
+  ASSERT_EQ(ByteContainer("0x0aba"), f16_2.get_bytes());
+  ASSERT_EQ(0u, phv_2->get_field(testHeader1, 0).get_uint());
+}
+
 // we are testing that the $valid$ hidden field is properly added internally by
 // the HeaderType class, that it is properly accessible and that it is updated
 // properly.
@@ -22,7 +22,12 @@
 
 #include <bm/bm_sim/stateful.h>
 
+#include <thread>
+#include <vector>
+
 using bm::RegisterArray;
+using bm::RegisterSync;
+using bm::Data;
 
 // Google Test fixture for Stateful tests
 class StatefulTest : public ::testing::Test {
@@ -70,3 +75,148 @@ TEST_F(StatefulTest, Notifier) {
     ASSERT_EQ(index_test_v, index);
   }
 }
+
+// Google Test fixture for the RegisterArray synchronization modes
+class StatefulSyncModeTest
+    : public StatefulTest,
+      public ::testing::WithParamInterface<RegisterArray::SyncMode> {
+ protected:
+  virtual void SetUp() {
+    ASSERT_TRUE(reg_array.set_sync_mode(GetParam(), 16));
+  }
+};
+
+TEST_P(StatefulSyncModeTest, PerIndex) {
+  size_t index(size);
+  reg_array.register_notifier([&index](size_t idx) { index = idx; });
+
+  Data v;
+  reg_array.write(3, Data(0x1234));
+  ASSERT_EQ(3u, index);
+  reg_array.read(3, &v);
+  ASSERT_EQ(0x1234u, v.get<uint64_t>());
+
+  reg_array.store(4, 0xffffffffull);
+  ASSERT_EQ(0xffffffffull, reg_array.fetch_add(4, 2));
+  ASSERT_EQ(1u, reg_array.load(4));  // wraps around at bitwidth
+  ASSERT_EQ(1u, reg_array.fetch_or(4, 0x100000002ull));
+  ASSERT_EQ(3u, reg_array.load(4));  // truncated to bitwidth
+
+  uint64_t expected = 2;
+  ASSERT_FALSE(reg_array.compare_exchange(4, &expected, 7));
+  ASSERT_EQ(3u, expected);
+  ASSERT_TRUE(reg_array.compare_exchange(4, &expected, 7));
+  ASSERT_EQ(7u, reg_array.load(4));
+  ASSERT_EQ(4u, index);
+
+  reg_array.reset_state();
+  ASSERT_EQ(0u, reg_array.load(4));
+}
+
+TEST_P(StatefulSyncModeTest, Concurrent) {
+  constexpr size_t num_threads = 4;
+  constexpr size_t iterations = 10000;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < num_threads; t++) {
+    threads.emplace_back([this] {
+      for (size_t i = 0; i < iterations; i++) {
+        reg_array.fetch_add(i % size, 1);
+        // CAS-based increment on a shared index
+        uint64_t v = reg_array.load(0);
+        while (!reg_array.compare_exchange(0, &v, v + 1)) { }
+      }
+    });
+  }
+  for (auto &t : threads) t.join();
+
+  uint64_t sum = 0;
+  for (size_t i = 1; i < size; i++) sum += reg_array.load(i);
+  // index 0 is incremented by both fetch_add and compare_exchange
+  ASSERT_EQ(num_threads * iterations * 2, sum + reg_array.load(0));
+  ASSERT_EQ(num_threads * (iterations / size + 1) + num_threads * iterations,
+            reg_array.load(0));
+}
+
+INSTANTIATE_TEST_CASE_P(
+    StatefulSyncModes, StatefulSyncModeTest,
+    ::testing::Values(RegisterArray::SyncMode::ARRAY_LOCK,
+                      RegisterArray::SyncMode::STRIPED,
+                      RegisterArray::SyncMode::LOCK_FREE));
+
+TEST_F(StatefulTest, SyncModeSwitch) {
+  {
+    auto lock = reg_array.unique_lock();
+    reg_array.at(7).set(77);
+  }
+  ASSERT_TRUE(reg_array.set_sync_mode(RegisterArray::SyncMode::LOCK_FREE));
+  ASSERT_EQ(77u, reg_array.load(7));
+  reg_array.store(8, 88);
+  ASSERT_TRUE(reg_array.set_sync_mode(RegisterArray::SyncMode::STRIPED));
+  ASSERT_EQ(77u, reg_array.at(7).get<uint64_t>());
+  ASSERT_EQ(88u, reg_array.at(8).get<uint64_t>());
+
+  RegisterArray wide_array("wide", 1, 4, 128);
+  ASSERT_FALSE(wide_array.set_sync_mode(RegisterArray::SyncMode::LOCK_FREE));
+  ASSERT_EQ(RegisterArray::SyncMode::ARRAY_LOCK, wide_array.get_sync_mode());
+  ASSERT_TRUE(wide_array.set_sync_mode(RegisterArray::SyncMode::STRIPED));
+  Data v;
+  wide_array.write(1, Data("0x1000000000000000000000000"));
+  wide_array.read(1, &v);
+  ASSERT_EQ(Data("0x1000000000000000000000000"), v);
+}
+
+// only the stripes of the indices referenced are acquired
+TEST_F(StatefulTest, RegisterSyncIndices) {
+  ASSERT_TRUE(reg_array.set_sync_mode(RegisterArray::SyncMode::STRIPED, 4));
+  RegisterSync sync;
+  sync.add_register_index(&reg_array, 1);
+  sync.add_register_index(&reg_array, 5);  // same stripe as 1
+  {
+    RegisterSync::RegisterLocks RL;
+    sync.lock(&RL);
+    ASSERT_EQ(1u, RL.v.size());
+    ASSERT_TRUE(RegisterSync::is_held(&reg_array, 1));
+    ASSERT_TRUE(RegisterSync::is_held(&reg_array, 5));
+    ASSERT_FALSE(RegisterSync::is_held(&reg_array, 2));
+    // another thread can access a different stripe in the meantime
+    std::thread t([this] { reg_array.store(2, 22); });
+    t.join();
+    reg_array.store(1, 11);
+  }
+  ASSERT_FALSE(RegisterSync::is_held(&reg_array, 1));
+  ASSERT_EQ(22u, reg_array.load(2));
+  ASSERT_EQ(11u, reg_array.load(1));
+
+  // with a single lock, holding an index means holding the whole array
+  ASSERT_TRUE(reg_array.set_sync_mode(RegisterArray::SyncMode::ARRAY_LOCK));
+  {
+    RegisterSync::RegisterLocks RL;
+    sync.lock(&RL);
+    ASSERT_EQ(1u, RL.v.size());
+    ASSERT_TRUE(RegisterSync::is_held(&reg_array, 2));
+  }
+}
+
+// an array which is only accessed through the per-index methods is not
+// acquired, unless specific indices are referenced as well
+TEST_F(StatefulTest, RegisterSyncUnlocked) {
+  ASSERT_TRUE(reg_array.set_sync_mode(RegisterArray::SyncMode::STRIPED, 4));
+  RegisterSync sync;
+  sync.add_register_array_unlocked(&reg_array);
+  {
+    RegisterSync::RegisterLocks RL;
+    sync.lock(&RL);
+    ASSERT_EQ(0u, RL.v.size());
+    ASSERT_FALSE(RegisterSync::is_held(&reg_array, 0));
+  }
+
+  RegisterSync sync_index;
+  sync_index.add_register_index(&reg_array, 1);
+  sync.merge_from(sync_index);
+  {
+    RegisterSync::RegisterLocks RL;
+    sync.lock(&RL);
+    ASSERT_EQ(4u, RL.v.size());
+    ASSERT_TRUE(RegisterSync::is_held(&reg_array, 2));
+  }
+}
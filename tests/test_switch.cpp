@@ -31,6 +31,7 @@
 #include <string>
 #include <thread>
 #include <map>
+#include <memory>
 
 #include "utils.h"
 
@@ -153,6 +154,31 @@ TEST(Switch, InitObjectsEmpty) {
   EXPECT_NEAR(elapsed, 1000, 500);
 }
 
+TEST(Switch, LoadNewObjects) {
+  SwitchTest sw;
+  ASSERT_EQ(0, sw.init_objects_empty(0, nullptr));
+  ASSERT_EQ(nullptr, sw.get_parser("parser"));
+
+  fs::path config_path = fs::path(TESTDATADIR) / fs::path("serialize.json");
+  std::ifstream is(config_path.string());
+  LookupStructureFactory factory;
+  auto p4objects = std::make_shared<P4Objects>();
+  ASSERT_EQ(0, p4objects->init_objects(&is, &factory));
+
+  ASSERT_EQ(RuntimeInterface::ErrorCode::CONFIG_SWAP_DISABLED,
+            sw.load_new_objects(0, p4objects));
+  sw.enable_config_swap();
+  ASSERT_EQ(RuntimeInterface::ErrorCode::SUCCESS,
+            sw.load_new_objects(0, p4objects));
+  ASSERT_EQ(RuntimeInterface::ErrorCode::ONGOING_SWAP,
+            sw.load_new_objects(0, p4objects));
+  // not used until the swap
+  ASSERT_EQ(nullptr, sw.get_parser("parser"));
+  ASSERT_EQ(RuntimeInterface::ErrorCode::SUCCESS, sw.swap_configs());
+  ASSERT_EQ(p4objects->get_parser_rt("parser"), sw.get_parser("parser"));
+  ASSERT_NE(nullptr, sw.get_pipeline("ingress"));
+}
+
 TEST(Switch, GetP4Objects) {
   // re-using serialize.json here as a convenience
   fs::path config_path = fs::path(TESTDATADIR) / fs::path("serialize.json");
@@ -964,6 +964,57 @@ TYPED_TEST(TableSizeTwo, GetEntries) {
   }
 }
 
+TYPED_TEST(TableSizeTwo, GetEntriesPage) {
+  MatchErrorCode rc;
+  entry_handle_t handle_1, handle_2, handle_3;
+  std::string key_1("\xaa\xaa");
+  std::string key_2("\xbb\xbb");
+  std::string key_3("\xcc\xcc");
+
+  rc = this->add_entry(key_1, &handle_1);
+  ASSERT_EQ(MatchErrorCode::SUCCESS, rc);
+  rc = this->add_entry(key_2, &handle_2);
+  ASSERT_EQ(MatchErrorCode::SUCCESS, rc);
+
+  MatchTableAbstract::EntryCursor cursor;
+  auto entries = this->table->get_entries_page(1, &cursor);
+  ASSERT_EQ(1u, entries.size());
+  ASSERT_EQ(handle_1, entries[0].handle);
+  ASSERT_EQ(key_1, entries[0].match_key[0].key);
+  ASSERT_FALSE(cursor.done);
+  entries = this->table->get_entries_page(1, &cursor);
+  ASSERT_EQ(1u, entries.size());
+  ASSERT_EQ(handle_2, entries[0].handle);
+  ASSERT_TRUE(cursor.done);
+  ASSERT_FALSE(cursor.modified);
+  ASSERT_TRUE(this->table->get_entries_page(1, &cursor).empty());
+
+  // updating the counters in-between pages does not modify the entries
+  cursor = MatchTableAbstract::EntryCursor();
+  entries = this->table->get_entries_page(1, &cursor);
+  rc = this->table->write_counters(handle_1, 64, 1);
+  ASSERT_EQ(MatchErrorCode::SUCCESS, rc);
+  entries = this->table->get_entries_page(1, &cursor);
+  ASSERT_TRUE(cursor.done);
+  ASSERT_FALSE(cursor.modified);
+
+  // the table is modified in-between pages: the entry which was present for
+  // the whole iteration is still returned, the new one re-uses the slot of the
+  // deleted one and is not
+  cursor = MatchTableAbstract::EntryCursor();
+  entries = this->table->get_entries_page(1, &cursor);
+  ASSERT_EQ(handle_1, entries[0].handle);
+  rc = this->table->delete_entry(handle_1);
+  ASSERT_EQ(MatchErrorCode::SUCCESS, rc);
+  rc = this->add_entry(key_3, &handle_3);
+  ASSERT_EQ(MatchErrorCode::SUCCESS, rc);
+  entries = this->table->get_entries_page(8, &cursor);
+  ASSERT_EQ(1u, entries.size());
+  ASSERT_EQ(handle_2, entries[0].handle);
+  ASSERT_TRUE(cursor.done);
+  ASSERT_TRUE(cursor.modified);
+}
+
 TYPED_TEST(TableSizeTwo, ImmutableEntries) {
   MatchErrorCode rc;
   entry_handle_t handle_1, handle_2;
@@ -1390,6 +1441,39 @@ TEST_F(TableIndirect, GetEntries) {
   }
 }
 
+TEST_F(TableIndirect, GetEntriesPage) {
+  MatchErrorCode rc;
+  mbr_hdl_t mbr;
+  rc = add_member(0xab, &mbr);
+  ASSERT_EQ(MatchErrorCode::SUCCESS, rc);
+
+  size_t num_entries = 64;
+  for (size_t e = 0; e < num_entries; e++) {
+    entry_handle_t handle;
+    rc = add_entry(std::string(2, static_cast<char>(e + 1)), mbr, &handle);
+    ASSERT_EQ(MatchErrorCode::SUCCESS, rc);
+  }
+
+  const auto entries = table->get_entries();
+  std::vector<MatchTableIndirect::Entry> paged_entries;
+  MatchTableAbstract::EntryCursor cursor;
+  size_t num_pages = 0;
+  while (!cursor.done) {
+    const auto page = table->get_entries_page(10, &cursor);
+    ASSERT_GE(10u, page.size());
+    paged_entries.insert(paged_entries.end(), page.begin(), page.end());
+    num_pages++;
+  }
+  ASSERT_EQ(7u, num_pages);
+  ASSERT_FALSE(cursor.modified);
+  ASSERT_EQ(entries.size(), paged_entries.size());
+  for (size_t i = 0; i < entries.size(); i++) {
+    ASSERT_EQ(entries[i].handle, paged_entries[i].handle);
+    ASSERT_EQ(entries[i].match_key[0].key, paged_entries[i].match_key[0].key);
+    ASSERT_EQ(entries[i].mbr, paged_entries[i].mbr);
+  }
+}
+
 
 class TableIndirectWS : public ::testing::Test {
  protected:
@@ -2109,6 +2193,39 @@ TEST_F(MatchKeyBuilderTest1, KeyToFields) {
   ASSERT_EQ(expected, v);
 }
 
+TEST_F(MatchKeyBuilderTest1, ReuseKey) {
+  Packet pkt = gen_pkt();
+  PHV *phv = pkt.get_phv();
+
+  // the builder overwrites the key, re-using its storage; the key fields are
+  // re-ordered by match type (valid first)
+  ByteContainer key("0x0102030405060708090a0b0c");
+  key_builder(*phv, &key);
+  ASSERT_EQ(ByteContainer("0x01abcd0100447001"), key);
+
+  phv->get_header(testHeader2).mark_invalid();
+  phv->get_header(testHeader3).mark_invalid();
+  key_builder(*phv, &key);
+  ASSERT_EQ(ByteContainer("0x00abcd0000000000"), key);
+}
+
+TEST_F(MatchKeyBuilderTest, Mask) {
+  key_builder.push_back_field(testHeader1, 0, 16, ByteContainer("0xff00"),
+                              MatchKeyParam::Type::EXACT);  // h1.f16
+  key_builder.push_back_field(testHeader1, 2, 17,
+                              MatchKeyParam::Type::EXACT);  // h1.f17
+  key_builder.build();
+
+  Packet pkt = get_pkt();
+  PHV *phv = pkt.get_phv();
+  phv->get_field(testHeader1, 0).set("0xabcd");
+  phv->get_field(testHeader1, 2).set("0x1abcd");
+
+  ByteContainer key;
+  key_builder(*phv, &key);
+  ASSERT_EQ(ByteContainer("0xab0001abcd"), key);
+}
+
 
 // added after exposing some hidden nasty bugs
 class AdvancedTest : public ::testing::Test {
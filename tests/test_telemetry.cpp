@@ -0,0 +1,194 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <bm/bm_sim/telemetry.h>
+#include <bm/bm_sim/queueing.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "jsoncpp/json.h"
+
+using bm::Telemetry;
+using bm::TelemetryCounter;
+using bm::TelemetryHistogram;
+using bm::TelemetryTimer;
+using bm::ThreadActivity;
+using bm::TelemetryRegistry;
+using bm::QueueTelemetry;
+using bm::QueueingLogicRL;
+
+TEST(TelemetryHistogram, Buckets) {
+  // every value maps to a bucket which contains it, and buckets are contiguous
+  uint64_t prev_highest = 0;
+  for (size_t idx = 0; idx < TelemetryHistogram::nb_buckets; idx++) {
+    uint64_t lowest = TelemetryHistogram::bucket_lowest(idx);
+    uint64_t highest = TelemetryHistogram::bucket_highest(idx);
+    ASSERT_LE(lowest, highest);
+    if (idx > 0) {
+      ASSERT_EQ(prev_highest + 1, lowest);
+    }
+    ASSERT_EQ(idx, TelemetryHistogram::bucket_index(lowest));
+    ASSERT_EQ(idx, TelemetryHistogram::bucket_index(highest));
+    // relative precision
+    ASSERT_LE(highest - lowest, lowest / 8);
+    prev_highest = highest;
+  }
+  // large values are clamped
+  ASSERT_EQ(TelemetryHistogram::nb_buckets - 1,
+            TelemetryHistogram::bucket_index(~0ull));
+}
+
+TEST(TelemetryHistogram, Percentiles) {
+  TelemetryHistogram histogram;
+  for (uint64_t v = 1; v <= 1000; v++) histogram.record(v);
+  auto snapshot = histogram.get_snapshot();
+  ASSERT_EQ(1000u, snapshot.count);
+  ASSERT_EQ(500500u, snapshot.sum);
+  ASSERT_DOUBLE_EQ(500.5, snapshot.mean());
+  ASSERT_EQ(1u, snapshot.min());
+  // reported values are never below the real ones, and within the precision
+  auto check = [&snapshot](double p, uint64_t expected) {
+    uint64_t v = snapshot.percentile(p);
+    EXPECT_GE(v, expected);
+    EXPECT_LE(v, expected + expected / 8);
+  };
+  check(50., 500);
+  check(90., 900);
+  check(99., 990);
+  check(100., 1000);
+  ASSERT_EQ(snapshot.percentile(100.), snapshot.max());
+
+  histogram.reset();
+  snapshot = histogram.get_snapshot();
+  ASSERT_EQ(0u, snapshot.count);
+  ASSERT_EQ(0u, snapshot.percentile(50.));
+}
+
+TEST(TelemetryHistogram, MultipleThreads) {
+  TelemetryHistogram histogram;
+  TelemetryCounter counter;
+  const size_t nb_threads = Telemetry::max_slots + 4;  // some slots are shared
+  const size_t iterations = 10000;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < nb_threads; t++) {
+    threads.emplace_back([&histogram, &counter, t, iterations]() {
+      for (size_t i = 0; i < iterations; i++) {
+        histogram.record(t);
+        counter.increment();
+      }
+    });
+  }
+  for (auto &t : threads) t.join();
+  auto snapshot = histogram.get_snapshot();
+  ASSERT_EQ(nb_threads * iterations, snapshot.count);
+  ASSERT_EQ(nb_threads * iterations, counter.get());
+  ASSERT_EQ(0u, snapshot.min());
+  counter.reset();
+  ASSERT_EQ(0u, counter.get());
+}
+
+TEST(TelemetryTimer, Record) {
+  TelemetryHistogram histogram;
+  {
+    TelemetryTimer timer(&histogram);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  auto snapshot = histogram.get_snapshot();
+  ASSERT_EQ(1u, snapshot.count);
+  ASSERT_GE(snapshot.max(), 2000000u);
+
+  // stop() records immediately, and only once
+  TelemetryTimer timer(&histogram);
+  timer.stop();
+  timer.stop();
+  ASSERT_EQ(2u, histogram.get_snapshot().count);
+
+  Telemetry::set_enabled(false);
+  { TelemetryTimer timer(&histogram); }
+  Telemetry::set_enabled(true);
+  ASSERT_EQ(2u, histogram.get_snapshot().count);
+}
+
+TEST(ThreadActivity, BusyIdle) {
+  ThreadActivity activity("test");
+  {
+    ThreadActivity::IdleScope idle(&activity);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    // an ongoing idle period is taken into account
+    ASSERT_GE(activity.get_idle_ns(), 20000000u);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  ASSERT_GE(activity.get_idle_ns(), 20000000u);
+  ASSERT_GE(activity.get_busy_ns(), 10000000u);
+
+  activity.reset();
+  ASSERT_LT(activity.get_idle_ns(), 20000000u);
+}
+
+namespace {
+
+struct SingleWorker {
+  size_t operator()(size_t queue_id) const {
+    (void) queue_id;
+    return 0;
+  }
+};
+
+}  // namespace
+
+TEST(QueueTelemetry, QueueingLogicRL) {
+  QueueingLogicRL<int, SingleWorker> queue(2, 1, 4, SingleWorker());
+  for (int i = 0; i < 6; i++) queue.push_front(1, i);
+  auto t = queue.get_telemetry(1);
+  ASSERT_EQ(4u, t->enqueued.get());
+  ASSERT_EQ(2u, t->dropped.get());
+  auto depth = t->depth.get_snapshot();
+  ASSERT_EQ(1u, depth.min());
+  ASSERT_EQ(4u, depth.max());
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  size_t queue_id;
+  int v;
+  for (int i = 0; i < 4; i++) queue.pop_back(0, &queue_id, &v);
+  auto sojourn = t->sojourn_ns.get_snapshot();
+  ASSERT_EQ(4u, sojourn.count);
+  ASSERT_GE(sojourn.min(), 1000000u * 7 / 8);
+  ASSERT_EQ(0u, queue.get_telemetry(0)->enqueued.get());
+
+  // only queues with traffic are reported
+  TelemetryRegistry registry;
+  registry.register_queue("q0", queue.get_telemetry(0));
+  registry.register_queue("q1", queue.get_telemetry(1));
+  registry.register_thread("worker");
+  Json::Value root;
+  registry.dump_json(&root);
+  ASSERT_EQ(1u, root["threads"].size());
+  ASSERT_EQ("worker", root["threads"][0]["name"].asString());
+  ASSERT_EQ(1u, root["queues"].size());
+  ASSERT_EQ("q1", root["queues"][0]["name"].asString());
+  ASSERT_EQ(4u, root["queues"][0]["sojourn_ns"]["count"].asUInt64());
+
+  registry.reset();
+  ASSERT_EQ(0u, t->enqueued.get());
+}
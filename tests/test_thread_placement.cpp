@@ -0,0 +1,120 @@
+/* Copyright 2013-present Barefoot Networks, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Antonin Bas (antonin@barefootnetworks.com)
+ *
+ */
+
+#include <gtest/gtest.h>
+
+#include <bm/bm_sim/options_parse.h>
+#include <bm/bm_sim/thread_placement.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using bm::ThreadPlacement;
+using bm::OptionsParser;
+
+TEST(ThreadPlacement, ParseCoreList) {
+  std::vector<int> cores;
+  ASSERT_TRUE(ThreadPlacement::parse_core_list("3", &cores));
+  ASSERT_EQ(std::vector<int>({3}), cores);
+  ASSERT_TRUE(ThreadPlacement::parse_core_list("0-3,8,10-11", &cores));
+  ASSERT_EQ(std::vector<int>({0, 1, 2, 3, 8, 10, 11}), cores);
+  // duplicates are removed, order is preserved
+  ASSERT_TRUE(ThreadPlacement::parse_core_list("4,1-2,2", &cores));
+  ASSERT_EQ(std::vector<int>({4, 1, 2}), cores);
+
+  for (const char *invalid : {"", "a", "1-", "-1", "3-1", "1,,2", "1;2",
+                              "+1", " 1", "1 ", "0x1", "99999999999999999999",
+                              "2147483648", "0-2000000000"}) {
+    cores = {42};
+    ASSERT_FALSE(ThreadPlacement::parse_core_list(invalid, &cores))
+        << invalid;
+    ASSERT_EQ(std::vector<int>({42}), cores);
+  }
+}
+
+namespace {
+
+// a core the test is allowed to run on, which may not be core 0 when running
+// in a restricted cpuset (e.g. in a container)
+int get_allowed_core() {
+#ifdef __linux__
+  cpu_set_t set;
+  if (sched_getaffinity(0, sizeof(set), &set) != 0) return 0;
+  for (int core = 0; core < CPU_SETSIZE; core++)
+    if (CPU_ISSET(core, &set)) return core;
+#endif
+  return 0;
+}
+
+}  // namespace
+
+TEST(ThreadPlacement, PlaceCurrentThread) {
+  const int allowed_core = get_allowed_core();
+  ThreadPlacement placement;
+  placement.set_cores("worker", {allowed_core});
+  ASSERT_TRUE(placement.has_cores("worker"));
+  ASSERT_FALSE(placement.has_cores("other"));
+
+  int core = -2;
+  std::thread t([&placement, &core]() {
+    core = placement.place_current_thread("worker", 1);
+  });
+  t.join();
+#ifdef __linux__
+  ASSERT_EQ(allowed_core, core);
+#endif
+
+#ifdef __linux__
+  cpu_set_t parent_set;
+  ASSERT_EQ(0, pthread_getaffinity_np(pthread_self(), sizeof(parent_set),
+                                      &parent_set));
+#endif
+  std::thread t2([&]() {
+    core = placement.place_current_thread("other");
+#ifdef __linux__
+    // affinity is unchanged (inherited from the parent thread)
+    cpu_set_t set;
+    ASSERT_EQ(0, pthread_getaffinity_np(pthread_self(), sizeof(set), &set));
+    ASSERT_TRUE(CPU_EQUAL(&parent_set, &set));
+#endif
+  });
+  t2.join();
+  ASSERT_EQ(-1, core);
+}
+
+TEST(ThreadPlacement, CommandLine) {
+  OptionsParser parser;
+  std::vector<std::string> args = {
+    "name", "--no-p4", "--cpu-affinity", "ingress=1",
+    "--cpu-affinity", "egress=2-3"};
+  std::vector<char *> argv;
+  for (auto &arg : args) argv.push_back(&arg[0]);
+  argv.push_back(nullptr);
+  parser.parse(static_cast<int>(args.size()), argv.data(), nullptr);
+  ASSERT_EQ(2u, parser.cpu_affinity.size());
+  ASSERT_EQ(std::vector<int>({1}), parser.cpu_affinity.at("ingress"));
+  ASSERT_EQ(std::vector<int>({2, 3}), parser.cpu_affinity.at("egress"));
+}
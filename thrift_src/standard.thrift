@@ -258,6 +258,19 @@ struct BmMtEntry {
  5:optional BmMtEntryLife life
 }
 
+// see bm_mt_get_entries_page
+struct BmMtEntriesCursor {
+ 1:i64 position,
+ 2:i64 version,
+ 3:bool done,
+ 4:bool modified
+}
+
+struct BmMtEntriesPage {
+ 1:list<BmMtEntry> entries,
+ 2:BmMtEntriesCursor cursor
+}
+
 struct BmMtActProfMember {
  1:BmMemberHandle mbr_handle,
  2:string action_name,
@@ -516,6 +529,17 @@ service Standard {
     2:string table_name
   ) throws (1:InvalidTableOperation ouch),
 
+  // reads the entries one page at a time, the table is only locked while
+  // reading each page; start with a zero-initialized cursor and pass the one
+  // returned with each page to the next call, until cursor.done is set;
+  // cursor.modified is set if the table was modified during the iteration
+  BmMtEntriesPage bm_mt_get_entries_page(
+    1:i32 cxt_id,
+    2:string table_name,
+    3:BmMtEntriesCursor cursor,
+    4:i32 max_entries
+  ) throws (1:InvalidTableOperation ouch),
+
   BmMtEntry bm_mt_get_entry(
     1:i32 cxt_id,
     2:string table_name,
@@ -698,4 +722,11 @@ service Standard {
   ) throws (1:InvalidIdLookup ouch)
 
   string bm_serialize_state()
+
+  // JSON document with per-table hit / miss counts and lookup latency
+  // histograms, parser / deparser latencies, queue depths and sojourn times and
+  // busy / idle times for the target threads
+  string bm_get_telemetry()
+
+  void bm_reset_telemetry()
 }
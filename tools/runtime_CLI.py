@@ -104,6 +104,9 @@ COUNTER_ARRAYS = {}
 REGISTER_ARRAYS = {}
 CUSTOM_CRC_CALCS = {}
 
+# number of entries retrieved at a time by table_dump
+TABLE_DUMP_PAGE_SIZE = 1024
+
 class MatchType:
     EXACT = 0
     LPM = 1
@@ -2065,14 +2068,25 @@ class RuntimeAPI(cmd.Cmd):
         self.exactly_n_args(args, 1)
         table_name = args[0]
         table = self.get_res("table", table_name, TABLES)
-        entries = self.client.bm_mt_get_entries(0, table_name)
 
         print "=========="
         print "TABLE ENTRIES"
 
-        for e in entries:
+        # entries are retrieved one page at a time, to avoid building a huge
+        # response for large tables
+        cursor = BmMtEntriesCursor(
+            position=0, version=0, done=False, modified=False)
+        while not cursor.done:
+            page = self.client.bm_mt_get_entries_page(
+                0, table_name, cursor, TABLE_DUMP_PAGE_SIZE)
+            for e in page.entries:
+                print "**********"
+                self.dump_one_entry(table, e)
+            cursor = page.cursor
+        if cursor.modified:
             print "**********"
-            self.dump_one_entry(table, e)
+            print "Table was modified while being dumped, some entries " \
+                "may be missing or outdated"
 
         if table.type_ == TableType.indirect or\
            table.type_ == TableType.indirect_ws:
@@ -2200,6 +2214,53 @@ class RuntimeAPI(cmd.Cmd):
         with open(filename, 'w') as f:
             f.write(state)
 
+    @handle_bad_input
+    def do_show_telemetry(self, line):
+        "Display per-stage telemetry (latencies in ns), or dump it as JSON to a file: show_telemetry [<filename>]"
+        args = line.split()
+        if len(args) > 1:
+            raise UIn_Error("Too many args")
+        telemetry = self.client.bm_get_telemetry()
+        if args:
+            with open(args[0], 'w') as f:
+                f.write(telemetry)
+            return
+        telemetry = json.loads(telemetry)
+
+        def hist_str(h):
+            if h["count"] == 0:
+                return "-"
+            return "mean={:.0f} p50={} p99={} max={}".format(
+                h["mean"], h["p50"], h["p99"], h["max"])
+
+        for cxt_id, cxt in enumerate(telemetry["contexts"]):
+            print "Context", cxt_id
+            for name, t in sorted(cxt["tables"].items()):
+                print "  table {:<32} hits={:<10} misses={:<10} lookup: {}".format(
+                    name, t["hits"], t["misses"], hist_str(t["lookup_ns"]))
+            for kind in ["parsers", "deparsers"]:
+                for name, h in sorted(cxt[kind].items()):
+                    print "  {:<5} {:<32} {}".format(
+                        kind[:-1], name, hist_str(h))
+        for t in telemetry["threads"]:
+            print "thread {:<16} busy={:.1%} (busy_ns={}, idle_ns={})".format(
+                t["name"], t["busy_ratio"], t["busy_ns"], t["idle_ns"])
+        for q in telemetry["queues"]:
+            print "queue {:<16} enqueued={} dropped={} depth: {} sojourn: {}".format(
+                q["name"], q["enqueued"], q["dropped"], hist_str(q["depth"]),
+                hist_str(q["sojourn_ns"]))
+        for c in telemetry.get("flow_caches", []):
+            print "flow cache {:<11} hit_rate={:.1%} hits={} misses={} uncacheable={} entries={} flushes={} flush: {}".format(
+                c["name"], c["hit_rate"], c["hits"], c["misses"],
+                c["uncacheable"], c["entries"], c["flushes"],
+                hist_str(c["flush_ns"]))
+
+    @handle_bad_input
+    def do_reset_telemetry(self, line):
+        "Reset all telemetry counters and histograms: reset_telemetry"
+        self.exactly_n_args(line.split(), 0)
+        self.client.bm_reset_telemetry()
+
     def set_crc_parameters_common(self, line, crc_width=16):
         conversion_fn = {16: hex_to_i16, 32: hex_to_i32}[crc_width]
         config_type = {16: BmCrc16Config, 32: BmCrc32Config}[crc_width]